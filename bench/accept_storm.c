@@ -0,0 +1,269 @@
+// A reconnect storm, as after a router reboot, and the admission control
+// that keeps verified controllers in when every client slot is taken.
+//
+//   storm     connections open at once from as many threads, each retrying
+//             until it is served; the time from the first connect to the
+//             response is reported for all of them, with the refusals and
+//             the accepts taken per select wakeup
+//   admission one verified controller and quiet plain clients fill the
+//             pool; new connections evict the quiet ones oldest first, are
+//             refused while the rest are fresh, and never push out the
+//             controller
+//   idle      past the idle timeout, with the clock moved forward, a quiet
+//             controller is closed and one subscribed to events is kept
+//
+//   bench_accept_storm [connections] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "bench.h"
+#include "bridge.h"
+#include "controller.h"
+
+#define BENCH_CONTROLLER_ID "4C1F8A20-6D3B-4E97-A5C2-0F9B7D1E3A64"
+#define BENCH_PATH          "/characteristics?id=2.9"
+#define BENCH_QUIET_US      ( ( CONFIG_HKS_CLIENT_EVICT_IDLE_MS + 100 ) * 1000 )
+#define BENCH_ATTEMPTS      100
+
+struct bench_storm_s {
+  uint16_t port;
+  pthread_barrier_t *start;
+  uint64_t served_ns; // from the first connect to the response, 0 if never
+  int refused;        // connections closed without a response
+};
+typedef struct bench_storm_s bench_storm_t;
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+// status of a plain GET, -1 when the connection is closed instead
+static int _bench_get( int fd, const char *path )
+{
+  char buffer[512];
+  int n = snprintf( buffer, sizeof( buffer ), "GET %s HTTP/1.1\r\n\r\n", path );
+  if ( write( fd, buffer, n ) != n )
+    return -1;
+
+  size_t len = 0;
+  while ( len < 4 || memcmp( buffer + len - 4, "\r\n\r\n", 4 ) != 0 )
+  {
+    if ( len == sizeof( buffer ) - 1 || read( fd, buffer + len, 1 ) != 1 )
+      return -1;
+    len++;
+  }
+  buffer[len] = '\0';
+
+  int status = 0;
+  const char *length = strstr( buffer, "Content-Length: " );
+  if ( sscanf( buffer, "HTTP/1.1 %d", &status ) != 1 || length == NULL )
+    return -1;
+
+  for ( size_t body = strtoul( length + 16, NULL, 10 ); body > 0; )
+  {
+    ssize_t r = read( fd, buffer, body < sizeof( buffer ) ? body : sizeof( buffer ) );
+    if ( r <= 0 )
+      return -1;
+    body -= r;
+  }
+
+  return status;
+}
+
+// whether the server closed `fd` within `timeout_ms`
+static int _bench_closed( int fd, int timeout_ms )
+{
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  char c;
+  return poll( &pfd, 1, timeout_ms ) > 0 && recv( fd, &c, 1, MSG_DONTWAIT ) <= 0;
+}
+
+static void *_bench_storm_client( void *arg )
+{
+  bench_storm_t *storm = arg;
+  pthread_barrier_wait( storm->start );
+
+  uint64_t t0 = bench_now_ns();
+  for ( int i = 0; i < BENCH_ATTEMPTS; i++ )
+  {
+    int fd = bench_connect( storm->port );
+    int status = fd >= 0 ? _bench_get( fd, BENCH_PATH ) : -1;
+    if ( fd >= 0 )
+      close( fd );
+    if ( status == 200 )
+    {
+      storm->served_ns = bench_now_ns() - t0;
+      break;
+    }
+    storm->refused++;
+  }
+
+  return NULL;
+}
+
+static int _bench_storm( hk_server_t *hks, uint16_t port, size_t connections )
+{
+  bench_storm_t *storms = calloc( connections, sizeof( bench_storm_t ) );
+  pthread_t *threads = calloc( connections, sizeof( pthread_t ) );
+  uint64_t *served = calloc( connections, sizeof( uint64_t ) );
+  pthread_barrier_t start;
+  pthread_barrier_init( &start, NULL, connections );
+
+  hks_stats_t before, after;
+  hk_server_get_stats( hks, &before );
+
+  for ( size_t i = 0; i < connections; i++ )
+  {
+    storms[i] = (bench_storm_t){ .port = port, .start = &start };
+    pthread_create( &threads[i], NULL, _bench_storm_client, &storms[i] );
+  }
+
+  int refused = 0;
+  size_t count = 0;
+  for ( size_t i = 0; i < connections; i++ )
+  {
+    pthread_join( threads[i], NULL );
+    if ( storms[i].served_ns )
+      served[count++] = storms[i].served_ns;
+    refused += storms[i].refused;
+  }
+  hk_server_get_stats( hks, &after );
+
+  int failed = _bench_report( "every connection served", count == connections );
+  bench_report_latency( "connect-to-response", served, count );
+
+  uint32_t accepts = after.stages[HKS_STATS_ACCEPT].count - before.stages[HKS_STATS_ACCEPT].count;
+  printf( "  %-34s %8d\n", "refused, then retried", refused );
+  printf( "  %-34s %8u accepted, %u wakeups\n", "", accepts, after.wakeups - before.wakeups );
+
+  pthread_barrier_destroy( &start );
+  free( served );
+  free( threads );
+  free( storms );
+  return failed;
+}
+
+static int _bench_admission( uint16_t port, bench_controller_t *ctl )
+{
+  uint64_t elapsed[3];
+  size_t len;
+
+  int fd = bench_connect( port );
+  int ok = bench_pair_setup( ctl, fd, elapsed ) == 0;
+  close( fd );
+
+  int verified = bench_connect( port );
+  ok &= bench_pair_verify( ctl, verified, elapsed ) == 0;
+  int failed = _bench_report( "controller verified", ok );
+
+  // the rest of the pool, quiet for longer than an eviction takes
+  int quiet[CONFIG_HKS_MAX_CLIENTS - 1];
+  for ( int i = 0; i < CONFIG_HKS_MAX_CLIENTS - 1; i++ )
+  {
+    quiet[i] = bench_connect( port );
+    usleep( 2000 );
+  }
+  usleep( BENCH_QUIET_US );
+
+  // each newcomer is served in place of the oldest quiet one; once
+  // accepted, plain requests are answered 470 as the accessory is paired
+  int fresh[CONFIG_HKS_MAX_CLIENTS - 1];
+  ok = 1;
+  for ( int i = 0; i < CONFIG_HKS_MAX_CLIENTS - 1; i++ )
+  {
+    fresh[i] = bench_connect( port );
+    ok &= _bench_get( fresh[i], BENCH_PATH ) > 0;
+    ok &= _bench_closed( quiet[i], 100 );
+    if ( i + 1 < CONFIG_HKS_MAX_CLIENTS - 1 )
+      ok &= !_bench_closed( quiet[i + 1], 0 );
+    usleep( 2000 );
+  }
+  failed |= _bench_report( "quiet clients evicted oldest first", ok );
+
+  // nobody has been quiet long enough
+  fd = bench_connect( port );
+  failed |= _bench_report( "refused while the pool is fresh", _bench_get( fd, BENCH_PATH ) < 0 );
+  close( fd );
+
+  // the controller is the oldest of all now and still stays
+  usleep( BENCH_QUIET_US );
+  fd = bench_connect( port );
+  ok = _bench_get( fd, BENCH_PATH ) > 0 && _bench_closed( fresh[0], 100 );
+  failed |= _bench_report( "admitted once they are quiet", ok );
+  failed |= _bench_report( "controller never evicted", bench_secure_get( ctl, verified, BENCH_PATH, &len ) == 200 );
+  close( fd );
+
+  close( verified );
+  for ( int i = 0; i < CONFIG_HKS_MAX_CLIENTS - 1; i++ )
+  {
+    close( quiet[i] );
+    close( fresh[i] );
+  }
+  return failed;
+}
+
+static int _bench_idle( uint16_t port, bench_controller_t *ctl )
+{
+  bench_controller_t other = *ctl;
+  uint64_t elapsed[2];
+  size_t len;
+
+  int subscribed = bench_connect( port );
+  int quiet = bench_connect( port );
+  int ok = bench_pair_verify( ctl, subscribed, elapsed ) == 0;
+  ok &= bench_pair_verify( &other, quiet, elapsed ) == 0;
+  ok &= bench_secure_put( ctl, subscribed, "/characteristics", "{\"characteristics\":[{\"aid\":2,\"iid\":10,\"ev\":true}]}" ) == 204;
+  int failed = _bench_report( "one of two controllers subscribed", ok );
+
+  // a connection wakes the loop to the timers that are now due
+  vHostTickAdvance( CONFIG_HKS_CLIENT_IDLE_TIMEOUT * 1000 + 1000 );
+  int fd = bench_connect( port );
+  failed |= _bench_report( "quiet controller timed out", _bench_closed( quiet, 1000 ) );
+  failed |= _bench_report( "subscriber kept past the timeout", bench_secure_get( ctl, subscribed, BENCH_PATH, &len ) == 200 );
+
+  close( fd );
+  close( quiet );
+  close( subscribed );
+  return failed;
+}
+
+int main( int argc, char **argv )
+{
+  size_t connections = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 50;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42591;
+  int failed = 0;
+
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  hk_server_t *hks = bench_server_create( port, &db );
+  hk_server_set_setup_code( hks, BENCH_SETUP_CODE );
+  bench_server_run( hks );
+
+  printf( "storm, %zu connections at once, %d slots\n", connections, CONFIG_HKS_MAX_CLIENTS );
+  failed |= _bench_storm( hks, port, connections );
+
+  bench_controller_t ctl;
+  bench_controller_init( &ctl, BENCH_CONTROLLER_ID );
+
+  printf( "admission\n" );
+  failed |= _bench_admission( port, &ctl );
+
+  printf( "idle\n" );
+  failed |= _bench_idle( port, &ctl );
+
+  if ( failed )
+    fprintf( stderr, "accept storm check failed\n" );
+
+  return failed;
+}
@@ -0,0 +1,149 @@
+// GET /accessories for a 100 accessory bridge: cold renders after a schema
+// change, warm hits on the cached document, in-place value updates and the
+// whole request over a loopback connection.
+//
+//   bench_accessories_cache [iterations] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sys/socket.h>
+#include "bench.h"
+#include "bridge.h"
+
+static size_t _bench_heap_in_use( void )
+{
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks;
+}
+
+static int _bench_get_accessories( int fd, char *buffer, size_t size )
+{
+  static const char request[] = "GET /accessories HTTP/1.1\r\nHost: hap.local\r\n\r\n";
+  if ( write( fd, request, sizeof( request ) - 1 ) < 0 )
+    return -1;
+
+  // read the headers, then exactly Content-Length bytes
+  size_t len = 0;
+  char *end = NULL;
+  while ( end == NULL )
+  {
+    ssize_t n = read( fd, buffer + len, size - len - 1 );
+    if ( n <= 0 )
+      return -1;
+    len += n;
+    buffer[len] = 0;
+    end = strstr( buffer, "\r\n\r\n" );
+  }
+
+  char *length = strstr( buffer, "Content-Length: " );
+  if ( length == NULL )
+    return -1;
+  size_t total = ( end + 4 - buffer ) + strtoul( length + 16, NULL, 10 );
+
+  while ( len < total )
+  {
+    ssize_t n = read( fd, buffer + len, size - len );
+    if ( n <= 0 )
+      return -1;
+    len += n;
+  }
+
+  return 0;
+}
+
+int main( int argc, char **argv )
+{
+  size_t iterations = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 2000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42504;
+
+  hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  // cold: render from scratch every time
+  uint64_t *samples = calloc( iterations, sizeof( uint64_t ) );
+  hks_db_json_t *json;
+  size_t heap_before = _bench_heap_in_use();
+  size_t heap_peak = 0;
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    hks_db_schema_changed( &db );
+    uint64_t t0 = bench_now_ns();
+    hks_db_accessories( &db, &json );
+    samples[i] = bench_now_ns() - t0;
+
+    size_t heap = _bench_heap_in_use() - heap_before;
+    if ( heap > heap_peak )
+      heap_peak = heap;
+    hks_db_json_release( json );
+  }
+
+  hks_db_accessories( &db, &json );
+  printf( "%u accessories: document %zu bytes, heap in use after render %zu bytes\n",
+    db.accessory_count, json->len, heap_peak );
+  hks_db_json_release( json );
+  bench_report_latency( "cold render", samples, iterations );
+
+  // warm: the cached document is handed out as is
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    hks_db_accessories( &db, &json );
+    samples[i] = bench_now_ns() - t0;
+    hks_db_json_release( json );
+  }
+  bench_report_latency( "warm fetch", samples, iterations );
+
+  // value changes patch the cached document
+  uint16_t on = hks_db_find( &db, 2, 9 );
+  uint16_t brightness = hks_db_find( &db, BENCH_BRIDGE_ACCESSORIES, 10 );
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    hks_value_t v = { .i = (int32_t)( i % 101 ) };
+    hks_value_t b = { .b = (int)( i & 1 ) };
+    uint64_t t0 = bench_now_ns();
+    hks_db_set_value( &db, brightness, &v );
+    hks_db_set_value( &db, on, &b );
+    samples[i] = bench_now_ns() - t0;
+  }
+  bench_report_latency( "patch 2 values", samples, iterations );
+
+  // while a response still holds the document the patch goes to a copy
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    hks_value_t v = { .i = (int32_t)( i % 101 ) };
+    hks_db_accessories( &db, &json );
+    uint64_t t0 = bench_now_ns();
+    hks_db_set_value( &db, brightness, &v );
+    samples[i] = bench_now_ns() - t0;
+    hks_db_json_release( json );
+  }
+  bench_report_latency( "patch while sending", samples, iterations );
+
+  // end to end over a keep-alive connection
+  bench_server_start( port, &db );
+  int fd = bench_connect( port );
+  size_t buffer_size = 256 * 1024;
+  char *buffer = malloc( buffer_size );
+  size_t done = 0;
+  uint64_t start = bench_now_ns();
+  for ( ; done < iterations; done++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    if ( _bench_get_accessories( fd, buffer, buffer_size ) )
+      break;
+    samples[done] = bench_now_ns() - t0;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  printf( "GET /accessories: %zu responses in %.3fs: %.0f responses/s\n", done, elapsed / 1e9, done / ( elapsed / 1e9 ) );
+  bench_report_latency( "request-to-response", samples, done );
+
+  close( fd );
+  free( buffer );
+  free( samples );
+  return done == iterations ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+// The server in a region of its own, and nothing allocated after init.
+//
+//   budget    hk_server_budget slice by slice; a region one byte short of
+//             it is refused
+//   traffic   with malloc, calloc and realloc wrapped at link time, every
+//             call the server makes once hk_server_init_static returned is
+//             counted: plain /accessories, /characteristics reads and
+//             writes with events to a subscriber, /stats, then pair-setup,
+//             pair-verify and pair-resume with secured requests. The count
+//             has to stay 0, and the time per round is reported.
+//   teardown  a second server in a region of its own freed with clients
+//             still connected; they have to see the connection closed
+//             before the region goes back to the caller
+//
+//   bench_arena [rounds] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <esp_log.h>
+#include "bench.h"
+#include "bridge.h"
+#include "controller.h"
+
+#define BENCH_CONTROLLER_ID "9E3B7C15-48A2-4F6D-B0C1-5D2E8A7F4936"
+#define BENCH_REGION_SIZE   ( 1 << 20 )
+
+extern void *__real_malloc( size_t size );
+extern void *__real_calloc( size_t count, size_t size );
+extern void *__real_realloc( void *p, size_t size );
+
+// the bench's own calls, all on the main thread, are not counted
+static __thread int _bench_exempt;
+static volatile int _bench_armed;
+static volatile uint32_t _bench_allocations;
+
+static void _bench_count( void )
+{
+  if ( _bench_armed && !_bench_exempt )
+    __atomic_add_fetch( &_bench_allocations, 1, __ATOMIC_RELAXED );
+}
+
+void *__wrap_malloc( size_t size )
+{
+  _bench_count();
+  return __real_malloc( size );
+}
+
+void *__wrap_calloc( size_t count, size_t size )
+{
+  _bench_count();
+  return __real_calloc( count, size );
+}
+
+void *__wrap_realloc( void *p, size_t size )
+{
+  _bench_count();
+  return __real_realloc( p, size );
+}
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+// status of the next HTTP or EVENT message on `fd`, its body read and
+// dropped; 0 if none came within a second
+static int _bench_message( int fd )
+{
+  char buffer[1024];
+  size_t len = 0;
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  while ( len < 4 || memcmp( buffer + len - 4, "\r\n\r\n", 4 ) != 0 )
+  {
+    if ( len == sizeof( buffer ) - 1 || poll( &pfd, 1, 1000 ) <= 0 || read( fd, buffer + len, 1 ) != 1 )
+      return 0;
+    len++;
+  }
+  buffer[len] = '\0';
+
+  int status = 0;
+  const char *length = strstr( buffer, "Content-Length: " );
+  if ( sscanf( buffer, "%*s %d", &status ) != 1 )
+    return 0;
+
+  for ( size_t body = length ? strtoul( length + 16, NULL, 10 ) : 0; body > 0; )
+  {
+    ssize_t r = read( fd, buffer, body < sizeof( buffer ) ? body : sizeof( buffer ) );
+    if ( r <= 0 )
+      return 0;
+    body -= r;
+  }
+
+  return status;
+}
+
+static int _bench_request( int fd, const char *method, const char *path, const char *body )
+{
+  char buffer[512];
+  int n = body == NULL
+    ? snprintf( buffer, sizeof( buffer ), "%s %s HTTP/1.1\r\n\r\n", method, path )
+    : snprintf( buffer, sizeof( buffer ), "%s %s HTTP/1.1\r\nContent-Type: application/hap+json\r\n"
+        "Content-Length: %zu\r\n\r\n%s", method, path, strlen( body ), body );
+  return write( fd, buffer, n ) == n ? _bench_message( fd ) : 0;
+}
+
+// plain requests while unpaired, a write on one connection sent as an
+// event to the other
+static int _bench_plain( uint16_t port, size_t round )
+{
+  int subscriber = bench_connect( port );
+  int writer = bench_connect( port );
+  char body[128];
+  int ok = 1;
+
+  ok &= _bench_request( subscriber, "PUT", "/characteristics",
+    "{\"characteristics\":[{\"aid\":2,\"iid\":10,\"ev\":true}]}" ) == 204;
+
+  // the document stays in use while the value under it changes
+  ok &= _bench_request( writer, "GET", "/accessories", NULL ) == 200;
+  snprintf( body, sizeof( body ), "{\"characteristics\":[{\"aid\":2,\"iid\":10,\"value\":%zu}]}", round % 101 );
+  ok &= _bench_request( writer, "PUT", "/characteristics", body ) == 204;
+  ok &= _bench_message( subscriber ) == 200;
+  ok &= _bench_request( subscriber, "GET", "/accessories", NULL ) == 200;
+
+  ok &= _bench_request( writer, "GET", "/characteristics?id=2.9,2.10,3.11,999.9&meta=1&perms=1&type=1&ev=1", NULL ) == 207;
+  ok &= _bench_request( writer, "GET", "/stats", NULL ) == 200;
+
+  close( subscriber );
+  close( writer );
+  return ok;
+}
+
+static int _bench_secure( bench_controller_t *ctl, uint16_t port )
+{
+  uint64_t elapsed[3];
+  size_t len;
+  int ok = 1;
+
+  int fd = bench_connect( port );
+  ok &= bench_pair_verify( ctl, fd, elapsed ) == 0;
+  ok &= bench_secure_get( ctl, fd, "/accessories", &len ) == 200;
+  close( fd );
+
+  fd = bench_connect( port );
+  ok &= bench_pair_resume( ctl, fd, elapsed ) == 0;
+  ok &= bench_secure_get( ctl, fd, "/characteristics?id=2.9,2.10", &len ) == 200;
+  close( fd );
+
+  return ok;
+}
+
+static int _bench_budget( void )
+{
+  hks_budget_t slices[16];
+  size_t count = sizeof( slices ) / sizeof( slices[0] );
+  size_t total = hk_server_budget( slices, &count );
+
+  for ( size_t i = 0; i < count; i++ )
+    printf( "  %-34s %8zu\n", slices[i].name, slices[i].size );
+  printf( "  %-34s %8zu\n", "total", total );
+
+  static uint8_t short_region[BENCH_REGION_SIZE] __attribute__(( aligned( 8 ) ));
+  hk_server_t *hks = NULL;
+  return _bench_report( "a region short of it refused",
+    total <= BENCH_REGION_SIZE &&
+    hk_server_init_static( TCPIP_ADAPTER_IF_STA, short_region, total - 1, &hks ) == ESP_ERR_INVALID_SIZE );
+}
+
+static int _bench_teardown( uint16_t port )
+{
+  static uint8_t region[BENCH_REGION_SIZE] __attribute__(( aligned( 8 ) ));
+  hk_server_t *hks = NULL;
+  if ( hk_server_init_static( TCPIP_ADAPTER_IF_STA, region, sizeof( region ), &hks ) ||
+       hk_server_listen( hks, port ) )
+    return 0;
+
+  int fds[2];
+  for ( int i = 0; i < 2; i++ )
+    fds[i] = bench_connect( port );
+
+  // driven from here, so the clients are taken before it is freed
+  for ( int i = 0; i < 10; i++ )
+    hk_server_poll( hks, 10 );
+  hk_server_free( hks );
+
+  int ok = 1;
+  for ( int i = 0; i < 2; i++ )
+  {
+    struct pollfd pfd = { .fd = fds[i], .events = POLLIN };
+    char c;
+    ok &= fds[i] >= 0 && poll( &pfd, 1, 1000 ) == 1 && read( fds[i], &c, 1 ) == 0;
+    if ( fds[i] >= 0 )
+      close( fds[i] );
+  }
+
+  return ok;
+}
+
+int main( int argc, char **argv )
+{
+  size_t rounds = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 50;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42611;
+  int failed = 0;
+  _bench_exempt = 1;
+
+  printf( "budget\n" );
+  failed |= _bench_budget();
+
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  signal( SIGPIPE, SIG_IGN );
+  esp_log_level_set( "*", ESP_LOG_WARN );
+
+  static uint8_t region[BENCH_REGION_SIZE] __attribute__(( aligned( 8 ) ));
+  hk_server_t *hks = NULL;
+  if ( hk_server_init_static( TCPIP_ADAPTER_IF_STA, region, sizeof( region ), &hks ) ||
+       hk_server_listen( hks, port ) || hk_server_set_database( hks, &db ) ||
+       hk_server_set_setup_code( hks, BENCH_SETUP_CODE ) || hk_server_set_event_coalescing( hks, 0 ) )
+  {
+    fprintf( stderr, "failed to start server on port %u\n", port );
+    return 1;
+  }
+  bench_server_run( hks );
+
+  bench_controller_t ctl;
+  bench_controller_init( &ctl, BENCH_CONTROLLER_ID );
+  _bench_armed = 1;
+
+  printf( "traffic, %zu rounds\n", rounds );
+  uint64_t *samples = __real_calloc( rounds, sizeof( uint64_t ) );
+  int ok = 1;
+  for ( size_t i = 0; i < rounds && ok; i++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    ok &= _bench_plain( port, i );
+    samples[i] = bench_now_ns() - t0;
+  }
+  failed |= _bench_report( "plain requests and events", ok );
+  bench_report_latency( "round", samples, rounds );
+
+  uint64_t elapsed[3];
+  int fd = bench_connect( port );
+  ok = bench_pair_setup( &ctl, fd, elapsed ) == 0;
+  close( fd );
+  for ( size_t i = 0; i < 4 && ok; i++ )
+    ok &= _bench_secure( &ctl, port );
+  failed |= _bench_report( "pairing and secured requests", ok );
+
+  // whatever is still on its way out is released on the server's thread
+  usleep( 100000 );
+  _bench_armed = 0;
+
+  printf( "  %-34s %8u\n", "allocations after init", _bench_allocations );
+  failed |= _bench_report( "nothing allocated after init", _bench_allocations == 0 );
+
+  printf( "teardown\n" );
+  failed |= _bench_report( "clients closed by hk_server_free", _bench_teardown( port + 1 ) );
+
+  free( samples );
+  if ( failed )
+    fprintf( stderr, "arena check failed\n" );
+
+  return failed;
+}
@@ -0,0 +1,159 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <esp_log.h>
+
+uint64_t bench_now_ns( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *_bench_server_thread( void *arg )
+{
+  hk_server_t *hks = arg;
+  esp_err_t err = hk_server_run( hks );
+  fprintf( stderr, "server stopped: %d\n", err );
+  return NULL;
+}
+
+hk_server_t *bench_server_create( uint16_t port, hks_db_t *db )
+{
+  signal( SIGPIPE, SIG_IGN );
+  esp_log_level_set( "*", ESP_LOG_WARN );
+
+  hk_server_t *hks = NULL;
+  if ( hk_server_init( TCPIP_ADAPTER_IF_STA, &hks ) || hk_server_listen( hks, port ) )
+  {
+    fprintf( stderr, "failed to start server on port %u\n", port );
+    exit( 1 );
+  }
+
+  if ( db != NULL )
+    hk_server_set_database( hks, db );
+
+  return hks;
+}
+
+hk_server_t *bench_server_start( uint16_t port, hks_db_t *db )
+{
+  hk_server_t *hks = bench_server_create( port, db );
+  bench_server_run( hks );
+  return hks;
+}
+
+void bench_server_run( hk_server_t *hks )
+{
+  pthread_t thread;
+  pthread_create( &thread, NULL, _bench_server_thread, hks );
+  pthread_detach( thread );
+}
+
+int bench_connect( uint16_t port )
+{
+  int fd = socket( AF_INET, SOCK_STREAM, 0 );
+  if ( fd < 0 )
+    return -1;
+
+  // the ephemeral port may be a later bench's server port; left in
+  // TIME_WAIT without SO_REUSEADDR it keeps that server from binding
+  int one = 1;
+  setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+  setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_port = htons( port ),
+    .sin_addr.s_addr = htonl( INADDR_LOOPBACK )
+  };
+  if ( connect( fd, (struct sockaddr *)&addr, sizeof( addr ) ) < 0 )
+  {
+    close( fd );
+    return -1;
+  }
+
+  return fd;
+}
+
+static int _bench_cmp_u64( const void *a, const void *b )
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+void bench_report_latency( const char *name, uint64_t *samples_ns, size_t count )
+{
+  if ( count == 0 )
+  {
+    printf( "%-28s no samples\n", name );
+    return;
+  }
+
+  qsort( samples_ns, count, sizeof( uint64_t ), _bench_cmp_u64 );
+  printf( "%-28s n=%zu min=%.1fus p50=%.1fus p99=%.1fus max=%.1fus\n",
+    name,
+    count,
+    samples_ns[0] / 1e3,
+    samples_ns[count / 2] / 1e3,
+    samples_ns[( count * 99 ) / 100] / 1e3,
+    samples_ns[count - 1] / 1e3
+  );
+}
+
+// upper bound in microseconds of the bucket the `q` quantile falls in
+static uint32_t _bench_stats_quantile( const hks_stats_histogram_t *h, double q )
+{
+  uint64_t rank = (uint64_t)( q * h->count ), seen = 0;
+  for ( int i = 0; i < HKS_STATS_BUCKETS; i++ )
+  {
+    seen += h->buckets[i];
+    if ( seen > rank )
+      return i == HKS_STATS_BUCKETS - 1 ? h->max_us : 1u << i;
+  }
+  return h->max_us;
+}
+
+void bench_report_stats( const hks_stats_t *stats )
+{
+  printf( "%-28s wakeups=%u in=%llu B out=%llu B\n", "server",
+    stats->wakeups,
+    (unsigned long long)stats->bytes_in,
+    (unsigned long long)stats->bytes_out
+  );
+
+  for ( int stage = 0; stage < HKS_STATS_STAGES; stage++ )
+  {
+    const hks_stats_histogram_t *h = &stats->stages[stage];
+    if ( h->count == 0 )
+    {
+      printf( "  %-26s no samples\n", hks_stats_stage_name( stage ) );
+      continue;
+    }
+
+    printf( "  %-26s n=%u mean=%.1fus p50<%uus p99<%uus max=%uus\n",
+      hks_stats_stage_name( stage ),
+      h->count,
+      (double)h->sum_us / h->count,
+      _bench_stats_quantile( h, 0.50 ),
+      _bench_stats_quantile( h, 0.99 ),
+      h->max_us
+    );
+
+    printf( "  %-26s", "" );
+    for ( int i = 0; i < HKS_STATS_BUCKETS; i++ )
+      if ( h->buckets[i] > 0 && i < HKS_STATS_BUCKETS - 1 )
+        printf( " <%u:%u", 1u << i, h->buckets[i] );
+      else if ( h->buckets[i] > 0 )
+        printf( " >=%u:%u", 1u << ( i - 1 ), h->buckets[i] );
+    printf( "\n" );
+  }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Shared helpers for the host benchmarks.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hk_server.h"
+
+// monotonic nanoseconds
+extern uint64_t bench_now_ns( void );
+
+// a server listening on port at 127.0.0.1 and ::1 serving `db` if not NULL,
+// driven by the caller through hk_server_poll
+extern hk_server_t *bench_server_create( uint16_t port, hks_db_t *db );
+
+// the same, running hk_server_run on its own thread
+extern hk_server_t *bench_server_start( uint16_t port, hks_db_t *db );
+
+// hk_server_run on its own thread for a server set up by the caller
+extern void bench_server_run( hk_server_t *hks );
+
+// blocking TCP connection to 127.0.0.1:port, -1 on failure
+extern int bench_connect( uint16_t port );
+
+// sort `samples` and print count/min/p50/p99/max in microseconds
+extern void bench_report_latency( const char *name, uint64_t *samples_ns, size_t count );
+
+// print the server's counters and a line per stage histogram: count, mean,
+// the bucket bounds p50 and p99 fall under, max and the non-empty buckets
+extern void bench_report_stats( const hks_stats_t *stats );
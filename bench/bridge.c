@@ -0,0 +1,42 @@
+#include "bridge.h"
+#include "hks_schema.h"
+
+#define BENCH_INFO( aid ) \
+  HKS_DB_ACCESSORY( aid ), \
+    HKS_DB_SERVICE( accessory_information, 0 ), \
+      HKS_DB_CHARACTERISTIC( identify ), \
+      HKS_DB_CHARACTERISTIC( manufacturer, .s = "Espressif" ), \
+      HKS_DB_CHARACTERISTIC( model, .s = "ESP32-Light" ), \
+      HKS_DB_CHARACTERISTIC( name, .s = "Light " #aid ), \
+      HKS_DB_CHARACTERISTIC( serial_number, .s = "SN" #aid ), \
+      HKS_DB_CHARACTERISTIC( firmware_revision, .s = "1.0.0" )
+
+#define BENCH_LIGHT( aid ) \
+  BENCH_INFO( aid ), \
+    HKS_DB_SERVICE( lightbulb, HKS_DB_PRIMARY ), \
+      HKS_DB_CHARACTERISTIC( on ), \
+      HKS_DB_CHARACTERISTIC( brightness, .i = 100 ), \
+      HKS_DB_CHARACTERISTIC( hue ), \
+      HKS_DB_CHARACTERISTIC( saturation )
+
+#define BENCH_LIGHTS_10( tens ) \
+  BENCH_LIGHT( tens##0 ), BENCH_LIGHT( tens##1 ), BENCH_LIGHT( tens##2 ), BENCH_LIGHT( tens##3 ), \
+  BENCH_LIGHT( tens##4 ), BENCH_LIGHT( tens##5 ), BENCH_LIGHT( tens##6 ), BENCH_LIGHT( tens##7 ), \
+  BENCH_LIGHT( tens##8 ), BENCH_LIGHT( tens##9 )
+
+static const hks_db_entry_t _bench_bridge[] = {
+  BENCH_INFO( 1 ),
+  BENCH_LIGHT( 2 ), BENCH_LIGHT( 3 ), BENCH_LIGHT( 4 ), BENCH_LIGHT( 5 ),
+  BENCH_LIGHT( 6 ), BENCH_LIGHT( 7 ), BENCH_LIGHT( 8 ), BENCH_LIGHT( 9 ),
+  BENCH_LIGHTS_10( 1 ), BENCH_LIGHTS_10( 2 ), BENCH_LIGHTS_10( 3 ),
+  BENCH_LIGHTS_10( 4 ), BENCH_LIGHTS_10( 5 ), BENCH_LIGHTS_10( 6 ),
+  BENCH_LIGHTS_10( 7 ), BENCH_LIGHTS_10( 8 ), BENCH_LIGHTS_10( 9 ),
+  BENCH_LIGHT( 100 ), BENCH_LIGHT( 101 ),
+};
+
+HKS_DB_STORAGE( _bench_bridge_db, _bench_bridge, BENCH_BRIDGE_ACCESSORIES );
+
+esp_err_t bench_bridge_init( hks_db_t *db )
+{
+  return HKS_DB_INIT_STATIC( db, _bench_bridge_db, _bench_bridge );
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// A HAP bridge fixture: the bridge itself (aid 1) plus 100 bridged light
+// bulbs (aids 2..101), each with an accessory information and a light bulb
+// service. Light bulb characteristics are iids 9 (on) to 12 (saturation).
+
+#include <stdint.h>
+#include "hks_db.h"
+
+#define BENCH_BRIDGE_ACCESSORIES 101
+
+extern esp_err_t bench_bridge_init( hks_db_t *db );
@@ -0,0 +1,181 @@
+// GET and PUT /characteristics over a loopback connection for batch sizes 1
+// to 100, against the same number of single characteristic requests: a
+// scene toggling 30 lights in one request or in 30 round trips.
+//
+//   bench_characteristics_batch [iterations] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "bridge.h"
+
+static size_t _bench_reads;
+static size_t _bench_writes;
+
+static void _bench_read( hks_db_t *db, const uint16_t *slots, int32_t *status, size_t count, void *ctx )
+{
+  _bench_reads++;
+}
+
+static void _bench_write( hks_db_t *db, const uint16_t *slots, const hks_value_t *values, int32_t *status, size_t count, void *ctx )
+{
+  _bench_writes++;
+}
+
+// send a request and read its response, returns the status code or -1
+static int _bench_exchange( int fd, const char *request, size_t len, char *buffer, size_t size )
+{
+  if ( write( fd, request, len ) != (ssize_t)len )
+    return -1;
+
+  size_t received = 0;
+  char *end = NULL;
+  while ( end == NULL )
+  {
+    ssize_t n = read( fd, buffer + received, size - received - 1 );
+    if ( n <= 0 )
+      return -1;
+    received += n;
+    buffer[received] = 0;
+    end = strstr( buffer, "\r\n\r\n" );
+  }
+
+  // 204 has no length
+  char *length = strstr( buffer, "Content-Length: " );
+  size_t total = ( end + 4 - buffer ) + ( length ? strtoul( length + 16, NULL, 10 ) : 0 );
+  while ( received < total )
+  {
+    ssize_t n = read( fd, buffer + received, size - received );
+    if ( n <= 0 )
+      return -1;
+    received += n;
+  }
+
+  return atoi( buffer + 9 );
+}
+
+// GET of the brightness of the first `n` lights
+static size_t _bench_get_request( char *request, size_t size, size_t first, size_t n )
+{
+  size_t len = snprintf( request, size, "GET /characteristics?id=" );
+  for ( size_t i = 0; i < n; i++ )
+    len += snprintf( request + len, size - len, "%s%zu.10", i ? "," : "", first + i + 2 );
+  len += snprintf( request + len, size - len, " HTTP/1.1\r\nHost: hap.local\r\n\r\n" );
+  return len;
+}
+
+// PUT turning the first `n` lights on or off
+static size_t _bench_put_request( char *request, size_t size, size_t first, size_t n, int on )
+{
+  char body[8192];
+  size_t body_len = snprintf( body, sizeof( body ), "{\"characteristics\":[" );
+  for ( size_t i = 0; i < n; i++ )
+    body_len += snprintf( body + body_len, sizeof( body ) - body_len, "%s{\"aid\":%zu,\"iid\":9,\"value\":%s}",
+      i ? "," : "", first + i + 2, on ? "true" : "false" );
+  body_len += snprintf( body + body_len, sizeof( body ) - body_len, "]}" );
+
+  return snprintf( request, size, "PUT /characteristics HTTP/1.1\r\nHost: hap.local\r\n"
+    "Content-Type: application/hap+json\r\nContent-Length: %zu\r\n\r\n%s", body_len, body );
+}
+
+int main( int argc, char **argv )
+{
+  size_t iterations = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 1000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42505;
+
+  hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+  hks_db_set_handlers( &db, _bench_read, _bench_write, NULL );
+
+  bench_server_start( port, &db );
+  int fd = bench_connect( port );
+
+  size_t size = 64 * 1024;
+  char *request = malloc( size );
+  char *buffer = malloc( size );
+  uint64_t *samples = calloc( iterations, sizeof( uint64_t ) );
+  char name[64];
+  int failed = 0;
+
+  static const size_t batches[] = { 1, 10, 30, 100 };
+  for ( size_t b = 0; b < sizeof( batches ) / sizeof( batches[0] ); b++ )
+  {
+    size_t n = batches[b];
+    printf( "batch of %zu\n", n );
+
+    // one request for the whole batch
+    size_t len = _bench_get_request( request, size, 0, n );
+    _bench_reads = 0;
+    for ( size_t i = 0; i < iterations; i++ )
+    {
+      uint64_t t0 = bench_now_ns();
+      failed |= _bench_exchange( fd, request, len, buffer, size ) != 200;
+      samples[i] = bench_now_ns() - t0;
+    }
+    printf( "  read callbacks per request: %.1f\n", (double)_bench_reads / iterations );
+    snprintf( name, sizeof( name ), "GET %zu ids", n );
+    bench_report_latency( name, samples, iterations );
+
+    for ( size_t i = 0; i < iterations; i++ )
+    {
+      len = _bench_put_request( request, size, 0, n, i & 1 );
+      uint64_t t0 = bench_now_ns();
+      failed |= _bench_exchange( fd, request, len, buffer, size ) != 204;
+      samples[i] = bench_now_ns() - t0;
+    }
+    snprintf( name, sizeof( name ), "PUT %zu values", n );
+    bench_report_latency( name, samples, iterations );
+
+    if ( n == 1 )
+      continue;
+
+    // the same work as n round trips
+    for ( size_t i = 0; i < iterations; i++ )
+    {
+      uint64_t t0 = bench_now_ns();
+      for ( size_t k = 0; k < n; k++ )
+      {
+        len = _bench_put_request( request, size, k, 1, i & 1 );
+        failed |= _bench_exchange( fd, request, len, buffer, size ) != 204;
+      }
+      samples[i] = bench_now_ns() - t0;
+    }
+    snprintf( name, sizeof( name ), "%zu x PUT 1 value", n );
+    bench_report_latency( name, samples, iterations );
+  }
+
+  // one unknown id turns the response into a multi-status
+  size_t len = snprintf( request, size, "GET /characteristics?id=2.10,999.10,1.1 HTTP/1.1\r\nHost: hap.local\r\n\r\n" );
+  failed |= _bench_exchange( fd, request, len, buffer, size ) != 207;
+
+  // a subscription ahead of a malformed item is not kept when the request
+  // is refused, and is once the batch is whole
+  static const char *bodies[] = {
+    "{\"characteristics\":[{\"aid\":2,\"iid\":10,\"ev\":true},{\"aid\":\"x\",\"iid\":9}]}",
+    "{\"characteristics\":[{\"aid\":2,\"iid\":10,\"ev\":true}]}",
+  };
+  static const int statuses[] = { 400, 204 };
+  static const char *subscribed[] = { "\"ev\":false", "\"ev\":true" };
+  for ( int i = 0; i < 2; i++ )
+  {
+    len = snprintf( request, size, "PUT /characteristics HTTP/1.1\r\nContent-Length: %zu\r\n\r\n%s",
+      strlen( bodies[i] ), bodies[i] );
+    failed |= _bench_exchange( fd, request, len, buffer, size ) != statuses[i];
+
+    // subscriptions belong to the connection, ask on the same one
+    len = snprintf( request, size, "GET /characteristics?id=2.10&ev=1 HTTP/1.1\r\n\r\n" );
+    failed |= _bench_exchange( fd, request, len, buffer, size ) != 200 || strstr( buffer, subscribed[i] ) == NULL;
+  }
+
+  if ( failed )
+    fprintf( stderr, "unexpected response status\n" );
+
+  close( fd );
+  free( samples );
+  free( buffer );
+  free( request );
+  return failed;
+}
@@ -0,0 +1,100 @@
+// Connection churn: connect, send one request, half-close and wait for the
+// server to close its side, one connection at a time, as a soak. The heap
+// high-water mark and largest free block of the server's own heap, and the
+// process heap from malloc's view, are printed before and after; a churn
+// that leaks or fragments shows up as the largest block shrinking.
+//
+//   bench_conn_churn [connections] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sys/socket.h>
+#include "bench.h"
+#include "bridge.h"
+
+static const char _request[] = "GET /accessories HTTP/1.1\r\nHost: hap.local\r\n\r\n";
+
+// a sample taken after whatever came before, then both heaps
+static void _bench_heap( hk_server_t *hks, const char *name )
+{
+  hks_watermarks_t w;
+  hk_server_get_watermarks( hks, &w );
+  uint32_t samples = w.samples;
+  for ( int i = 0; i < 100 && w.samples < samples + 2; i++ )
+  {
+    usleep( CONFIG_HKS_WATERMARK_PERIOD_MS * 1000 );
+    hk_server_get_watermarks( hks, &w );
+  }
+
+  struct mallinfo2 info = mallinfo2();
+  printf( "%-28s server heap peak=%u largest free=%u of %u, process heap in use=%zu free=%zu\n",
+    name,
+    CONFIG_HKS_HEAP_SIZE - w.server_heap,
+    w.server_heap_largest,
+    CONFIG_HKS_HEAP_SIZE,
+    info.uordblks + info.hblkhd,
+    info.fordblks
+  );
+}
+
+int main( int argc, char **argv )
+{
+  size_t count = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 100000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42501;
+
+  // the document is rendered into the server's heap and dropped with it
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  hk_server_t *hks = bench_server_start( port, &db );
+
+  uint64_t *connect_ns = calloc( count, sizeof( uint64_t ) );
+  uint64_t *lifetime_ns = calloc( count, sizeof( uint64_t ) );
+  size_t failed = 0;
+  char buffer[4096];
+
+  _bench_heap( hks, "before" );
+
+  uint64_t start = bench_now_ns();
+  for ( size_t i = 0; i < count; i++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    int fd = bench_connect( port );
+    connect_ns[i] = bench_now_ns() - t0;
+    if ( fd < 0 )
+    {
+      failed++;
+      continue;
+    }
+
+    if ( write( fd, _request, sizeof( _request ) - 1 ) < 0 )
+      failed++;
+    shutdown( fd, SHUT_WR );
+
+    // the server closes once it sees our FIN
+    while ( read( fd, buffer, sizeof( buffer ) ) > 0 );
+    lifetime_ns[i] = bench_now_ns() - t0;
+
+    close( fd );
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  printf( "connections %zu failed %zu in %.3fs: %.0f conn/s\n",
+    count,
+    failed,
+    elapsed / 1e9,
+    count / ( elapsed / 1e9 )
+  );
+  bench_report_latency( "connect", connect_ns, count );
+  bench_report_latency( "connect-to-close", lifetime_ns, count );
+
+  _bench_heap( hks, "after" );
+
+  free( connect_ns );
+  free( lifetime_ns );
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+#define _GNU_SOURCE // memmem
+#include "controller.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <esp_system.h>
+#include "bench.h"
+#include "hks_crypto.h"
+#include "hks_curve25519.h"
+#include "hks_bignum.h"
+#include "hks_tlv.h"
+
+// RFC 5054 3072-bit group, g = 5
+static const char _bench_srp_n[] =
+  "ffffffffffffffffc90fdaa22168c234c4c6628b80dc1cd129024e088a67cc74"
+  "020bbea63b139b22514a08798e3404ddef9519b3cd3a431b302b0a6df25f1437"
+  "4fe1356d6d51c245e485b576625e7ec6f44c42e9a637ed6b0bff5cb6f406b7ed"
+  "ee386bfb5a899fa5ae9f24117c4b1fe649286651ece45b3dc2007cb8a163bf05"
+  "98da48361c55d39a69163fa8fd24cf5f83655d23dca3ad961c62f356208552bb"
+  "9ed529077096966d670c354e4abc9804f1746c08ca18217c32905e462e36ce3b"
+  "e39e772c180e86039b2783a2ec07a28fb5c55df06f4c52c9de2bcbf695581718"
+  "3995497cea956ae515d2261898fa051015728e5a8aaac42dad33170d04507a33"
+  "a85521abdf1cba64ecfb850458dbef0a8aea71575d060c7db3970f85a6e1e4c7"
+  "abf5ae8cdb0933d71e8c94e04a25619dcee3d2261ad2ee6bf12ffa06d98a0864"
+  "d87602733ec86a64521f2b18177b200cbbe117577a615d6c770988c0bad946e2"
+  "08e24fa074e5ab3143db5bfce0fd108e4b82d120a93ad2caffffffffffffffff";
+
+static size_t _bench_hex( uint8_t *out, const char *hex )
+{
+  size_t n = 0;
+  for ( ; hex[0] && hex[1]; hex += 2 )
+  {
+    unsigned int byte;
+    sscanf( hex, "%2x", &byte );
+    out[n++] = byte;
+  }
+  return n;
+}
+
+void bench_controller_init( bench_controller_t *ctl, const char *id )
+{
+  memset( ctl, 0, sizeof( bench_controller_t ) );
+  strncpy( ctl->id, id, sizeof( ctl->id ) - 1 );
+  esp_fill_random( ctl->seed, sizeof( ctl->seed ) );
+  hks_ed25519_public( ctl->public_key, ctl->seed );
+}
+
+static int _bench_read_all( int fd, uint8_t *data, size_t len )
+{
+  while ( len > 0 )
+  {
+    ssize_t n = read( fd, data, len );
+    if ( n <= 0 )
+      return -1;
+    data += n;
+    len -= n;
+  }
+  return 0;
+}
+
+int bench_post( int fd, const char *path, const uint8_t *body, size_t len, uint8_t *response, size_t *response_len )
+{
+  char head[256];
+  int n = snprintf( head, sizeof( head ),
+    "POST %s HTTP/1.1\r\nHost: hap.local\r\nContent-Type: application/pairing+tlv8\r\nContent-Length: %zu\r\n\r\n",
+    path, len );
+  if ( write( fd, head, n ) != n || write( fd, body, len ) != (ssize_t)len )
+    return -1;
+
+  // the header a byte at a time up to the blank line
+  size_t head_len = 0;
+  while ( head_len < 4 || memcmp( head + head_len - 4, "\r\n\r\n", 4 ) != 0 )
+  {
+    if ( head_len == sizeof( head ) - 1 || read( fd, head + head_len, 1 ) != 1 )
+      return -1;
+    head_len++;
+  }
+  head[head_len] = '\0';
+
+  int status = 0;
+  const char *length = strstr( head, "Content-Length: " );
+  if ( sscanf( head, "HTTP/1.1 %d", &status ) != 1 || length == NULL )
+    return -1;
+
+  *response_len = strtoul( length + 16, NULL, 10 );
+  if ( _bench_read_all( fd, response, *response_len ) )
+    return -1;
+
+  return status;
+}
+
+// the TLV8 body of a pairing response, NULL unless it is a 200 without error
+static hks_tlv_items_t *_bench_pair_request( int fd, const char *path, hks_tlv_writer_t *w, uint8_t *response, hks_tlv_items_t *items, uint64_t *elapsed )
+{
+  size_t len;
+  uint64_t t0 = bench_now_ns();
+  int status = bench_post( fd, path, w->data, w->len, response, &len );
+  *elapsed = bench_now_ns() - t0;
+
+  if ( status != 200 || hks_tlv_decode( response, len, items ) != ESP_OK )
+    return NULL;
+  if ( hks_tlv_get( items, HKS_TLV_ERROR ) != NULL )
+    return NULL;
+
+  return items;
+}
+
+static void _bench_nonce( uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH], const char *label )
+{
+  memset( nonce, 0, 4 );
+  memcpy( nonce + 4, label, 8 );
+}
+
+// a sub-TLV sealed in place, the tag appended
+static size_t _bench_seal( const uint8_t *key, const char *label, uint8_t *data, size_t len )
+{
+  uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH];
+  _bench_nonce( nonce, label );
+
+  hks_aead_t aead;
+  hks_aead_init( &aead, key, nonce, NULL, 0 );
+  hks_aead_encrypt( &aead, data, data, len );
+  hks_aead_finish( &aead, data + len );
+  return len + HKS_POLY1305_TAG_LENGTH;
+}
+
+static int _bench_open( const uint8_t *key, const char *label, const hks_tlv_item_t *item, hks_tlv_items_t *items )
+{
+  if ( item == NULL || item->len < HKS_POLY1305_TAG_LENGTH )
+    return 0;
+
+  uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH], tag[HKS_POLY1305_TAG_LENGTH];
+  size_t len = item->len - HKS_POLY1305_TAG_LENGTH;
+  _bench_nonce( nonce, label );
+
+  hks_aead_t aead;
+  hks_aead_init( &aead, key, nonce, NULL, 0 );
+  hks_aead_decrypt( &aead, item->value, item->value, len );
+  hks_aead_finish( &aead, tag );
+
+  return hks_crypto_equal( tag, item->value + len, sizeof( tag ) ) && hks_tlv_decode( item->value, len, items ) == ESP_OK;
+}
+
+static void _bench_hash_bn( hks_sha512_t *sha, const hks_bn_t *a )
+{
+  uint8_t bytes[HKS_BN_BYTES];
+  hks_bn_to_bytes( a, bytes );
+  hks_sha512_update( sha, bytes, sizeof( bytes ) );
+}
+
+// The controller's half of SRP from the salt and B of M2: A, M1 and the M2
+// to expect, and the shared key K. S = (B - k g^x)^(a + u x) is taken as
+// (B - k g^x)^a ((B - k g^x)^x)^u, the bignum code has no plain multiply.
+static void _bench_srp_client(
+  const uint8_t *salt,
+  const uint8_t *b,
+  size_t b_len,
+  uint8_t a_bytes[HKS_BN_BYTES],
+  uint8_t m1[HKS_SHA512_LENGTH],
+  uint8_t m2[HKS_SHA512_LENGTH],
+  uint8_t key[HKS_SHA512_LENGTH]
+)
+{
+  static hks_bn_mont_t mont;
+  hks_bn_t n, g, v, base, s, t;
+  uint8_t n_bytes[HKS_BN_BYTES], g_byte = 5, secret[32];
+  uint8_t k[HKS_SHA512_LENGTH], x[HKS_SHA512_LENGTH], u[HKS_SHA512_LENGTH], digest[HKS_SHA512_LENGTH];
+  hks_sha512_t sha;
+
+  _bench_hex( n_bytes, _bench_srp_n );
+  hks_bn_from_bytes( &n, n_bytes, sizeof( n_bytes ) );
+  hks_bn_mont_init( &mont, &n );
+  hks_bn_from_bytes( &g, &g_byte, 1 );
+
+  esp_fill_random( secret, sizeof( secret ) );
+  hks_bn_mod_exp( &mont, &t, &g, secret, sizeof( secret ) );
+  hks_bn_to_bytes( &t, a_bytes );
+
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, n_bytes, sizeof( n_bytes ) );
+  _bench_hash_bn( &sha, &g );
+  hks_sha512_finish( &sha, k );
+
+  hks_sha512( "Pair-Setup:" BENCH_SETUP_CODE, strlen( "Pair-Setup:" BENCH_SETUP_CODE ), digest );
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, salt, 16 );
+  hks_sha512_update( &sha, digest, sizeof( digest ) );
+  hks_sha512_finish( &sha, x );
+
+  hks_bn_t b_bn;
+  hks_bn_from_bytes( &b_bn, b, b_len );
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, a_bytes, HKS_BN_BYTES );
+  _bench_hash_bn( &sha, &b_bn );
+  hks_sha512_finish( &sha, u );
+
+  hks_bn_mod_exp( &mont, &v, &g, x, sizeof( x ) );
+  hks_bn_from_bytes( &t, k, sizeof( k ) );
+  hks_bn_mod_mul( &mont, &t, &t, &v );
+  hks_bn_mod_sub( &mont, &base, &b_bn, &t );
+
+  hks_bn_mod_exp( &mont, &s, &base, secret, sizeof( secret ) );
+  hks_bn_mod_exp( &mont, &t, &base, x, sizeof( x ) );
+  hks_bn_mod_exp( &mont, &t, &t, u, sizeof( u ) );
+  hks_bn_mod_mul( &mont, &s, &s, &t );
+
+  hks_sha512_init( &sha );
+  _bench_hash_bn( &sha, &s );
+  hks_sha512_finish( &sha, key );
+
+  uint8_t hn[HKS_SHA512_LENGTH];
+  hks_sha512( n_bytes, sizeof( n_bytes ), hn );
+  hks_sha512( &g_byte, 1, digest );
+  for ( int i = 0; i < HKS_SHA512_LENGTH; i++ )
+    hn[i] ^= digest[i];
+
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, hn, sizeof( hn ) );
+  hks_sha512( "Pair-Setup", 10, digest );
+  hks_sha512_update( &sha, digest, sizeof( digest ) );
+  hks_sha512_update( &sha, salt, 16 );
+  hks_sha512_update( &sha, a_bytes, HKS_BN_BYTES );
+  _bench_hash_bn( &sha, &b_bn );
+  hks_sha512_update( &sha, key, HKS_SHA512_LENGTH );
+  hks_sha512_finish( &sha, m1 );
+
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, a_bytes, HKS_BN_BYTES );
+  hks_sha512_update( &sha, m1, HKS_SHA512_LENGTH );
+  hks_sha512_update( &sha, key, HKS_SHA512_LENGTH );
+  hks_sha512_finish( &sha, m2 );
+}
+
+int bench_pair_setup( bench_controller_t *ctl, int fd, uint64_t elapsed[3] )
+{
+  uint8_t body[1024], response[1024], sub[256];
+  hks_tlv_writer_t w, sw;
+  hks_tlv_items_t items, sub_items;
+  const hks_tlv_item_t *item;
+
+  hks_tlv_writer_init( &w, body, sizeof( body ) );
+  hks_tlv_put_byte( &w, HKS_TLV_STATE, 1 );
+  hks_tlv_put_byte( &w, HKS_TLV_METHOD, 0 );
+  if ( !_bench_pair_request( fd, "/pair-setup", &w, response, &items, &elapsed[0] ) )
+    return -1;
+
+  const hks_tlv_item_t *salt = hks_tlv_get( &items, HKS_TLV_SALT );
+  const hks_tlv_item_t *b = hks_tlv_get( &items, HKS_TLV_PUBLIC_KEY );
+  if ( salt == NULL || salt->len != 16 || b == NULL || b->len > HKS_BN_BYTES )
+    return -1;
+
+  uint8_t a[HKS_BN_BYTES], m1[64], m2[64], key[64];
+  _bench_srp_client( salt->value, b->value, b->len, a, m1, m2, key );
+
+  hks_tlv_writer_init( &w, body, sizeof( body ) );
+  hks_tlv_put_byte( &w, HKS_TLV_STATE, 3 );
+  hks_tlv_put( &w, HKS_TLV_PUBLIC_KEY, a, sizeof( a ) );
+  hks_tlv_put( &w, HKS_TLV_PROOF, m1, sizeof( m1 ) );
+  if ( !_bench_pair_request( fd, "/pair-setup", &w, response, &items, &elapsed[1] ) )
+    return -1;
+  if ( ( item = hks_tlv_get( &items, HKS_TLV_PROOF ) ) == NULL || item->len != 64 || memcmp( item->value, m2, 64 ) != 0 )
+    return -1;
+
+  // M5: the controller's long-term key signed under K
+  uint8_t encrypt_key[32], info[32 + HKS_PAIRING_ID_LENGTH + 32], signature[64];
+  size_t id_len = strlen( ctl->id );
+  hks_hkdf_sha512( key, sizeof( key ), "Pair-Setup-Encrypt-Salt", "Pair-Setup-Encrypt-Info", encrypt_key, 32 );
+  hks_hkdf_sha512( key, sizeof( key ), "Pair-Setup-Controller-Sign-Salt", "Pair-Setup-Controller-Sign-Info", info, 32 );
+  memcpy( info + 32, ctl->id, id_len );
+  memcpy( info + 32 + id_len, ctl->public_key, 32 );
+  hks_ed25519_sign( signature, info, 32 + id_len + 32, ctl->seed, ctl->public_key );
+
+  hks_tlv_writer_init( &sw, sub, sizeof( sub ) - HKS_POLY1305_TAG_LENGTH );
+  hks_tlv_put( &sw, HKS_TLV_IDENTIFIER, ctl->id, id_len );
+  hks_tlv_put( &sw, HKS_TLV_PUBLIC_KEY, ctl->public_key, 32 );
+  hks_tlv_put( &sw, HKS_TLV_SIGNATURE, signature, sizeof( signature ) );
+
+  hks_tlv_writer_init( &w, body, sizeof( body ) );
+  hks_tlv_put_byte( &w, HKS_TLV_STATE, 5 );
+  hks_tlv_put( &w, HKS_TLV_ENCRYPTED_DATA, sub, _bench_seal( encrypt_key, "PS-Msg05", sub, sw.len ) );
+  if ( !_bench_pair_request( fd, "/pair-setup", &w, response, &items, &elapsed[2] ) )
+    return -1;
+
+  // M6: the accessory's, checked the same way
+  if ( !_bench_open( encrypt_key, "PS-Msg06", hks_tlv_get( &items, HKS_TLV_ENCRYPTED_DATA ), &sub_items ) )
+    return -1;
+  const hks_tlv_item_t *id = hks_tlv_get( &sub_items, HKS_TLV_IDENTIFIER );
+  const hks_tlv_item_t *ltpk = hks_tlv_get( &sub_items, HKS_TLV_PUBLIC_KEY );
+  const hks_tlv_item_t *sig = hks_tlv_get( &sub_items, HKS_TLV_SIGNATURE );
+  if ( id == NULL || id->len != 17 || ltpk == NULL || ltpk->len != 32 || sig == NULL || sig->len != 64 )
+    return -1;
+
+  hks_hkdf_sha512( key, sizeof( key ), "Pair-Setup-Accessory-Sign-Salt", "Pair-Setup-Accessory-Sign-Info", info, 32 );
+  memcpy( info + 32, id->value, 17 );
+  memcpy( info + 32 + 17, ltpk->value, 32 );
+  if ( !hks_ed25519_verify( sig->value, info, 32 + 17 + 32, ltpk->value ) )
+    return -1;
+
+  memcpy( ctl->accessory_id, id->value, 17 );
+  memcpy( ctl->accessory_key, ltpk->value, 32 );
+
+  return 0;
+}
+
+static void _bench_session_keys( bench_controller_t *ctl )
+{
+  hks_hkdf_sha512( ctl->shared, 32, "Control-Salt", "Control-Write-Encryption-Key", ctl->write_key, 32 );
+  hks_hkdf_sha512( ctl->shared, 32, "Control-Salt", "Control-Read-Encryption-Key", ctl->read_key, 32 );
+  ctl->read_count = 0;
+  ctl->write_count = 0;
+}
+
+int bench_pair_verify( bench_controller_t *ctl, int fd, uint64_t elapsed[2] )
+{
+  uint8_t body[512], response[512], sub[256];
+  hks_tlv_writer_t w, sw;
+  hks_tlv_items_t items, sub_items;
+  uint8_t secret[32], public_key[32], shared[32], key[32], info[32 + HKS_PAIRING_ID_LENGTH + 32], signature[64];
+
+  esp_fill_random( secret, sizeof( secret ) );
+  hks_x25519_public( public_key, secret );
+
+  hks_tlv_writer_init( &w, body, sizeof( body ) );
+  hks_tlv_put_byte( &w, HKS_TLV_STATE, 1 );
+  hks_tlv_put( &w, HKS_TLV_PUBLIC_KEY, public_key, sizeof( public_key ) );
+  if ( !_bench_pair_request( fd, "/pair-verify", &w, response, &items, &elapsed[0] ) )
+    return -1;
+
+  const hks_tlv_item_t *accessory = hks_tlv_get( &items, HKS_TLV_PUBLIC_KEY );
+  if ( accessory == NULL || accessory->len != 32 )
+    return -1;
+  uint8_t accessory_public_key[32];
+  memcpy( accessory_public_key, accessory->value, 32 );
+
+  hks_x25519( shared, secret, accessory_public_key );
+  hks_hkdf_sha512( shared, sizeof( shared ), "Pair-Verify-Encrypt-Salt", "Pair-Verify-Encrypt-Info", key, sizeof( key ) );
+  if ( !_bench_open( key, "PV-Msg02", hks_tlv_get( &items, HKS_TLV_ENCRYPTED_DATA ), &sub_items ) )
+    return -1;
+
+  const hks_tlv_item_t *id = hks_tlv_get( &sub_items, HKS_TLV_IDENTIFIER );
+  const hks_tlv_item_t *sig = hks_tlv_get( &sub_items, HKS_TLV_SIGNATURE );
+  if ( id == NULL || id->len != 17 || memcmp( id->value, ctl->accessory_id, 17 ) != 0 || sig == NULL || sig->len != 64 )
+    return -1;
+
+  memcpy( info, accessory_public_key, 32 );
+  memcpy( info + 32, ctl->accessory_id, 17 );
+  memcpy( info + 32 + 17, public_key, 32 );
+  if ( !hks_ed25519_verify( sig->value, info, 32 + 17 + 32, ctl->accessory_key ) )
+    return -1;
+
+  size_t id_len = strlen( ctl->id );
+  memcpy( info, public_key, 32 );
+  memcpy( info + 32, ctl->id, id_len );
+  memcpy( info + 32 + id_len, accessory_public_key, 32 );
+  hks_ed25519_sign( signature, info, 32 + id_len + 32, ctl->seed, ctl->public_key );
+
+  hks_tlv_writer_init( &sw, sub, sizeof( sub ) - HKS_POLY1305_TAG_LENGTH );
+  hks_tlv_put( &sw, HKS_TLV_IDENTIFIER, ctl->id, id_len );
+  hks_tlv_put( &sw, HKS_TLV_SIGNATURE, signature, sizeof( signature ) );
+
+  hks_tlv_writer_init( &w, body, sizeof( body ) );
+  hks_tlv_put_byte( &w, HKS_TLV_STATE, 3 );
+  hks_tlv_put( &w, HKS_TLV_ENCRYPTED_DATA, sub, _bench_seal( key, "PV-Msg03", sub, sw.len ) );
+
+  size_t len;
+  uint64_t t0 = bench_now_ns();
+  int status = bench_post( fd, "/pair-verify", body, w.len, response, &len );
+  elapsed[1] = bench_now_ns() - t0;
+  if ( status != 200 || hks_tlv_decode( response, len, &items ) != ESP_OK )
+    return -1;
+
+  uint8_t error;
+  if ( hks_tlv_get_byte( &items, HKS_TLV_ERROR, &error ) )
+    return error;
+
+  memcpy( ctl->shared, shared, sizeof( shared ) );
+  hks_hkdf_sha512( shared, sizeof( shared ), "Pair-Verify-ResumeSessionID-Salt", "Pair-Verify-ResumeSessionID-Info",
+    ctl->session_id, sizeof( ctl->session_id ) );
+  _bench_session_keys( ctl );
+  return 0;
+}
+
+int bench_pair_resume( bench_controller_t *ctl, int fd, uint64_t *elapsed )
+{
+  uint8_t body[128], response[512], secret[32], public_key[32], key[32], tag[HKS_POLY1305_TAG_LENGTH];
+  uint8_t salt[32 + HKS_PAIRING_SESSION_ID_LENGTH];
+  hks_tlv_writer_t w;
+  hks_tlv_items_t items, sub_items;
+
+  // a new key all the same, the accessory falls back to a full verify with it
+  esp_fill_random( secret, sizeof( secret ) );
+  hks_x25519_public( public_key, secret );
+
+  memcpy( salt, public_key, 32 );
+  memcpy( salt + 32, ctl->session_id, HKS_PAIRING_SESSION_ID_LENGTH );
+  hks_hkdf_sha512_salt( ctl->shared, 32, salt, sizeof( salt ), "Pair-Resume-Request-Info", key, sizeof( key ) );
+
+  hks_tlv_writer_init( &w, body, sizeof( body ) );
+  hks_tlv_put_byte( &w, HKS_TLV_STATE, 1 );
+  hks_tlv_put_byte( &w, HKS_TLV_METHOD, HKS_PAIRING_METHOD_RESUME );
+  hks_tlv_put( &w, HKS_TLV_PUBLIC_KEY, public_key, sizeof( public_key ) );
+  hks_tlv_put( &w, HKS_TLV_SESSION_ID, ctl->session_id, HKS_PAIRING_SESSION_ID_LENGTH );
+  hks_tlv_put( &w, HKS_TLV_ENCRYPTED_DATA, tag, _bench_seal( key, "PR-Msg01", tag, 0 ) );
+
+  size_t len;
+  uint64_t t0 = bench_now_ns();
+  int status = bench_post( fd, "/pair-verify", body, w.len, response, &len );
+  *elapsed = bench_now_ns() - t0;
+  if ( status != 200 || hks_tlv_decode( response, len, &items ) != ESP_OK )
+    return -1;
+
+  uint8_t error;
+  if ( hks_tlv_get_byte( &items, HKS_TLV_ERROR, &error ) )
+    return error;
+  if ( hks_tlv_get( &items, HKS_TLV_PUBLIC_KEY ) != NULL )
+    return 1;
+
+  const hks_tlv_item_t *id = hks_tlv_get( &items, HKS_TLV_SESSION_ID );
+  if ( id == NULL || id->len != HKS_PAIRING_SESSION_ID_LENGTH )
+    return -1;
+
+  memcpy( salt + 32, id->value, HKS_PAIRING_SESSION_ID_LENGTH );
+  hks_hkdf_sha512_salt( ctl->shared, 32, salt, sizeof( salt ), "Pair-Resume-Response-Info", key, sizeof( key ) );
+  if ( !_bench_open( key, "PR-Msg02", hks_tlv_get( &items, HKS_TLV_ENCRYPTED_DATA ), &sub_items ) )
+    return -1;
+
+  hks_hkdf_sha512_salt( ctl->shared, 32, salt, sizeof( salt ), "Pair-Resume-Shared-Secret-Info", ctl->shared, 32 );
+  memcpy( ctl->session_id, id->value, HKS_PAIRING_SESSION_ID_LENGTH );
+  _bench_session_keys( ctl );
+  return 0;
+}
+
+static void _bench_session_nonce( uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH], uint64_t count )
+{
+  memset( nonce, 0, 4 );
+  for ( int i = 0; i < 8; i++ )
+    nonce[4 + i] = count >> ( i * 8 );
+}
+
+// one request in a single frame, then its response
+static int _bench_secure_request( bench_controller_t *ctl, int fd, const char *request, size_t *len )
+{
+  uint8_t frame[2 + 1024 + HKS_POLY1305_TAG_LENGTH], nonce[HKS_CHACHA20_NONCE_LENGTH];
+  size_t n = strlen( request );
+  if ( n > 1024 )
+    return -1;
+  memcpy( frame + 2, request, n );
+  frame[0] = n & 0xff;
+  frame[1] = n >> 8;
+
+  hks_aead_t aead;
+  _bench_session_nonce( nonce, ctl->write_count++ );
+  hks_aead_init( &aead, ctl->write_key, nonce, frame, 2 );
+  hks_aead_encrypt( &aead, frame + 2, frame + 2, n );
+  hks_aead_finish( &aead, frame + 2 + n );
+  if ( write( fd, frame, n + 18 ) != (ssize_t)( n + 18 ) )
+    return -1;
+
+  // frames until the header and the body it announces are in
+  size_t size = 1024 * 1024, plain_len = 0, expected = 0;
+  uint8_t *plain = malloc( size );
+  int status = -1;
+  while ( expected == 0 || plain_len < expected )
+  {
+    uint8_t header[2], tag[HKS_POLY1305_TAG_LENGTH];
+    if ( _bench_read_all( fd, header, 2 ) )
+      break;
+    size_t frame_len = header[0] | ( header[1] << 8 );
+    if ( frame_len > 1024 || plain_len + frame_len + HKS_POLY1305_TAG_LENGTH > size )
+      break;
+    if ( _bench_read_all( fd, plain + plain_len, frame_len + HKS_POLY1305_TAG_LENGTH ) )
+      break;
+
+    _bench_session_nonce( nonce, ctl->read_count++ );
+    hks_aead_init( &aead, ctl->read_key, nonce, header, 2 );
+    hks_aead_decrypt( &aead, plain + plain_len, plain + plain_len, frame_len );
+    hks_aead_finish( &aead, tag );
+    if ( !hks_crypto_equal( tag, plain + plain_len + frame_len, sizeof( tag ) ) )
+      break;
+    plain_len += frame_len;
+
+    uint8_t *end = memmem( plain, plain_len, "\r\n\r\n", 4 );
+    uint8_t *length = memmem( plain, plain_len, "Content-Length: ", 16 );
+    // a 204 comes without a length
+    if ( expected == 0 && end != NULL )
+    {
+      sscanf( (const char *)plain, "HTTP/1.1 %d", &status );
+      *len = length != NULL && length < end ? strtoul( (const char *)length + 16, NULL, 10 ) : 0;
+      expected = end + 4 - plain + *len;
+    }
+  }
+
+  free( plain );
+  return expected > 0 && plain_len == expected ? status : -1;
+}
+
+int bench_secure_get( bench_controller_t *ctl, int fd, const char *path, size_t *len )
+{
+  char request[256];
+  snprintf( request, sizeof( request ), "GET %s HTTP/1.1\r\nHost: hap.local\r\n\r\n", path );
+  return _bench_secure_request( ctl, fd, request, len );
+}
+
+int bench_secure_put( bench_controller_t *ctl, int fd, const char *path, const char *body )
+{
+  char request[1024];
+  size_t len;
+  snprintf( request, sizeof( request ), "PUT %s HTTP/1.1\r\nHost: hap.local\r\nContent-Length: %zu\r\n\r\n%s",
+    path, strlen( body ), body );
+  return _bench_secure_request( ctl, fd, request, &len );
+}
+
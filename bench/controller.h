@@ -0,0 +1,50 @@
+#pragma once
+
+// The controller side of HAP pairing for the benchmarks: pair-setup with the
+// SRP client, pair-verify and requests over the secured session, all with
+// blocking sockets.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hks_pairing.h"
+
+#define BENCH_SETUP_CODE "031-45-154"
+
+// a controller with its long-term key and what it learns about the accessory
+struct bench_controller_s {
+  char id[HKS_PAIRING_ID_LENGTH + 1];
+  uint8_t seed[HKS_ED25519_SEED_LENGTH];
+  uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH];
+  uint8_t accessory_id[17];
+  uint8_t accessory_key[HKS_ED25519_PUBLIC_LENGTH];
+  uint8_t read_key[HKS_CHACHA20_KEY_LENGTH];
+  uint8_t write_key[HKS_CHACHA20_KEY_LENGTH];
+  uint64_t read_count;
+  uint64_t write_count;
+  uint8_t shared[HKS_X25519_KEY_LENGTH];                // of the last session, to resume it
+  uint8_t session_id[HKS_PAIRING_SESSION_ID_LENGTH];
+};
+typedef struct bench_controller_s bench_controller_t;
+
+// a fresh long-term key for `id`
+extern void bench_controller_init( bench_controller_t *ctl, const char *id );
+
+// status of a plain POST, the body lands in `response`
+extern int bench_post( int fd, const char *path, const uint8_t *body, size_t len, uint8_t *response, size_t *response_len );
+
+// M1 to M6, the time of each exchange in `elapsed`; 0 once paired
+extern int bench_pair_setup( bench_controller_t *ctl, int fd, uint64_t elapsed[3] );
+
+// M1 to M4, 0 with the session keys, the TLV error the accessory sent, or -1
+extern int bench_pair_verify( bench_controller_t *ctl, int fd, uint64_t elapsed[2] );
+
+// M1 and M2 resuming the last session, 0 with new session keys, 1 when the
+// accessory answered with the M2 of a full pair-verify instead, the TLV error
+// it sent, or -1
+extern int bench_pair_resume( bench_controller_t *ctl, int fd, uint64_t *elapsed );
+
+// status of a GET over the secured session, the length of its body in `len`
+extern int bench_secure_get( bench_controller_t *ctl, int fd, const char *path, size_t *len );
+
+// status of a PUT of `body` over the secured session
+extern int bench_secure_put( bench_controller_t *ctl, int fd, const char *path, const char *body );
@@ -0,0 +1,249 @@
+// ChaCha20-Poly1305 against the RFC 8439 test vectors, then the cost of the
+// session layer: sealing and opening 1024 byte frames, opening a received
+// stream in place and flushing a 100 KB /accessories sized response
+// through a secured session against the plain send queue.
+//
+//   bench_crypto [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "bench.h"
+#include "hks_crypto.h"
+#include "hks_session.h"
+
+#define BENCH_DOCUMENT_LENGTH ( 100 * 1024 )
+
+static const char _bench_sunscreen[] =
+  "Ladies and Gentlemen of the class of '99: If I could offer you only one "
+  "tip for the future, sunscreen would be it.";
+
+static size_t _bench_hex( uint8_t *out, const char *hex )
+{
+  size_t n = 0;
+  for ( ; hex[0] && hex[1]; hex += 2 )
+  {
+    unsigned int byte;
+    sscanf( hex, "%2x", &byte );
+    out[n++] = byte;
+  }
+  return n;
+}
+
+static int _bench_check( const char *name, const uint8_t *data, const char *expected_hex )
+{
+  uint8_t expected[256];
+  size_t len = _bench_hex( expected, expected_hex );
+  int ok = memcmp( data, expected, len ) == 0;
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+static int _bench_vectors( void )
+{
+  int failed = 0;
+  uint8_t key[32], nonce[12], aad[12], buffer[256], tag[16];
+  size_t len = sizeof( _bench_sunscreen ) - 1;
+
+  printf( "RFC 8439 test vectors\n" );
+
+  // 2.4.2
+  for ( int i = 0; i < 32; i++ )
+    key[i] = i;
+  _bench_hex( nonce, "000000000000004a00000000" );
+  hks_chacha20_t chacha;
+  hks_chacha20_init( &chacha, key, nonce, 1 );
+  hks_chacha20_xor( &chacha, buffer, (const uint8_t *)_bench_sunscreen, len );
+  failed |= _bench_check( "2.4.2 ChaCha20 encryption", buffer,
+    "6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0b"
+    "f91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d8"
+    "07ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab7793736"
+    "5af90bbf74a35be6b40b8eedf2785e42874d" );
+
+  // 2.5.2
+  _bench_hex( key, "85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b" );
+  hks_poly1305_t poly;
+  hks_poly1305_init( &poly, key );
+  hks_poly1305_update( &poly, (const uint8_t *)"Cryptographic Forum Research Group", 34 );
+  hks_poly1305_finish( &poly, tag );
+  failed |= _bench_check( "2.5.2 Poly1305", tag, "a8061dc1305136c6c22b8baf0c0127a9" );
+
+  // 2.8.2, sealed in two pieces and opened in place
+  for ( int i = 0; i < 32; i++ )
+    key[i] = 0x80 + i;
+  _bench_hex( nonce, "070000004041424344454647" );
+  _bench_hex( aad, "50515253c0c1c2c3c4c5c6c7" );
+  hks_aead_t aead;
+  hks_aead_init( &aead, key, nonce, aad, sizeof( aad ) );
+  hks_aead_encrypt( &aead, buffer, (const uint8_t *)_bench_sunscreen, 37 );
+  hks_aead_encrypt( &aead, buffer + 37, (const uint8_t *)_bench_sunscreen + 37, len - 37 );
+  hks_aead_finish( &aead, tag );
+  failed |= _bench_check( "2.8.2 AEAD ciphertext", buffer,
+    "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+    "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+    "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+    "3ff4def08e4b7a9de576d26586cec64b6116" );
+  failed |= _bench_check( "2.8.2 AEAD tag", tag, "1ae10b594f09e26a7e902ecbd0600691" );
+
+  uint8_t opened[16];
+  hks_aead_init( &aead, key, nonce, aad, sizeof( aad ) );
+  hks_aead_decrypt( &aead, buffer, buffer, len );
+  hks_aead_finish( &aead, opened );
+  int ok = memcmp( buffer, _bench_sunscreen, len ) == 0 && hks_crypto_equal( opened, tag, 16 );
+  printf( "  %-34s %s\n", "2.8.2 AEAD decryption in place", ok ? "ok" : "FAILED" );
+  failed |= !ok;
+
+  return failed;
+}
+
+static void _bench_report_rate( const char *name, size_t bytes, size_t frames, uint64_t ns )
+{
+  printf( "  %-34s %8.1f MB/s %7.2f us/frame\n", name,
+    bytes / ( ns / 1e9 ) / 1e6, ns / 1e3 / frames );
+}
+
+// socket to write into and the peer draining it
+static void _bench_socketpair( int fds[2] )
+{
+  socketpair( AF_UNIX, SOCK_STREAM, 0, fds );
+  fcntl( fds[0], F_SETFL, O_NONBLOCK );
+  fcntl( fds[1], F_SETFL, O_NONBLOCK );
+}
+
+static size_t _bench_drain( int fd, uint8_t *out, size_t size )
+{
+  uint8_t scratch[64 * 1024];
+  size_t total = 0;
+  for (;;)
+  {
+    uint8_t *dst = out && total < size ? out + total : scratch;
+    size_t space = out && total < size ? size - total : sizeof( scratch );
+    ssize_t n = read( fd, dst, space );
+    if ( n <= 0 )
+      return total;
+    total += n;
+  }
+}
+
+// queue the document as one segment and write it all out, draining the peer
+// whenever the socket fills; returns the bytes received
+static size_t _bench_send_document( hks_session_t *session, int fds[2], const uint8_t *document, uint8_t *out, size_t size )
+{
+  hks_send_queue_t queue;
+  hks_send_queue_init( &queue );
+  hks_send_queue_push( &queue, document, BENCH_DOCUMENT_LENGTH, NULL, NULL );
+
+  size_t received = 0;
+  for (;;)
+  {
+    esp_err_t err = session
+      ? hks_session_flush( session, &queue, fds[0] )
+      : hks_send_queue_flush( &queue, fds[0] );
+    received += _bench_drain( fds[1], out ? out + received : NULL, size - received );
+    if ( err != HKS_ERR_SEND_PENDING )
+      break;
+  }
+  return received;
+}
+
+int main( int argc, char **argv )
+{
+  size_t iterations = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 200;
+  int failed = _bench_vectors();
+
+  uint8_t key[32], nonce[12] = { 0 };
+  for ( int i = 0; i < 32; i++ )
+    key[i] = i * 7;
+
+  uint8_t *document = malloc( BENCH_DOCUMENT_LENGTH );
+  for ( size_t i = 0; i < BENCH_DOCUMENT_LENGTH; i++ )
+    document[i] = "{\"aid\":1,\"iid\":9,\"value\":true}"[i % 31];
+
+  printf( "frames of %d bytes\n", HKS_SESSION_FRAME_LENGTH );
+
+  uint8_t frame[HKS_SESSION_FRAME_LENGTH], tag[16];
+  size_t frames = iterations * 100;
+  hks_aead_t aead;
+  uint64_t t0 = bench_now_ns();
+  for ( size_t i = 0; i < frames; i++ )
+  {
+    nonce[4] = i;
+    hks_aead_init( &aead, key, nonce, (const uint8_t *)"\x00\x04", 2 );
+    hks_aead_encrypt( &aead, frame, document, sizeof( frame ) );
+    hks_aead_finish( &aead, tag );
+  }
+  _bench_report_rate( "seal", frames * sizeof( frame ), frames, bench_now_ns() - t0 );
+
+  t0 = bench_now_ns();
+  for ( size_t i = 0; i < frames; i++ )
+  {
+    hks_aead_init( &aead, key, nonce, (const uint8_t *)"\x00\x04", 2 );
+    hks_aead_decrypt( &aead, frame, frame, sizeof( frame ) );
+    hks_aead_finish( &aead, tag );
+  }
+  _bench_report_rate( "open in place", frames * sizeof( frame ), frames, bench_now_ns() - t0 );
+
+  // the sealed document is what a controller sends back, here it is opened
+  // the way the receive ring is
+  int fds[2];
+  _bench_socketpair( fds );
+  hks_send_queue_t empty;
+  hks_send_queue_init( &empty );
+
+  static hks_session_t session;
+  hks_session_init( &session );
+  hks_session_start( &session, &empty, key, key );
+
+  size_t sealed_size = BENCH_DOCUMENT_LENGTH + ( BENCH_DOCUMENT_LENGTH / HKS_SESSION_FRAME_LENGTH + 1 ) * HKS_SESSION_FRAME_OVERHEAD;
+  uint8_t *sealed = malloc( sealed_size );
+  uint8_t *stream = malloc( sealed_size );
+  size_t sealed_len = _bench_send_document( &session, fds, document, sealed, sealed_size );
+  size_t stream_frames = session.write_count;
+
+  uint64_t elapsed = 0;
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    memcpy( stream, sealed, sealed_len );
+    session.read_count = 0;
+    size_t len = sealed_len, decrypted = 0;
+    t0 = bench_now_ns();
+    failed |= hks_session_decrypt( &session, stream, &len, &decrypted ) != ESP_OK;
+    elapsed += bench_now_ns() - t0;
+    failed |= decrypted != BENCH_DOCUMENT_LENGTH || len != BENCH_DOCUMENT_LENGTH;
+  }
+  failed |= memcmp( stream, document, BENCH_DOCUMENT_LENGTH ) != 0;
+  _bench_report_rate( "session decrypt", iterations * BENCH_DOCUMENT_LENGTH, iterations * stream_frames, elapsed );
+
+  // a tampered frame is rejected
+  memcpy( stream, sealed, sealed_len );
+  stream[sealed_len / 2] ^= 1;
+  session.read_count = 0;
+  size_t len = sealed_len, decrypted = 0;
+  failed |= hks_session_decrypt( &session, stream, &len, &decrypted ) != ESP_FAIL;
+
+  // the whole document out through a socket, plain and secured
+  printf( "%d KB response, %d frame(s) per write\n", BENCH_DOCUMENT_LENGTH / 1024, HKS_SESSION_TX_FRAMES );
+
+  t0 = bench_now_ns();
+  for ( size_t i = 0; i < iterations; i++ )
+    failed |= _bench_send_document( NULL, fds, document, NULL, 0 ) != BENCH_DOCUMENT_LENGTH;
+  _bench_report_rate( "send queue flush", iterations * BENCH_DOCUMENT_LENGTH, iterations * stream_frames, bench_now_ns() - t0 );
+
+  t0 = bench_now_ns();
+  for ( size_t i = 0; i < iterations; i++ )
+    failed |= _bench_send_document( &session, fds, document, NULL, 0 ) != sealed_len;
+  _bench_report_rate( "session flush", iterations * BENCH_DOCUMENT_LENGTH, iterations * stream_frames, bench_now_ns() - t0 );
+
+  if ( failed )
+    fprintf( stderr, "crypto check failed\n" );
+
+  close( fds[0] );
+  close( fds[1] );
+  free( stream );
+  free( sealed );
+  free( document );
+  return failed;
+}
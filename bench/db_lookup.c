@@ -0,0 +1,76 @@
+// Characteristic lookup by (aid, iid) on the 100 accessory bridge: the
+// slot arithmetic of hks_db_find against a linear scan of the table.
+//
+//   bench_db_lookup [lookups]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "bridge.h"
+
+struct bench_id_s {
+  uint32_t aid;
+  uint16_t iid;
+};
+
+// what resolving an id costs without the slot index
+static uint16_t _bench_scan( const hks_db_t *db, uint32_t aid, uint16_t iid )
+{
+  uint16_t accessory = HKS_DB_SLOT_NONE;
+  for ( uint16_t slot = 0; slot < db->count; slot++ )
+  {
+    const hks_db_entry_t *entry = &db->entries[slot];
+    if ( entry->kind == HKS_DB_KIND_ACCESSORY )
+    {
+      if ( accessory != HKS_DB_SLOT_NONE )
+        break;
+      if ( entry->aid == aid )
+        accessory = slot;
+    }
+    else if ( accessory != HKS_DB_SLOT_NONE && slot - accessory == iid )
+      return entry->kind == HKS_DB_KIND_CHARACTERISTIC ? slot : HKS_DB_SLOT_NONE;
+  }
+
+  return HKS_DB_SLOT_NONE;
+}
+
+int main( int argc, char **argv )
+{
+  size_t count = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 1000000;
+
+  hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  printf( "%u accessories, %u slots: %zu bytes of const table, %zu bytes of RAM slots\n",
+    db.accessory_count,
+    db.count,
+    db.count * sizeof( hks_db_entry_t ),
+    db.count * sizeof( hks_db_slot_t ) + db.accessory_count * sizeof( uint16_t )
+  );
+
+  struct bench_id_s *ids = malloc( count * sizeof( struct bench_id_s ) );
+  srand( 1 );
+  for ( size_t i = 0; i < count; i++ )
+  {
+    ids[i].aid = 2 + rand() % ( BENCH_BRIDGE_ACCESSORIES - 1 );
+    ids[i].iid = 9 + rand() % 4;
+  }
+
+  size_t found = 0;
+  uint64_t start = bench_now_ns();
+  for ( size_t i = 0; i < count; i++ )
+    found += hks_db_find( &db, ids[i].aid, ids[i].iid ) != HKS_DB_SLOT_NONE;
+  uint64_t elapsed = bench_now_ns() - start;
+  printf( "hks_db_find: %zu/%zu found, %.1f ns/lookup\n", found, count, (double)elapsed / count );
+
+  found = 0;
+  start = bench_now_ns();
+  for ( size_t i = 0; i < count; i++ )
+    found += _bench_scan( &db, ids[i].aid, ids[i].iid ) != HKS_DB_SLOT_NONE;
+  elapsed = bench_now_ns() - start;
+  printf( "linear scan: %zu/%zu found, %.1f ns/lookup\n", found, count, (double)elapsed / count );
+
+  free( ids );
+  return 0;
+}
@@ -0,0 +1,262 @@
+// The server over both address families on loopback. First the responder's
+// answer has to carry an A record for 127.0.0.1 and an AAAA record for ::1,
+// and still one of each once a second interface is advertised, as every
+// host interface is loopback. Then a connection over 127.0.0.1 and one over
+// ::1 are open side by side and each gets /accessories; the time from
+// connect to the response is reported per family.
+//
+//   bench_dual_stack [requests] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "bench.h"
+#include "bridge.h"
+
+static const uint8_t _query[] =
+  "\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+  "\x04_hap\x04_tcp\x05local\x00"
+  "\x00\x0c\x00\x01";
+
+struct bench_addresses_s {
+  int a, aaaa;       // records of each type
+  int ipv4, ipv6;    // of those, the ones holding 127.0.0.1 and ::1
+};
+typedef struct bench_addresses_s bench_addresses_t;
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+static int _bench_connect( int family, uint16_t port )
+{
+  int fd = socket( family, SOCK_STREAM, 0 );
+  if ( fd < 0 )
+    return -1;
+
+  // as bench_connect, no TIME_WAIT left to keep a later bench from binding
+  int one = 1;
+  setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+  setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+
+  struct sockaddr_storage addr;
+  socklen_t len;
+  memset( &addr, 0, sizeof( addr ) );
+  if ( family == AF_INET6 )
+  {
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons( port );
+    in6->sin6_addr = in6addr_loopback;
+    len = sizeof( *in6 );
+  }
+  else
+  {
+    struct sockaddr_in *in = (struct sockaddr_in *)&addr;
+    in->sin_family = AF_INET;
+    in->sin_port = htons( port );
+    in->sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+    len = sizeof( *in );
+  }
+
+  if ( connect( fd, (struct sockaddr *)&addr, len ) < 0 )
+  {
+    close( fd );
+    return -1;
+  }
+  return fd;
+}
+
+// status of GET /accessories, the body read and thrown away
+static int _bench_get( int fd )
+{
+  static const char request[] = "GET /accessories HTTP/1.1\r\nHost: hap.local\r\n\r\n";
+  if ( write( fd, request, sizeof( request ) - 1 ) != sizeof( request ) - 1 )
+    return -1;
+
+  char buffer[1024];
+  size_t len = 0;
+  while ( len < 4 || memcmp( buffer + len - 4, "\r\n\r\n", 4 ) != 0 )
+  {
+    if ( len == sizeof( buffer ) - 1 || read( fd, buffer + len, 1 ) != 1 )
+      return -1;
+    len++;
+  }
+  buffer[len] = '\0';
+
+  int status = 0;
+  const char *length = strstr( buffer, "Content-Length: " );
+  if ( sscanf( buffer, "HTTP/1.1 %d", &status ) != 1 || length == NULL )
+    return -1;
+
+  for ( size_t body = strtoul( length + 16, NULL, 10 ); body > 0; )
+  {
+    ssize_t r = read( fd, buffer, body < sizeof( buffer ) ? body : sizeof( buffer ) );
+    if ( r <= 0 )
+      return -1;
+    body -= r;
+  }
+
+  return status;
+}
+
+// both families connected at once, `requests` times over
+static int _bench_families( uint16_t port, size_t requests )
+{
+  uint64_t *latency[2] = { calloc( requests, sizeof( uint64_t ) ), calloc( requests, sizeof( uint64_t ) ) };
+  const int families[2] = { AF_INET, AF_INET6 };
+  int ok = 1;
+
+  for ( size_t i = 0; i < requests && ok; i++ )
+  {
+    int fds[2];
+    uint64_t t0[2];
+    for ( int f = 0; f < 2; f++ )
+    {
+      t0[f] = bench_now_ns();
+      fds[f] = _bench_connect( families[f], port );
+      ok &= fds[f] >= 0;
+    }
+
+    // the second is answered while the first is still open
+    for ( int f = 0; f < 2; f++ )
+    {
+      ok &= fds[f] >= 0 && _bench_get( fds[f] ) == 200;
+      latency[f][i] = bench_now_ns() - t0[f];
+    }
+
+    for ( int f = 0; f < 2; f++ )
+      if ( fds[f] >= 0 )
+        close( fds[f] );
+  }
+
+  int failed = _bench_report( "127.0.0.1 and ::1 side by side", ok );
+  if ( ok )
+  {
+    bench_report_latency( "connect-to-response, IPv4", latency[0], requests );
+    bench_report_latency( "connect-to-response, IPv6", latency[1], requests );
+  }
+
+  free( latency[0] );
+  free( latency[1] );
+  return failed;
+}
+
+// past a name at `p`, compressed or not, NULL if it runs off the packet
+static const uint8_t *_bench_skip_name( const uint8_t *p, const uint8_t *end )
+{
+  while ( p < end )
+  {
+    if ( *p == 0 )
+      return p + 1;
+    if ( ( *p & 0xC0 ) == 0xC0 )
+      return p + 2 <= end ? p + 2 : NULL;
+    p += 1 + *p;
+  }
+  return NULL;
+}
+
+// the address records of the responder's answer to a legacy unicast query,
+// polling the server meanwhile
+static int _bench_query( hk_server_t *hks, bench_addresses_t *addresses )
+{
+  memset( addresses, 0, sizeof( bench_addresses_t ) );
+
+  int fd = socket( AF_INET, SOCK_DGRAM, 0 );
+  struct sockaddr_in responder = {
+    .sin_family = AF_INET,
+    .sin_port = htons( 5353 ),
+    .sin_addr.s_addr = htonl( INADDR_LOOPBACK )
+  };
+  sendto( fd, _query, sizeof( _query ) - 1, 0, (struct sockaddr *)&responder, sizeof( responder ) );
+
+  uint8_t pkt[1500];
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  for ( int i = 0; i < 100 && poll( &pfd, 1, 0 ) == 0; i++ )
+    hk_server_poll( hks, 10 );
+  ssize_t n = poll( &pfd, 1, 0 ) > 0 ? recv( fd, pkt, sizeof( pkt ), 0 ) : -1;
+  close( fd );
+  if ( n < 12 )
+    return -1;
+
+  const uint8_t *end = pkt + n;
+  const uint8_t *p = pkt + 12;
+  for ( int q = ( pkt[4] << 8 ) | pkt[5]; q > 0 && p != NULL; q-- )
+    p = ( p = _bench_skip_name( p, end ) ) != NULL && p + 4 <= end ? p + 4 : NULL;
+
+  for ( int a = ( pkt[6] << 8 ) | pkt[7]; a > 0; a-- )
+  {
+    if ( p == NULL || ( p = _bench_skip_name( p, end ) ) == NULL || p + 10 > end )
+      return -1;
+
+    uint16_t type = ( p[0] << 8 ) | p[1];
+    uint16_t rdlength = ( p[8] << 8 ) | p[9];
+    p += 10;
+    if ( p + rdlength > end )
+      return -1;
+
+    if ( type == 1 && rdlength == 4 )
+    {
+      uint32_t loopback = htonl( INADDR_LOOPBACK );
+      addresses->a++;
+      addresses->ipv4 += memcmp( p, &loopback, 4 ) == 0;
+    }
+    else if ( type == 28 && rdlength == 16 )
+    {
+      addresses->aaaa++;
+      addresses->ipv6 += memcmp( p, &in6addr_loopback, 16 ) == 0;
+    }
+    p += rdlength;
+  }
+
+  return 0;
+}
+
+static int _bench_records( hk_server_t *hks )
+{
+  bench_addresses_t addresses;
+  int failed = _bench_report( "A 127.0.0.1 and AAAA ::1",
+    _bench_query( hks, &addresses ) == 0 && addresses.a == 1 && addresses.ipv4 == 1 &&
+    addresses.aaaa == 1 && addresses.ipv6 == 1 );
+
+  failed |= _bench_report( "second interface added", hk_server_add_interface( hks, TCPIP_ADAPTER_IF_AP ) == ESP_OK );
+  failed |= _bench_report( "an unknown interface refused", hk_server_add_interface( hks, TCPIP_ADAPTER_IF_MAX ) != ESP_OK );
+  failed |= _bench_report( "shared addresses answered once",
+    _bench_query( hks, &addresses ) == 0 && addresses.a == 1 && addresses.aaaa == 1 );
+  return failed;
+}
+
+int main( int argc, char **argv )
+{
+  size_t requests = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 1000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42581;
+  int failed = 0;
+
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  // driven from here for the records, on its own thread for the requests
+  hk_server_t *hks = bench_server_create( port, &db );
+
+  printf( "mdns\n" );
+  failed |= _bench_records( hks );
+
+  bench_server_run( hks );
+
+  printf( "listeners\n" );
+  failed |= _bench_families( port, requests );
+
+  if ( failed )
+    fprintf( stderr, "dual stack check failed\n" );
+
+  return failed;
+}
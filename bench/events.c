@@ -0,0 +1,254 @@
+// Event notifications for a 100 light bridge: the engine alone (render and
+// fan-out to 8 subscribed controllers, coalescing of 10 Hz sensors under
+// different windows) and delivered over loopback with the server driven from
+// this thread.
+//
+//   bench_events [rounds] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "bench.h"
+#include "bridge.h"
+#include "hks_client.h"
+#include "hks_events.h"
+
+#define BENCH_LIGHTS       ( BENCH_BRIDGE_ACCESSORIES - 1 )
+#define BENCH_CONTROLLERS  4
+
+struct bench_controller_s {
+  int fd;
+  char *buffer;
+  size_t len;
+  size_t responses;
+  size_t messages;
+  size_t notifications;
+};
+typedef struct bench_controller_s bench_controller_t;
+
+static uint16_t _bench_slots[BENCH_LIGHTS];
+
+static void _bench_set( hks_db_t *db, size_t light, int32_t brightness )
+{
+  hks_value_t v = { .i = brightness };
+  hks_db_set_value( db, _bench_slots[light], &v );
+}
+
+static void _bench_engine( hks_db_t *db, size_t rounds )
+{
+  hks_client_pool_t *pool = malloc( sizeof( hks_client_pool_t ) );
+  hks_events_t *ev = malloc( sizeof( hks_events_t ) );
+  hks_timer_t *heap[4];
+  hks_timers_t timers;
+
+  hks_client_pool_init( pool );
+  hks_timers_init( &timers, heap, 4 );
+  hks_events_init( ev, pool, &timers, NULL );
+  hks_events_set_database( ev, db );
+  hks_db_set_observer( db, hks_events_changed, ev );
+
+  // every controller subscribed to every light, nothing is ever written to
+  // the sockets
+  for ( size_t k = 0; k < HKS_CLIENT_MAX; k++ )
+  {
+    int sv[2];
+    hks_client_t *c;
+    socketpair( AF_UNIX, SOCK_STREAM, 0, sv );
+    hks_client_new( pool, sv[0], &c );
+    for ( size_t i = 0; i < BENCH_LIGHTS; i++ )
+      hks_subscriptions_set( &c->events, _bench_slots[i], 1 );
+  }
+
+  // fan-out: every light changes, one flush
+  uint64_t *samples = calloc( rounds, sizeof( uint64_t ) );
+  uint64_t start = bench_now_ns();
+  for ( size_t r = 0; r < rounds; r++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    for ( size_t i = 0; i < BENCH_LIGHTS; i++ )
+      _bench_set( db, i, ( r + i ) % 101 );
+    hks_events_flush( ev );
+    samples[r] = bench_now_ns() - t0;
+
+    hks_client_t *c;
+    HKS_CLIENT_POOL_FOREACH( pool, c )
+      hks_send_queue_clear( &c->tx );
+  }
+  double elapsed = ( bench_now_ns() - start ) / 1e9;
+
+  printf( "engine: %u controllers x %u lights, %zu rounds\n", HKS_CLIENT_MAX, BENCH_LIGHTS, rounds );
+  printf( "  %.0f notifications/s, %.0f messages/s, %u renders for %u messages, %u dropped\n",
+    ev->notifications / elapsed, ev->messages / elapsed, ev->renders, ev->messages, ev->dropped );
+  bench_report_latency( "change 100 + flush", samples, rounds );
+  free( samples );
+
+  // 10 Hz sensors on a simulated clock, flushed when the window closes
+  static const uint32_t windows[] = { 0, 100, 250, 1000 };
+  for ( size_t w = 0; w < sizeof( windows ) / sizeof( windows[0] ); w++ )
+  {
+    ev->changes = ev->coalesced = ev->messages = ev->notifications = 0;
+
+    uint32_t opened = 0;
+    for ( uint32_t t = 0; t < 10000; t++ )
+    {
+      for ( size_t i = t % 100; i < BENCH_LIGHTS; i += 100 )
+      {
+        if ( ev->count == 0 )
+          opened = t;
+        _bench_set( db, i, ( t / 100 + i ) % 101 );
+      }
+
+      if ( ev->count > 0 && t - opened >= windows[w] )
+      {
+        hks_events_flush( ev );
+
+        hks_client_t *c;
+        HKS_CLIENT_POOL_FOREACH( pool, c )
+          hks_send_queue_clear( &c->tx );
+      }
+    }
+    hks_events_flush( ev );
+
+    double per_controller = (double)ev->notifications / HKS_CLIENT_MAX;
+    printf( "  10 Hz sensors, window %4ums: %u changes, %.0f sent per controller, coalescing %.1f:1, %.1f messages/s per controller\n",
+      windows[w], ev->changes, per_controller, ev->changes / per_controller, ev->messages / 10.0 / HKS_CLIENT_MAX );
+  }
+
+  hks_client_t *c;
+  HKS_CLIENT_POOL_FOREACH( pool, c )
+  {
+    hks_client_close( c );
+    hks_client_free( pool, c );
+  }
+  hks_db_set_observer( db, NULL, NULL );
+  free( ev );
+  free( pool );
+}
+
+// consume complete messages, returns -1 once the connection is gone
+static int _bench_receive( bench_controller_t *c, size_t size )
+{
+  ssize_t n = read( c->fd, c->buffer + c->len, size - c->len - 1 );
+  if ( n == 0 || ( n < 0 && errno != EAGAIN ) )
+    return -1;
+  if ( n > 0 )
+    c->len += n;
+  c->buffer[c->len] = 0;
+
+  for (;;)
+  {
+    char *end = strstr( c->buffer, "\r\n\r\n" );
+    if ( end == NULL )
+      return 0;
+
+    char *length = strstr( c->buffer, "Content-Length: " );
+    size_t total = ( end + 4 - c->buffer ) + ( length && length < end ? strtoul( length + 16, NULL, 10 ) : 0 );
+    if ( c->len < total )
+      return 0;
+
+    if ( memcmp( c->buffer, "HTTP/1.1 ", 9 ) == 0 )
+      c->responses++;
+    else
+    {
+      c->messages++;
+      for ( char *p = end; ( p = strstr( p, "{\"aid\"" ) ) != NULL && p < c->buffer + total; p++ )
+        c->notifications++;
+    }
+
+    memmove( c->buffer, c->buffer + total, c->len - total + 1 );
+    c->len -= total;
+  }
+}
+
+static int _bench_wire( hks_db_t *db, size_t rounds, uint16_t port )
+{
+  hk_server_t *hks = bench_server_create( port, db );
+  hk_server_set_event_coalescing( hks, 0 );
+
+  size_t size = 256 * 1024;
+  bench_controller_t controllers[BENCH_CONTROLLERS];
+
+  // subscribe to every light in one request each
+  char body[8192];
+  size_t body_len = snprintf( body, sizeof( body ), "{\"characteristics\":[" );
+  for ( size_t i = 0; i < BENCH_LIGHTS; i++ )
+    body_len += snprintf( body + body_len, sizeof( body ) - body_len, "%s{\"aid\":%zu,\"iid\":10,\"ev\":true}", i ? "," : "", i + 2 );
+  body_len += snprintf( body + body_len, sizeof( body ) - body_len, "]}" );
+
+  char request[8448];
+  size_t request_len = snprintf( request, sizeof( request ),
+    "PUT /characteristics HTTP/1.1\r\nContent-Length: %zu\r\n\r\n%s", body_len, body );
+
+  for ( size_t k = 0; k < BENCH_CONTROLLERS; k++ )
+  {
+    bench_controller_t *c = &controllers[k];
+    c->fd = bench_connect( port );
+    c->buffer = malloc( size );
+    c->len = c->responses = c->messages = c->notifications = 0;
+    fcntl( c->fd, F_SETFL, O_NONBLOCK );
+    if ( write( c->fd, request, request_len ) != (ssize_t)request_len )
+      return 1;
+
+    // accept, handle the PUT and read the 204
+    while ( c->responses == 0 )
+    {
+      hk_server_poll( hks, 1 );
+      if ( _bench_receive( c, size ) )
+        return 1;
+    }
+  }
+
+  uint64_t start = bench_now_ns();
+  size_t delivered = 0;
+  for ( size_t r = 0; r < rounds; r++ )
+  {
+    for ( size_t i = 0; i < BENCH_LIGHTS; i++ )
+      _bench_set( db, i, ( r + i ) % 101 );
+
+    // until every controller has seen the round
+    size_t expected = ( r + 1 ) * BENCH_LIGHTS;
+    for ( size_t k = 0; k < BENCH_CONTROLLERS; k++ )
+    {
+      while ( controllers[k].notifications < expected )
+      {
+        hk_server_poll( hks, 0 );
+        if ( _bench_receive( &controllers[k], size ) )
+          return 1;
+      }
+    }
+    delivered += BENCH_LIGHTS * BENCH_CONTROLLERS;
+  }
+  double elapsed = ( bench_now_ns() - start ) / 1e9;
+
+  printf( "loopback: %u controllers x %u lights, %zu rounds\n", BENCH_CONTROLLERS, BENCH_LIGHTS, rounds );
+  printf( "  %.0f notifications/s delivered, %.0f messages/s, %.1f us per round\n",
+    delivered / elapsed, BENCH_CONTROLLERS * rounds / elapsed, elapsed * 1e6 / rounds );
+
+  for ( size_t k = 0; k < BENCH_CONTROLLERS; k++ )
+  {
+    close( controllers[k].fd );
+    free( controllers[k].buffer );
+  }
+
+  return 0;
+}
+
+int main( int argc, char **argv )
+{
+  size_t rounds = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 2000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42506;
+
+  hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  for ( size_t i = 0; i < BENCH_LIGHTS; i++ )
+    _bench_slots[i] = hks_db_find( &db, i + 2, 10 );
+
+  _bench_engine( &db, rounds );
+  return _bench_wire( &db, rounds, port );
+}
@@ -0,0 +1,351 @@
+// The resumable request parser fed the same bytes in random chunks, one at a
+// time and all at once.
+//
+//   chunked   a corpus of single and pipelined requests, with and without
+//             bodies, oversized request and header lines, bad methods,
+//             versions and headers, and random mutations of them, each
+//             parsed in random chunkings and byte by byte; every chunking
+//             has to give the same requests, or the same error, as
+//             parsing it in one go
+//   throughput  the valid corpus in one go and byte by byte
+//
+//   bench_http_parser [chunkings] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "hks_http.h"
+
+#define BENCH_BUFFER      4096
+#define BENCH_REQUESTS    8  // pipelined in one buffer at most
+#define BENCH_MUTATIONS   200
+#define BENCH_ROUNDS      2000
+
+// what parsing one buffer came to: the requests in it and how it ended
+struct bench_outcome_s {
+  size_t count;
+  hks_http_request_t requests[BENCH_REQUESTS];
+  size_t offsets[BENCH_REQUESTS]; // where each started in the buffer
+  esp_err_t end;                  // ESP_OK when the buffer was used up
+};
+typedef struct bench_outcome_s bench_outcome_t;
+
+static const char *_valid[] = {
+  "GET /accessories HTTP/1.1\r\nHost: hap.local\r\n\r\n",
+  "GET /characteristics?id=1.9,1.10&meta=1 HTTP/1.1\r\n\r\n",
+  "PUT /characteristics HTTP/1.1\r\nContent-Type: application/hap+json\r\nContent-Length: 50\r\n\r\n"
+    "{\"characteristics\":[{\"aid\":2,\"iid\":10,\"ev\":true}]}",
+  "POST /pair-verify HTTP/1.1\r\nContent-Length: 5\r\nConnection: close\r\n\r\nabcde",
+  "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n",
+  "GET /a HTTP/1.1\nX-Bare-Newlines:   padded value \t\n\n",
+  "\r\n\r\nGET /after-blank-lines HTTP/1.1\r\n\r\n",
+  "GET /one HTTP/1.1\r\n\r\nGET /two HTTP/1.1\r\nContent-Length: 3\r\n\r\nxyzGET /three HTTP/1.0\r\n\r\n",
+  "GET /many HTTP/1.1\r\nA: 1\r\nB: 2\r\nC: 3\r\nD: 4\r\nE: 5\r\nF: 6\r\nG: 7\r\nH: 8\r\nI: 9\r\n"
+    "J: 10\r\nK: 11\r\nL: 12\r\nM: 13\r\nN: 14\r\n\r\n",
+  "POST /same HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc",
+};
+
+static const char *_invalid[] = {
+  " /no-method HTTP/1.1\r\n\r\n",
+  "GETTINGTOOLONGAMETHOD / HTTP/1.1\r\n\r\n",
+  "GET  HTTP/1.1\r\n\r\n",
+  "GET / HTTP/2.0\r\n\r\n",
+  "GET / HTTP/x\r\n\r\n",
+  "GET / HTTP/1.x\r\n\r\n",
+  "GET / FTP/1.1!\r\n\r\n",
+  "GET / HTTP/1.1\r\nNo colon here\r\n\r\n",
+  "GET / HTTP/1.1\r\n: empty name\r\n\r\n",
+  "GET / HTTP/1.1\r\nContent-Length: 12a\r\n\r\n",
+  "GET / HTTP/1.1\r\nContent-Length:\r\n\r\n",
+  "GET / HTTP/1.1\r\nContent-Length: 99999\r\n\r\n",
+  "POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 30\r\n\r\nabc",
+  "GET / HTTP/1.1\r\n\rX\r\n",
+  "GET /ok HTTP/1.1\r\n\r\nBAD\nLINE HTTP/1.1\r\n\r\n",
+};
+
+static uint32_t _bench_seed;
+
+static uint32_t _bench_random( void )
+{
+  // xorshift32, reproducible from the seed on the command line
+  _bench_seed ^= _bench_seed << 13;
+  _bench_seed ^= _bench_seed >> 17;
+  _bench_seed ^= _bench_seed << 5;
+  return _bench_seed;
+}
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+// feed `data` growing by `chunk( i )` bytes a call, consuming each request
+// as it completes; chunk 0 feeds everything at once
+static void _bench_parse( uint8_t *data, size_t len, size_t max_chunk, bench_outcome_t *out )
+{
+  hks_http_parser_t parser;
+  hks_http_parser_reset( &parser );
+  memset( out, 0, sizeof( bench_outcome_t ) );
+
+  size_t start = 0, fed = 0;
+  for (;;)
+  {
+    if ( max_chunk == 0 )
+      fed = len;
+    else if ( fed < len )
+    {
+      size_t chunk = max_chunk == 1 ? 1 : 1 + _bench_random() % max_chunk;
+      fed = fed + chunk > len ? len : fed + chunk;
+    }
+
+    hks_http_request_t request;
+    esp_err_t err = hks_http_request_parse( &parser, &request, data + start, fed - start );
+    if ( err == ESP_OK )
+    {
+      if ( out->count < BENCH_REQUESTS )
+      {
+        out->offsets[out->count] = start;
+        out->requests[out->count] = request;
+      }
+      out->count++;
+      start += request.content_len;
+      continue;
+    }
+
+    if ( err != HKS_ERR_HTTP_INCOMPLETE )
+    {
+      out->end = err;
+      return;
+    }
+
+    if ( fed == len )
+    {
+      // whatever is left has to be the start of another request
+      out->end = start == len ? ESP_OK : HKS_ERR_HTTP_INCOMPLETE;
+      return;
+    }
+  }
+}
+
+static int _bench_slice_equals( const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len )
+{
+  return a_len == b_len && ( a_len == 0 || memcmp( a, b, a_len ) == 0 );
+}
+
+static int _bench_request_equals( const hks_http_request_t *a, const hks_http_request_t *b )
+{
+  if ( a->content_len != b->content_len || a->keep_alive != b->keep_alive || a->header_count != b->header_count )
+    return 0;
+
+  if ( !_bench_slice_equals( a->method, a->method_len, b->method, b->method_len ) ||
+       !_bench_slice_equals( a->path, a->path_len, b->path, b->path_len ) ||
+       !_bench_slice_equals( a->query, a->query_len, b->query, b->query_len ) ||
+       !_bench_slice_equals( a->protocol, a->protocol_len, b->protocol, b->protocol_len ) ||
+       !_bench_slice_equals( a->body, a->body_len, b->body, b->body_len ) )
+    return 0;
+
+  for ( int i = 0; i < a->header_count; i++ )
+    if ( !_bench_slice_equals( a->headers[i].name, a->headers[i].name_len, b->headers[i].name, b->headers[i].name_len ) ||
+         !_bench_slice_equals( a->headers[i].value, a->headers[i].value_len, b->headers[i].value, b->headers[i].value_len ) )
+      return 0;
+
+  return 1;
+}
+
+static int _bench_outcome_equals( const bench_outcome_t *a, const bench_outcome_t *b )
+{
+  if ( a->count != b->count || a->end != b->end )
+    return 0;
+
+  for ( size_t i = 0; i < a->count && i < BENCH_REQUESTS; i++ )
+    if ( a->offsets[i] != b->offsets[i] || !_bench_request_equals( &a->requests[i], &b->requests[i] ) )
+      return 0;
+
+  return 1;
+}
+
+// one buffer in `chunkings` random chunkings and byte by byte against the
+// one-shot parse, the first mismatch printed
+static int _bench_check( const uint8_t *input, size_t len, size_t chunkings )
+{
+  static uint8_t data[BENCH_BUFFER];
+  memcpy( data, input, len );
+
+  bench_outcome_t whole, split;
+  _bench_parse( data, len, 0, &whole );
+
+  for ( size_t i = 0; i <= chunkings; i++ )
+  {
+    size_t max_chunk = i == 0 ? 1 : 1 + _bench_random() % 64;
+    _bench_parse( data, len, max_chunk, &split );
+    if ( !_bench_outcome_equals( &whole, &split ) )
+    {
+      printf( "  mismatch in chunks up to %zu: %zu requests ending %d against %zu ending %d for\n  %.*s\n",
+        max_chunk, split.count, split.end, whole.count, whole.end, (int)len, (const char *)input );
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// a copy of `input` with random bytes replaced, inserted or dropped
+static size_t _bench_mutate( uint8_t *dst, const char *input )
+{
+  static const char alphabet[] = " :\r\n/?0123456789ACGHLPT-.\t\x7f";
+  size_t len = strlen( input );
+  memcpy( dst, input, len );
+
+  for ( int n = 1 + _bench_random() % 4; n > 0 && len > 0; n-- )
+  {
+    size_t at = _bench_random() % len;
+    uint8_t c = (uint8_t)alphabet[_bench_random() % ( sizeof( alphabet ) - 1 )];
+    switch ( _bench_random() % 3 )
+    {
+      case 0:
+        dst[at] = c;
+        break;
+      case 1:
+        memmove( dst + at + 1, dst + at, len - at );
+        dst[at] = c;
+        len++;
+        break;
+      default:
+        memmove( dst + at, dst + at + 1, len - at - 1 );
+        len--;
+        break;
+    }
+  }
+
+  return len;
+}
+
+// a line just over each limit, in the request line and in a header
+static size_t _bench_oversized( uint8_t *dst, int header )
+{
+  size_t len = 0;
+  if ( header )
+  {
+    len += sprintf( (char *)dst, "GET / HTTP/1.1\r\nX-Long: " );
+    memset( dst + len, 'h', HKS_HTTP_MAX_HEADER_LINE );
+    len += HKS_HTTP_MAX_HEADER_LINE;
+  }
+  else
+  {
+    len += sprintf( (char *)dst, "GET /" );
+    memset( dst + len, 'p', HKS_HTTP_MAX_REQUEST_LINE );
+    len += HKS_HTTP_MAX_REQUEST_LINE;
+    len += sprintf( (char *)dst + len, " HTTP/1.1" );
+  }
+  len += sprintf( (char *)dst + len, "\r\n\r\n" );
+  return len;
+}
+
+static int _bench_chunked( size_t chunkings )
+{
+  static uint8_t buffer[BENCH_BUFFER];
+  int failed = 0;
+  int ok = 1;
+
+  for ( size_t i = 0; i < sizeof( _valid ) / sizeof( _valid[0] ); i++ )
+  {
+    bench_outcome_t whole;
+    size_t len = strlen( _valid[i] );
+    memcpy( buffer, _valid[i], len );
+    _bench_parse( buffer, len, 0, &whole );
+    ok &= whole.count > 0 && whole.end == ESP_OK;
+    ok &= _bench_check( (const uint8_t *)_valid[i], len, chunkings );
+  }
+  failed |= _bench_report( "valid requests", ok );
+
+  ok = 1;
+  for ( size_t i = 0; i < sizeof( _invalid ) / sizeof( _invalid[0] ); i++ )
+  {
+    bench_outcome_t whole;
+    size_t len = strlen( _invalid[i] );
+    memcpy( buffer, _invalid[i], len );
+    _bench_parse( buffer, len, 0, &whole );
+    ok &= whole.end != ESP_OK && whole.end != HKS_ERR_HTTP_INCOMPLETE;
+    ok &= _bench_check( (const uint8_t *)_invalid[i], len, chunkings );
+  }
+  failed |= _bench_report( "invalid requests refused", ok );
+
+  ok = 1;
+  for ( int header = 0; header < 2; header++ )
+  {
+    bench_outcome_t whole;
+    size_t len = _bench_oversized( buffer, header );
+    _bench_parse( buffer, len, 0, &whole );
+    ok &= whole.end == ESP_ERR_INVALID_SIZE;
+
+    static uint8_t copy[BENCH_BUFFER];
+    memcpy( copy, buffer, len );
+    ok &= _bench_check( copy, len, chunkings );
+  }
+  failed |= _bench_report( "oversized lines refused", ok );
+
+  ok = 1;
+  size_t mutations = 0;
+  for ( size_t i = 0; i < sizeof( _valid ) / sizeof( _valid[0] ) && ok; i++ )
+  {
+    for ( int m = 0; m < BENCH_MUTATIONS && ok; m++, mutations++ )
+    {
+      size_t len = _bench_mutate( buffer, _valid[i] );
+      static uint8_t copy[BENCH_BUFFER];
+      memcpy( copy, buffer, len );
+      ok &= _bench_check( copy, len, chunkings / 10 );
+    }
+  }
+  printf( "  %-34s %8zu\n", "mutations", mutations );
+  failed |= _bench_report( "mutations agree with one-shot", ok );
+
+  return failed;
+}
+
+static void _bench_throughput( void )
+{
+  static uint8_t buffer[BENCH_BUFFER];
+  size_t len = 0;
+  for ( size_t i = 0; i < sizeof( _valid ) / sizeof( _valid[0] ); i++ )
+  {
+    memcpy( buffer + len, _valid[i], strlen( _valid[i] ) );
+    len += strlen( _valid[i] );
+  }
+
+  bench_outcome_t out;
+  for ( size_t max_chunk = 0; max_chunk < 2; max_chunk++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    for ( int i = 0; i < BENCH_ROUNDS; i++ )
+      _bench_parse( buffer, len, max_chunk, &out );
+    uint64_t elapsed = bench_now_ns() - t0;
+
+    printf( "  %-34s %7.1f MB/s %7.1f ns/request\n",
+      max_chunk == 0 ? "one-shot" : "byte by byte",
+      (double)len * BENCH_ROUNDS / ( elapsed / 1e9 ) / 1e6,
+      (double)elapsed / ( (double)out.count * BENCH_ROUNDS )
+    );
+  }
+}
+
+int main( int argc, char **argv )
+{
+  size_t chunkings = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 200;
+  _bench_seed = argc > 2 ? (uint32_t)strtoul( argv[2], NULL, 10 ) : 0x9e3779b9;
+  if ( _bench_seed == 0 )
+    _bench_seed = 1;
+  int failed = 0;
+
+  printf( "chunked, %zu chunkings each, seed %u\n", chunkings, _bench_seed );
+  failed |= _bench_chunked( chunkings );
+
+  printf( "throughput\n" );
+  _bench_throughput();
+
+  if ( failed )
+    fprintf( stderr, "parser check failed\n" );
+
+  return failed;
+}
@@ -0,0 +1,109 @@
+// What an idle server costs, and how fast a new client is answered.
+//
+//   idle      the server with no clients, then with idle clients connected,
+//             left alone for a while: loop wakeups per second from its own
+//             counters and the CPU time it burnt per second; the 100 ms
+//             watermark period of bench/sdkconfig.defaults is 10 of them
+//   first byte  connect, send a request and wait for the first byte of the
+//             response, one connection at a time with the loop asleep in
+//             select in between
+//
+//   bench_idle_wakeups [seconds] [connections] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "bench.h"
+
+#define BENCH_IDLE_CLIENTS 4
+
+static const char _request[] = "GET /accessories HTTP/1.1\r\nHost: hap.local\r\n\r\n";
+
+static uint64_t _bench_cpu_ns( void )
+{
+  struct rusage usage;
+  getrusage( RUSAGE_SELF, &usage );
+  return ( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) * 1000000000ull +
+    ( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) * 1000ull;
+}
+
+// wakeups per second and CPU microseconds per second over `seconds` of
+// leaving the server alone
+static void _bench_idle( hk_server_t *hks, const char *name, unsigned seconds )
+{
+  hks_stats_t before, after;
+  hk_server_get_stats( hks, &before );
+  uint64_t cpu = _bench_cpu_ns();
+  uint64_t t0 = bench_now_ns();
+
+  sleep( seconds );
+
+  double elapsed = ( bench_now_ns() - t0 ) / 1e9;
+  cpu = _bench_cpu_ns() - cpu;
+  hk_server_get_stats( hks, &after );
+
+  printf( "  %-34s %7.2f wakeups/s %8.1f us CPU/s\n", name,
+    ( after.wakeups - before.wakeups ) / elapsed,
+    cpu / 1e3 / elapsed
+  );
+}
+
+int main( int argc, char **argv )
+{
+  unsigned seconds = argc > 1 ? (unsigned)atoi( argv[1] ) : 5;
+  size_t count = argc > 2 ? strtoul( argv[2], NULL, 10 ) : 1000;
+  uint16_t port = argc > 3 ? (uint16_t)atoi( argv[3] ) : 42651;
+
+  hk_server_t *hks = bench_server_start( port, NULL );
+  hks_stats_t stats;
+  if ( hk_server_get_stats( hks, &stats ) != ESP_OK )
+  {
+    fprintf( stderr, "built without CONFIG_HKS_STATS, no wakeups to count\n" );
+    return 1;
+  }
+
+  // whatever the server does on its own as it starts up is over by then
+  usleep( 200000 );
+
+  printf( "idle, %u s each\n", seconds );
+  _bench_idle( hks, "no clients", seconds );
+
+  int idle[BENCH_IDLE_CLIENTS];
+  for ( int i = 0; i < BENCH_IDLE_CLIENTS; i++ )
+    idle[i] = bench_connect( port );
+  usleep( 100000 );
+  _bench_idle( hks, "idle clients", seconds );
+
+  printf( "first byte, %zu connections\n", count );
+  uint64_t *samples = calloc( count, sizeof( uint64_t ) );
+  size_t failed = 0;
+  char buffer[512];
+  for ( size_t i = 0; i < count; i++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    int fd = bench_connect( port );
+    if ( fd < 0 || write( fd, _request, sizeof( _request ) - 1 ) < 0 || read( fd, buffer, 1 ) != 1 )
+      failed++;
+    samples[i] = bench_now_ns() - t0;
+
+    // the server closes once it sees our FIN
+    if ( fd >= 0 )
+    {
+      shutdown( fd, SHUT_WR );
+      while ( read( fd, buffer, sizeof( buffer ) ) > 0 );
+      close( fd );
+    }
+  }
+  bench_report_latency( "connect-to-first-byte", samples, count );
+  printf( "  %-34s %8zu\n", "failed", failed );
+
+  for ( int i = 0; i < BENCH_IDLE_CLIENTS; i++ )
+    if ( idle[i] >= 0 )
+      close( idle[i] );
+
+  free( samples );
+  return failed ? 1 : 0;
+}
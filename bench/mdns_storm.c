@@ -0,0 +1,242 @@
+// Discovery storm against the built-in mDNS responder over multicast
+// loopback: many _hap._tcp PTR queries in a short burst.
+//
+//   bench_mdns_storm [queries] [port]
+//
+// Direct (legacy unicast) queries measure answer latency and rate and are
+// checked to be plain DNS answers: id and question echoed, names that still
+// resolve, no cache-flush bits and TTLs of at most 10 s. The multicast burst
+// checks that answers are rate limited, and per record set: an enumeration
+// query right after it is still answered.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "bench.h"
+
+static const uint8_t _query[] =
+  "\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+  "\x04_hap\x04_tcp\x05local\x00"
+  "\x00\x0c\x00\x01";
+
+static const uint8_t _enumeration[] =
+  "\x12\x34\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+  "\x09_services\x07_dns-sd\x04_udp\x05local\x00"
+  "\x00\x0c\x00\x01";
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+static uint16_t _bench_get16( const uint8_t *p )
+{
+  return ( p[0] << 8 ) | p[1];
+}
+
+// a name into dotted form, pointers only back to an earlier name
+static int _bench_name( const uint8_t *pkt, size_t len, size_t *pos, char *out, size_t size )
+{
+  size_t p = *pos, n = 0;
+  int jumped = 0;
+  while ( p < len && pkt[p] != 0 )
+  {
+    if ( ( pkt[p] & 0xC0 ) == 0xC0 )
+    {
+      size_t target = ( ( pkt[p] & 0x3F ) << 8 ) | pkt[p + 1];
+      if ( p + 1 >= len || target >= p )
+        return -1;
+      if ( !jumped )
+        *pos = p + 2;
+      jumped = 1;
+      p = target;
+      continue;
+    }
+    if ( p + 1 + pkt[p] > len || n + pkt[p] + 2 > size )
+      return -1;
+    memcpy( out + n, pkt + p + 1, pkt[p] );
+    n += pkt[p];
+    out[n++] = '.';
+    p += 1 + pkt[p];
+  }
+  if ( p >= len )
+    return -1;
+  if ( !jumped )
+    *pos = p + 1;
+  out[n] = 0;
+  return 0;
+}
+
+// RFC 6762 section 6.7: the query's id and question, answers without the
+// cache-flush bit and with TTLs of at most 10 s, every name resolvable; a
+// PTR answer for `ptr` must point at a name ending in `target`
+static int _bench_legacy_answer( const uint8_t *query, size_t query_len, const uint8_t *pkt, size_t len, const char *ptr, const char *target )
+{
+  size_t question = query_len - 12;
+  if ( len < query_len || memcmp( pkt, query, 2 ) != 0 || !( pkt[2] & 0x80 ) || _bench_get16( pkt + 4 ) != 1 ||
+       memcmp( pkt + 12, query + 12, question ) != 0 )
+    return 0;
+
+  int found = 0;
+  size_t pos = query_len;
+  char name[256], rdata[256];
+  for ( uint16_t i = 0; i < _bench_get16( pkt + 6 ); i++ )
+  {
+    if ( _bench_name( pkt, len, &pos, name, sizeof( name ) ) || pos + 10 > len )
+      return 0;
+    uint16_t type = _bench_get16( pkt + pos );
+    uint16_t rclass = _bench_get16( pkt + pos + 2 );
+    uint32_t ttl = ( (uint32_t)_bench_get16( pkt + pos + 4 ) << 16 ) | _bench_get16( pkt + pos + 6 );
+    size_t end = pos + 10 + _bench_get16( pkt + pos + 8 );
+    if ( ( rclass & 0x8000 ) || ttl > 10 || end > len )
+      return 0;
+
+    size_t at = pos + 10 + ( type == 33 ? 6 : 0 );
+    if ( ( type == 12 || type == 33 ) && _bench_name( pkt, len, &at, rdata, sizeof( rdata ) ) )
+      return 0;
+    if ( type == 12 && strcmp( name, ptr ) == 0 && strlen( rdata ) >= strlen( target ) &&
+         strcmp( rdata + strlen( rdata ) - strlen( target ), target ) == 0 )
+      found = 1;
+    pos = end;
+  }
+
+  return found && pos == len;
+}
+
+static int _bench_udp_socket( uint16_t port, int join )
+{
+  int fd = socket( AF_INET, SOCK_DGRAM, 0 );
+  int one = 1;
+  setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+  setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof( one ) );
+
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons( port ) };
+  bind( fd, (struct sockaddr *)&addr, sizeof( addr ) );
+
+  if ( join )
+  {
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr.s_addr = inet_addr( "224.0.0.251" );
+    mreq.imr_interface.s_addr = htonl( INADDR_LOOPBACK );
+    setsockopt( fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof( mreq ) );
+    setsockopt( fd, IPPROTO_IP, IP_MULTICAST_IF, &mreq.imr_interface, sizeof( mreq.imr_interface ) );
+  }
+
+  return fd;
+}
+
+static int _bench_wait( int fd, int timeout_ms )
+{
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  return poll( &pfd, 1, timeout_ms );
+}
+
+int main( int argc, char **argv )
+{
+  size_t count = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 10000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42502;
+
+  bench_server_start( port, NULL );
+
+  struct sockaddr_in responder = {
+    .sin_family = AF_INET,
+    .sin_port = htons( 5353 ),
+    .sin_addr.s_addr = htonl( INADDR_LOOPBACK )
+  };
+  struct sockaddr_in group = {
+    .sin_family = AF_INET,
+    .sin_port = htons( 5353 ),
+    .sin_addr.s_addr = inet_addr( "224.0.0.251" )
+  };
+
+  // direct queries, one outstanding at a time
+  int fd = _bench_udp_socket( 0, 0 );
+  uint64_t *latency_ns = calloc( count, sizeof( uint64_t ) );
+  size_t answered = 0;
+  uint8_t buffer[1500];
+
+  uint64_t start = bench_now_ns();
+  for ( size_t i = 0; i < count; i++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    sendto( fd, _query, sizeof( _query ) - 1, 0, (struct sockaddr *)&responder, sizeof( responder ) );
+    if ( _bench_wait( fd, 1000 ) <= 0 )
+      continue;
+    if ( recv( fd, buffer, sizeof( buffer ), 0 ) > 12 )
+      latency_ns[answered++] = bench_now_ns() - t0;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  printf( "direct queries %zu answered %zu: %.0f answers/s\n", count, answered, answered / ( elapsed / 1e9 ) );
+  bench_report_latency( "query-to-answer", latency_ns, answered );
+
+  int failed = 0;
+  uint8_t query[sizeof( _query )];
+  memcpy( query, _query, sizeof( _query ) );
+  query[0] = 0xab;
+  query[1] = 0xcd;
+  while ( _bench_wait( fd, 0 ) > 0 )
+    recv( fd, buffer, sizeof( buffer ), 0 );
+  sendto( fd, query, sizeof( query ) - 1, 0, (struct sockaddr *)&responder, sizeof( responder ) );
+  ssize_t n = _bench_wait( fd, 1000 ) > 0 ? recv( fd, buffer, sizeof( buffer ), 0 ) : -1;
+  failed |= _bench_report( "legacy answer",
+    n > 0 && _bench_legacy_answer( query, sizeof( query ) - 1, buffer, n, "_hap._tcp.local.", "._hap._tcp.local." ) );
+
+  sendto( fd, _enumeration, sizeof( _enumeration ) - 1, 0, (struct sockaddr *)&responder, sizeof( responder ) );
+  n = _bench_wait( fd, 1000 ) > 0 ? recv( fd, buffer, sizeof( buffer ), 0 ) : -1;
+  failed |= _bench_report( "legacy enumeration answer",
+    n > 0 && _bench_legacy_answer( _enumeration, sizeof( _enumeration ) - 1, buffer, n, "_services._dns-sd._udp.local.", "_hap._tcp.local." ) );
+  close( fd );
+
+  // multicast burst from port 5353, answers should be rate limited
+  int mfd = _bench_udp_socket( 5353, 1 );
+  while ( _bench_wait( mfd, 1500 ) > 0 )
+    recv( mfd, buffer, sizeof( buffer ), 0 ); // drain announcements
+
+  size_t responses = 0;
+  start = bench_now_ns();
+  for ( size_t i = 0; i <= count; i++ )
+  {
+    if ( i < count )
+      sendto( mfd, _query, sizeof( _query ) - 1, 0, (struct sockaddr *)&group, sizeof( group ) );
+
+    // our own queries loop back too, keep reading so answers are not dropped
+    while ( _bench_wait( mfd, i < count ? 0 : 200 ) > 0 )
+    {
+      ssize_t n = recv( mfd, buffer, sizeof( buffer ), 0 );
+      if ( n > 12 && ( buffer[2] & 0x80 ) )
+        responses++;
+    }
+  }
+  elapsed = bench_now_ns() - start;
+
+  printf( "multicast burst %zu queries in %.3fs: %zu multicast answers\n", count, elapsed / 1e9, responses );
+
+  // the _hap._tcp answer was just sent, the enumeration one was not
+  uint8_t enumeration[sizeof( _enumeration )];
+  memcpy( enumeration, _enumeration, sizeof( _enumeration ) );
+  enumeration[0] = enumeration[1] = 0;
+  sendto( mfd, enumeration, sizeof( enumeration ) - 1, 0, (struct sockaddr *)&group, sizeof( group ) );
+  sendto( mfd, _query, sizeof( _query ) - 1, 0, (struct sockaddr *)&group, sizeof( group ) );
+  size_t enumerations = 0, answers = 0;
+  while ( _bench_wait( mfd, 200 ) > 0 )
+  {
+    n = recv( mfd, buffer, sizeof( buffer ), 0 );
+    if ( n <= 12 || !( buffer[2] & 0x80 ) )
+      continue;
+    if ( n > 13 && buffer[12] == 9 && memcmp( buffer + 13, "_services", 9 ) == 0 )
+      enumerations++;
+    else
+      answers++;
+  }
+  failed |= _bench_report( "multicast rate limited per set", enumerations == 1 && answers == 0 );
+
+  close( mfd );
+  free( latency_ns );
+  return answered == count && !failed ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+// Request latency for a controller that is already paired while another one
+// pairs. A verified controller times encrypted GET /characteristics round
+// trips with the server otherwise idle, then while a second connection runs
+// pair-verify back to back. The same is repeated on an unpaired server with
+// plain requests while pair-setup M1 (an SRP exponentiation each) is sent
+// over and over. The arithmetic runs on the crypto workers, so the round
+// trips stay near the idle baseline instead of waiting out a pairing step.
+//
+//   bench_pair_contention [requests] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "bench.h"
+#include "bridge.h"
+#include "controller.h"
+
+#define BENCH_CONTROLLER_ID "6F0E3B52-8A1D-4C7E-B9A4-1D2C3E4F5A6B"
+#define BENCH_PATH          "/characteristics?id=2.9"
+
+struct bench_background_s {
+  uint16_t port;
+  const bench_controller_t *ctl; // pair-verify as this controller, else pair-setup M1
+  volatile int running;
+  size_t steps;
+  uint64_t elapsed_ns;
+};
+typedef struct bench_background_s bench_background_t;
+
+static void *_bench_background( void *arg )
+{
+  bench_background_t *bg = (bench_background_t *)arg;
+  bench_controller_t ctl;
+  uint8_t m1[] = { 0x06, 0x01, 0x01, 0x00, 0x01, 0x00 }, response[512];
+  size_t len;
+
+  int fd = bench_connect( bg->port );
+  while ( bg->running )
+  {
+    uint64_t t0 = bench_now_ns();
+    if ( bg->ctl != NULL )
+    {
+      // a new connection for every verify, as controllers do
+      ctl = *bg->ctl;
+      if ( bench_pair_verify( &ctl, fd, (uint64_t[2]){ 0 } ) != 0 )
+        break;
+      close( fd );
+      fd = bench_connect( bg->port );
+    }
+    else if ( bench_post( fd, "/pair-setup", m1, sizeof( m1 ), response, &len ) != 200 )
+      break;
+
+    bg->elapsed_ns += bench_now_ns() - t0;
+    bg->steps++;
+  }
+
+  close( fd );
+  return NULL;
+}
+
+// status of a plain GET, its body skipped
+static int _bench_get( int fd, const char *path )
+{
+  char buffer[1024];
+  int n = snprintf( buffer, sizeof( buffer ), "GET %s HTTP/1.1\r\nHost: hap.local\r\n\r\n", path );
+  if ( write( fd, buffer, n ) != n )
+    return -1;
+
+  size_t len = 0;
+  while ( len < 4 || memcmp( buffer + len - 4, "\r\n\r\n", 4 ) != 0 )
+  {
+    if ( len == sizeof( buffer ) - 1 || read( fd, buffer + len, 1 ) != 1 )
+      return -1;
+    len++;
+  }
+  buffer[len] = '\0';
+
+  int status = 0;
+  const char *length = strstr( buffer, "Content-Length: " );
+  if ( sscanf( buffer, "HTTP/1.1 %d", &status ) != 1 || length == NULL )
+    return -1;
+
+  for ( size_t body = strtoul( length + 16, NULL, 10 ); body > 0; )
+  {
+    ssize_t r = read( fd, buffer, body < sizeof( buffer ) ? body : sizeof( buffer ) );
+    if ( r <= 0 )
+      return -1;
+    body -= r;
+  }
+
+  return status;
+}
+
+// `count` round trips with `bg` running alongside if not NULL
+static int _bench_round_trips( const char *name, bench_controller_t *ctl, int fd, size_t count, bench_background_t *bg )
+{
+  uint64_t *samples = calloc( count, sizeof( uint64_t ) );
+  pthread_t thread;
+  int failed = 0;
+  size_t len;
+
+  if ( bg != NULL )
+  {
+    bg->running = 1;
+    pthread_create( &thread, NULL, _bench_background, bg );
+    usleep( 20000 ); // under way before the first request
+  }
+
+  for ( size_t i = 0; i < count; i++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    int status = ctl ? bench_secure_get( ctl, fd, BENCH_PATH, &len ) : _bench_get( fd, BENCH_PATH );
+    samples[i] = bench_now_ns() - t0;
+    failed |= status != 200;
+  }
+
+  if ( bg != NULL )
+  {
+    bg->running = 0;
+    pthread_join( thread, NULL );
+    failed |= bg->steps == 0;
+  }
+
+  bench_report_latency( name, samples, count );
+  if ( bg != NULL && bg->steps > 0 )
+    printf( "%-28s %zu steps alongside, %.1f ms each\n", "", bg->steps, bg->elapsed_ns / 1e6 / bg->steps );
+
+  free( samples );
+  return failed;
+}
+
+int main( int argc, char **argv )
+{
+  size_t count = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 2000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42521;
+  int failed = 0;
+
+  static hks_db_t paired_db, unpaired_db;
+  if ( bench_bridge_init( &paired_db ) || bench_bridge_init( &unpaired_db ) )
+    return 1;
+
+  hk_server_t *hks = bench_server_create( port, &paired_db );
+  hk_server_set_setup_code( hks, BENCH_SETUP_CODE );
+  bench_server_run( hks );
+
+  hks = bench_server_create( port + 1, &unpaired_db );
+  hk_server_set_setup_code( hks, BENCH_SETUP_CODE );
+  bench_server_run( hks );
+
+  bench_controller_t ctl;
+  bench_controller_init( &ctl, BENCH_CONTROLLER_ID );
+
+  int fd = bench_connect( port );
+  if ( bench_pair_setup( &ctl, fd, (uint64_t[3]){ 0 } ) != 0 )
+  {
+    fprintf( stderr, "pair-setup failed\n" );
+    return 1;
+  }
+  close( fd );
+
+  fd = bench_connect( port );
+  if ( bench_pair_verify( &ctl, fd, (uint64_t[2]){ 0 } ) != 0 )
+  {
+    fprintf( stderr, "pair-verify failed\n" );
+    return 1;
+  }
+
+  printf( "encrypted GET %s, paired server\n", BENCH_PATH );
+  bench_background_t verify = { .port = port, .ctl = &ctl };
+  failed |= _bench_round_trips( "idle", &ctl, fd, count, NULL );
+  failed |= _bench_round_trips( "during pair-verify", &ctl, fd, count, &verify );
+  close( fd );
+
+  printf( "plain GET %s, unpaired server\n", BENCH_PATH );
+  bench_background_t setup = { .port = port + 1, .ctl = NULL };
+  fd = bench_connect( port + 1 );
+  failed |= _bench_round_trips( "idle", NULL, fd, count, NULL );
+  failed |= _bench_round_trips( "during pair-setup M1", NULL, fd, count, &setup );
+  close( fd );
+
+  if ( failed )
+    fprintf( stderr, "request failed\n" );
+
+  return failed;
+}
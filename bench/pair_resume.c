@@ -0,0 +1,145 @@
+// Reconnecting a verified controller: a full pair-verify against a pair-resume
+// of its last session, each timed from connect to the first encrypted
+// response. Only the accessory's round trips are counted; the controller's
+// own curve arithmetic is left out of both. The checks first make sure a
+// resumed session carries requests, that it resumes only once, and that an
+// unknown, tampered or evicted session falls back to a full pair-verify.
+//
+//   bench_pair_resume [reconnects] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "bridge.h"
+#include "controller.h"
+#include "hks_resume.h"
+
+#define BENCH_CONTROLLER_ID "0C9F5E61-2B7A-4D38-A1E6-93B4C2D7F805"
+#define BENCH_PATH          "/characteristics?id=2.9"
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+// bench_pair_resume on a new connection, then a request if it resumed
+static int _bench_resume( bench_controller_t *ctl, uint16_t port )
+{
+  uint64_t elapsed;
+  size_t len;
+  int fd = bench_connect( port );
+  int err = bench_pair_resume( ctl, fd, &elapsed );
+  if ( err == 0 && bench_secure_get( ctl, fd, BENCH_PATH, &len ) != 200 )
+    err = -1;
+  close( fd );
+  return err;
+}
+
+static int _bench_verify( bench_controller_t *ctl, uint16_t port )
+{
+  uint64_t elapsed[2];
+  int fd = bench_connect( port );
+  int err = bench_pair_verify( ctl, fd, elapsed );
+  close( fd );
+  return err;
+}
+
+int main( int argc, char **argv )
+{
+  size_t reconnects = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 200;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42531;
+  int failed = 0;
+
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  hk_server_t *hks = bench_server_create( port, &db );
+  hk_server_set_setup_code( hks, BENCH_SETUP_CODE );
+  bench_server_run( hks );
+
+  bench_controller_t ctl;
+  bench_controller_init( &ctl, BENCH_CONTROLLER_ID );
+
+  uint64_t setup[3];
+  int fd = bench_connect( port );
+  if ( bench_pair_setup( &ctl, fd, setup ) != 0 )
+  {
+    fprintf( stderr, "pair-setup failed\n" );
+    return 1;
+  }
+  close( fd );
+
+  printf( "pair-resume\n" );
+  failed |= _bench_report( "pair-verify", _bench_verify( &ctl, port ) == 0 );
+
+  bench_controller_t spent = ctl;
+  failed |= _bench_report( "resumed session carries requests", _bench_resume( &ctl, port ) == 0 );
+  failed |= _bench_report( "resumed again from the new id", _bench_resume( &ctl, port ) == 0 );
+  failed |= _bench_report( "spent id falls back", _bench_resume( &spent, port ) == 1 );
+
+  bench_controller_t stranger = ctl;
+  memset( stranger.session_id, 0x5a, sizeof( stranger.session_id ) );
+  failed |= _bench_report( "unknown id falls back", _bench_resume( &stranger, port ) == 1 );
+
+  // a wrong tag does not cost the controller its session
+  bench_controller_t forger = ctl;
+  forger.shared[0] ^= 1;
+  failed |= _bench_report( "wrong tag falls back", _bench_resume( &forger, port ) == 1 );
+  failed |= _bench_report( "session kept after a wrong tag", _bench_resume( &ctl, port ) == 0 );
+
+  // as many newer sessions as there are slots push it out
+  bench_controller_t oldest = ctl, newest = ctl;
+  int ok = 1;
+  for ( int i = 0; i < HKS_RESUME_SLOTS; i++ )
+    ok &= _bench_verify( &newest, port ) == 0;
+  failed |= _bench_report( "least recently used evicted", ok && _bench_resume( &oldest, port ) == 1 );
+  failed |= _bench_report( "most recently used kept", _bench_resume( &newest, port ) == 0 );
+  ctl = newest;
+
+  // connect, pair-verify or pair-resume, first encrypted response
+  uint64_t *verify_ns = calloc( reconnects, sizeof( uint64_t ) );
+  uint64_t *resume_ns = calloc( reconnects, sizeof( uint64_t ) );
+  uint64_t verify_sum = 0, resume_sum = 0;
+  size_t len;
+  ok = 1;
+  for ( size_t i = 0; i < reconnects; i++ )
+  {
+    uint64_t elapsed[2], t0 = bench_now_ns();
+    fd = bench_connect( port );
+    uint64_t connected = bench_now_ns() - t0;
+    ok &= bench_pair_verify( &ctl, fd, elapsed ) == 0;
+    t0 = bench_now_ns();
+    ok &= bench_secure_get( &ctl, fd, BENCH_PATH, &len ) == 200;
+    verify_ns[i] = connected + elapsed[0] + elapsed[1] + bench_now_ns() - t0;
+    verify_sum += verify_ns[i];
+    close( fd );
+
+    t0 = bench_now_ns();
+    fd = bench_connect( port );
+    connected = bench_now_ns() - t0;
+    ok &= bench_pair_resume( &ctl, fd, &elapsed[0] ) == 0;
+    t0 = bench_now_ns();
+    ok &= bench_secure_get( &ctl, fd, BENCH_PATH, &len ) == 200;
+    resume_ns[i] = connected + elapsed[0] + bench_now_ns() - t0;
+    resume_sum += resume_ns[i];
+    close( fd );
+  }
+  failed |= _bench_report( "reconnects", ok );
+
+  printf( "reconnect to first response\n" );
+  bench_report_latency( "full pair-verify", verify_ns, reconnects );
+  bench_report_latency( "pair-resume", resume_ns, reconnects );
+  if ( resume_sum > 0 )
+    printf( "  %-34s %8.1fx\n", "mean speedup", (double)verify_sum / resume_sum );
+
+  if ( failed )
+    fprintf( stderr, "pair-resume check failed\n" );
+
+  free( verify_ns );
+  free( resume_ns );
+  return failed;
+}
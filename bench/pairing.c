@@ -0,0 +1,425 @@
+// Pairing against published vectors, the cost of each cryptographic step,
+// then a controller over loopback: pair-setup, pair-verify and an encrypted
+// GET /accessories on the verified session.
+//
+//   bench_pairing [iterations] [port]
+//
+// The SRP vectors are those of the HAP specification (RFC 5054 appendix B
+// with the 3072-bit group and SHA-512): I = alice, P = password123.
+
+#define _GNU_SOURCE // memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <esp_system.h>
+#include "bench.h"
+#include "bridge.h"
+#include "controller.h"
+#include "hks_crypto.h"
+#include "hks_curve25519.h"
+#include "hks_bignum.h"
+#include "hks_srp.h"
+#include "hks_tlv.h"
+#include "hks_pairing.h"
+
+#define BENCH_CONTROLLER_ID "B2AB6CE4-3D0B-4B4E-9C4B-7E0D5C1A2F30"
+
+static const char _bench_srp_a[] =
+  "fab6f5d2615d1e323512e7991cc37443f487da604ca8c9230fcb04e541dce628"
+  "0b27ca4680b0374f179dc3bdc7553fe62459798c701ad864a91390a28c93b644"
+  "adbf9c00745b942b79f9012a21b9b78782319d83a1f8362866fbd6f46bfc0ddb"
+  "2e1ab6e4b45a9906b82e37f05d6f97f6a3eb6e182079759c4f6847837b62321a"
+  "c1b4fa68641fcb4bb98dd697a0c73641385f4bab25b793584cc39fc8d48d4bd8"
+  "67a9a3c10f8ea12170268e34fe3bbe6ff89998d60da2f3e4283cbec1393d52af"
+  "724a57230c604e9fbce583d7613e6bffd67596ad121a8707eec4694495703368"
+  "6a155f644d5c5863b48f61bdbf19a53eab6dad0a186b8c152e5f5d8cad4b0ef8"
+  "aa4ea5008834c3cd342e5e0f167ad04592cd8bd279639398ef9e114dfaaab919"
+  "e14e850989224ddd98576d79385d2210902e9f9b1f2d86cfa47ee244635465f7"
+  "1058421a0184be51dd10cc9d079e6f1604e7aa9b7cf7883c7d4ce12b06ebe160"
+  "81e23f27a231d18432d7d1bb55c28ae21ffcf005f57528d15a88881bb3bbb7fe";
+
+static const char _bench_srp_b[] =
+  "40f57088a482d4c7733384fe0d301fddca9080ad7d4f6fdf09a01006c3cb6d56"
+  "2e41639ae8fa21de3b5dba7585b275589bdb279863c562807b2b99083cd1429c"
+  "dbe89e25bfbd7e3cad3173b2e3c5a0b174da6d5391e6a06e465f037a40062548"
+  "39a56bf76da84b1c94e0ae208576156fe5c140a4ba4ffc9e38c3b07b88845fc6"
+  "f7ddda93381fe0ca6084c4cd2d336e5451c464ccb6ec65e7d16e548a273e8262"
+  "84af2559b6264274215960fff47bdd63d3aff064d6137af769661c9d4fee4738"
+  "2603c88eaa0980581d07758461b777e4356dda5835198b51feea308d70f75450"
+  "b71675c08c7d8302fd7539dd1ff2a11cb4258aa70d234436aa42b6a0615f3f91"
+  "5d55cc3b966b2716b36e4d1a06ce5e5d2ea3bee5a1270e8751da45b60b997b0f"
+  "fdb0f9962fee4f03bee780ba0a845b1d9271421783ae6601a61ea2e342e4f2e8"
+  "bc935a409ead19f221bd1b74e2964dd19fc845f60efc09338b60b6b256d8cac8"
+  "89cca306cc370a0b18c8b886e95da0af5235fef4393020d2b7f3056904759042";
+
+static const char _bench_srp_k[] =
+  "5cbc219db052138ee1148c71cd4498963d682549ce91ca24f098468f06015beb"
+  "6af245c2093f98c3651bca83ab8cab2b580bbf02184fefdf26142f73df95ac50";
+
+static const char _bench_srp_m1[] =
+  "5f7c14ab57ed0e94fd1d78c6b4dd09ed7e340b7e05d419a9fd760f6b35e523d1"
+  "310777a1ae1d2826f596f3a85116cc457c7c964d4f44ded5559da818c88b617f";
+
+static const char _bench_srp_m2[] =
+  "2fa0e81f5cb73b88fa0964270f321dd641f2227a5d805c40f1bfe96aaf6a19ff"
+  "ce8e23287965a39eab9d5a02215f89e128177ed2c4f103e655a045531bcbf7ad";
+
+static size_t _bench_hex( uint8_t *out, const char *hex )
+{
+  size_t n = 0;
+  for ( ; hex[0] && hex[1]; hex += 2 )
+  {
+    unsigned int byte;
+    sscanf( hex, "%2x", &byte );
+    out[n++] = byte;
+  }
+  return n;
+}
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+static int _bench_check( const char *name, const uint8_t *data, const char *expected_hex )
+{
+  uint8_t expected[HKS_BN_BYTES];
+  size_t len = _bench_hex( expected, expected_hex );
+  return _bench_report( name, memcmp( data, expected, len ) == 0 );
+}
+
+static int _bench_vectors( void )
+{
+  int failed = 0;
+  uint8_t buffer[HKS_BN_BYTES];
+
+  printf( "test vectors\n" );
+
+  hks_sha512( "abc", 3, buffer );
+  failed |= _bench_check( "FIPS 180-2 SHA-512 \"abc\"", buffer,
+    "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+    "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f" );
+
+  // no published SHA-512 vector uses these labels, computed with Python's hmac
+  uint8_t ikm[22];
+  memset( ikm, 0x0b, sizeof( ikm ) );
+  hks_hkdf_sha512( ikm, sizeof( ikm ), "Pair-Setup-Encrypt-Salt", "Pair-Setup-Encrypt-Info", buffer, 32 );
+  failed |= _bench_check( "HKDF-SHA-512", buffer,
+    "af57b1adbdc91b8db159d11d654af3e0573a7120d682b48506f9d04696ea522f" );
+
+  // RFC 8032 7.1, test 1
+  uint8_t seed[32], public_key[32], signature[64];
+  _bench_hex( seed, "9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60" );
+  hks_ed25519_public( public_key, seed );
+  failed |= _bench_check( "RFC 8032 Ed25519 public key", public_key,
+    "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a" );
+  hks_ed25519_sign( signature, (const uint8_t *)"", 0, seed, public_key );
+  failed |= _bench_check( "RFC 8032 Ed25519 signature", signature,
+    "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e06522490155"
+    "5fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b" );
+  int ok = hks_ed25519_verify( signature, (const uint8_t *)"", 0, public_key );
+  signature[0] ^= 1;
+  ok &= !hks_ed25519_verify( signature, (const uint8_t *)"", 0, public_key );
+  failed |= _bench_report( "Ed25519 verify", ok );
+
+  // RFC 7748 5.2, first vector
+  uint8_t scalar[32], point[32];
+  _bench_hex( scalar, "a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4" );
+  _bench_hex( point, "e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c" );
+  hks_x25519( buffer, scalar, point );
+  failed |= _bench_check( "RFC 7748 X25519", buffer,
+    "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552" );
+
+  // SRP-6a, b and a from the specification's vectors
+  static hks_srp_t srp;
+  uint8_t salt[16], secret[32], a[HKS_BN_BYTES], proof[64];
+  _bench_hex( salt, "beb25379d1a8581eb5a727673a2441ee" );
+  _bench_hex( secret, "e487cb59d31ac550471e81f00f6928e01dda08e974a004f49e61f5d105284d20" );
+  _bench_hex( a, _bench_srp_a );
+  _bench_hex( proof, _bench_srp_m1 );
+
+  hks_srp_start( &srp, "alice", "password123", salt, secret );
+  failed |= _bench_check( "SRP B", srp.public_key, _bench_srp_b );
+  proof[0] ^= 1;
+  failed |= _bench_report( "SRP wrong M1 rejected", hks_srp_verify( &srp, a, sizeof( a ), proof ) == ESP_FAIL );
+  proof[0] ^= 1;
+
+  hks_srp_start( &srp, "alice", "password123", salt, secret );
+  failed |= _bench_report( "SRP M1", hks_srp_verify( &srp, a, sizeof( a ), proof ) == ESP_OK );
+  failed |= _bench_check( "SRP K", srp.key, _bench_srp_k );
+  failed |= _bench_check( "SRP M2", srp.proof, _bench_srp_m2 );
+
+  memset( a, 0, sizeof( a ) );
+  hks_srp_start( &srp, "alice", "password123", salt, secret );
+  failed |= _bench_report( "SRP A = 0 rejected", hks_srp_verify( &srp, a, sizeof( a ), proof ) == ESP_FAIL );
+
+  // a value over three fragments comes back whole
+  uint8_t value[600], tlv[640];
+  for ( size_t i = 0; i < sizeof( value ); i++ )
+    value[i] = i * 13;
+
+  hks_tlv_writer_t w;
+  hks_tlv_items_t items;
+  for ( int truncate = 0; truncate < 2; truncate++ )
+  {
+    hks_tlv_writer_init( &w, tlv, sizeof( tlv ) );
+    hks_tlv_put_byte( &w, HKS_TLV_STATE, 3 );
+    hks_tlv_put( &w, HKS_TLV_PUBLIC_KEY, value, sizeof( value ) );
+    hks_tlv_put( &w, HKS_TLV_SEPARATOR, NULL, 0 );
+    ok = !hks_tlv_overflow( &w ) && w.len == 3 + hks_tlv_length( sizeof( value ) ) + 2;
+
+    if ( truncate )
+    {
+      ok &= hks_tlv_decode( tlv, w.len - 1, &items ) == ESP_ERR_INVALID_SIZE;
+      failed |= _bench_report( "TLV8 truncated item rejected", ok );
+      break;
+    }
+
+    uint8_t state;
+    const hks_tlv_item_t *item = NULL;
+    ok &= hks_tlv_decode( tlv, w.len, &items ) == ESP_OK && items.count == 3;
+    ok &= hks_tlv_get_byte( &items, HKS_TLV_STATE, &state ) && state == 3;
+    ok &= ( item = hks_tlv_get( &items, HKS_TLV_PUBLIC_KEY ) ) != NULL;
+    ok &= item && item->len == sizeof( value ) && memcmp( item->value, value, sizeof( value ) ) == 0;
+    failed |= _bench_report( "TLV8 fragments joined in place", ok );
+  }
+
+  return failed;
+}
+
+// the cost of each step on its own, the device is some 50 times slower
+static void _bench_steps( size_t iterations )
+{
+  uint64_t *samples = calloc( iterations, sizeof( uint64_t ) );
+  static hks_srp_t srp;
+  uint8_t salt[16], secret[32], a[HKS_BN_BYTES], proof[64];
+  uint8_t scalar[32], point[32], out[32], seed[32], public_key[32], signature[64];
+  uint8_t message[100] = { 0 };
+
+  printf( "steps\n" );
+
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    esp_fill_random( salt, sizeof( salt ) );
+    esp_fill_random( secret, sizeof( secret ) );
+    uint64_t t0 = bench_now_ns();
+    hks_srp_start( &srp, "Pair-Setup", BENCH_SETUP_CODE, salt, secret );
+    samples[i] = bench_now_ns() - t0;
+  }
+  bench_report_latency( "SRP start (M2)", samples, iterations );
+
+  _bench_hex( salt, "beb25379d1a8581eb5a727673a2441ee" );
+  _bench_hex( secret, "e487cb59d31ac550471e81f00f6928e01dda08e974a004f49e61f5d105284d20" );
+  _bench_hex( a, _bench_srp_a );
+  _bench_hex( proof, _bench_srp_m1 );
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    hks_srp_start( &srp, "alice", "password123", salt, secret );
+    uint64_t t0 = bench_now_ns();
+    hks_srp_verify( &srp, a, sizeof( a ), proof );
+    samples[i] = bench_now_ns() - t0;
+  }
+  bench_report_latency( "SRP verify (M4)", samples, iterations );
+
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    esp_fill_random( scalar, sizeof( scalar ) );
+    esp_fill_random( point, sizeof( point ) );
+    uint64_t t0 = bench_now_ns();
+    hks_x25519( out, scalar, point );
+    samples[i] = bench_now_ns() - t0;
+  }
+  bench_report_latency( "X25519", samples, iterations );
+
+  esp_fill_random( seed, sizeof( seed ) );
+  hks_ed25519_public( public_key, seed );
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    message[0] = i;
+    uint64_t t0 = bench_now_ns();
+    hks_ed25519_sign( signature, message, sizeof( message ), seed, public_key );
+    samples[i] = bench_now_ns() - t0;
+  }
+  bench_report_latency( "Ed25519 sign", samples, iterations );
+
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    hks_ed25519_verify( signature, message, sizeof( message ), public_key );
+    samples[i] = bench_now_ns() - t0;
+  }
+  bench_report_latency( "Ed25519 verify", samples, iterations );
+
+  free( samples );
+}
+
+// pair-verify M1 and plain requests behind it, more than the receive
+// buffer holds while the step is out on a worker; true once every one of
+// them is answered
+static int _bench_parked_pipeline( uint16_t port )
+{
+  uint8_t body[64], key[HKS_X25519_KEY_LENGTH] = { 9 };
+  hks_tlv_writer_t w;
+  hks_tlv_writer_init( &w, body, sizeof( body ) );
+  hks_tlv_put_byte( &w, HKS_TLV_STATE, 1 );
+  hks_tlv_put( &w, HKS_TLV_PUBLIC_KEY, key, sizeof( key ) );
+
+  const char get[] = "GET /accessories HTTP/1.1\r\nHost: hap.local\r\n\r\n";
+  size_t requests = 4 * CONFIG_HKS_CLIENT_RX_BUFFER_SIZE / ( sizeof( get ) - 1 );
+  size_t size = 128 + w.len + requests * ( sizeof( get ) - 1 );
+  char *burst = malloc( size );
+  size_t len = snprintf( burst, size, "POST /pair-verify HTTP/1.1\r\nContent-Length: %zu\r\n\r\n", w.len );
+  memcpy( burst + len, body, w.len );
+  len += w.len;
+  for ( size_t i = 0; i < requests; i++, len += sizeof( get ) - 1 )
+    memcpy( burst + len, get, sizeof( get ) - 1 );
+
+  int fd = bench_connect( port );
+  struct timeval tv = { .tv_sec = 2 };
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+  int ok = write( fd, burst, len ) == (ssize_t)len;
+
+  // count the status lines, a header never splits one across reads here
+  // as every response but the first is the same few bytes
+  size_t answered = 0, kept = 0;
+  char buffer[4096];
+  while ( ok && answered < requests + 1 )
+  {
+    ssize_t n = read( fd, buffer + kept, sizeof( buffer ) - kept );
+    if ( n <= 0 )
+      break;
+    n += kept;
+    char *p = buffer;
+    while ( ( p = memmem( p, buffer + n - p, "HTTP/1.1 ", 9 ) ) != NULL )
+    {
+      answered++;
+      p += 9;
+    }
+    kept = n < 8 ? n : 8;
+    memmove( buffer, buffer + n - kept, kept );
+  }
+
+  close( fd );
+  free( burst );
+  return ok && answered == requests + 1;
+}
+
+int main( int argc, char **argv )
+{
+  size_t iterations = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 10;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42511;
+  int failed = _bench_vectors();
+
+  _bench_steps( iterations );
+
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  hk_server_t *hks = bench_server_create( port, &db );
+  hk_server_set_setup_code( hks, BENCH_SETUP_CODE );
+  bench_server_run( hks );
+
+  bench_controller_t ctl;
+  bench_controller_init( &ctl, BENCH_CONTROLLER_ID );
+
+  printf( "loopback\n" );
+
+  // a subscription made in the clear while unpaired, on the connection
+  // that goes on to pair and verify
+  uint64_t setup[3];
+  int fd = bench_connect( port );
+  const char subscribe[] = "PUT /characteristics HTTP/1.1\r\nContent-Length: 50\r\n\r\n"
+    "{\"characteristics\":[{\"aid\":2,\"iid\":10,\"ev\":true}]}";
+  char reply[64] = { 0 };
+  failed |= _bench_report( "subscribed in the clear",
+    write( fd, subscribe, sizeof( subscribe ) - 1 ) == sizeof( subscribe ) - 1 &&
+    read( fd, reply, sizeof( reply ) - 1 ) > 0 && strncmp( reply, "HTTP/1.1 204", 12 ) == 0 );
+
+  int err = bench_pair_setup( &ctl, fd, setup );
+  failed |= _bench_report( "pair-setup", err == 0 );
+  if ( err == 0 )
+  {
+    printf( "  %-34s %8.1f ms\n", "pair-setup M1/M2", setup[0] / 1e6 );
+    printf( "  %-34s %8.1f ms\n", "pair-setup M3/M4", setup[1] / 1e6 );
+    printf( "  %-34s %8.1f ms\n", "pair-setup M5/M6", setup[2] / 1e6 );
+  }
+
+  // "ev":false is a byte longer than "ev":true, so the answer is as long as
+  // on a connection that never subscribed once the session dropped it
+  uint64_t verify[2];
+  size_t carried = 0, fresh = 0;
+  int other = bench_connect( port );
+  bench_controller_t second = ctl;
+  failed |= _bench_report( "subscriptions left behind at verify",
+    bench_pair_verify( &ctl, fd, verify ) == 0 &&
+    bench_secure_get( &ctl, fd, "/characteristics?id=2.10&ev=1", &carried ) == 200 &&
+    bench_pair_verify( &second, other, verify ) == 0 &&
+    bench_secure_get( &second, other, "/characteristics?id=2.10&ev=1", &fresh ) == 200 &&
+    carried == fresh );
+  close( other );
+  close( fd );
+
+  // paired now: a second pair-setup is refused and so are plain requests
+  uint8_t body[8], response[512];
+  hks_tlv_writer_t w;
+  hks_tlv_items_t items;
+  uint8_t error = 0;
+  size_t len;
+  fd = bench_connect( port );
+  hks_tlv_writer_init( &w, body, sizeof( body ) );
+  hks_tlv_put_byte( &w, HKS_TLV_STATE, 1 );
+  hks_tlv_put_byte( &w, HKS_TLV_METHOD, 0 );
+  int status = bench_post( fd, "/pair-setup", body, w.len, response, &len );
+  failed |= _bench_report( "pair-setup once paired unavailable",
+    status == 200 && hks_tlv_decode( response, len, &items ) == ESP_OK &&
+    hks_tlv_get_byte( &items, HKS_TLV_ERROR, &error ) && error == HKS_TLV_ERROR_UNAVAILABLE );
+
+  const char get[] = "GET /accessories HTTP/1.1\r\nHost: hap.local\r\n\r\n";
+  char head[64] = { 0 };
+  failed |= write( fd, get, sizeof( get ) - 1 ) != sizeof( get ) - 1;
+  failed |= _bench_report( "unverified request 470", read( fd, head, sizeof( head ) - 1 ) > 0 && strncmp( head, "HTTP/1.1 470", 12 ) == 0 );
+  close( fd );
+  failed |= _bench_report( "requests pipelined past a step", _bench_parked_pipeline( port ) );
+
+  // an unknown controller fails M3
+  bench_controller_t stranger = ctl;
+  strcpy( stranger.id, "00000000-0000-0000-0000-000000000000" );
+  fd = bench_connect( port );
+  failed |= _bench_report( "unknown controller refused", bench_pair_verify( &stranger, fd, verify ) == HKS_TLV_ERROR_AUTHENTICATION );
+  close( fd );
+
+  uint64_t *m1_ns = calloc( iterations, sizeof( uint64_t ) );
+  uint64_t *m3_ns = calloc( iterations, sizeof( uint64_t ) );
+  size_t verified = 0, document = 0;
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    fd = bench_connect( port );
+    if ( bench_pair_verify( &ctl, fd, verify ) == 0 )
+    {
+      m1_ns[verified] = verify[0];
+      m3_ns[verified] = verify[1];
+      verified++;
+
+      // the same session carries several requests
+      if ( bench_secure_get( &ctl, fd, "/accessories", &document ) != 200 ||
+           bench_secure_get( &ctl, fd, "/accessories", &document ) != 200 )
+        failed = 1;
+    }
+    close( fd );
+  }
+  failed |= _bench_report( "pair-verify", verified == iterations );
+  printf( "  %-34s %8zu bytes\n", "encrypted GET /accessories", document );
+  bench_report_latency( "pair-verify M1/M2", m1_ns, verified );
+  bench_report_latency( "pair-verify M3/M4", m3_ns, verified );
+
+  if ( failed )
+    fprintf( stderr, "pairing check failed\n" );
+
+  free( m1_ns );
+  free( m3_ns );
+  return failed;
+}
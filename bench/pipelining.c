@@ -0,0 +1,309 @@
+// Pipelined requests against one request per round trip, then the
+// connection semantics around them.
+//
+//   pipelined   connections at once, each writing its GETs back to back and
+//               reading the responses as they come; every response has to
+//               answer its own request, in order
+//   round trip  the same requests one at a time, each connection waking the
+//               server once per request
+//   connection  Connection: close and HTTP/1.0 end the connection after
+//               their response and nothing behind them is answered;
+//               keep-alive holds HTTP/1.0 open, other versions get 505 and
+//               malformed ones or disagreeing Content-Lengths 400; a body
+//               or headers larger than the receive buffer get 413 and 431
+//
+//   bench_pipelining [requests] [connections] [port]
+
+#define _GNU_SOURCE // memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include "bench.h"
+#include "bridge.h"
+
+#define BENCH_BUFFER_SIZE 65536
+
+struct bench_client_s {
+  uint16_t port;
+  size_t requests;
+  int pipelined;
+  size_t answered;  // in order, each to its own request
+  uint64_t elapsed_ns;
+};
+typedef struct bench_client_s bench_client_t;
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+// request `i` reads a characteristic of its own, the response names it
+static int _bench_request( char *buffer, size_t size, size_t i )
+{
+  return snprintf( buffer, size, "GET /characteristics?id=%zu.%zu HTTP/1.1\r\n\r\n",
+    2 + i % 100, 9 + i / 100 % 4 );
+}
+
+static int _bench_answers( const char *body, size_t len, size_t i )
+{
+  char expected[64];
+  int n = snprintf( expected, sizeof( expected ), "{\"aid\":%zu,\"iid\":%zu,", 2 + i % 100, 9 + i / 100 % 4 );
+  return len > (size_t)n && memmem( body, len, expected, n ) != NULL;
+}
+
+// Responses complete in `buffer`, checked against the requests from
+// `*answered` on. Returns the bytes they took, -1 for a wrong one.
+static ssize_t _bench_responses( const char *buffer, size_t len, size_t *answered )
+{
+  size_t used = 0;
+  for (;;)
+  {
+    const char *head = buffer + used;
+    const char *end = memmem( head, len - used, "\r\n\r\n", 4 );
+    if ( end == NULL )
+      return used;
+
+    const char *length = memmem( head, end - head, "Content-Length: ", 16 );
+    if ( length == NULL || memcmp( head, "HTTP/1.1 200 ", 13 ) != 0 )
+      return -1;
+
+    size_t body = strtoul( length + 16, NULL, 10 );
+    size_t total = end + 4 - head + body;
+    if ( total > len - used )
+      return used;
+
+    if ( !_bench_answers( end + 4, body, *answered ) )
+      return -1;
+    ( *answered )++;
+    used += total;
+  }
+}
+
+static void *_bench_client( void *arg )
+{
+  bench_client_t *client = arg;
+  char *out = malloc( client->requests * 64 );
+  char *in = malloc( BENCH_BUFFER_SIZE );
+  size_t out_len = 0, out_sent = 0, in_len = 0;
+  size_t *offsets = calloc( client->requests + 1, sizeof( size_t ) );
+
+  for ( size_t i = 0; i < client->requests; i++ )
+  {
+    offsets[i] = out_len;
+    out_len += _bench_request( out + out_len, 64, i );
+  }
+  offsets[client->requests] = out_len;
+
+  int fd = bench_connect( client->port );
+  fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+
+  uint64_t t0 = bench_now_ns();
+  while ( fd >= 0 && client->answered < client->requests )
+  {
+    // one at a time, the next goes out once the last is answered
+    size_t limit = client->pipelined ? out_len : offsets[client->answered + 1];
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN | ( out_sent < limit ? POLLOUT : 0 ) };
+    if ( poll( &pfd, 1, 2000 ) <= 0 )
+      break;
+
+    if ( ( pfd.revents & POLLOUT ) && out_sent < limit )
+    {
+      ssize_t n = write( fd, out + out_sent, limit - out_sent );
+      if ( n > 0 )
+        out_sent += n;
+    }
+
+    if ( pfd.revents & ( POLLIN | POLLHUP ) )
+    {
+      ssize_t n = read( fd, in + in_len, BENCH_BUFFER_SIZE - in_len );
+      if ( n <= 0 )
+        break;
+      in_len += n;
+
+      ssize_t used = _bench_responses( in, in_len, &client->answered );
+      if ( used < 0 )
+        break;
+      memmove( in, in + used, in_len - used );
+      in_len -= used;
+    }
+  }
+  client->elapsed_ns = bench_now_ns() - t0;
+
+  if ( fd >= 0 )
+    close( fd );
+  free( offsets );
+  free( in );
+  free( out );
+  return NULL;
+}
+
+static int _bench_load( hk_server_t *hks, uint16_t port, size_t requests, size_t connections, int pipelined )
+{
+  bench_client_t *clients = calloc( connections, sizeof( bench_client_t ) );
+  pthread_t *threads = calloc( connections, sizeof( pthread_t ) );
+
+  hks_stats_t before, after;
+  hk_server_get_stats( hks, &before );
+
+  uint64_t t0 = bench_now_ns();
+  for ( size_t i = 0; i < connections; i++ )
+  {
+    clients[i] = (bench_client_t){ .port = port, .requests = requests, .pipelined = pipelined };
+    pthread_create( &threads[i], NULL, _bench_client, &clients[i] );
+  }
+
+  size_t answered = 0;
+  for ( size_t i = 0; i < connections; i++ )
+  {
+    pthread_join( threads[i], NULL );
+    answered += clients[i].answered;
+  }
+  uint64_t elapsed = bench_now_ns() - t0;
+  hk_server_get_stats( hks, &after );
+
+  int failed = _bench_report( pipelined ? "pipelined, answered in order" : "round trips answered",
+    answered == requests * connections );
+  uint32_t wakeups = after.wakeups - before.wakeups;
+  printf( "  %-34s %8.0f requests/s, %.2f per wakeup\n", "", answered / ( elapsed / 1e9 ),
+    wakeups ? (double)answered / wakeups : 0.0 );
+
+  free( threads );
+  free( clients );
+  return failed;
+}
+
+// status of the next response on `fd`, 0 when the server closed it instead
+static int _bench_status( int fd )
+{
+  char buffer[1024];
+  size_t len = 0;
+  while ( len < 4 || memcmp( buffer + len - 4, "\r\n\r\n", 4 ) != 0 )
+  {
+    if ( len == sizeof( buffer ) - 1 || read( fd, buffer + len, 1 ) != 1 )
+      return 0;
+    len++;
+  }
+  buffer[len] = '\0';
+
+  int status = 0;
+  const char *length = strstr( buffer, "Content-Length: " );
+  if ( sscanf( buffer, "HTTP/1.1 %d", &status ) != 1 )
+    return 0;
+
+  for ( size_t body = length ? strtoul( length + 16, NULL, 10 ) : 0; body > 0; )
+  {
+    ssize_t r = read( fd, buffer, body < sizeof( buffer ) ? body : sizeof( buffer ) );
+    if ( r <= 0 )
+      return 0;
+    body -= r;
+  }
+
+  return status;
+}
+
+// the statuses of `requests` sent together, ended by 0 once closed
+static void _bench_exchange( uint16_t port, const char *requests, int *statuses, size_t count )
+{
+  int fd = bench_connect( port );
+  ssize_t len = strlen( requests );
+  int sent = write( fd, requests, len ) == len;
+  for ( size_t i = 0; i < count; i++ )
+    statuses[i] = sent ? _bench_status( fd ) : -1;
+  close( fd );
+}
+
+static int _bench_connection( uint16_t port )
+{
+  int statuses[3];
+  int failed = 0;
+
+  _bench_exchange( port,
+    "GET /characteristics?id=2.9 HTTP/1.1\r\n\r\n"
+    "GET /characteristics?id=2.10 HTTP/1.1\r\nConnection: close\r\n\r\n"
+    "GET /characteristics?id=2.11 HTTP/1.1\r\n\r\n", statuses, 3 );
+  failed |= _bench_report( "Connection: close", statuses[0] == 200 && statuses[1] == 200 && statuses[2] == 0 );
+
+  _bench_exchange( port,
+    "GET /characteristics?id=2.9 HTTP/1.0\r\n\r\n"
+    "GET /characteristics?id=2.10 HTTP/1.0\r\n\r\n", statuses, 2 );
+  failed |= _bench_report( "HTTP/1.0 closes", statuses[0] == 200 && statuses[1] == 0 );
+
+  _bench_exchange( port,
+    "GET /characteristics?id=2.9 HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n"
+    "GET /characteristics?id=2.10 HTTP/1.0\r\n\r\n"
+    "GET /characteristics?id=2.11 HTTP/1.1\r\n\r\n", statuses, 3 );
+  failed |= _bench_report( "HTTP/1.0 keep-alive", statuses[0] == 200 && statuses[1] == 200 && statuses[2] == 0 );
+
+  _bench_exchange( port,
+    "GET /characteristics?id=2.9 HTTP/2.0\r\n\r\n"
+    "GET /characteristics?id=2.10 HTTP/1.1\r\n\r\n", statuses, 2 );
+  failed |= _bench_report( "HTTP/2.0 refused with 505", statuses[0] == 505 && statuses[1] == 0 );
+
+  _bench_exchange( port, "GET /characteristics?id=2.9 HTTQ/1.1\r\n\r\n", statuses, 1 );
+  failed |= _bench_report( "no protocol refused with 400", statuses[0] == 400 );
+
+  _bench_exchange( port, "GET /characteristics?id=2.9 HTTP/1.x\r\n\r\n", statuses, 1 );
+  failed |= _bench_report( "malformed version refused with 400", statuses[0] == 400 );
+
+  // the body is read as 3 bytes or as 30, a smuggled request either way
+  _bench_exchange( port,
+    "PUT /characteristics HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 30\r\n\r\n"
+    "{}\nGET /characteristics?id=2.9 HTTP/1.1\r\n\r\n", statuses, 2 );
+  failed |= _bench_report( "Content-Length twice refused", statuses[0] == 400 && statuses[1] == 0 );
+
+  // twice what the receive buffer holds, answered before the close
+  size_t size = 2 * CONFIG_HKS_CLIENT_RX_BUFFER_SIZE;
+  char *large = malloc( size + 256 );
+  int n = snprintf( large, 256, "PUT /characteristics HTTP/1.1\r\nContent-Length: %zu\r\n\r\n", size );
+  memset( large + n, ' ', size );
+  large[n + size] = '\0';
+  _bench_exchange( port, large, statuses, 2 );
+  failed |= _bench_report( "body too large refused with 413", statuses[0] == 413 && statuses[1] == 0 );
+
+  n = sprintf( large, "GET /accessories HTTP/1.1\r\n" );
+  for ( int i = 0; n < (int)size - 512; i++ )
+  {
+    n += sprintf( large + n, "X-Padding-%d: ", i );
+    memset( large + n, 'x', 400 );
+    n += 400;
+    n += sprintf( large + n, "\r\n" );
+  }
+  sprintf( large + n, "\r\n" );
+  _bench_exchange( port, large, statuses, 2 );
+  failed |= _bench_report( "headers too large refused with 431", statuses[0] == 431 && statuses[1] == 0 );
+  free( large );
+
+  return failed;
+}
+
+int main( int argc, char **argv )
+{
+  size_t requests = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 1000;
+  size_t connections = argc > 2 ? strtoul( argv[2], NULL, 10 ) : 4;
+  uint16_t port = argc > 3 ? (uint16_t)atoi( argv[3] ) : 42601;
+  int failed = 0;
+
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  hk_server_t *hks = bench_server_start( port, &db );
+
+  printf( "%zu connections, %zu requests each\n", connections, requests );
+  failed |= _bench_load( hks, port, requests, connections, 1 );
+  failed |= _bench_load( hks, port, requests, connections, 0 );
+
+  printf( "connection\n" );
+  failed |= _bench_connection( port );
+
+  if ( failed )
+    fprintf( stderr, "pipelining check failed\n" );
+
+  return failed;
+}
@@ -0,0 +1,184 @@
+// The receive ring replayed against a stream of pipelined requests, the way
+// _hk_server_read_client drives it: write into the free space, parse what
+// is pending in place, consume each request as it completes.
+//
+//   replay    the stream written byte by byte, in random chunks and in bulk
+//             (all the space there is) through rings of several sizes, so
+//             the pending bytes are moved to the front at every offset;
+//             after each step what is pending has to be exactly the part
+//             of the stream written but not consumed yet, and the requests
+//             parsed have to be those of a bulk read into a flat buffer
+//   throughput  bytes replayed per second in bulk and byte by byte
+//
+//   bench_ring_replay [requests] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "hks_ring.h"
+#include "hks_http.h"
+
+#define BENCH_STREAM   ( 1 << 20 )
+#define BENCH_RING_MAX 2048
+
+static const char *_requests[] = {
+  "GET /accessories HTTP/1.1\r\n\r\n",
+  "GET /characteristics?id=1.9,1.10 HTTP/1.1\r\nHost: hap.local\r\n\r\n",
+  "PUT /characteristics HTTP/1.1\r\nContent-Length: 50\r\n\r\n"
+    "{\"characteristics\":[{\"aid\":2,\"iid\":10,\"ev\":true}]}",
+  "POST /pair-verify HTTP/1.1\r\nContent-Type: application/pairing+tlv8\r\nContent-Length: 37\r\n\r\n"
+    "\x06\x01\x01\x03\x20" "0123456789abcdef0123456789abcdef",
+};
+
+static uint8_t _stream[BENCH_STREAM];
+static size_t _stream_len;
+static uint32_t _bench_seed;
+
+static uint32_t _bench_random( void )
+{
+  _bench_seed ^= _bench_seed << 13;
+  _bench_seed ^= _bench_seed >> 17;
+  _bench_seed ^= _bench_seed << 5;
+  return _bench_seed;
+}
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+// where each request of the stream starts, from a flat one-shot parse
+static size_t _bench_offsets( size_t *offsets, size_t max )
+{
+  hks_http_parser_t parser;
+  hks_http_parser_reset( &parser );
+
+  size_t count = 0;
+  for ( size_t at = 0; at < _stream_len && count < max; )
+  {
+    hks_http_request_t request;
+    if ( hks_http_request_parse( &parser, &request, _stream + at, _stream_len - at ) != ESP_OK )
+      break;
+    offsets[count++] = at;
+    at += request.content_len;
+  }
+
+  return count;
+}
+
+// replay the stream through a ring of `size`, at most `max_chunk` bytes a
+// write, 0 for all the space there is; 1 if it holds to the stream throughout
+static int _bench_replay( uint16_t size, size_t max_chunk, const size_t *offsets, size_t count, int check )
+{
+  static uint8_t data[BENCH_RING_MAX];
+  hks_ring_t ring;
+  hks_ring_init( &ring, data, size );
+
+  hks_http_parser_t parser;
+  hks_http_parser_reset( &parser );
+
+  size_t written = 0, consumed = 0, parsed = 0;
+  while ( consumed < _stream_len )
+  {
+    size_t space;
+    uint8_t *dst = hks_ring_write_ptr( &ring, &space );
+    if ( space == 0 )
+      return 0; // every request in the stream fits the smallest ring
+
+    size_t n = _stream_len - written;
+    if ( n > space )
+      n = space;
+    if ( max_chunk == 1 )
+      n = n > 0 ? 1 : 0;
+    else if ( max_chunk > 0 && n > 0 )
+      n = 1 + _bench_random() % ( n < max_chunk ? n : max_chunk );
+
+    memcpy( dst, _stream + written, n );
+    hks_ring_commit( &ring, n );
+    written += n;
+
+    for (;;)
+    {
+      size_t len;
+      uint8_t *pending = hks_ring_read_ptr( &ring, &len );
+      if ( check && ( len != written - consumed || memcmp( pending, _stream + consumed, len ) != 0 ) )
+        return 0;
+
+      hks_http_request_t request;
+      esp_err_t err = hks_http_request_parse( &parser, &request, pending, len );
+      if ( err == HKS_ERR_HTTP_INCOMPLETE )
+        break;
+      if ( err || parsed >= count || offsets[parsed] != consumed )
+        return 0;
+
+      parsed++;
+      consumed += request.content_len;
+      hks_ring_consume( &ring, request.content_len );
+    }
+  }
+
+  return parsed == count;
+}
+
+int main( int argc, char **argv )
+{
+  size_t requests = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 2000;
+  _bench_seed = argc > 2 ? (uint32_t)strtoul( argv[2], NULL, 10 ) : 0x2545f491;
+  if ( _bench_seed == 0 )
+    _bench_seed = 1;
+  uint32_t seed = _bench_seed;
+  int failed = 0;
+
+  // a random mix, so requests end at every offset of the ring
+  size_t longest = 0;
+  for ( size_t i = 0; i < requests; i++ )
+  {
+    const char *r = _requests[_bench_random() % ( sizeof( _requests ) / sizeof( _requests[0] ) )];
+    size_t len = strlen( r );
+    if ( _stream_len + len > BENCH_STREAM )
+      break;
+    memcpy( _stream + _stream_len, r, len );
+    _stream_len += len;
+    if ( len > longest )
+      longest = len;
+  }
+
+  size_t *offsets = calloc( requests, sizeof( size_t ) );
+  size_t count = _bench_offsets( offsets, requests );
+
+  printf( "replay, %zu requests, %zu bytes, seed %u\n", count, _stream_len, seed );
+  static const uint16_t sizes[] = { 0, 1, 17, 256, 1024, BENCH_RING_MAX };
+  int bytewise = 1, chunked = 1, bulk = 1;
+  for ( size_t i = 0; i < sizeof( sizes ) / sizeof( sizes[0] ); i++ )
+  {
+    // from the longest request up, and odd sizes in between
+    uint16_t size = (uint16_t)( longest + sizes[i] );
+    if ( size > BENCH_RING_MAX )
+      size = BENCH_RING_MAX;
+
+    bytewise &= _bench_replay( size, 1, offsets, count, 1 );
+    for ( int round = 0; round < 8; round++ )
+      chunked &= _bench_replay( size, 1 + _bench_random() % size, offsets, count, 1 );
+    bulk &= _bench_replay( size, 0, offsets, count, 1 );
+  }
+  failed |= _bench_report( "byte by byte", bytewise );
+  failed |= _bench_report( "random chunks", chunked );
+  failed |= _bench_report( "bulk", bulk );
+
+  printf( "throughput\n" );
+  for ( size_t max_chunk = 0; max_chunk < 2; max_chunk++ )
+  {
+    uint64_t t0 = bench_now_ns();
+    _bench_replay( 1024, max_chunk, offsets, count, 0 );
+    uint64_t elapsed = bench_now_ns() - t0;
+    printf( "  %-34s %7.1f MB/s\n", max_chunk == 0 ? "bulk" : "byte by byte", _stream_len / ( elapsed / 1e9 ) / 1e6 );
+  }
+
+  free( offsets );
+  if ( failed )
+    fprintf( stderr, "ring replay failed\n" );
+
+  return failed;
+}
@@ -0,0 +1,109 @@
+// Request/response rate with and without a controller that pipelines
+// requests but never reads its responses.
+//
+//   bench_slow_reader [requests] [port]
+//
+// A few keep-alive clients take turns sending a request and waiting for its
+// response. The maximum round trip is the worst stall of the server loop;
+// with the slow reader connected it must stay close to the baseline.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "bench.h"
+
+#define BENCH_FAST_CLIENTS 4
+
+static const char _request[] = "GET /accessories HTTP/1.1\r\nHost: hap.local\r\n\r\n";
+
+static volatile int _slow_running = 1;
+
+static void *_bench_slow_reader( void *arg )
+{
+  int fd = *(int *)arg;
+  char batch[64 * ( sizeof( _request ) - 1 )];
+  for ( size_t i = 0; i < 64; i++ )
+    memcpy( batch + i * ( sizeof( _request ) - 1 ), _request, sizeof( _request ) - 1 );
+
+  // blocks once the server stops taking requests from us
+  while ( _slow_running && write( fd, batch, sizeof( batch ) ) > 0 );
+
+  return NULL;
+}
+
+static int _bench_read_response( int fd )
+{
+  char buffer[256];
+  size_t len = 0;
+
+  // responses carry no body, the blank line ends them
+  while ( len < 4 || memcmp( buffer + len - 4, "\r\n\r\n", 4 ) != 0 )
+  {
+    if ( len == sizeof( buffer ) || read( fd, buffer + len, 1 ) != 1 )
+      return -1;
+    len++;
+  }
+
+  return 0;
+}
+
+static int _bench_round_trips( const char *name, uint16_t port, size_t count )
+{
+  int fds[BENCH_FAST_CLIENTS];
+  for ( int i = 0; i < BENCH_FAST_CLIENTS; i++ )
+    fds[i] = bench_connect( port );
+
+  uint64_t *latency_ns = calloc( count, sizeof( uint64_t ) );
+  size_t done = 0;
+
+  uint64_t start = bench_now_ns();
+  for ( size_t i = 0; i < count; i++ )
+  {
+    int fd = fds[i % BENCH_FAST_CLIENTS];
+    uint64_t t0 = bench_now_ns();
+    if ( write( fd, _request, sizeof( _request ) - 1 ) < 0 || _bench_read_response( fd ) )
+      break;
+    latency_ns[done++] = bench_now_ns() - t0;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  printf( "%s: %zu responses in %.3fs: %.0f responses/s\n", name, done, elapsed / 1e9, done / ( elapsed / 1e9 ) );
+  bench_report_latency( "  request-to-response", latency_ns, done );
+
+  for ( int i = 0; i < BENCH_FAST_CLIENTS; i++ )
+    close( fds[i] );
+  free( latency_ns );
+
+  return done == count ? 0 : -1;
+}
+
+int main( int argc, char **argv )
+{
+  size_t count = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 50000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42503;
+
+  bench_server_start( port, NULL );
+
+  int failed = _bench_round_trips( "baseline", port, count );
+
+  // a small receive window makes the server's socket fill up quickly
+  int slow = bench_connect( port );
+  int rcvbuf = 4096;
+  setsockopt( slow, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof( rcvbuf ) );
+
+  pthread_t thread;
+  pthread_create( &thread, NULL, _bench_slow_reader, &slow );
+  usleep( 200 * 1000 ); // let its responses back up
+
+  failed |= _bench_round_trips( "with slow reader", port, count );
+
+  _slow_running = 0;
+  shutdown( slow, SHUT_RDWR );
+  pthread_join( thread, NULL );
+  close( slow );
+
+  return failed ? 1 : 0;
+}
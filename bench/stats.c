@@ -0,0 +1,208 @@
+// The server's own counters, read back while it serves. Plain requests, then
+// pair-setup, pair-verify and encrypted requests, with a second thread taking
+// snapshots all along; every snapshot has to be whole (the buckets of each
+// stage add up to its count). The totals are checked against what the
+// controller sent and received, GET /stats has to answer, and the stage
+// histograms are printed. Last, what a sample costs the loop.
+//
+//   bench_stats [requests] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "bench.h"
+#include "bridge.h"
+#include "controller.h"
+
+#define BENCH_CONTROLLER_ID "9B2E4D71-0C3A-4F6E-8D15-7A9C0B2E4F68"
+#define BENCH_PATH          "/characteristics?id=2.9"
+#define BENCH_SAMPLES       1000000
+
+struct bench_reader_s {
+  hk_server_t *hks;
+  volatile int running;
+  size_t snapshots;
+  size_t torn;
+};
+typedef struct bench_reader_s bench_reader_t;
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+static int _bench_whole( const hks_stats_t *stats )
+{
+  for ( int stage = 0; stage < HKS_STATS_STAGES; stage++ )
+  {
+    uint32_t sum = 0;
+    for ( int i = 0; i < HKS_STATS_BUCKETS; i++ )
+      sum += stats->stages[stage].buckets[i];
+    if ( sum != stats->stages[stage].count )
+      return 0;
+  }
+  return 1;
+}
+
+static void *_bench_reader( void *arg )
+{
+  bench_reader_t *reader = arg;
+  hks_stats_t stats;
+  while ( reader->running )
+  {
+    hk_server_get_stats( reader->hks, &stats );
+    reader->snapshots++;
+    reader->torn += !_bench_whole( &stats );
+  }
+  return NULL;
+}
+
+// status of a plain GET, the bytes of the exchange added to `sent` and `received`
+static int _bench_get( int fd, const char *path, size_t *sent, size_t *received )
+{
+  char buffer[1024];
+  int n = snprintf( buffer, sizeof( buffer ), "GET %s HTTP/1.1\r\nHost: hap.local\r\n\r\n", path );
+  if ( write( fd, buffer, n ) != n )
+    return -1;
+  *sent += n;
+
+  size_t len = 0;
+  while ( len < 4 || memcmp( buffer + len - 4, "\r\n\r\n", 4 ) != 0 )
+  {
+    if ( len == sizeof( buffer ) - 1 || read( fd, buffer + len, 1 ) != 1 )
+      return -1;
+    len++;
+  }
+  buffer[len] = '\0';
+  *received += len;
+
+  int status = 0;
+  const char *length = strstr( buffer, "Content-Length: " );
+  if ( sscanf( buffer, "HTTP/1.1 %d", &status ) != 1 || length == NULL )
+    return -1;
+
+  for ( size_t body = strtoul( length + 16, NULL, 10 ); body > 0; )
+  {
+    ssize_t r = read( fd, buffer, body < sizeof( buffer ) ? body : sizeof( buffer ) );
+    if ( r <= 0 )
+      return -1;
+    body -= r;
+    *received += r;
+  }
+
+  return status;
+}
+
+// the loop records a response once it is written, which may be after the
+// controller has read it: wait until it has been quiet for a while
+static void _bench_settled( hk_server_t *hks, hks_stats_t *stats )
+{
+  hks_stats_t last;
+  hk_server_get_stats( hks, stats );
+  do
+  {
+    last = *stats;
+    usleep( 20000 );
+    hk_server_get_stats( hks, stats );
+  } while ( memcmp( &last, stats, sizeof( hks_stats_t ) ) != 0 );
+}
+
+static void _bench_cost( void )
+{
+  static hks_stats_t stats;
+  hks_stats_init( &stats );
+
+  volatile uint32_t sink = 0;
+  uint64_t t0 = bench_now_ns();
+  for ( uint32_t i = 0; i < BENCH_SAMPLES; i++ )
+    sink += hksu_now_us();
+  uint64_t clock = bench_now_ns() - t0;
+  (void)sink;
+
+  t0 = bench_now_ns();
+  for ( uint32_t i = 0; i < BENCH_SAMPLES; i++ )
+    hks_stats_record( &stats, HKS_STATS_HANDLER, i & 0xFFF );
+  uint64_t record = bench_now_ns() - t0;
+
+  printf( "  %-34s %8.1f ns\n", "clock read", (double)clock / BENCH_SAMPLES );
+  printf( "  %-34s %8.1f ns\n", "histogram sample", (double)record / BENCH_SAMPLES );
+}
+
+int main( int argc, char **argv )
+{
+  size_t requests = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 1000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42551;
+  int failed = 0;
+
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  hk_server_t *hks = bench_server_create( port, &db );
+  hk_server_set_setup_code( hks, BENCH_SETUP_CODE );
+  bench_server_run( hks );
+
+  bench_reader_t reader = { .hks = hks, .running = 1 };
+  pthread_t thread;
+  pthread_create( &thread, NULL, _bench_reader, &reader );
+
+  // unpaired, plain requests only: the totals are exactly the wire bytes
+  hks_stats_t stats;
+  size_t sent = 0, received = 0;
+  int ok = 1;
+  int fd = bench_connect( port );
+  for ( size_t i = 0; i < requests; i++ )
+    ok &= _bench_get( fd, BENCH_PATH, &sent, &received ) == 200;
+  ok &= hk_server_get_stats( hks, &stats ) == ESP_OK;
+  _bench_settled( hks, &stats );
+  close( fd );
+
+  printf( "stats\n" );
+  failed |= _bench_report( "plain requests", ok );
+  failed |= _bench_report( "bytes in and out match the wire", stats.bytes_in == sent && stats.bytes_out == received );
+  failed |= _bench_report( "a sample per request", stats.stages[HKS_STATS_HANDLER].count == requests &&
+    stats.stages[HKS_STATS_PARSE].count == requests );
+
+  bench_controller_t ctl;
+  bench_controller_init( &ctl, BENCH_CONTROLLER_ID );
+  uint64_t elapsed[3];
+  size_t len;
+  fd = bench_connect( port );
+  ok = bench_pair_setup( &ctl, fd, elapsed ) == 0;
+  close( fd );
+
+  fd = bench_connect( port );
+  ok &= bench_pair_verify( &ctl, fd, elapsed ) == 0;
+  for ( size_t i = 0; i < requests; i++ )
+    ok &= bench_secure_get( &ctl, fd, BENCH_PATH, &len ) == 200;
+  failed |= _bench_report( "encrypted requests", ok );
+  failed |= _bench_report( "GET /stats", bench_secure_get( &ctl, fd, "/stats", &len ) == 200 && len > 0 );
+  close( fd );
+
+  reader.running = 0;
+  pthread_join( thread, NULL );
+  _bench_settled( hks, &stats );
+
+  // three pair-setup and two pair-verify steps, then the requests and /stats
+  uint32_t handled = 2 * requests + 3 + 2 + 1;
+  failed |= _bench_report( "accepts counted", stats.stages[HKS_STATS_ACCEPT].count == 3 );
+  failed |= _bench_report( "requests counted", stats.stages[HKS_STATS_HANDLER].count == handled );
+  failed |= _bench_report( "frames opened and sealed", stats.stages[HKS_STATS_ENCRYPT].count >= 2 * ( requests + 1 ) );
+  failed |= _bench_report( "a wakeup for every request", stats.wakeups >= handled );
+  failed |= _bench_report( "snapshots whole", reader.torn == 0 && _bench_whole( &stats ) );
+  printf( "  %-34s %8zu snapshots, %zu torn\n", "", reader.snapshots, reader.torn );
+
+  printf( "cost\n" );
+  _bench_cost();
+
+  printf( "histograms, %zu plain and %zu encrypted requests\n", requests, requests );
+  bench_report_stats( &stats );
+
+  if ( failed )
+    fprintf( stderr, "stats check failed\n" );
+
+  return failed;
+}
@@ -0,0 +1,248 @@
+// The pairing store on its host backend, a memory-mapped file.
+//
+//   lookup    hks_pairings_find with the table full, for every controller
+//             and a stranger
+//   crash     a child commits image after image and is killed at a random
+//             moment, over and over; every reopen has to find the newest
+//             image it completed or the one before, intact
+//   torn      the newest slot damaged as a write cut short would leave it
+//   restart   a controller paired with one server verifies against a second
+//             one opened on the same file, signed with the restored key
+//
+//   bench_store [kills] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "bridge.h"
+#include "controller.h"
+#include "hks_store.h"
+
+#define BENCH_CONTROLLER_ID "3A7D2C14-95E8-4F0B-8C61-D2E4B7A90F53"
+#define BENCH_LOOKUPS       1000000
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+static void _bench_controller_id( uint8_t id[HKS_PAIRING_ID_LENGTH], uint32_t n )
+{
+  char text[HKS_PAIRING_ID_LENGTH + 1];
+  snprintf( text, sizeof( text ), "%08X-0000-4000-8000-%012X", n, n * 2654435761u );
+  memcpy( id, text, HKS_PAIRING_ID_LENGTH );
+}
+
+// the pairings of image `n`, so any image can be checked against its number
+static void _bench_pairings( hks_pairings_t *p, uint32_t n )
+{
+  uint8_t id[HKS_PAIRING_ID_LENGTH], key[HKS_ED25519_PUBLIC_LENGTH];
+  p->count = 0;
+  memset( p->seed, n, sizeof( p->seed ) );
+
+  for ( uint32_t i = 0; i < n % ( HKS_PAIRING_MAX + 1 ); i++ )
+  {
+    _bench_controller_id( id, n + i );
+    memset( key, n + i, sizeof( key ) );
+    hks_pairings_add( p, id, sizeof( id ), key, HKS_PAIRING_PERMISSION_ADMIN );
+  }
+}
+
+static int _bench_image_matches( const hks_store_image_t *image )
+{
+  static hks_pairings_t expected;
+  uint32_t n = image->configuration;
+  _bench_pairings( &expected, n );
+
+  return image->digest == ( n ^ 0xA5A5A5A5 ) &&
+    memcmp( image->seed, expected.seed, sizeof( expected.seed ) ) == 0 &&
+    image->count == expected.count &&
+    memcmp( image->pairings, expected.pairings, expected.count * sizeof( hks_pairing_t ) ) == 0;
+}
+
+static int _bench_lookup( void )
+{
+  static hks_pairings_t p;
+  static uint8_t ids[HKS_PAIRING_MAX + 1][HKS_PAIRING_ID_LENGTH];
+  uint8_t mac[6] = { 0x02, 0, 0, 0, 0, 1 };
+  int ok = hks_pairings_init( &p, mac ) == ESP_OK;
+
+  for ( uint32_t i = 0; i <= HKS_PAIRING_MAX; i++ )
+  {
+    _bench_controller_id( ids[i], i );
+    if ( i < HKS_PAIRING_MAX )
+      ok &= hks_pairings_add( &p, ids[i], HKS_PAIRING_ID_LENGTH, p.public_key, 0 ) == ESP_OK;
+  }
+
+  // every controller where it was added, the last one is a stranger
+  for ( uint32_t i = 0; i <= HKS_PAIRING_MAX; i++ )
+    ok &= hks_pairings_find( &p, ids[i], HKS_PAIRING_ID_LENGTH ) == ( i < HKS_PAIRING_MAX ? i : HKS_PAIRING_NONE );
+  int failed = _bench_report( "every controller found", ok );
+
+  volatile uint8_t sink = 0;
+  uint64_t t0 = bench_now_ns();
+  for ( uint32_t i = 0; i < BENCH_LOOKUPS; i++ )
+    sink ^= hks_pairings_find( &p, ids[i % ( HKS_PAIRING_MAX + 1 )], HKS_PAIRING_ID_LENGTH );
+  uint64_t elapsed = bench_now_ns() - t0;
+  (void)sink;
+
+  printf( "  %-34s %8.1f ns\n", "find", (double)elapsed / BENCH_LOOKUPS );
+  return failed;
+}
+
+static void _bench_writer( const char *path )
+{
+  static hks_store_t store;
+  static hks_pairings_t p;
+  hks_store_backend_t backend;
+  if ( hks_store_file_init( &backend, path ) )
+    _exit( 1 );
+
+  hks_store_open( &store, &backend );
+  for ( uint32_t n = store.image.configuration + 1;; n++ )
+  {
+    _bench_pairings( &p, n );
+    hks_store_set_pairings( &store, &p );
+    hks_store_set_configuration( &store, n, n ^ 0xA5A5A5A5 );
+    hks_store_commit( &store );
+  }
+}
+
+static int _bench_crash( const char *path, size_t kills )
+{
+  static hks_store_t store;
+  static hks_pairings_t p;
+  hks_store_backend_t backend;
+  int ok = 1, torn = 0;
+  uint32_t generation = 0;
+  uint64_t commit_ns = 0;
+
+  // a first image, timing commits while at it
+  ok &= hks_store_file_init( &backend, path ) == ESP_OK;
+  ok &= hks_store_open( &store, &backend ) == ESP_ERR_NOT_FOUND;
+  for ( uint32_t n = 1; n <= 100; n++ )
+  {
+    _bench_pairings( &p, n );
+    hks_store_set_pairings( &store, &p );
+    hks_store_set_configuration( &store, n, n ^ 0xA5A5A5A5 );
+    uint64_t t0 = bench_now_ns();
+    ok &= hks_store_commit( &store ) == ESP_OK;
+    commit_ns += bench_now_ns() - t0;
+  }
+  ok &= hks_store_commit( &store ) == ESP_OK && !store.dirty; // nothing changed, nothing written
+  hks_store_close( &store );
+  int failed = _bench_report( "commit and reopen", ok );
+
+  for ( size_t i = 0; i < kills && ok; i++ )
+  {
+    pid_t pid = fork();
+    if ( pid == 0 )
+      _bench_writer( path );
+
+    usleep( 200 + rand() % 5000 );
+    kill( pid, SIGKILL );
+    waitpid( pid, NULL, 0 );
+
+    // the slot the child was writing when it died may be torn
+    hks_store_image_t *image = &store.image;
+    ok &= hks_store_file_init( &backend, path ) == ESP_OK;
+    for ( uint8_t slot = 0; slot < HKS_STORE_SLOTS; slot++ )
+    {
+      backend.read( backend.ctx, slot, image, sizeof( hks_store_image_t ) );
+      torn += !_bench_image_matches( image );
+    }
+    backend.close( backend.ctx );
+
+    ok &= hks_store_file_init( &backend, path ) == ESP_OK;
+    ok &= hks_store_open( &store, &backend ) == ESP_OK;
+    ok &= _bench_image_matches( image ) && image->generation >= generation;
+    generation = image->generation;
+    hks_store_close( &store );
+  }
+  failed |= _bench_report( "killed mid-write, reopened intact", ok );
+  printf( "  %-34s %8zu kills, %d torn slots, generation %u\n", "", kills, torn, generation );
+
+  // the newest image damaged: the one before it is used
+  ok = hks_store_file_init( &backend, path ) == ESP_OK && hks_store_open( &store, &backend ) == ESP_OK;
+  uint8_t newest = ( store.slot + HKS_STORE_SLOTS - 1 ) % HKS_STORE_SLOTS;
+  generation = store.image.generation;
+  store.image.pairings[0].public_key[7] ^= 0x40;
+  backend.write( backend.ctx, newest, &store.image, sizeof( hks_store_image_t ) );
+  hks_store_close( &store );
+
+  ok &= hks_store_file_init( &backend, path ) == ESP_OK && hks_store_open( &store, &backend ) == ESP_OK;
+  ok &= store.image.generation == generation - 1 && _bench_image_matches( &store.image );
+  hks_store_close( &store );
+  failed |= _bench_report( "torn newest slot, older one used", ok );
+
+  printf( "  %-34s %8.1f us\n", "commit (msync)", commit_ns / 100 / 1e3 );
+  return failed;
+}
+
+static int _bench_restart( const char *path, uint16_t port )
+{
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  // the first server keeps running, it is not asked anything again
+  hks_store_backend_t backend;
+  hk_server_t *hks = bench_server_create( port, &db );
+  hk_server_set_setup_code( hks, BENCH_SETUP_CODE );
+  int ok = hks_store_file_init( &backend, path ) == ESP_OK && hk_server_set_storage( hks, &backend ) == ESP_OK;
+  bench_server_run( hks );
+
+  bench_controller_t ctl;
+  bench_controller_init( &ctl, BENCH_CONTROLLER_ID );
+  uint64_t elapsed[3];
+  int fd = bench_connect( port );
+  ok &= bench_pair_setup( &ctl, fd, elapsed ) == 0;
+  close( fd );
+
+  hks = bench_server_create( port + 1, &db );
+  ok &= hks_store_file_init( &backend, path ) == ESP_OK && hk_server_set_storage( hks, &backend ) == ESP_OK;
+  bench_server_run( hks );
+
+  size_t len;
+  fd = bench_connect( port + 1 );
+  ok &= bench_pair_verify( &ctl, fd, elapsed ) == 0 && bench_secure_get( &ctl, fd, "/accessories", &len ) == 200;
+  close( fd );
+
+  return _bench_report( "paired before a restart, verified", ok );
+}
+
+int main( int argc, char **argv )
+{
+  size_t kills = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 200;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42541;
+  int failed = 0;
+
+  char path[] = "/tmp/bench_store.XXXXXX";
+  int fd = mkstemp( path );
+  if ( fd < 0 )
+    return 1;
+  close( fd );
+  unlink( path );
+
+  printf( "lookup, %d pairings\n", HKS_PAIRING_MAX );
+  failed |= _bench_lookup();
+
+  // before any server thread, the writer is forked
+  printf( "crash consistency\n" );
+  failed |= _bench_crash( path, kills );
+  unlink( path );
+
+  printf( "restart\n" );
+  failed |= _bench_restart( path, port );
+  unlink( path );
+
+  if ( failed )
+    fprintf( stderr, "store check failed\n" );
+
+  return failed;
+}
@@ -0,0 +1,291 @@
+// The timer heap driven by a clock of the bench's own, against a plain
+// array of deadlines as the model.
+//
+//   random    timers started, re-armed earlier and later, stopped, and the
+//             clock moved on and the heap run, at random; the clock starts
+//             just short of 2^32 so it wraps along the way. After every
+//             step the heap has to be a heap with every index right, the
+//             next deadline has to be the model's, and a run has to fire
+//             what the model says expired, earliest first
+//   callbacks timers re-arming themselves and stopping others from inside
+//             the run
+//   full      a start on a full heap refused, re-arming an armed timer
+//             still taken
+//   cost      start, re-arm and stop with the heap full
+//
+//   bench_timer [steps] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "hks_timer.h"
+
+#define BENCH_TIMERS    24
+#define BENCH_COST      1000000
+
+struct bench_timer_s {
+  hks_timer_t timer;
+  int armed;         // the model's view
+  uint32_t deadline;
+  uint32_t fired;    // in the current run
+  uint32_t order;    // position in it
+};
+typedef struct bench_timer_s bench_timer_t;
+
+static hks_timers_t _timers;
+static hks_timer_t *_heap[BENCH_TIMERS];
+static bench_timer_t _bench_timers[BENCH_TIMERS];
+static uint32_t _now;
+static uint32_t _fired;
+static uint32_t _last_deadline;
+static int _out_of_order;
+static uint32_t _bench_seed;
+
+static uint32_t _bench_random( void )
+{
+  _bench_seed ^= _bench_seed << 13;
+  _bench_seed ^= _bench_seed >> 17;
+  _bench_seed ^= _bench_seed << 5;
+  return _bench_seed;
+}
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+static void _bench_fire( hks_timer_t *timer, uint32_t now, void *ctx )
+{
+  bench_timer_t *t = (bench_timer_t *)timer->arg;
+
+  // earliest first, the clock wrapping along the way
+  if ( _fired > 0 && (int32_t)( timer->deadline - _last_deadline ) < 0 )
+    _out_of_order = 1;
+  _last_deadline = timer->deadline;
+
+  t->armed = 0;
+  t->fired++;
+  t->order = _fired++;
+}
+
+static int _bench_heap_valid( void )
+{
+  for ( uint8_t i = 0; i < _timers.count; i++ )
+  {
+    if ( _heap[i]->index != i )
+      return 0;
+    if ( i > 0 && (int32_t)( _heap[i]->deadline - _heap[( i - 1 ) / 2]->deadline ) < 0 )
+      return 0;
+  }
+
+  size_t armed = 0;
+  for ( int i = 0; i < BENCH_TIMERS; i++ )
+  {
+    bench_timer_t *t = &_bench_timers[i];
+    armed += t->armed;
+    if ( t->armed != hks_timer_armed( &t->timer ) || ( t->armed && t->timer.deadline != t->deadline ) )
+      return 0;
+  }
+
+  return armed == _timers.count;
+}
+
+// what hks_timers_next has to say according to the model
+static int32_t _bench_model_next( void )
+{
+  int32_t next = -1;
+  for ( int i = 0; i < BENCH_TIMERS; i++ )
+  {
+    if ( !_bench_timers[i].armed )
+      continue;
+    int32_t remaining = (int32_t)( _bench_timers[i].deadline - _now );
+    if ( remaining < 0 )
+      remaining = 0;
+    if ( next < 0 || remaining < next )
+      next = remaining;
+  }
+  return next;
+}
+
+static void _bench_reset( uint32_t now )
+{
+  hks_timers_init( &_timers, _heap, BENCH_TIMERS );
+  for ( int i = 0; i < BENCH_TIMERS; i++ )
+  {
+    memset( &_bench_timers[i], 0, sizeof( bench_timer_t ) );
+    hks_timer_init( &_bench_timers[i].timer, _bench_fire, &_bench_timers[i] );
+  }
+  _now = now;
+}
+
+// advance the clock and run, checking what fired against the model
+static int _bench_run( uint32_t advance )
+{
+  _now += advance;
+
+  int expected[BENCH_TIMERS];
+  for ( int i = 0; i < BENCH_TIMERS; i++ )
+  {
+    bench_timer_t *t = &_bench_timers[i];
+    expected[i] = t->armed && (int32_t)( _now - t->deadline ) >= 0;
+    t->fired = 0;
+  }
+
+  _fired = 0;
+  _out_of_order = 0;
+  hks_timers_run( &_timers, _now, NULL );
+
+  for ( int i = 0; i < BENCH_TIMERS; i++ )
+    if ( _bench_timers[i].fired != (uint32_t)expected[i] )
+      return 0;
+
+  return !_out_of_order;
+}
+
+static int _bench_random_steps( size_t steps )
+{
+  // a little over a minute short of the wrap
+  _bench_reset( UINT32_MAX - 65000 );
+
+  for ( size_t step = 0; step < steps; step++ )
+  {
+    bench_timer_t *t = &_bench_timers[_bench_random() % BENCH_TIMERS];
+    uint32_t delay = _bench_random() % 120000;
+    switch ( _bench_random() % 4 )
+    {
+      case 0: // start, or re-arm later or earlier
+      case 1:
+        if ( hks_timer_start( &_timers, &t->timer, _now + delay ) != ESP_OK )
+          return 0;
+        t->armed = 1;
+        t->deadline = _now + delay;
+        break;
+      case 2:
+        hks_timer_stop( &_timers, &t->timer );
+        t->armed = 0;
+        break;
+      default:
+        if ( !_bench_run( _bench_random() % 30000 ) )
+          return 0;
+        break;
+    }
+
+    if ( !_bench_heap_valid() || hks_timers_next( &_timers, _now ) != _bench_model_next() )
+      return 0;
+  }
+
+  // everything left fires once the clock is past it
+  return _bench_run( 200000 ) && _timers.count == 0 && hks_timers_next( &_timers, _now ) == -1;
+}
+
+// the first timer re-arms itself a second on, the second stops the third
+static void _bench_rearm( hks_timer_t *timer, uint32_t now, void *ctx )
+{
+  bench_timer_t *t = (bench_timer_t *)timer->arg;
+  t->fired++;
+  hks_timer_start( &_timers, timer, now + 1000 );
+}
+
+static void _bench_stop_next( hks_timer_t *timer, uint32_t now, void *ctx )
+{
+  bench_timer_t *t = (bench_timer_t *)timer->arg;
+  t->fired++;
+  hks_timer_stop( &_timers, &_bench_timers[2].timer );
+}
+
+static int _bench_callbacks( void )
+{
+  _bench_reset( UINT32_MAX - 500 );
+  _bench_timers[0].timer.cb = _bench_rearm;
+  _bench_timers[1].timer.cb = _bench_stop_next;
+
+  hks_timer_start( &_timers, &_bench_timers[0].timer, _now + 100 );
+  hks_timer_start( &_timers, &_bench_timers[1].timer, _now + 200 );
+  hks_timer_start( &_timers, &_bench_timers[2].timer, _now + 300 );
+
+  // all three expired, but the second stops the third before it comes up
+  _now += 400;
+  hks_timers_run( &_timers, _now, NULL );
+  int ok = _bench_timers[0].fired == 1 && _bench_timers[1].fired == 1 && _bench_timers[2].fired == 0;
+  ok &= _timers.count == 1 && hks_timers_next( &_timers, _now ) == 1000;
+
+  // a re-armed timer does not fire again within the same run
+  _now += 999;
+  hks_timers_run( &_timers, _now, NULL );
+  ok &= _bench_timers[0].fired == 1;
+  _now += 1;
+  hks_timers_run( &_timers, _now, NULL );
+  ok &= _bench_timers[0].fired == 2 && hks_timers_next( &_timers, _now ) == 1000;
+
+  return ok;
+}
+
+static int _bench_full( void )
+{
+  static hks_timer_t extra;
+  _bench_reset( 0 );
+  hks_timer_init( &extra, _bench_fire, NULL );
+
+  int ok = 1;
+  for ( int i = 0; i < BENCH_TIMERS; i++ )
+    ok &= hks_timer_start( &_timers, &_bench_timers[i].timer, 1000 + i ) == ESP_OK;
+  ok &= hks_timer_start( &_timers, &extra, 10 ) == ESP_ERR_NO_MEM && !hks_timer_armed( &extra );
+
+  // re-arming takes no new slot
+  ok &= hks_timer_start( &_timers, &_bench_timers[BENCH_TIMERS - 1].timer, 5 ) == ESP_OK;
+  ok &= _timers.count == BENCH_TIMERS && _heap[0] == &_bench_timers[BENCH_TIMERS - 1].timer;
+  ok &= hks_timers_next( &_timers, 0 ) == 5 && hks_timers_next( &_timers, 10 ) == 0;
+
+  return ok;
+}
+
+static void _bench_cost( void )
+{
+  _bench_reset( 0 );
+  for ( int i = 0; i < BENCH_TIMERS; i++ )
+    hks_timer_start( &_timers, &_bench_timers[i].timer, _bench_random() % 60000 );
+
+  uint64_t t0 = bench_now_ns();
+  for ( int i = 0; i < BENCH_COST; i++ )
+  {
+    hks_timer_t *timer = &_bench_timers[i % BENCH_TIMERS].timer;
+    hks_timer_start( &_timers, timer, _bench_random() % 60000 );
+  }
+  uint64_t rearm = bench_now_ns() - t0;
+
+  t0 = bench_now_ns();
+  for ( int i = 0; i < BENCH_COST; i++ )
+  {
+    hks_timer_t *timer = &_bench_timers[i % BENCH_TIMERS].timer;
+    hks_timer_stop( &_timers, timer );
+    hks_timer_start( &_timers, timer, _bench_random() % 60000 );
+  }
+  uint64_t cycle = bench_now_ns() - t0;
+
+  printf( "  %-34s %7.1f ns\n", "re-arm, heap full", (double)rearm / BENCH_COST );
+  printf( "  %-34s %7.1f ns\n", "stop and start, heap full", (double)cycle / BENCH_COST );
+}
+
+int main( int argc, char **argv )
+{
+  size_t steps = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 1000000;
+  _bench_seed = argc > 2 ? (uint32_t)strtoul( argv[2], NULL, 10 ) : 0x6c8e9cf5;
+  if ( _bench_seed == 0 )
+    _bench_seed = 1;
+  int failed = 0;
+
+  printf( "timers, %zu random steps, seed %u\n", steps, _bench_seed );
+  failed |= _bench_report( "random against the model", _bench_random_steps( steps ) );
+  failed |= _bench_report( "re-arm and stop from callbacks", _bench_callbacks() );
+  failed |= _bench_report( "full heap", _bench_full() );
+
+  printf( "cost\n" );
+  _bench_cost();
+
+  if ( failed )
+    fprintf( stderr, "timer check failed\n" );
+
+  return failed;
+}
@@ -0,0 +1,172 @@
+// The trace ring against the ESP_LOGI lines it replaces in the server loop.
+//
+//   cost      one event recorded, one left out at build time, and ESP_LOGI
+//             both formatting into /dev/null and filtered out by level; on
+//             the device the formatted line also waits on the UART
+//   reader    a second thread drains the ring while events are written as
+//             fast as they can be; what it gets is in order and complete
+//             once the dropped ones are counted
+//   server    a connection and its request come back out of
+//             hk_server_read_trace formatted as the old log lines
+//
+//   bench_trace [events] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <esp_log.h>
+#include "bench.h"
+
+#define BENCH_PATH "/characteristics?id=1.2"
+
+static const char *TAG = "bench-trace";
+
+struct bench_reader_s {
+  hks_trace_t *trace;
+  size_t events;
+  size_t read;
+  uint32_t dropped;
+  int ordered;
+};
+typedef struct bench_reader_s bench_reader_t;
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+static void _bench_cost( size_t events )
+{
+  static hks_trace_t trace;
+  hks_trace_init( &trace );
+  int fd = 7;
+
+  uint64_t t0 = bench_now_ns();
+  for ( size_t i = 0; i < events; i++ )
+    HKS_TRACEI( &trace, HKS_TRACE_ACCEPT, fd, i, 0 );
+  uint64_t recorded = bench_now_ns() - t0;
+
+  t0 = bench_now_ns();
+  for ( size_t i = 0; i < events; i++ )
+  {
+    HKS_TRACED( &trace, HKS_TRACE_CLOSE, fd, i, 0 );
+    __asm__ volatile( "" ::: "memory" ); // keep the empty loop
+  }
+  uint64_t left_out = bench_now_ns() - t0;
+
+  // the lines the server used to print, formatted but thrown away
+  FILE *saved = fdopen( dup( fileno( stderr ) ), "w" );
+  if ( freopen( "/dev/null", "w", stderr ) == NULL )
+    return;
+  esp_log_level_set( "*", ESP_LOG_INFO );
+  t0 = bench_now_ns();
+  for ( size_t i = 0; i < events; i++ )
+    ESP_LOGI( TAG, "%.*s Request: %.*s", 3, "GET", 16, "/characteristics" );
+  uint64_t logged = bench_now_ns() - t0;
+
+  esp_log_level_set( "*", ESP_LOG_WARN );
+  t0 = bench_now_ns();
+  for ( size_t i = 0; i < events; i++ )
+    ESP_LOGI( TAG, "Accepted new client (%d)", fd );
+  uint64_t filtered = bench_now_ns() - t0;
+  fflush( stderr );
+  dup2( fileno( saved ), fileno( stderr ) );
+  fclose( saved );
+
+  printf( "  %-34s %8.1f ns\n", "HKS_TRACEI", (double)recorded / events );
+  printf( "  %-34s %8.1f ns\n", "HKS_TRACED, built out", (double)left_out / events );
+  printf( "  %-34s %8.1f ns\n", "ESP_LOGI to /dev/null", (double)logged / events );
+  printf( "  %-34s %8.1f ns\n", "ESP_LOGI, below the level", (double)filtered / events );
+}
+
+static void *_bench_reader( void *arg )
+{
+  bench_reader_t *reader = arg;
+  hks_trace_record_t records[32];
+  uint32_t cursor = 0, last = 0;
+
+  while ( reader->read + reader->dropped < reader->events )
+  {
+    size_t n = hks_trace_read( reader->trace, &cursor, records, 32, &reader->dropped );
+    for ( size_t i = 0; i < n; i++ )
+    {
+      // the argument is the event's number, starting at 1
+      reader->ordered &= records[i].args[0] > last && records[i].args[1] == ~records[i].args[0];
+      last = records[i].args[0];
+    }
+    reader->read += n;
+  }
+  return NULL;
+}
+
+static int _bench_concurrent( size_t events )
+{
+  static hks_trace_t trace;
+  hks_trace_init( &trace );
+  bench_reader_t reader = { .trace = &trace, .events = events, .ordered = 1 };
+
+  pthread_t thread;
+  pthread_create( &thread, NULL, _bench_reader, &reader );
+  for ( uint32_t i = 1; i <= events; i++ )
+    hks_trace_write( &trace, HKS_TRACE_REQUEST, 3, i, ~i );
+  pthread_join( thread, NULL );
+
+  int failed = _bench_report( "read in order, nothing torn", reader.ordered );
+  failed |= _bench_report( "read and dropped add up", reader.read + reader.dropped == events );
+  printf( "  %-34s %8zu read, %u dropped\n", "", reader.read, reader.dropped );
+  return failed;
+}
+
+static int _bench_server( uint16_t port )
+{
+  hk_server_t *hks = bench_server_start( port, NULL );
+  int fd = bench_connect( port );
+  const char request[] = "GET " BENCH_PATH " HTTP/1.1\r\n\r\n";
+  char response[256];
+  int ok = write( fd, request, sizeof( request ) - 1 ) == sizeof( request ) - 1 &&
+    read( fd, response, sizeof( response ) ) > 0;
+  close( fd );
+  usleep( 50000 );
+
+  hks_trace_record_t records[8];
+  uint32_t cursor = 0, dropped = 0;
+  size_t count = 8;
+  ok &= hk_server_read_trace( hks, &cursor, records, &count, &dropped ) == ESP_OK && count >= 2;
+
+  char line[128], expected[128];
+  hks_trace_format( &records[0], line, sizeof( line ) );
+  snprintf( expected, sizeof( expected ), "Accepted new client (%d)", records[0].fd );
+  ok &= line[0] == 'I' && strstr( line, expected ) != NULL;
+  printf( "    %s\n", line );
+
+  hks_trace_format( &records[1], line, sizeof( line ) );
+  snprintf( expected, sizeof( expected ), "GET Request: /characteristics (%d)", records[0].fd );
+  ok &= strstr( line, expected ) != NULL;
+  printf( "    %s\n", line );
+
+  return _bench_report( "server events formatted", ok );
+}
+
+int main( int argc, char **argv )
+{
+  size_t events = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 1000000;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42561;
+  int failed = 0;
+
+  printf( "per event\n" );
+  _bench_cost( events );
+
+  printf( "reader\n" );
+  failed |= _bench_concurrent( events );
+
+  printf( "server\n" );
+  failed |= _bench_server( port );
+
+  if ( failed )
+    fprintf( stderr, "trace check failed\n" );
+
+  return failed;
+}
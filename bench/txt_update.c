@@ -0,0 +1,73 @@
+// TXT record update cost: the wire-format builder in hks_txt against the
+// previous path of one vsnprintf per record into separate heap strings.
+//
+//   bench_txt_update [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "bench.h"
+#include "hks_txt.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+// previous implementation, kept here as the baseline
+static char *_legacy_records[HKS_TXT_RECORD_COUNT];
+
+static void _legacy_set( int key, const char *fmt, ... )
+{
+  va_list ap;
+  va_start( ap, fmt );
+  vsnprintf( _legacy_records[key], HKS_TXT_RECORD_LENGTH, fmt, ap );
+  va_end( ap );
+}
+
+static volatile uint32_t _sink;
+
+int main( int argc, char **argv )
+{
+  size_t iterations = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 1000000;
+
+  for ( int i = 0; i < HKS_TXT_RECORD_COUNT; i++ )
+    _legacy_records[i] = malloc( HKS_TXT_RECORD_LENGTH );
+
+  uint64_t t0 = bench_now_ns();
+  uint64_t c0 = BENCH_CYCLES();
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    _legacy_set( 0, "c#=%u", (unsigned)( i & 0xffff ) );
+    _legacy_set( 6, "sf=%hhu", (unsigned char)( i & 1 ) );
+    _sink += (uint8_t)_legacy_records[0][3];
+  }
+  uint64_t legacy_cycles = BENCH_CYCLES() - c0;
+  uint64_t legacy_ns = bench_now_ns() - t0;
+
+  hks_txt_t txt;
+  hks_txt_init( &txt );
+
+  t0 = bench_now_ns();
+  c0 = BENCH_CYCLES();
+  for ( size_t i = 0; i < iterations; i++ )
+  {
+    hks_txt_set_configuration_number( &txt, (uint32_t)( i & 0xffff ) );
+    hks_txt_set_state_flags( &txt, (hks_txt_state_t)( i & 1 ) );
+    _sink += txt.rdata[4];
+  }
+  uint64_t txt_cycles = BENCH_CYCLES() - c0;
+  uint64_t txt_ns = bench_now_ns() - t0;
+
+  // two field updates per iteration
+  double updates = iterations * 2.0;
+  printf( "vsnprintf strings   %7.1f ns/update %7.1f cycles/update\n", legacy_ns / updates, legacy_cycles / updates );
+  printf( "wire-format patch   %7.1f ns/update %7.1f cycles/update\n", txt_ns / updates, txt_cycles / updates );
+
+  for ( int i = 0; i < HKS_TXT_RECORD_COUNT; i++ )
+    free( _legacy_records[i] );
+
+  return 0;
+}
@@ -0,0 +1,290 @@
+// The server loop on its own task (hk_server_start) with the stacks it is
+// configured with, driven down its deepest paths, then the headroom it had
+// left according to hk_server_get_watermarks.
+//
+//   deepest   every client slot subscribed to 100 characteristics while a
+//             write of 100 values fans out as events, reads of 100 values
+//             with all their metadata, /accessories, /stats, refused
+//             requests and mDNS queries, then pair-setup, pair-verify and
+//             pair-resume with the arithmetic on the crypto workers
+//   headroom  what the server task and the workers had left, which has to
+//             be at least BENCH_HEADROOM of each
+//   guard     a task running past its stack faults on the guard page below
+//             it instead of writing over whatever lies there
+//   stop      hk_server_stop and hk_server_free from this task with the
+//             loop asleep in select on its own and a client connected; the
+//             client is closed and free returns once the task has left
+//
+//   bench_watermarks [rounds] [port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "bench.h"
+#include "bridge.h"
+#include "controller.h"
+
+#define BENCH_CONTROLLER_ID "5A8E2D47-C1B3-4F90-8D6A-E74B0C2F1935"
+#define BENCH_HEADROOM      1024
+#define BENCH_LIGHTS        100
+
+static const uint8_t _query[] =
+  "\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+  "\x04_hap\x04_tcp\x05local\x00"
+  "\x00\x0c\x00\x01";
+
+static int _bench_report( const char *name, int ok )
+{
+  printf( "  %-34s %s\n", name, ok ? "ok" : "FAILED" );
+  return !ok;
+}
+
+// status of the next HTTP or EVENT message on `fd`, its body read and
+// dropped; 0 if none came within a second
+static int _bench_message( int fd )
+{
+  char buffer[1024];
+  size_t len = 0;
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  while ( len < 4 || memcmp( buffer + len - 4, "\r\n\r\n", 4 ) != 0 )
+  {
+    if ( len == sizeof( buffer ) - 1 || poll( &pfd, 1, 1000 ) <= 0 || read( fd, buffer + len, 1 ) != 1 )
+      return 0;
+    len++;
+  }
+  buffer[len] = '\0';
+
+  int status = 0;
+  const char *length = strstr( buffer, "Content-Length: " );
+  if ( sscanf( buffer, "%*s %d", &status ) != 1 )
+    return 0;
+
+  for ( size_t body = length ? strtoul( length + 16, NULL, 10 ) : 0; body > 0; )
+  {
+    ssize_t r = read( fd, buffer, body < sizeof( buffer ) ? body : sizeof( buffer ) );
+    if ( r <= 0 )
+      return 0;
+    body -= r;
+  }
+
+  return status;
+}
+
+static int _bench_request( int fd, const char *method, const char *path, const char *body )
+{
+  static char buffer[4096];
+  int n = body == NULL
+    ? snprintf( buffer, sizeof( buffer ), "%s %s HTTP/1.1\r\n\r\n", method, path )
+    : snprintf( buffer, sizeof( buffer ), "%s %s HTTP/1.1\r\nContent-Type: application/hap+json\r\n"
+        "Content-Length: %zu\r\n\r\n%s", method, path, strlen( body ), body );
+  return write( fd, buffer, n ) == n ? _bench_message( fd ) : 0;
+}
+
+// {"characteristics":[...]} with `member` for the brightness of every light
+static void _bench_lights( char *body, size_t size, const char *member )
+{
+  size_t len = snprintf( body, size, "{\"characteristics\":[" );
+  for ( int i = 0; i < BENCH_LIGHTS; i++ )
+    len += snprintf( body + len, size - len, "%s{\"aid\":%d,\"iid\":10,%s}", i ? "," : "", 2 + i, member );
+  snprintf( body + len, size - len, "]}" );
+}
+
+// a legacy unicast query for the service, answered by the responder
+static int _bench_query( void )
+{
+  int fd = socket( AF_INET, SOCK_DGRAM, 0 );
+  struct sockaddr_in responder = {
+    .sin_family = AF_INET,
+    .sin_port = htons( 5353 ),
+    .sin_addr.s_addr = htonl( INADDR_LOOPBACK )
+  };
+  sendto( fd, _query, sizeof( _query ) - 1, 0, (struct sockaddr *)&responder, sizeof( responder ) );
+
+  uint8_t pkt[1500];
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  ssize_t n = poll( &pfd, 1, 1000 ) > 0 ? recv( fd, pkt, sizeof( pkt ), 0 ) : -1;
+  close( fd );
+  return n > 12;
+}
+
+static int _bench_plain( uint16_t port, int round )
+{
+  int fds[CONFIG_HKS_MAX_CLIENTS];
+  char body[4096];
+  int ok = 1;
+
+  _bench_lights( body, sizeof( body ), "\"ev\":true" );
+  for ( int i = 0; i < CONFIG_HKS_MAX_CLIENTS; i++ )
+  {
+    fds[i] = bench_connect( port );
+    ok &= _bench_request( fds[i], "PUT", "/characteristics", body ) == 204;
+  }
+
+  // one write of every light, an event to each of the others
+  char value[32];
+  snprintf( value, sizeof( value ), "\"value\":%d", round % 101 );
+  _bench_lights( body, sizeof( body ), value );
+  ok &= _bench_request( fds[0], "PUT", "/characteristics", body ) == 204;
+  for ( int i = 1; i < CONFIG_HKS_MAX_CLIENTS; i++ )
+    ok &= _bench_message( fds[i] ) == 200;
+
+  size_t len = snprintf( body, sizeof( body ), "/characteristics?id=" );
+  for ( int i = 0; i < BENCH_LIGHTS; i++ )
+    len += snprintf( body + len, sizeof( body ) - len, "%s%d.%d", i ? "," : "", 2 + i, 9 + i % 4 );
+  snprintf( body + len, sizeof( body ) - len, "&meta=1&perms=1&type=1&ev=1" );
+  ok &= _bench_request( fds[1], "GET", body, NULL ) == 200;
+
+  ok &= _bench_request( fds[2], "GET", "/accessories", NULL ) == 200;
+  ok &= _bench_request( fds[3], "GET", "/stats", NULL ) == 200;
+  ok &= _bench_request( fds[4], "GET", "/characteristics?id=2.9", NULL ) == 200;
+  ok &= write( fds[5], "GET / HTTP/2.0\r\n\r\n", 18 ) == 18 && _bench_message( fds[5] ) == 505;
+  ok &= _bench_query();
+
+  for ( int i = 0; i < CONFIG_HKS_MAX_CLIENTS; i++ )
+    close( fds[i] );
+  return ok;
+}
+
+static int _bench_secure( uint16_t port )
+{
+  bench_controller_t ctl;
+  bench_controller_init( &ctl, BENCH_CONTROLLER_ID );
+  uint64_t elapsed[3];
+  size_t len;
+
+  int fd = bench_connect( port );
+  int ok = bench_pair_setup( &ctl, fd, elapsed ) == 0;
+  close( fd );
+
+  for ( int i = 0; i < 4 && ok; i++ )
+  {
+    fd = bench_connect( port );
+    ok &= ( i % 2 ? bench_pair_resume( &ctl, fd, elapsed ) : bench_pair_verify( &ctl, fd, elapsed ) ) == 0;
+    ok &= bench_secure_get( &ctl, fd, "/accessories", &len ) == 200;
+    close( fd );
+  }
+
+  return ok;
+}
+
+static int _bench_headroom( hk_server_t *hks )
+{
+  // a sample taken after all of it
+  hks_watermarks_t w;
+  hk_server_get_watermarks( hks, &w );
+  uint32_t samples = w.samples;
+  for ( int i = 0; i < 100 && w.samples < samples + 2; i++ )
+  {
+    usleep( CONFIG_HKS_WATERMARK_PERIOD_MS * 1000 );
+    hk_server_get_watermarks( hks, &w );
+  }
+
+  printf( "  %-34s %8u of %u bytes left\n", "server task", w.server_stack, CONFIG_HKS_SERVER_TASK_STACK );
+  printf( "  %-34s %8u of %u bytes left\n", "crypto workers", w.worker_stack, CONFIG_HKS_CRYPTO_WORKER_STACK );
+  printf( "  %-34s %8u of %u bytes left\n", "server heap", w.server_heap, CONFIG_HKS_HEAP_SIZE );
+
+  int failed = _bench_report( "sampled", w.samples > samples );
+  failed |= _bench_report( "server task headroom", w.server_stack >= BENCH_HEADROOM );
+  failed |= _bench_report( "crypto worker headroom", w.worker_stack >= BENCH_HEADROOM );
+  return failed;
+}
+
+// a megabyte of frames, deeper than any stack the task could have been given
+#define BENCH_OVERFLOW_FRAMES 1024
+
+static void _bench_overflow( void *arg )
+{
+  uintptr_t depth = (uintptr_t)arg;
+  volatile uint8_t frame[1024];
+  frame[0] = 1;
+  if ( depth < BENCH_OVERFLOW_FRAMES )
+    _bench_overflow( (void *)( depth + frame[0] ) );
+  frame[1] = 0;
+}
+
+static int _bench_stop( hk_server_t *hks, uint16_t port )
+{
+  int fd = bench_connect( port );
+  usleep( 100000 );
+
+  int failed = _bench_report( "stopped from another task", hk_server_stop( hks ) == ESP_OK );
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  char c;
+  failed |= _bench_report( "client closed", fd >= 0 && poll( &pfd, 1, 1000 ) == 1 && read( fd, &c, 1 ) == 0 );
+  if ( fd >= 0 )
+    close( fd );
+
+  // waits for the task to leave the loop before the region goes
+  uint64_t t0 = bench_now_ns();
+  hk_server_free( hks );
+  printf( "  %-34s %7.1f ms\n", "free", ( bench_now_ns() - t0 ) / 1e6 );
+  return failed;
+}
+
+// a task overflowing its stack in a child, which has to die of SIGSEGV
+static int _bench_guard( void )
+{
+  pid_t pid = fork();
+  if ( pid == 0 )
+  {
+    xTaskCreatePinnedToCore( _bench_overflow, "overflow", 4096, NULL, 1, NULL, tskNO_AFFINITY );
+    sleep( 5 );
+    _exit( 0 );
+  }
+
+  int status = 0;
+  waitpid( pid, &status, 0 );
+  return _bench_report( "overflow faults on the guard page", WIFSIGNALED( status ) && WTERMSIG( status ) == SIGSEGV );
+}
+
+int main( int argc, char **argv )
+{
+  int rounds = argc > 1 ? atoi( argv[1] ) : 20;
+  uint16_t port = argc > 2 ? (uint16_t)atoi( argv[2] ) : 42641;
+  int failed = 0;
+
+  // forked before there are threads to leave behind
+  printf( "guard\n" );
+  failed |= _bench_guard();
+
+  static hks_db_t db;
+  if ( bench_bridge_init( &db ) )
+    return 1;
+
+  hk_server_t *hks = bench_server_create( port, &db );
+  hk_server_set_setup_code( hks, BENCH_SETUP_CODE );
+  hk_server_set_event_coalescing( hks, 0 );
+  if ( hk_server_start( hks ) != ESP_OK )
+  {
+    fprintf( stderr, "failed to start the server task\n" );
+    return 1;
+  }
+
+  printf( "deepest, %d rounds\n", rounds );
+  failed |= _bench_report( "started once only", hk_server_start( hks ) == ESP_ERR_INVALID_STATE );
+  int ok = 1;
+  for ( int i = 0; i < rounds && ok; i++ )
+    ok &= _bench_plain( port, i );
+  failed |= _bench_report( "events, batches, refusals, mDNS", ok );
+  failed |= _bench_report( "pairing and secured requests", _bench_secure( port ) );
+
+  printf( "headroom\n" );
+  failed |= _bench_headroom( hks );
+
+  printf( "stop\n" );
+  failed |= _bench_stop( hks, port );
+
+  if ( failed )
+    fprintf( stderr, "watermarks check failed\n" );
+
+  return failed;
+}
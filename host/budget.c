@@ -0,0 +1,25 @@
+// Prints the RAM a server takes with the Kconfig defaults, slice by slice;
+// the build runs it after linking. The sizes are this host's, with its
+// pointers and padding, not the ESP32's: only the device build checks its
+// own layout against CONFIG_HKS_RAM_BUDGET, failing when it goes over, and
+// logs hk_server_budget as the server starts.
+//
+//   hap_budget
+
+#include <stdio.h>
+#include "hk_server.h"
+
+int main( int argc, char **argv )
+{
+  hks_budget_t slices[16];
+  size_t count = sizeof( slices ) / sizeof( slices[0] );
+  size_t total = hk_server_budget( slices, &count );
+
+  printf( "hk_server RAM budget, %d clients, host-sized (%zu-bit pointers, the device differs)\n",
+    CONFIG_HKS_MAX_CLIENTS, sizeof( void * ) * 8 );
+  for ( size_t i = 0; i < count; i++ )
+    printf( "  %-10s %8zu\n", slices[i].name, slices[i].size );
+  printf( "  %-10s %8zu of %d\n", "total", total, CONFIG_HKS_RAM_BUDGET );
+
+  return 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Host port of the ESP-IDF error codes used by the server.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK                    0
+#define ESP_FAIL                  -1
+
+#define ESP_ERR_NO_MEM            0x101
+#define ESP_ERR_INVALID_ARG       0x102
+#define ESP_ERR_INVALID_STATE     0x103
+#define ESP_ERR_INVALID_SIZE      0x104
+#define ESP_ERR_NOT_FOUND         0x105
+#define ESP_ERR_NOT_SUPPORTED     0x106
+#define ESP_ERR_TIMEOUT           0x107
+#define ESP_ERR_INVALID_RESPONSE  0x108
+#define ESP_ERR_INVALID_CRC       0x109
+
+#define ESP_ERROR_CHECK( x ) do { esp_err_t rc = ( x ); assert( rc == ESP_OK ); (void)rc; } while ( 0 )
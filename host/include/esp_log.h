@@ -0,0 +1,22 @@
+#pragma once
+
+// Host port of esp_log, prints to stderr above a global level.
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+extern void esp_log_level_set( const char *tag, esp_log_level_t level );
+extern void esp_log_write( esp_log_level_t level, const char *tag, const char *format, ... )
+  __attribute__(( format( printf, 3, 4 ) ));
+
+#define ESP_LOGE( tag, format, ... ) esp_log_write( ESP_LOG_ERROR,   tag, "E %s: " format "\n", tag, ##__VA_ARGS__ )
+#define ESP_LOGW( tag, format, ... ) esp_log_write( ESP_LOG_WARN,    tag, "W %s: " format "\n", tag, ##__VA_ARGS__ )
+#define ESP_LOGI( tag, format, ... ) esp_log_write( ESP_LOG_INFO,    tag, "I %s: " format "\n", tag, ##__VA_ARGS__ )
+#define ESP_LOGD( tag, format, ... ) esp_log_write( ESP_LOG_DEBUG,   tag, "D %s: " format "\n", tag, ##__VA_ARGS__ )
+#define ESP_LOGV( tag, format, ... ) esp_log_write( ESP_LOG_VERBOSE, tag, "V %s: " format "\n", tag, ##__VA_ARGS__ )
@@ -0,0 +1,14 @@
+#pragma once
+
+// Host port of the esp_system calls the server makes.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// from the kernel's CSPRNG, the hardware RNG on the device
+extern void esp_fill_random( void *buf, size_t len );
+extern uint32_t esp_random( void );
+
+// the machine's free RAM, the lowest of it any call has seen, UINT32_MAX
+// once past what 32 bits hold
+extern uint32_t esp_get_minimum_free_heap_size( void );
@@ -0,0 +1,8 @@
+#pragma once
+
+// Host port of the esp_timer clock.
+
+#include <stdint.h>
+
+// monotonic microseconds since start
+extern int64_t esp_timer_get_time( void );
@@ -0,0 +1,27 @@
+#pragma once
+
+// Host port of the few esp_wifi calls the server makes.
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+typedef enum {
+  ESP_IF_WIFI_STA = 0,
+  ESP_IF_WIFI_AP,
+  ESP_IF_ETH,
+  ESP_IF_MAX
+} esp_interface_t;
+typedef esp_interface_t wifi_interface_t;
+
+typedef enum {
+  WIFI_MODE_NULL = 0,
+  WIFI_MODE_STA,
+  WIFI_MODE_AP,
+  WIFI_MODE_APSTA,
+  WIFI_MODE_MAX
+} wifi_mode_t;
+
+extern esp_err_t esp_wifi_get_mac( wifi_interface_t ifx, uint8_t mac[6] );
+extern esp_err_t esp_wifi_get_mode( wifi_mode_t *mode );
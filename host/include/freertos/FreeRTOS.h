@@ -0,0 +1,16 @@
+#pragma once
+
+// Host port of the FreeRTOS types the server uses.
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE             0
+#define pdTRUE              1
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+#define portMAX_DELAY       ( (TickType_t)0xffffffffUL )
+#define portTICK_PERIOD_MS  1
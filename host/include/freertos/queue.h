@@ -0,0 +1,14 @@
+#pragma once
+
+// Host port of FreeRTOS queues: fixed-size items copied in and out of a ring
+// under a pthread mutex, blocking on condition variables.
+
+#include <freertos/FreeRTOS.h>
+
+typedef void *QueueHandle_t;
+typedef QueueHandle_t xQueueHandle;
+
+extern QueueHandle_t xQueueCreate( UBaseType_t length, UBaseType_t item_size );
+extern void vQueueDelete( QueueHandle_t queue );
+extern BaseType_t xQueueSend( QueueHandle_t queue, const void *item, TickType_t ticks );
+extern BaseType_t xQueueReceive( QueueHandle_t queue, void *item, TickType_t ticks );
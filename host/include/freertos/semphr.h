@@ -0,0 +1,18 @@
+#pragma once
+
+// Host port of FreeRTOS mutexes on top of pthreads.
+
+#include <freertos/FreeRTOS.h>
+
+typedef void *SemaphoreHandle_t;
+typedef SemaphoreHandle_t xSemaphoreHandle;
+
+extern SemaphoreHandle_t xSemaphoreCreateMutex( void );
+extern void vSemaphoreDelete( SemaphoreHandle_t semaphore );
+extern BaseType_t xSemaphoreTake( SemaphoreHandle_t semaphore, TickType_t ticks );
+extern BaseType_t xSemaphoreGive( SemaphoreHandle_t semaphore );
+
+// the same mutex taken again by the task holding it, given as often
+extern SemaphoreHandle_t xSemaphoreCreateRecursiveMutex( void );
+extern BaseType_t xSemaphoreTakeRecursive( SemaphoreHandle_t semaphore, TickType_t ticks );
+extern BaseType_t xSemaphoreGiveRecursive( SemaphoreHandle_t semaphore );
@@ -0,0 +1,38 @@
+#pragma once
+
+// Host port of the FreeRTOS task calls the server uses, ticks are
+// milliseconds of CLOCK_MONOTONIC. Tasks are detached pthreads with stacks
+// of the size asked for behind a guard page; priorities and cores are
+// ignored.
+
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+
+#define tskNO_AFFINITY  0x7FFFFFFF
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)( void *arg );
+
+extern TickType_t xTaskGetTickCount( void );
+extern void vTaskDelay( TickType_t ticks );
+
+// host only: moves the tick count forward, for checks of timeouts longer
+// than a bench should wait
+extern void vHostTickAdvance( TickType_t ticks );
+
+extern BaseType_t xTaskCreatePinnedToCore(
+  TaskFunction_t task,
+  const char *name,
+  uint32_t stack_depth,
+  void *arg,
+  UBaseType_t priority,
+  TaskHandle_t *handle,
+  BaseType_t core
+);
+
+// only a task deleting itself (NULL) is supported
+extern void vTaskDelete( TaskHandle_t task );
+
+// Bytes of stack `task` (NULL for the caller) never touched so far, as on
+// ESP-IDF. 0 for threads that were not created as tasks.
+extern UBaseType_t uxTaskGetStackHighWaterMark( TaskHandle_t task );
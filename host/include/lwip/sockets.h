@@ -0,0 +1,37 @@
+#pragma once
+
+// Host port of the lwIP socket API, lwip_* map straight onto POSIX sockets.
+
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+
+#define lwip_socket       socket
+#define lwip_bind         bind
+#define lwip_listen       listen
+#define lwip_accept       accept
+#define lwip_connect      connect
+#define lwip_select       select
+#define lwip_read         read
+#define lwip_write        write
+#define lwip_writev       writev
+#define lwip_recv         recv
+#define lwip_recvfrom     recvfrom
+#define lwip_send( fd, data, len, flags ) send( fd, data, len, (flags) | MSG_NOSIGNAL )
+#define lwip_sendto( fd, data, len, flags, to, tolen ) sendto( fd, data, len, (flags) | MSG_NOSIGNAL, to, tolen )
+#define lwip_setsockopt   setsockopt
+#define lwip_getsockopt   getsockopt
+#define lwip_getsockname  getsockname
+#define lwip_shutdown     shutdown
+#define lwip_close        close
+#define lwip_fcntl        fcntl
+
+#ifndef __unused
+#define __unused __attribute__(( unused ))
+#endif
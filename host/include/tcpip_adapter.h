@@ -0,0 +1,32 @@
+#pragma once
+
+// Host port of the tcpip_adapter interface API, every interface is loopback.
+
+#include <stdint.h>
+#include <esp_err.h>
+
+typedef enum {
+  TCPIP_ADAPTER_IF_STA = 0,
+  TCPIP_ADAPTER_IF_AP,
+  TCPIP_ADAPTER_IF_ETH,
+  TCPIP_ADAPTER_IF_MAX
+} tcpip_adapter_if_t;
+
+typedef struct {
+  uint32_t addr; // network order
+} ip4_addr_t;
+
+typedef struct {
+  ip4_addr_t ip;
+  ip4_addr_t netmask;
+  ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+
+typedef struct {
+  uint32_t addr[4]; // network order
+} ip6_addr_t;
+
+extern esp_err_t tcpip_adapter_get_ip_info( tcpip_adapter_if_t tcpip_if, tcpip_adapter_ip_info_t *ip_info );
+
+// ::1 on the host
+extern esp_err_t tcpip_adapter_get_ip6_linklocal( tcpip_adapter_if_t tcpip_if, ip6_addr_t *if_ip6 );
@@ -0,0 +1,121 @@
+// Host entry point, serves the HAP port on every local address and keeps
+// pairings in a memory-mapped file. With a trace file, the server's trace
+// records are appended to it as they are, for hap_trace to print.
+//
+//   hap_server [port] [store] [trace]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <esp_log.h>
+#include "hk_server.h"
+
+#define HAP_HOST_PORT 42424
+#define HAP_HOST_NAME "HAP32 Host"
+#define HAP_HOST_SETUP_CODE "031-45-154"
+#define HAP_HOST_STORE "hap32.store"
+
+static const char *TAG = "hap-host";
+
+struct hap_trace_dump_s {
+  hk_server_t *hks;
+  FILE *file;
+};
+
+static void *_hap_trace_dump( void *arg )
+{
+  struct hap_trace_dump_s *dump = arg;
+  hks_trace_record_t records[64];
+  uint32_t cursor = 0, dropped = 0;
+
+  uint32_t header[2] = { HKS_TRACE_MAGIC, sizeof( hks_trace_record_t ) };
+  fwrite( header, sizeof( header ), 1, dump->file );
+
+  for (;;)
+  {
+    size_t count = sizeof( records ) / sizeof( records[0] );
+    if ( hk_server_read_trace( dump->hks, &cursor, records, &count, &dropped ) )
+      return NULL;
+
+    fwrite( records, sizeof( hks_trace_record_t ), count, dump->file );
+    fflush( dump->file );
+    if ( count < sizeof( records ) / sizeof( records[0] ) )
+      usleep( 100000 );
+  }
+}
+
+int main( int argc, char **argv )
+{
+  uint16_t port = argc > 1 ? (uint16_t)atoi( argv[1] ) : HAP_HOST_PORT;
+  const char *store_path = argc > 2 ? argv[2] : HAP_HOST_STORE;
+  const char *trace_path = argc > 3 ? argv[3] : NULL;
+
+  signal( SIGPIPE, SIG_IGN );
+
+  hk_server_t *hks = NULL;
+  esp_err_t err = hk_server_init( TCPIP_ADAPTER_IF_STA, &hks );
+  if ( err )
+  {
+    ESP_LOGE( TAG, "Failed starting HomeKit server: %d", err );
+    return 1;
+  }
+
+  // pairings from before the restart
+  hks_store_backend_t store;
+  err = hks_store_file_init( &store, store_path );
+  if ( !err )
+    err = hk_server_set_storage( hks, &store );
+  if ( err )
+  {
+    ESP_LOGE( TAG, "Failed opening HomeKit store %s: %d", store_path, err );
+    return 1;
+  }
+
+  err = hk_server_listen( hks, port );
+  if ( err )
+  {
+    ESP_LOGE( TAG, "Failed starting HomeKit server: %d", err );
+    return 1;
+  }
+
+  err = hk_server_set_name( hks, HAP_HOST_NAME );
+  if ( err )
+  {
+    ESP_LOGE( TAG, "Failed setting HomeKit server name: %d", err );
+    return 1;
+  }
+
+  err = hk_server_set_setup_code( hks, HAP_HOST_SETUP_CODE );
+  if ( err )
+  {
+    ESP_LOGE( TAG, "Failed setting HomeKit setup code: %d", err );
+    return 1;
+  }
+
+  static struct hap_trace_dump_s dump;
+  if ( trace_path != NULL )
+  {
+    dump.hks = hks;
+    dump.file = fopen( trace_path, "wb" );
+    if ( dump.file == NULL )
+    {
+      ESP_LOGE( TAG, "Failed opening trace file %s", trace_path );
+      return 1;
+    }
+
+    pthread_t thread;
+    pthread_create( &thread, NULL, _hap_trace_dump, &dump );
+    pthread_detach( thread );
+  }
+
+  ESP_LOGI( TAG, "Listening on port %u", port );
+
+  err = hk_server_run( hks );
+  ESP_LOGE( TAG, "Failed running HomeKit server: %d", err );
+
+  hk_server_free( hks );
+
+  return 1;
+}
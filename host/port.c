@@ -0,0 +1,429 @@
+// POSIX implementations of the ESP-IDF and FreeRTOS calls used by the server.
+
+#define _GNU_SOURCE // pthread_getattr_np
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <sys/sysinfo.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <tcpip_adapter.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+static esp_log_level_t _esp_log_level = ESP_LOG_INFO;
+
+void esp_log_level_set( const char *tag, esp_log_level_t level )
+{
+  (void)tag; // one global level is enough on the host
+  _esp_log_level = level;
+}
+
+void esp_log_write( esp_log_level_t level, const char *tag, const char *format, ... )
+{
+  (void)tag;
+  if ( level > _esp_log_level )
+    return;
+
+  va_list ap;
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+}
+
+esp_err_t esp_wifi_get_mac( wifi_interface_t ifx, uint8_t mac[6] )
+{
+  // locally administered address, last byte tells the interfaces apart
+  static const uint8_t host_mac[6] = { 0x02, 0x48, 0x4b, 0x53, 0x00, 0x00 };
+
+  if ( ifx >= ESP_IF_MAX )
+    return ESP_ERR_INVALID_ARG;
+
+  memcpy( mac, host_mac, 6 );
+  mac[5] = (uint8_t)ifx;
+
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode( wifi_mode_t *mode )
+{
+  *mode = WIFI_MODE_APSTA;
+  return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_get_ip_info( tcpip_adapter_if_t tcpip_if, tcpip_adapter_ip_info_t *ip_info )
+{
+  if ( tcpip_if >= TCPIP_ADAPTER_IF_MAX || ip_info == NULL )
+    return ESP_ERR_INVALID_ARG;
+
+  ip_info->ip.addr = htonl( INADDR_LOOPBACK );
+  ip_info->netmask.addr = htonl( 0xff000000 );
+  ip_info->gw.addr = 0;
+
+  return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_get_ip6_linklocal( tcpip_adapter_if_t tcpip_if, ip6_addr_t *if_ip6 )
+{
+  if ( tcpip_if >= TCPIP_ADAPTER_IF_MAX || if_ip6 == NULL )
+    return ESP_ERR_INVALID_ARG;
+
+  memcpy( if_ip6->addr, &in6addr_loopback, sizeof( if_ip6->addr ) );
+
+  return ESP_OK;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex( void )
+{
+  pthread_mutex_t *mutex = malloc( sizeof( pthread_mutex_t ) );
+  if ( mutex == NULL )
+    return NULL;
+
+  pthread_mutex_init( mutex, NULL );
+  return mutex;
+}
+
+void vSemaphoreDelete( SemaphoreHandle_t semaphore )
+{
+  if ( semaphore == NULL )
+    return;
+
+  pthread_mutex_destroy( (pthread_mutex_t *)semaphore );
+  free( semaphore );
+}
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t semaphore, TickType_t ticks )
+{
+  if ( ticks == portMAX_DELAY )
+    return pthread_mutex_lock( (pthread_mutex_t *)semaphore ) == 0 ? pdTRUE : pdFALSE;
+
+  for (;;)
+  {
+    if ( pthread_mutex_trylock( (pthread_mutex_t *)semaphore ) == 0 )
+      return pdTRUE;
+    if ( ticks-- == 0 )
+      return pdFALSE;
+    vTaskDelay( 1 );
+  }
+}
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t semaphore )
+{
+  return pthread_mutex_unlock( (pthread_mutex_t *)semaphore ) == 0 ? pdTRUE : pdFALSE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex( void )
+{
+  pthread_mutex_t *mutex = malloc( sizeof( pthread_mutex_t ) );
+  if ( mutex == NULL )
+    return NULL;
+
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init( &attr );
+  pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+  pthread_mutex_init( mutex, &attr );
+  pthread_mutexattr_destroy( &attr );
+  return mutex;
+}
+
+// a pthread mutex of the recursive type counts for itself
+BaseType_t xSemaphoreTakeRecursive( SemaphoreHandle_t semaphore, TickType_t ticks )
+{
+  return xSemaphoreTake( semaphore, ticks );
+}
+
+BaseType_t xSemaphoreGiveRecursive( SemaphoreHandle_t semaphore )
+{
+  return xSemaphoreGive( semaphore );
+}
+
+struct _host_queue_s {
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  UBaseType_t length;
+  UBaseType_t item_size;
+  UBaseType_t head;
+  UBaseType_t count;
+  uint8_t items[];
+};
+
+static int _host_queue_wait( pthread_cond_t *cond, pthread_mutex_t *mutex, TickType_t ticks, const struct timespec *deadline )
+{
+  if ( ticks == portMAX_DELAY )
+    return pthread_cond_wait( cond, mutex );
+  return pthread_cond_timedwait( cond, mutex, deadline );
+}
+
+static void _host_queue_deadline( TickType_t ticks, struct timespec *deadline )
+{
+  clock_gettime( CLOCK_REALTIME, deadline );
+  deadline->tv_sec += ticks / 1000;
+  deadline->tv_nsec += (long)( ticks % 1000 ) * 1000000;
+  if ( deadline->tv_nsec >= 1000000000 )
+  {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000;
+  }
+}
+
+QueueHandle_t xQueueCreate( UBaseType_t length, UBaseType_t item_size )
+{
+  struct _host_queue_s *q = malloc( sizeof( struct _host_queue_s ) + length * item_size );
+  if ( q == NULL )
+    return NULL;
+
+  pthread_mutex_init( &q->mutex, NULL );
+  pthread_cond_init( &q->not_empty, NULL );
+  pthread_cond_init( &q->not_full, NULL );
+  q->length = length;
+  q->item_size = item_size;
+  q->head = 0;
+  q->count = 0;
+  return q;
+}
+
+void vQueueDelete( QueueHandle_t queue )
+{
+  struct _host_queue_s *q = queue;
+  if ( q == NULL )
+    return;
+
+  pthread_cond_destroy( &q->not_full );
+  pthread_cond_destroy( &q->not_empty );
+  pthread_mutex_destroy( &q->mutex );
+  free( q );
+}
+
+BaseType_t xQueueSend( QueueHandle_t queue, const void *item, TickType_t ticks )
+{
+  struct _host_queue_s *q = queue;
+  struct timespec deadline;
+  _host_queue_deadline( ticks, &deadline );
+
+  pthread_mutex_lock( &q->mutex );
+  while ( q->count == q->length )
+  {
+    if ( ticks == 0 || _host_queue_wait( &q->not_full, &q->mutex, ticks, &deadline ) == ETIMEDOUT )
+    {
+      pthread_mutex_unlock( &q->mutex );
+      return pdFAIL;
+    }
+  }
+
+  memcpy( q->items + ( ( q->head + q->count ) % q->length ) * q->item_size, item, q->item_size );
+  q->count++;
+  pthread_cond_signal( &q->not_empty );
+  pthread_mutex_unlock( &q->mutex );
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive( QueueHandle_t queue, void *item, TickType_t ticks )
+{
+  struct _host_queue_s *q = queue;
+  struct timespec deadline;
+  _host_queue_deadline( ticks, &deadline );
+
+  pthread_mutex_lock( &q->mutex );
+  while ( q->count == 0 )
+  {
+    if ( ticks == 0 || _host_queue_wait( &q->not_empty, &q->mutex, ticks, &deadline ) == ETIMEDOUT )
+    {
+      pthread_mutex_unlock( &q->mutex );
+      return pdFALSE;
+    }
+  }
+
+  memcpy( item, q->items + q->head * q->item_size, q->item_size );
+  q->head = ( q->head + 1 ) % q->length;
+  q->count--;
+  pthread_cond_signal( &q->not_full );
+  pthread_mutex_unlock( &q->mutex );
+  return pdTRUE;
+}
+
+// glibc keeps the thread's TLS and its own start-up frames at the top of the
+// stack, on top of what the task asked for
+#define _HOST_STACK_RESERVE  16384
+#define _HOST_STACK_PAINT    0xA5
+
+// Task stacks are stack_depth bytes plus the reserve with a guard page
+// below, so an overflow faults instead of running into the heap. Like
+// FreeRTOS the stack is painted when the task starts; the bytes still
+// painted from the bottom up are the high water mark.
+struct _host_task_s {
+  TaskFunction_t task;
+  void *arg;
+  uint32_t depth;
+  const uint8_t *stack; // lowest byte above the guard page
+  size_t size;          // painted from `stack` up
+};
+
+static __thread struct _host_task_s *_host_task;
+
+static void _host_task_paint( struct _host_task_s *t )
+{
+  pthread_attr_t attr;
+  void *low;
+  size_t size;
+  pthread_getattr_np( pthread_self(), &attr );
+  pthread_attr_getstack( &attr, &low, &size );
+  pthread_attr_destroy( &attr );
+
+  // up to a little below this frame, everything under it is unused
+  uint8_t *top = (uint8_t *)__builtin_frame_address( 0 ) - 512;
+  memset( low, _HOST_STACK_PAINT, top - (uint8_t *)low );
+  t->stack = low;
+  t->size = top - (uint8_t *)low;
+}
+
+static void *_host_task_thread( void *arg )
+{
+  struct _host_task_s *t = arg;
+  _host_task = t;
+  _host_task_paint( t );
+
+  // vTaskDelete( NULL ) leaves through pthread_exit
+  pthread_cleanup_push( free, t );
+  t->task( t->arg );
+  pthread_cleanup_pop( 1 );
+  return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(
+  TaskFunction_t task,
+  const char *name,
+  uint32_t stack_depth,
+  void *arg,
+  UBaseType_t priority,
+  TaskHandle_t *handle,
+  BaseType_t core
+)
+{
+  struct _host_task_s *start = calloc( 1, sizeof( struct _host_task_s ) );
+  if ( start == NULL )
+    return pdFAIL;
+
+  start->task = task;
+  start->arg = arg;
+  start->depth = stack_depth;
+
+  size_t page = sysconf( _SC_PAGESIZE );
+  pthread_attr_t attr;
+  pthread_attr_init( &attr );
+  pthread_attr_setstacksize( &attr, ( stack_depth + _HOST_STACK_RESERVE + page - 1 ) / page * page );
+  pthread_attr_setguardsize( &attr, page );
+  pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+
+  pthread_t thread;
+  int err = pthread_create( &thread, &attr, _host_task_thread, start );
+  pthread_attr_destroy( &attr );
+  if ( err )
+  {
+    free( start );
+    return pdFAIL;
+  }
+
+  if ( handle != NULL )
+    *handle = (TaskHandle_t)start;
+  return pdPASS;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark( TaskHandle_t task )
+{
+  const struct _host_task_s *t = task != NULL ? task : _host_task;
+  if ( t == NULL || t->stack == NULL )
+    return 0;
+
+  size_t painted = 0;
+  while ( painted < t->size && t->stack[painted] == _HOST_STACK_PAINT )
+    painted++;
+
+  // the reserve counts as used, what is left is of the depth asked for
+  size_t reserve = t->size > t->depth ? t->size - t->depth : 0;
+  return painted > reserve ? painted - reserve : 0;
+}
+
+void vTaskDelete( TaskHandle_t task )
+{
+  if ( task == NULL )
+    pthread_exit( NULL );
+}
+
+static TickType_t _host_tick_offset;
+
+TickType_t xTaskGetTickCount( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  TickType_t offset = __atomic_load_n( &_host_tick_offset, __ATOMIC_RELAXED );
+  return (TickType_t)( (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 ) + offset;
+}
+
+void vHostTickAdvance( TickType_t ticks )
+{
+  __atomic_add_fetch( &_host_tick_offset, ticks, __ATOMIC_RELAXED );
+}
+
+int64_t esp_timer_get_time( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void vTaskDelay( TickType_t ticks )
+{
+  struct timespec ts = {
+    .tv_sec = ticks / 1000,
+    .tv_nsec = (long)( ticks % 1000 ) * 1000000
+  };
+  nanosleep( &ts, NULL );
+}
+
+void esp_fill_random( void *buf, size_t len )
+{
+  uint8_t *p = buf;
+  while ( len > 0 )
+  {
+    ssize_t n = getrandom( p, len, 0 );
+    if ( n <= 0 )
+      continue; // interrupted, the pool never runs dry once seeded
+    p += n;
+    len -= n;
+  }
+}
+
+uint32_t esp_random( void )
+{
+  uint32_t v;
+  esp_fill_random( &v, sizeof( v ) );
+  return v;
+}
+
+uint32_t esp_get_minimum_free_heap_size( void )
+{
+  static uint32_t lowest = UINT32_MAX;
+
+  struct sysinfo info;
+  if ( sysinfo( &info ) == 0 )
+  {
+    uint64_t free = (uint64_t)info.freeram * info.mem_unit;
+    uint32_t now = free < UINT32_MAX ? (uint32_t)free : UINT32_MAX;
+    for ( uint32_t seen = __atomic_load_n( &lowest, __ATOMIC_RELAXED ); now < seen; )
+      if ( __atomic_compare_exchange_n( &lowest, &seen, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        break;
+  }
+
+  return __atomic_load_n( &lowest, __ATOMIC_RELAXED );
+}
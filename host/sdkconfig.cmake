@@ -0,0 +1,59 @@
+# sdkconfig.h for the host build, made the way the IDF makes it for the
+# device: every default in main/Kconfig.projbuild, then the CONFIG_NAME=value
+# lines of an sdkconfig.defaults on top. Bools that are n are left out.
+#
+#   hks_sdkconfig( <output> [<sdkconfig.defaults>] )
+
+function( hks_sdkconfig output )
+  set( kconfig ${PROJECT_SOURCE_DIR}/main/Kconfig.projbuild )
+  set_property( DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${kconfig} ${ARGN} )
+
+  set( names "" )
+  set( name "" )
+  file( STRINGS ${kconfig} lines )
+  foreach( line IN LISTS lines )
+    if( line MATCHES "^config[ \t]+([A-Za-z0-9_]+)" )
+      set( name ${CMAKE_MATCH_1} )
+      set( type "" )
+    elseif( line MATCHES "^[ \t]*help" OR line MATCHES "^(menu|endmenu)" )
+      set( name "" ) # help text may mention a default
+    elseif( name AND line MATCHES "^[ \t]*(bool|int|string)" )
+      set( type ${CMAKE_MATCH_1} )
+    elseif( name AND line MATCHES "^[ \t]*default[ \t]+(.+)$" )
+      string( STRIP "${CMAKE_MATCH_1}" value )
+      list( APPEND names ${name} )
+      set( value_${name} "${value}" )
+      set( type_${name} ${type} )
+      set( name "" )
+    endif()
+  endforeach()
+
+  foreach( defaults ${ARGN} )
+    file( STRINGS ${defaults} lines )
+    foreach( line IN LISTS lines )
+      if( line MATCHES "^CONFIG_([A-Za-z0-9_]+)=(.*)$" )
+        if( NOT DEFINED value_${CMAKE_MATCH_1} )
+          message( FATAL_ERROR "${defaults}: no CONFIG_${CMAKE_MATCH_1} in ${kconfig}" )
+        endif()
+        set( value_${CMAKE_MATCH_1} "${CMAKE_MATCH_2}" )
+      elseif( line MATCHES "^# CONFIG_([A-Za-z0-9_]+) is not set" )
+        set( value_${CMAKE_MATCH_1} n )
+      endif()
+    endforeach()
+  endforeach()
+
+  set( header "#pragma once\n\n// Generated from main/Kconfig.projbuild by host/sdkconfig.cmake, do not edit.\n\n" )
+  foreach( name IN LISTS names )
+    if( type_${name} STREQUAL "bool" )
+      if( value_${name} STREQUAL "y" )
+        string( APPEND header "#define CONFIG_${name} 1\n" )
+      endif()
+    else()
+      string( APPEND header "#define CONFIG_${name} ${value_${name}}\n" )
+    endif()
+  endforeach()
+
+  # rewritten only when it changes, so a reconfigure rebuilds nothing
+  file( WRITE ${output}.tmp "${header}" )
+  configure_file( ${output}.tmp ${output} COPYONLY )
+endfunction()
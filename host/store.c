@@ -0,0 +1,83 @@
+// hks_store on the host: both slots in one file, mapped shared. A write is in
+// the page cache as soon as it is copied, so it outlives the process being
+// killed; msync makes it outlive the machine too.
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hks_store.h"
+
+#define _HOST_STORE_SIZE ( HKS_STORE_SLOTS * sizeof( hks_store_image_t ) )
+
+struct _host_store_s {
+  int fd;
+  uint8_t *map;
+};
+
+static esp_err_t _host_store_read( void *ctx, uint8_t slot, void *data, size_t len );
+static esp_err_t _host_store_write( void *ctx, uint8_t slot, const void *data, size_t len );
+static void _host_store_close( void *ctx );
+
+esp_err_t hks_store_file_init( hks_store_backend_t *backend, const char *name )
+{
+  struct _host_store_s *store = (struct _host_store_s *)calloc( 1, sizeof( struct _host_store_s ) );
+  if ( store == NULL )
+    return ESP_ERR_NO_MEM;
+
+  // a new file reads as zeros, which is no image
+  struct stat st;
+  store->fd = open( name, O_RDWR | O_CREAT, 0600 );
+  if ( store->fd < 0 || fstat( store->fd, &st ) ||
+       ( st.st_size != _HOST_STORE_SIZE && ftruncate( store->fd, _HOST_STORE_SIZE ) ) )
+  {
+    if ( store->fd >= 0 )
+      close( store->fd );
+    free( store );
+    return ESP_FAIL;
+  }
+
+  store->map = (uint8_t *)mmap( NULL, _HOST_STORE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0 );
+  if ( store->map == MAP_FAILED )
+  {
+    close( store->fd );
+    free( store );
+    return ESP_FAIL;
+  }
+
+  backend->read = _host_store_read;
+  backend->write = _host_store_write;
+  backend->close = _host_store_close;
+  backend->ctx = store;
+  return ESP_OK;
+}
+
+esp_err_t _host_store_read( void *ctx, uint8_t slot, void *data, size_t len )
+{
+  struct _host_store_s *store = (struct _host_store_s *)ctx;
+  if ( len != sizeof( hks_store_image_t ) || slot >= HKS_STORE_SLOTS )
+    return ESP_ERR_INVALID_SIZE;
+
+  memcpy( data, store->map + slot * len, len );
+  return ESP_OK;
+}
+
+esp_err_t _host_store_write( void *ctx, uint8_t slot, const void *data, size_t len )
+{
+  struct _host_store_s *store = (struct _host_store_s *)ctx;
+  if ( len != sizeof( hks_store_image_t ) || slot >= HKS_STORE_SLOTS )
+    return ESP_ERR_INVALID_SIZE;
+
+  memcpy( store->map + slot * len, data, len );
+  return msync( store->map, _HOST_STORE_SIZE, MS_SYNC ) ? ESP_FAIL : ESP_OK;
+}
+
+void _host_store_close( void *ctx )
+{
+  struct _host_store_s *store = (struct _host_store_s *)ctx;
+  munmap( store->map, _HOST_STORE_SIZE );
+  close( store->fd );
+  free( store );
+}
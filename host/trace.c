@@ -0,0 +1,43 @@
+// Prints a trace file written by hap_server, one line per record.
+//
+//   hap_trace <trace>
+
+#include <stdio.h>
+#include <stdint.h>
+#include "hks_trace.h"
+
+int main( int argc, char **argv )
+{
+  if ( argc < 2 )
+  {
+    fprintf( stderr, "usage: %s <trace>\n", argv[0] );
+    return 2;
+  }
+
+  FILE *file = fopen( argv[1], "rb" );
+  if ( file == NULL )
+  {
+    perror( argv[1] );
+    return 1;
+  }
+
+  // written by the same build, the records are as they were in memory
+  uint32_t header[2];
+  if ( fread( header, sizeof( header ), 1, file ) != 1 ||
+       header[0] != HKS_TRACE_MAGIC || header[1] != sizeof( hks_trace_record_t ) )
+  {
+    fprintf( stderr, "%s: not a trace of this build\n", argv[1] );
+    return 1;
+  }
+
+  hks_trace_record_t record;
+  char line[128];
+  while ( fread( &record, sizeof( record ), 1, file ) == 1 )
+  {
+    hks_trace_format( &record, line, sizeof( line ) );
+    printf( "%s\n", line );
+  }
+
+  fclose( file );
+  return 0;
+}
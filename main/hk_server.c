@@ -1,43 +1,156 @@
 #include "hk_server.h"
 #include <string.h>
-#include <mdns.h>
+#include <stdlib.h>
+#include <errno.h>
 #include <lwip/sockets.h>
 #include <lwip/netdb.h>
 #include <esp_log.h>
+#include <esp_system.h>
 #include <esp_wifi.h>
 #include "hks_utils.h"
+#include "hks_arena.h"
 #include "hks_client.h"
 #include "hks_http.h"
 #include "hks_txt.h"
+#include "hks_mdns.h"
+#include "hks_db.h"
+#include "hks_characteristics.h"
+#include "hks_events.h"
+#include "hks_resume.h"
 
 static const char *TAG = "hk-server";
 
+// an idle timer per client plus room for server-wide timers
+#define HKS_SERVER_TIMER_MAX ( HKS_CLIENT_MAX + 8 )
+
+// reads from one client per wakeup while each fills its receive buffer
+#define HKS_SERVER_READ_BURST 4
+
+// a wildcard listener per address family, between them every interface
+#if CONFIG_HKS_IPV6
+#define HKS_SERVER_LISTENERS 2
+#else
+#define HKS_SERVER_LISTENERS 1
+#endif
+
 struct hk_server_s
 {
-  tcpip_adapter_if_t tcpip_if;
   hks_txt_t txt;
-  mdns_server_t *mdns;
-  int fd;
-  xSemaphoreHandle lock;
-
-  hks_client_t *clients;
+  hks_mdns_t mdns;
+  hks_timer_t mdns_timer;
+  hks_db_t *db;
+  hks_characteristics_batch_t batch; // of the request being handled
+  hks_events_t events;
+  hks_pairings_t pairings;
+  hks_resume_t resume;
+  hks_worker_t worker;
+  hks_store_t store;       // backend.write is NULL without one
+  hks_timer_t store_timer; // commits what changed since the last one
+#if CONFIG_HKS_STATS
+  hks_stats_t stats;
+#endif
+#if HKS_TRACE_LEVEL > HKS_TRACE_LEVEL_NONE
+  hks_trace_t trace;
+#endif
+  int listeners[HKS_SERVER_LISTENERS];
+  uint8_t listener_count; // open, none before hk_server_listen
+  xSemaphoreHandle lock;  // see _hk_server_lock
+
+  hks_client_pool_t clients;
+
+  hks_timers_t timers;
+  hks_timer_t *timer_heap[HKS_SERVER_TIMER_MAX];
+
+  uint8_t looping;             // hk_server_run is in the loop
+  uint8_t task_running;        // hk_server_start's task has the loop
+  hks_timer_t watermark_timer;
+  hks_watermarks_t watermarks; // the loop writes, any task reads
+
+  hks_heap_t heap; // bodies, events, the /accessories document, pair exchanges
+  void *region;    // from hk_server_init, NULL if the caller's
 };
 
-static const char *_HK_HAP_SERVICE = "_hap";
-static const char *_HK_HAP_PROTO   = "_tcp";
+// the heap follows the server in its region
+#define HKS_SERVER_REGION_SIZE ( HKS_ARENA_ROUND( sizeof( hk_server_t ) ) + CONFIG_HKS_HEAP_SIZE )
+
+_Static_assert( HKS_SERVER_REGION_SIZE <= CONFIG_HKS_RAM_BUDGET,
+  "the server takes more than CONFIG_HKS_RAM_BUDGET with this sdkconfig" );
+
+#define HKS_SERVER_SLICE( name, member ) { name, sizeof( ( (hk_server_t *)0 )->member ) }
+
+// the larger parts of hk_server_t, what is left of it is counted as "server"
+static const hks_budget_t _hk_server_slices[] = {
+  HKS_SERVER_SLICE( "clients", clients ),
+  HKS_SERVER_SLICE( "txt", txt ),
+  HKS_SERVER_SLICE( "mdns", mdns ),
+  HKS_SERVER_SLICE( "pairings", pairings ),
+  HKS_SERVER_SLICE( "resume", resume ),
+  HKS_SERVER_SLICE( "events", events ),
+  HKS_SERVER_SLICE( "batch", batch ),
+#if CONFIG_HKS_STATS
+  HKS_SERVER_SLICE( "stats", stats ),
+#endif
+#if HKS_TRACE_LEVEL > HKS_TRACE_LEVEL_NONE
+  HKS_SERVER_SLICE( "trace", trace ),
+#endif
+};
 
-static esp_err_t _hk_server_init_txt( hks_txt_t *txt );
-static esp_err_t _hk_server_update_txt( hk_server_t *hks );
-static esp_err_t _hk_server_bind( hk_server_t *hks, uint16_t port );
-static esp_err_t _hk_server_accept( hk_server_t *hks );
-static esp_err_t _hk_server_close_client(
-  hk_server_t *hks,
-  hks_client_t *client,
-  hks_client_t *previous
-);
-static esp_err_t _hk_server_read_client( hks_client_t *c );
+#define HKS_SERVER_SLICES ( sizeof( _hk_server_slices ) / sizeof( _hk_server_slices[0] ) )
+
+#define HKS_CLIENT_IDLE_TIMEOUT_MS ( CONFIG_HKS_CLIENT_IDLE_TIMEOUT * 1000 )
+
+static esp_err_t _hk_server_init_txt( hk_server_t *hks );
+static void _hk_server_update_txt( hk_server_t *hks );
+static void _hk_server_mdns_schedule( hk_server_t *hks );
+static void _hk_server_mdns_announce( hks_timer_t *timer, uint32_t now, void *ctx );
+static esp_err_t _hk_server_bind( hk_server_t *hks, int family, uint16_t port );
+static esp_err_t _hk_server_set_nonblocking( int fd );
+static esp_err_t _hk_server_accept( hk_server_t *hks, int listener );
+static esp_err_t _hk_server_close_client( hk_server_t *hks, hks_client_t *client );
+static esp_err_t _hk_server_read_client( hk_server_t *hks, hks_client_t *c );
+static esp_err_t _hk_server_process_client( hk_server_t *hks, hks_client_t *c );
+static esp_err_t _hk_server_decrypt_client( hk_server_t *hks, hks_client_t *c );
+static esp_err_t _hk_server_flush_client( hk_server_t *hks, hks_client_t *c );
+static esp_err_t _hk_server_handle_request( hk_server_t *hks, hks_client_t *c, hks_http_request_t *request );
+static esp_err_t _hk_server_get_accessories( hk_server_t *hks, hks_client_t *c );
+static esp_err_t _hk_server_characteristics( hk_server_t *hks, hks_client_t *c, hks_http_request_t *request, int put );
+#if CONFIG_HKS_STATS_ENDPOINT
+static esp_err_t _hk_server_stats( hk_server_t *hks, hks_client_t *c );
+#endif
+static esp_err_t _hk_server_pair( hk_server_t *hks, hks_client_t *c, hks_http_request_t *request, hks_pair_method_t method );
+static esp_err_t _hk_server_pair_respond( hk_server_t *hks, hks_client_t *c, hks_pair_t *pair );
+static void _hk_server_pair_work( void *arg );
+static void _hk_server_pair_done( hk_server_t *hks );
+static uint32_t _hk_server_configuration( hk_server_t *hks );
+static void _hk_server_store_schedule( hk_server_t *hks );
+static void _hk_server_store_commit( hks_timer_t *timer, uint32_t now, void *ctx );
+static int _hk_server_request_is( hks_http_request_t *request, const char *method, const char *path );
+static void _hk_server_client_idle( hks_timer_t *timer, uint32_t now, void *ctx );
+static void _hk_server_lock( hk_server_t *hks );
+static void _hk_server_unlock( hk_server_t *hks );
+static esp_err_t _hk_server_dispatch( hk_server_t *hks, int result, fd_set *fds, fd_set *wfds );
+static void _hk_server_task( void *arg );
+static void _hk_server_sample_watermarks( hks_timer_t *timer, uint32_t now, void *ctx );
 
 esp_err_t hk_server_init( tcpip_adapter_if_t tcpip_if, hk_server_t **hks )
+{
+  // the one allocation, all of it up front
+  void *region = malloc( HKS_SERVER_REGION_SIZE );
+  if ( region == NULL )
+    return ESP_ERR_NO_MEM;
+
+  esp_err_t err = hk_server_init_static( tcpip_if, region, HKS_SERVER_REGION_SIZE, hks );
+  if ( err )
+  {
+    free( region );
+    return err;
+  }
+
+  ( *hks )->region = region;
+  return ESP_OK;
+}
+
+esp_err_t hk_server_init_static( tcpip_adapter_if_t tcpip_if, void *region, size_t size, hk_server_t **hks )
 {
   esp_err_t err = ESP_OK;
 
@@ -45,53 +158,70 @@ esp_err_t hk_server_init( tcpip_adapter_if_t tcpip_if, hk_server_t **hks )
   if ( err )
     return err;
 
-  hk_server_t *server = (hk_server_t *)malloc( sizeof( hk_server_t ) );
-  if ( !server )
-    return ESP_ERR_NO_MEM;
-
-  server->tcpip_if = tcpip_if;
-  server->mdns = NULL;
-  server->fd = -1;
-  server->clients = NULL;
+  hks_arena_t arena;
+  hks_arena_init( &arena, region, size );
+  hk_server_t *server = (hk_server_t *)hks_arena_alloc( &arena, sizeof( hk_server_t ) );
+  void *heap = hks_arena_alloc( &arena, CONFIG_HKS_HEAP_SIZE );
+  if ( server == NULL || heap == NULL )
+    return ESP_ERR_INVALID_SIZE;
+
+  server->region = NULL;
+  hks_heap_init( &server->heap, heap, CONFIG_HKS_HEAP_SIZE );
+  server->batch.heap = &server->heap;
+
+  server->listener_count = 0;
+  server->db = NULL;
+  hks_client_pool_init( &server->clients );
+  hks_timers_init( &server->timers, server->timer_heap, HKS_SERVER_TIMER_MAX );
+  hks_events_init( &server->events, &server->clients, &server->timers, &server->heap );
+  hks_resume_init( &server->resume );
+  memset( &server->store, 0, sizeof( hks_store_t ) );
+  hks_timer_init( &server->store_timer, _hk_server_store_commit, NULL );
+  server->looping = 0;
+  server->task_running = 0;
+  hks_timer_init( &server->watermark_timer, _hk_server_sample_watermarks, NULL );
+  memset( &server->watermarks, 0, sizeof( hks_watermarks_t ) );
+#if CONFIG_HKS_STATS
+  hks_stats_init( &server->stats );
+#endif
+#if HKS_TRACE_LEVEL > HKS_TRACE_LEVEL_NONE
+  hks_trace_init( &server->trace );
+#endif
 
   err = hks_txt_init( &server->txt );
   if ( err )
-  {
-    free( server );
     return err;
-  }
 
-  err = _hk_server_init_txt( &server->txt );
+  hks_mdns_init( &server->mdns, tcpip_if, &server->txt );
+  hks_timer_init( &server->mdns_timer, _hk_server_mdns_announce, &server->mdns );
+
+  err = _hk_server_init_txt( server );
   if ( err )
-  {
-    hks_txt_free( &server->txt );
-    free( server );
     return err;
-  }
 
-  err = mdns_init( TCPIP_ADAPTER_IF_STA, &server->mdns );
+  // the workers are running from here on, every failure below stops them
+  // before the caller frees the region under them
+  err = hks_worker_init( &server->worker );
   if ( err )
-  {
-    hks_txt_free( &server->txt );
-    free( server );
     return err;
-  }
 
-  server->lock = xSemaphoreCreateMutex();
+  server->lock = xSemaphoreCreateRecursiveMutex();
   if ( !server->lock )
   {
-    mdns_free( server->mdns );
-    hks_txt_free( &server->txt );
-    free( server );
-    return ESP_ERR_NO_MEM;
+    err = ESP_ERR_NO_MEM;
+    goto fail;
   }
 
   *hks = server;
 
   return ESP_OK;
+
+fail:
+  hks_worker_free( &server->worker );
+  return err;
 }
 
-esp_err_t _hk_server_init_txt( hks_txt_t *txt )
+esp_err_t _hk_server_init_txt( hk_server_t *hks )
 {
   uint8_t sta_mac[6];
   esp_err_t err = ESP_OK;
@@ -100,7 +230,24 @@ esp_err_t _hk_server_init_txt( hks_txt_t *txt )
   if ( err )
     return err;
 
-  err = hks_txt_set_device_id( txt, sta_mac );
+  err = hks_txt_set_device_id( &hks->txt, sta_mac );
+  if ( err )
+    return err;
+
+  // controllers know the accessory by the same id
+  err = hks_pairings_init( &hks->pairings, sta_mac );
+  if ( err )
+    return err;
+
+  // the host name doubles as the instance name until one is set
+  char hostname[20];
+  snprintf( hostname, sizeof( hostname ), "hap32-%02x%02x%02x", sta_mac[3], sta_mac[4], sta_mac[5] );
+
+  err = hks_mdns_set_hostname( &hks->mdns, hostname );
+  if ( err )
+    return err;
+
+  err = hks_mdns_set_instance( &hks->mdns, hostname );
   if ( err )
     return err;
 
@@ -114,281 +261,1140 @@ void hk_server_free( hk_server_t *hks )
 
   hk_server_stop( hks );
 
-  hks_txt_free( &hks->txt );
-  mdns_free( hks->mdns );
+  // the loop sees the listeners gone at its next wakeup and leaves
+  while ( __atomic_load_n( &hks->looping, __ATOMIC_SEQ_CST ) ||
+          __atomic_load_n( &hks->task_running, __ATOMIC_SEQ_CST ) )
+    vTaskDelay( 1 );
+
+  // exchanges handed to the workers are theirs until they come back
+  hks_worker_stop( &hks->worker );
+  hks_job_t *job;
+  while ( ( job = hks_worker_done( &hks->worker ) ) != NULL )
+    hks_pair_free( &hks->pairings, (hks_pair_t *)job->arg );
+  hks_worker_free( &hks->worker );
+
   vSemaphoreDelete( hks->lock );
 
-  free( hks );
+  if ( hks->store.backend.write != NULL )
+    hks_store_close( &hks->store );
+
+  // the document outlives the server, but not in its heap
+  if ( hks->db != NULL )
+    hks_db_set_heap( hks->db, NULL );
+
+  // resumable session secrets
+  hks_resume_init( &hks->resume );
+  free( hks->region );
+}
+
+size_t hk_server_budget( hks_budget_t *slices, size_t *count )
+{
+  size_t n = 0;
+  size_t max = slices != NULL ? *count : 0;
+  size_t rest = HKS_ARENA_ROUND( sizeof( hk_server_t ) );
+
+  for ( size_t i = 0; i < HKS_SERVER_SLICES; i++ )
+  {
+    rest -= _hk_server_slices[i].size;
+    if ( n < max )
+      slices[n++] = _hk_server_slices[i];
+  }
+
+  const hks_budget_t tail[] = { { "server", rest }, { "heap", CONFIG_HKS_HEAP_SIZE } };
+  for ( size_t i = 0; i < 2 && n < max; i++ )
+    slices[n++] = tail[i];
+
+  if ( count != NULL )
+    *count = n;
+  return HKS_SERVER_REGION_SIZE;
 }
 
 esp_err_t hk_server_listen( hk_server_t *hks, uint16_t port )
 {
   esp_err_t err = ESP_OK;
-  if ( hks == NULL || hks->fd >= 0 )
+  if ( hks == NULL )
     return ESP_ERR_INVALID_STATE;
 
-  int fd = lwip_socket( AF_INET, SOCK_STREAM, 0 );
-  if ( fd < 0 )
-    return ESP_FAIL;
+  _hk_server_lock( hks );
+  if ( hks->listener_count > 0 )
+  {
+    _hk_server_unlock( hks );
+    return ESP_ERR_INVALID_STATE;
+  }
 
-  hks->fd = fd;
+  err = _hk_server_bind( hks, AF_INET, port );
 
-  err = _hk_server_bind( hks, port );
-  if ( err )
-    return err;
+#if CONFIG_HKS_IPV6
+  // welcome but not required, the stack may be built without it
+  if ( !err )
+    _hk_server_bind( hks, AF_INET6, port );
+#endif
 
-  err = mdns_service_add( hks->mdns, _HK_HAP_SERVICE, _HK_HAP_PROTO, port );
-  if ( err )
-    return err;
+  if ( !err )
+    err = hks_mdns_start( &hks->mdns, port );
 
-  err = _hk_server_update_txt( hks );
+  // not listening unless advertised, a later listen starts over
   if ( err )
-    return err;
+  {
+    for ( int i = 0; i < hks->listener_count; i++ )
+      lwip_close( hks->listeners[i] );
+    hks->listener_count = 0;
+  }
+  else
+  {
+    _hk_server_mdns_schedule( hks );
+
+    // the first sample as soon as the loop runs
+    hks_timer_start( &hks->timers, &hks->watermark_timer, hksu_now_ms() );
+  }
+  _hk_server_unlock( hks );
+
+  return err;
+}
+
+esp_err_t hk_server_start( hk_server_t *hks )
+{
+  if ( hks == NULL )
+    return ESP_ERR_INVALID_STATE;
+
+  xSemaphoreTakeRecursive( hks->lock, portMAX_DELAY );
+  uint8_t listening = hks->listener_count > 0;
+  xSemaphoreGiveRecursive( hks->lock );
+  if ( !listening )
+    return ESP_ERR_INVALID_STATE;
+
+  uint8_t idle = 0;
+  if ( !__atomic_compare_exchange_n( &hks->task_running, &idle, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) )
+    return ESP_ERR_INVALID_STATE;
+
+  BaseType_t core = CONFIG_HKS_SERVER_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_HKS_SERVER_TASK_CORE;
+  if ( xTaskCreatePinnedToCore( _hk_server_task, "hk_server", CONFIG_HKS_SERVER_TASK_STACK, hks,
+         CONFIG_HKS_SERVER_TASK_PRIORITY, NULL, core ) != pdPASS )
+  {
+    __atomic_store_n( &hks->task_running, 0, __ATOMIC_SEQ_CST );
+    return ESP_ERR_NO_MEM;
+  }
 
   return ESP_OK;
 }
 
-esp_err_t _hk_server_update_txt( hk_server_t *hks )
+void _hk_server_task( void *arg )
 {
-  hks_txt_t *txt = &hks->txt;
-  char **records = &txt->records[0];
-  return mdns_service_txt_set(
-    hks->mdns,
-    _HK_HAP_SERVICE,
-    _HK_HAP_PROTO,
-    HKS_TXT_RECORD_COUNT,
-    (const char **)records
-  );
+  hk_server_t *hks = (hk_server_t *)arg;
+
+  esp_err_t err = hk_server_run( hks );
+  ESP_LOGE( TAG, "Server loop stopped: %d", err );
+
+  __atomic_store_n( &hks->task_running, 0, __ATOMIC_SEQ_CST );
+  vTaskDelete( NULL );
+}
+
+esp_err_t hk_server_get_watermarks( hk_server_t *hks, hks_watermarks_t *watermarks )
+{
+  if ( hks == NULL )
+    return ESP_ERR_INVALID_STATE;
+
+  // each field is written whole, a copy may mix two samples
+  const hks_watermarks_t *w = &hks->watermarks;
+  watermarks->server_stack = __atomic_load_n( &w->server_stack, __ATOMIC_RELAXED );
+  watermarks->worker_stack = __atomic_load_n( &w->worker_stack, __ATOMIC_RELAXED );
+  watermarks->heap = __atomic_load_n( &w->heap, __ATOMIC_RELAXED );
+  watermarks->server_heap = __atomic_load_n( &w->server_heap, __ATOMIC_RELAXED );
+  watermarks->server_heap_largest = __atomic_load_n( &w->server_heap_largest, __ATOMIC_RELAXED );
+  watermarks->samples = __atomic_load_n( &w->samples, __ATOMIC_ACQUIRE );
+  return ESP_OK;
 }
 
 esp_err_t hk_server_stop( hk_server_t *hks )
 {
+  if ( hks == NULL )
+    return ESP_ERR_INVALID_STATE;
+
+  _hk_server_lock( hks );
+  hks_timer_stop( &hks->timers, &hks->watermark_timer );
+  hks_timer_stop( &hks->timers, &hks->mdns_timer );
+  hks_mdns_stop( &hks->mdns );
+
+  // nothing is lost to a pending commit
+  if ( hks->store.backend.write != NULL )
+  {
+    hks_timer_stop( &hks->timers, &hks->store_timer );
+    hks_store_commit( &hks->store );
+  }
+
   esp_err_t err = ESP_OK;
+  for ( int i = 0; i < hks->listener_count; i++ )
+    if ( lwip_close( hks->listeners[i] ) )
+      err = ESP_FAIL;
 
+  hks->listener_count = 0;
+
+  // the clients go with the listeners, their sockets must not outlive the
+  // region they are kept in
+  hks_client_t *client;
+  HKS_CLIENT_POOL_FOREACH( &hks->clients, client )
+    _hk_server_close_client( hks, client );
+  _hk_server_unlock( hks );
+
+  return err;
+}
+
+esp_err_t hk_server_add_interface( hk_server_t *hks, tcpip_adapter_if_t tcpip_if )
+{
   if ( hks == NULL )
     return ESP_ERR_INVALID_STATE;
 
-  err = mdns_service_remove( hks->mdns, _HK_HAP_SERVICE, _HK_HAP_PROTO );
+  esp_err_t err = hksu_validate_if( tcpip_if );
   if ( err )
     return err;
 
-  if ( lwip_close( hks->fd ) )
-    return ESP_FAIL;
+  // the listeners take connections on every interface already, only
+  // the advertising is new
+  _hk_server_lock( hks );
+  err = hks_mdns_add_interface( &hks->mdns, tcpip_if );
+  if ( !err )
+    _hk_server_mdns_schedule( hks );
+  _hk_server_unlock( hks );
 
-  return ESP_OK;
+  return err;
 }
 
 esp_err_t hk_server_set_name( hk_server_t *hks, const char *name )
 {
   esp_err_t err = ESP_OK;
 
-  if ( hks == NULL || hks->mdns == NULL )
+  if ( hks == NULL )
     return ESP_ERR_INVALID_STATE;
 
-  err = mdns_set_instance( hks->mdns, name );
-  if ( err )
-    return err;
+  _hk_server_lock( hks );
+  err = hks_mdns_set_instance( &hks->mdns, name );
+  if ( !err )
+    _hk_server_mdns_schedule( hks );
+  _hk_server_unlock( hks );
 
-  return ESP_OK;
+  return err;
+}
+
+esp_err_t hk_server_set_setup_code( hk_server_t *hks, const char *code )
+{
+  if ( hks == NULL )
+    return ESP_ERR_INVALID_STATE;
+
+  _hk_server_lock( hks );
+  esp_err_t err = hks_pairings_set_setup_code( &hks->pairings, code );
+  _hk_server_unlock( hks );
+
+  return err;
 }
 
-esp_err_t hk_server_accept( hk_server_t *hks )
+esp_err_t hk_server_set_database( hk_server_t *hks, hks_db_t *db )
 {
   esp_err_t err = ESP_OK;
 
-  if ( hks == NULL || hks->fd < 0)
+  if ( hks == NULL || db == NULL )
     return ESP_ERR_INVALID_STATE;
 
-  fd_set fds;
-  struct timeval tv = { .tv_usec = 250 };
+  _hk_server_lock( hks );
+  if ( hks->db != NULL && hks->db != db )
+  {
+    hks_db_set_observer( hks->db, NULL, NULL );
+    hks_db_set_heap( hks->db, NULL );
+  }
 
-  FD_ZERO( &fds );
-  FD_SET( hks->fd, &fds );
+  if ( db->heap != &hks->heap )
+    hks_db_set_heap( db, &hks->heap );
 
-  int result = lwip_select( hks->fd + 1, &fds, NULL, NULL, &tv );
-  if ( result == 0 )
-    return ESP_ERR_TIMEOUT;
+  hks->db = db;
+  hks_events_set_database( &hks->events, db );
+  hks_db_set_observer( db, hks_events_changed, &hks->events );
 
-  if ( result < 0 )
-    return ESP_FAIL;
+  err = hks_txt_set_configuration_number( &hks->txt, _hk_server_configuration( hks ) );
+  if ( !err )
+    _hk_server_update_txt( hks );
+  _hk_server_unlock( hks );
+
+  return err;
+}
+
+esp_err_t hk_server_set_storage( hk_server_t *hks, const hks_store_backend_t *backend )
+{
+  esp_err_t err = ESP_OK;
 
-  if ( FD_ISSET( hks->fd, &fds ) )
+  if ( hks == NULL || backend == NULL )
+    return ESP_ERR_INVALID_STATE;
+
+  _hk_server_lock( hks );
+  if ( hks->store.backend.write != NULL )
   {
-    err = _hk_server_accept( hks );
-    if ( err )
-      return err;
+    _hk_server_unlock( hks );
+    return ESP_ERR_INVALID_STATE;
   }
 
+  err = hks_store_open( &hks->store, backend );
+  if ( err == ESP_OK )
+  {
+    const hks_store_image_t *image = &hks->store.image;
+    hks_pairings_load( &hks->pairings, image->seed, image->pairings, image->count );
+    hks_txt_set_state_flags( &hks->txt, hks->pairings.count > 0 ? 0 : HKS_TXT_STATE_UNPAIRED );
+  }
+
+  err = ESP_OK;
+  if ( hks->db != NULL )
+    err = hks_txt_set_configuration_number( &hks->txt, _hk_server_configuration( hks ) );
+
+  if ( !err )
+  {
+    _hk_server_update_txt( hks );
+
+    // a fresh long-term key is kept straight away, before anyone pairs with it
+    hks_timer_stop( &hks->timers, &hks->store_timer );
+    hks_store_set_pairings( &hks->store, &hks->pairings );
+    err = hks_store_commit( &hks->store );
+  }
+  _hk_server_unlock( hks );
+
+  return err;
+}
+
+esp_err_t hk_server_get_stats( hk_server_t *hks, hks_stats_t *stats )
+{
+#if CONFIG_HKS_STATS
+  if ( hks == NULL )
+    return ESP_ERR_INVALID_STATE;
+
+  hks_stats_snapshot( &hks->stats, stats );
   return ESP_OK;
+#else
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
 }
 
-esp_err_t hk_server_process_clients( hk_server_t *hks )
+esp_err_t hk_server_read_trace( hk_server_t *hks, uint32_t *cursor, hks_trace_record_t *records, size_t *count, uint32_t *dropped )
 {
-  esp_err_t err = ESP_OK;
+#if HKS_TRACE_LEVEL > HKS_TRACE_LEVEL_NONE
+  if ( hks == NULL )
+    return ESP_ERR_INVALID_STATE;
 
-  if ( hks == NULL || hks->fd < 0)
+  *count = hks_trace_read( &hks->trace, cursor, records, *count, dropped );
+  return ESP_OK;
+#else
+  *count = 0;
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t hk_server_set_event_coalescing( hk_server_t *hks, uint32_t window_ms )
+{
+  if ( hks == NULL )
     return ESP_ERR_INVALID_STATE;
 
-  fd_set fds;
-  struct timeval tv = { .tv_usec = 250 };
+  _hk_server_lock( hks );
+  hks->events.window_ms = window_ms;
+  _hk_server_unlock( hks );
 
-  FD_ZERO( &fds );
-  FD_SET( hks->fd, &fds );
+  return ESP_OK;
+}
 
-  struct timeval now;
-  gettimeofday( &now, NULL );
+esp_err_t hk_server_poll( hk_server_t *hks, int32_t timeout_ms )
+{
+  if ( hks == NULL )
+    return ESP_ERR_INVALID_STATE;
 
+  xSemaphoreTakeRecursive( hks->lock, portMAX_DELAY );
+  if ( hks->listener_count == 0 )
+  {
+    xSemaphoreGiveRecursive( hks->lock );
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  fd_set fds, wfds;
+  FD_ZERO( &fds );
+  FD_ZERO( &wfds );
   int maxfd = -1;
-  hks_client_t *prev = NULL;
-  for ( hks_client_t *client = hks->clients; client != NULL; /* see below */ )
+  for ( int i = 0; i < hks->listener_count; i++ )
   {
-    if ( (now.tv_sec - client->last_read.tv_sec) > 60 )
-    {
-      ESP_LOGI( TAG, "Closing client (%d) due to timeout", client->fd );
+    FD_SET( hks->listeners[i], &fds );
+    if ( hks->listeners[i] > maxfd )
+      maxfd = hks->listeners[i];
+  }
 
-      hks_client_t *next = client->next;
-      err = _hk_server_close_client( hks, client, prev ); // close and remove
-      if ( err == ESP_ERR_INVALID_STATE )
-        return ESP_ERR_INVALID_STATE; // Fatal
-      client = next;
-      continue;
-    }
+  hks_client_t *client;
+  HKS_CLIENT_POOL_FOREACH( &hks->clients, client )
+  {
+    // stop reading from a client whose receive buffer is full while it
+    // does not take its responses or waits for a pairing step, the queued
+    // requests wait for the socket or the worker
+    if ( client->rx.len < client->rx.size || !( hks_client_tx_pending( client ) || client->parked ) )
+      FD_SET( client->fd, &fds );
 
-    FD_SET( client->fd, &fds );
+    if ( hks_client_tx_pending( client ) )
+      FD_SET( client->fd, &wfds );
 
     if ( client->fd > maxfd )
       maxfd = client->fd;
+  }
+
+  // finished pairing steps, and setters on other tasks
+  FD_SET( hks->worker.fd, &fds );
+  if ( hks->worker.fd > maxfd )
+    maxfd = hks->worker.fd;
+
+  if ( hks->mdns.fd >= 0 )
+  {
+    FD_SET( hks->mdns.fd, &fds );
 
-    prev = client;
-    client = client->next;
+    if ( hks->mdns.fd > maxfd )
+      maxfd = hks->mdns.fd;
   }
 
-  if ( maxfd < -1 )
-    return ESP_OK; // No clients to process
+  // sleep until activity or the nearest timer deadline, NULL blocks
+  int32_t wait_ms = hks_timers_next( &hks->timers, hksu_now_ms() );
+  if ( timeout_ms >= 0 && ( wait_ms < 0 || timeout_ms < wait_ms ) )
+    wait_ms = timeout_ms;
+  xSemaphoreGiveRecursive( hks->lock );
+
+  struct timeval tv = {
+    .tv_sec = wait_ms / 1000,
+    .tv_usec = ( wait_ms % 1000 ) * 1000
+  };
+  int result = lwip_select( maxfd + 1, &fds, &wfds, NULL, wait_ms < 0 ? NULL : &tv );
+  if ( result < 0 )
+    return ESP_FAIL;
+
+  xSemaphoreTakeRecursive( hks->lock, portMAX_DELAY );
+  esp_err_t err = _hk_server_dispatch( hks, result, &fds, &wfds );
+  xSemaphoreGiveRecursive( hks->lock );
+
+  return err;
+}
+
+esp_err_t hk_server_run( hk_server_t *hks )
+{
+  if ( hks == NULL )
+    return ESP_ERR_INVALID_STATE;
+
+  __atomic_store_n( &hks->looping, 1, __ATOMIC_SEQ_CST );
+  esp_err_t err;
+  do
+    err = hk_server_poll( hks, -1 );
+  while ( !err || err == ESP_ERR_TIMEOUT );
+  __atomic_store_n( &hks->looping, 0, __ATOMIC_SEQ_CST );
+
+  return err;
+}
+
+// The loop holds the lock but for select; setters on other tasks hold it
+// while they change what the loop works with, then wake it so it picks up
+// new sockets and deadlines. Recursive, the accessory callbacks run on the
+// loop and may call the setters.
+void _hk_server_lock( hk_server_t *hks )
+{
+  xSemaphoreTakeRecursive( hks->lock, portMAX_DELAY );
+}
+
+void _hk_server_unlock( hk_server_t *hks )
+{
+  xSemaphoreGiveRecursive( hks->lock );
+  hks_worker_wake( &hks->worker );
+}
+
+// what select found, with the lock held
+esp_err_t _hk_server_dispatch( hk_server_t *hks, int result, fd_set *fds, fd_set *wfds )
+{
+  esp_err_t err = ESP_OK;
+
+  HKS_STATS_WAKEUP( &hks->stats );
+  hks_timers_run( &hks->timers, hksu_now_ms(), hks );
 
-  int result = lwip_select( maxfd + 1, &fds, NULL, NULL, &tv );
   if ( result == 0 )
     return ESP_ERR_TIMEOUT;
 
-  if ( result < 0 )
-    return ESP_FAIL;
+  if ( hks->mdns.fd >= 0 && FD_ISSET( hks->mdns.fd, fds ) )
+  {
+    hks_mdns_process( &hks->mdns, hksu_now_ms() );
+    _hk_server_mdns_schedule( hks );
+  }
 
-  prev = NULL;
-  for ( hks_client_t *client = hks->clients; client != NULL; /* see below */ )
+  // pairing steps done on a worker answer their parked clients
+  if ( FD_ISSET( hks->worker.fd, fds ) )
+    _hk_server_pair_done( hks );
+
+  hks_client_t *client;
+  HKS_CLIENT_POOL_FOREACH( &hks->clients, client )
   {
-    if ( FD_ISSET( client->fd, &fds ) )
+    err = ESP_OK;
+
+    // resume queued responses first, they may unblock pipelined requests
+    if ( FD_ISSET( client->fd, wfds ) )
+      err = _hk_server_process_client( hks, client );
+
+    if ( !err && FD_ISSET( client->fd, fds ) )
+      err = _hk_server_read_client( hks, client );
+
+    if ( err )
     {
-      err = _hk_server_read_client( client );
-      if ( err )
-      {
-        hks_client_t *next = client->next;
-        err = _hk_server_close_client( hks, client, prev ); // close and remove
-        if ( err == ESP_ERR_INVALID_STATE )
-          return ESP_ERR_INVALID_STATE; // Fatal
-        client = next;
-        continue;
-      }
+      err = _hk_server_close_client( hks, client ); // close and remove
+      if ( err == ESP_ERR_INVALID_STATE )
+        return ESP_ERR_INVALID_STATE; // Fatal
     }
-    prev = client;
-    client = client->next;
+  }
+
+  // accept last so the new client is not mistaken for a ready one above
+  for ( int i = 0; i < hks->listener_count; i++ )
+  {
+    if ( !FD_ISSET( hks->listeners[i], fds ) )
+      continue;
+
+    err = _hk_server_accept( hks, hks->listeners[i] );
+    if ( err )
+      ESP_LOGE( TAG, "Failed accepting client: %d", err );
   }
 
   return ESP_OK;
 }
 
-esp_err_t _hk_server_bind( hk_server_t *hks, uint16_t port )
+esp_err_t _hk_server_bind( hk_server_t *hks, int family, uint16_t port )
 {
-  struct sockaddr_in sock_addr;
+  int fd = lwip_socket( family, SOCK_STREAM, 0 );
+  if ( fd < 0 )
+    return ESP_FAIL;
+
+  // evicted and refused clients leave the port in TIME_WAIT, a restart
+  // must still get it back
+  int reuse = 1;
+  lwip_setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+
+  // the any address of the family
+  struct sockaddr_storage sock_addr;
+  socklen_t addr_len = sizeof( struct sockaddr_in );
   bzero( &sock_addr, sizeof(sock_addr) );
-  sock_addr.sin_family = AF_INET;
-  sock_addr.sin_addr.s_addr = 0;
-  sock_addr.sin_port = htons( port );
+#if CONFIG_HKS_IPV6
+  if ( family == AF_INET6 )
+  {
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&sock_addr;
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons( port );
+    addr_len = sizeof( struct sockaddr_in6 );
+
+    // IPv4 has a listener of its own, leave this one to IPv6
+    int v6only = 1;
+    lwip_setsockopt( fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof( v6only ) );
+  }
+  else
+#endif
+  {
+    struct sockaddr_in *in = (struct sockaddr_in *)&sock_addr;
+    in->sin_family = AF_INET;
+    in->sin_port = htons( port );
+  }
 
-  if ( lwip_bind( hks->fd, (struct sockaddr *)&sock_addr, sizeof(sock_addr) ) < 0 )
+  if ( lwip_bind( fd, (struct sockaddr *)&sock_addr, addr_len ) < 0 ||
+       _hk_server_set_nonblocking( fd ) ||
+       lwip_listen( fd, CONFIG_HKS_LISTEN_BACKLOG ) )
+  {
+    lwip_close( fd );
     return ESP_FAIL;
+  }
 
-  int flags = lwip_fcntl( hks->fd, F_GETFL, 0 );
-  if ( flags < 0 )
-    return ESP_FAIL;
+  hks->listeners[hks->listener_count++] = fd;
 
-  if ( lwip_fcntl( hks->fd, F_SETFL, flags | O_NONBLOCK ) < 0 )
+  return ESP_OK;
+}
+
+esp_err_t _hk_server_set_nonblocking( int fd )
+{
+  int flags = lwip_fcntl( fd, F_GETFL, 0 );
+  if ( flags < 0 )
     return ESP_FAIL;
 
-  if ( lwip_listen( hks->fd, 3 ) )
+  if ( lwip_fcntl( fd, F_SETFL, flags | O_NONBLOCK ) < 0 )
     return ESP_FAIL;
 
   return ESP_OK;
 }
 
-esp_err_t _hk_server_accept( hk_server_t *hks )
+esp_err_t _hk_server_accept( hk_server_t *hks, int listener )
 {
-  int new_socket = 0;
-  socklen_t addr_len;
-  struct sockaddr_in sock_addr;
-  if ((new_socket = lwip_accept( hks->fd, (struct sockaddr *)&sock_addr, (socklen_t *)&addr_len )) < 0)
-    return ESP_FAIL;
+  // everything queued since the last wakeup, a burst of reconnects is taken
+  // in one go; bounded so a flood cannot hold the loop
+  for ( int i = 0; i < CONFIG_HKS_LISTEN_BACKLOG; i++ )
+  {
+    HKS_STATS_START( accepting );
+    struct sockaddr_storage sock_addr;
+    socklen_t addr_len = sizeof( sock_addr );
+    int new_socket = lwip_accept( listener, (struct sockaddr *)&sock_addr, &addr_len );
+    if ( new_socket < 0 )
+    {
+      if ( errno == EAGAIN || errno == EWOULDBLOCK )
+        break;
+
+      // ECONNABORTED, EMFILE, ENFILE and the like lose this connection
+      // only, the rest of the backlog is still there
+      ESP_LOGW( TAG, "Failed accepting client: %d", errno );
+      continue;
+    }
+
+    // a client that stops reading must never block the loop on a write
+    if ( _hk_server_set_nonblocking( new_socket ) )
+    {
+      lwip_close( new_socket );
+      continue;
+    }
+
+    hks_client_t *client;
+    esp_err_t err = hks_client_new( &hks->clients, new_socket, &client );
+    if ( err == ESP_ERR_NO_MEM )
+    {
+      // every slot taken: make room at the expense of a client that never
+      // verified and has gone quiet, verified controllers always stay
+      hks_client_t *idle = hks_client_evictable( &hks->clients, hksu_now_ms(), CONFIG_HKS_CLIENT_EVICT_IDLE_MS );
+      if ( idle != NULL )
+      {
+        HKS_TRACEW( &hks->trace, HKS_TRACE_EVICT, idle->fd, new_socket, 0 );
+        _hk_server_close_client( hks, idle );
+        err = hks_client_new( &hks->clients, new_socket, &client );
+      }
+    }
+    if ( err )
+    {
+      // refuse rather than leave it pending in the backlog
+      HKS_TRACEW( &hks->trace, HKS_TRACE_REFUSE, new_socket, err, 0 );
+      lwip_close( new_socket );
+      continue;
+    }
 
-  ESP_LOGI( TAG, "Accepted new client (%d)", new_socket );
+    client->last_read = hksu_now_ms();
+    hks_timer_init( &client->idle_timer, _hk_server_client_idle, client );
+    hks_timer_start( &hks->timers, &client->idle_timer, client->last_read + HKS_CLIENT_IDLE_TIMEOUT_MS );
+
+    HKS_TRACEI( &hks->trace, HKS_TRACE_ACCEPT, new_socket, 0, 0 );
+
+    HKS_STATS_CLIENT_OPEN( &hks->stats, client->slot );
+    HKS_STATS_RECORD( &hks->stats, HKS_STATS_ACCEPT, accepting );
+  }
 
-  return hks_client_new( new_socket, &hks->clients );
+  return ESP_OK;
 }
 
-esp_err_t _hk_server_close_client( hk_server_t *hks, hks_client_t *c, hks_client_t *p )
+esp_err_t _hk_server_close_client( hk_server_t *hks, hks_client_t *c )
 {
   __unused esp_err_t err = ESP_OK;
 
   if ( hks == NULL || c == NULL )
     return ESP_ERR_INVALID_STATE;
 
+  hks_timer_stop( &hks->timers, &c->idle_timer );
+  HKS_TRACED( &hks->trace, HKS_TRACE_CLOSE, c->fd, 0, 0 );
+
+  // a worker may still be computing the exchange, it is freed once back
+  if ( c->parked )
+    c->pair->job.owner = NULL;
+  else
+    hks_pair_free( &hks->pairings, c->pair );
+  c->pair = NULL;
+  c->parked = 0;
+
   err = hks_client_close( c );
 
-  if ( p )
-  {
-    p->next = c->next;
-  }
-  else if ( hks->clients == c )
+  hks_client_free( &hks->clients, c );
+
+  return ESP_OK;
+}
+
+esp_err_t _hk_server_read_client( hk_server_t *hks, hks_client_t *c )
+{
+  if ( c == NULL )
+    return ESP_ERR_INVALID_STATE;
+
+  // the idle timer notices this lazily when it fires
+  c->last_read = hksu_now_ms();
+
+  // a pipelined burst may be more than the buffer holds, what is handled
+  // makes room for the rest without waiting for the next wakeup
+  for ( int i = 0; i < HKS_SERVER_READ_BURST; i++ )
   {
-    hks->clients = c->next;
+    size_t space;
+    uint8_t *dst = hks_ring_write_ptr( &c->rx, &space );
+    // a parked client reads on once its step is done and the buffer drains
+    if ( space == 0 && ( i > 0 || c->parked ) )
+      return ESP_OK;
+
+    // a request the buffer cannot hold, refused once what is queued ahead
+    // of it is out: its body is too large once the headers are in
+    if ( space == 0 )
+    {
+      uint16_t status = c->parser.state == HKS_HTTP_PARSER_BODY ? 413 : 431;
+      hks_http_response_write( &c->tx, status, NULL, NULL, 0, NULL, NULL );
+      c->closing = 1;
+      esp_err_t err = _hk_server_flush_client( hks, c );
+      if ( err == HKS_ERR_SEND_PENDING )
+        return ESP_OK;
+      return err ? err : HKS_ERR_CLIENT_DONE;
+    }
+
+    int n = lwip_read( c->fd, dst, space );
+    if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+      return ESP_OK;
+    if ( n <= 0 )
+    {
+      return ESP_FAIL;
+    }
+    hks_ring_commit( &c->rx, n );
+    HKS_STATS_BYTES( &hks->stats, c->slot, n, 0 );
+
+    esp_err_t err = _hk_server_process_client( hks, c );
+    if ( err || (size_t)n < space || c->parked || c->closing || hks_client_tx_pending( c ) )
+      return err;
   }
-  else
+
+  return ESP_OK;
+}
+
+esp_err_t _hk_server_process_client( hk_server_t *hks, hks_client_t *c )
+{
+  esp_err_t err = ESP_OK;
+
+  for (;;)
   {
-    return ESP_ERR_INVALID_STATE;
+    int blocked = 0;
+
+    // a single read may carry the tail of one request and several more
+    for (;;)
+    {
+      // nothing is parsed behind a request waiting on a worker, or one
+      // that asked to close the connection
+      if ( c->parked || c->closing )
+        break;
+
+      // frames are opened as they complete, including any that came in
+      // behind the request that set up the keys
+      int secured = c->session.active;
+      if ( secured && _hk_server_decrypt_client( hks, c ) )
+        return ESP_FAIL;
+
+      size_t len;
+      uint8_t *data = hks_ring_read_ptr( &c->rx, &len );
+      if ( secured )
+        len = c->rx_plain;
+
+      hks_http_request_t request;
+      HKS_STATS_START( parsing );
+      err = hks_http_request_parse( &c->parser, &request, data, len );
+      if ( err == HKS_ERR_HTTP_INCOMPLETE )
+        break;
+      HKS_STATS_RECORD( &hks->stats, HKS_STATS_PARSE, parsing );
+      if ( err )
+      {
+        // best effort, the connection is closed either way
+        hks_http_response_write( &c->tx, err == HKS_ERR_HTTP_VERSION ? 505 : 400, NULL, NULL, 0, NULL, NULL );
+        _hk_server_flush_client( hks, c );
+        return err;
+      }
+
+      HKS_STATS_START( handling );
+      err = _hk_server_handle_request( hks, c, &request );
+      if ( err == ESP_ERR_NO_MEM )
+      {
+        // send queue is full, the request is parsed again once it drained
+        blocked = 1;
+        break;
+      }
+      HKS_STATS_RECORD( &hks->stats, HKS_STATS_HANDLER, handling );
+      if ( err && err != HKS_ERR_PAIR_COMPUTE )
+        return err;
+
+      // a pairing request parks the client but is done with its bytes
+      hks_ring_consume( &c->rx, request.content_len );
+      if ( secured )
+        c->rx_plain -= request.content_len;
+      c->closing = !request.keep_alive;
+    }
+
+    err = _hk_server_flush_client( hks, c );
+    if ( err == HKS_ERR_SEND_PENDING )
+      return ESP_OK; // resumed once the socket is writable
+    if ( !err && c->closing && !c->parked )
+      return HKS_ERR_CLIENT_DONE; // every response is out
+    if ( err || !blocked )
+      return err;
   }
+}
 
-  hks_client_free( c );
+esp_err_t _hk_server_decrypt_client( hk_server_t *hks, hks_client_t *c )
+{
+  // in place, a partial frame waits for the next read
+  size_t len;
+  uint8_t *data = hks_ring_read_ptr( &c->rx, &len );
+  if ( len == c->rx_plain )
+    return ESP_OK; // nothing new since the last pass
+
+  HKS_STATS_START( opening );
+  esp_err_t err = hks_session_decrypt( &c->session, data, &len, &c->rx_plain );
+  if ( err )
+    return err;
 
+  hks_ring_truncate( &c->rx, len );
+  HKS_STATS_RECORD( &hks->stats, HKS_STATS_ENCRYPT, opening );
   return ESP_OK;
 }
 
-esp_err_t _hk_server_read_client( hks_client_t *c )
+esp_err_t _hk_server_flush_client( hk_server_t *hks, hks_client_t *c )
 {
-  esp_err_t err = ESP_OK;
+#if CONFIG_HKS_STATS
+  if ( !hks_client_tx_pending( c ) )
+    return ESP_OK;
+
+  uint32_t start = hksu_now_us();
+  size_t pending = c->tx.pending;
+  uint64_t frames = c->session.write_count;
+  c->session.seal_us = 0;
+  esp_err_t err = hks_client_flush( c );
+
+  // sealing is its own stage, what is left is the socket's
+  if ( c->session.write_count != frames )
+    hks_stats_record( &hks->stats, HKS_STATS_ENCRYPT, c->session.seal_us );
+  hks_stats_record( &hks->stats, HKS_STATS_WRITE, hksu_now_us() - start - c->session.seal_us );
+  hks_stats_bytes( &hks->stats, c->slot, 0, pending - c->tx.pending );
+  return err;
+#else
+  return hks_client_flush( c );
+#endif
+}
 
-  if ( c == NULL )
-    return ESP_ERR_INVALID_STATE;
+esp_err_t _hk_server_handle_request( hk_server_t *hks, hks_client_t *c, hks_http_request_t *request )
+{
+  HKS_TRACEI( &hks->trace, HKS_TRACE_REQUEST, c->fd,
+    hks_trace_pack( request->method, request->method_len ),
+    hks_trace_token( request->path, request->path_len )
+  );
 
-  gettimeofday( &c->last_read, NULL );
+  if ( _hk_server_request_is( request, "POST", "/pair-setup" ) )
+    return _hk_server_pair( hks, c, request, HKS_PAIR_SETUP );
+  if ( _hk_server_request_is( request, "POST", "/pair-verify" ) )
+    return _hk_server_pair( hks, c, request, HKS_PAIR_VERIFY );
+
+  // once paired, everything else is for verified controllers only
+  if ( hks->pairings.count > 0 && !c->session.active )
+    return hks_http_response_write( &c->tx, 470, NULL, NULL, 0, NULL, NULL );
+
+  if ( _hk_server_request_is( request, "GET", "/accessories" ) )
+    return _hk_server_get_accessories( hks, c );
+  if ( _hk_server_request_is( request, "GET", "/characteristics" ) )
+    return _hk_server_characteristics( hks, c, request, 0 );
+  if ( _hk_server_request_is( request, "PUT", "/characteristics" ) )
+    return _hk_server_characteristics( hks, c, request, 1 );
+#if CONFIG_HKS_STATS_ENDPOINT
+  if ( _hk_server_request_is( request, "GET", "/stats" ) )
+    return _hk_server_stats( hks, c );
+#endif
+
+  return hks_http_response_write( &c->tx, 404, NULL, NULL, 0, NULL, NULL );
+}
+
+esp_err_t _hk_server_get_accessories( hk_server_t *hks, hks_client_t *c )
+{
+  if ( hks->db == NULL )
+    return hks_http_response_write( &c->tx, 404, NULL, NULL, 0, NULL, NULL );
+
+  // check for room first, rendering is the expensive part
+  if ( hks_send_queue_available( &c->tx ) < 3 )
+    return ESP_ERR_NO_MEM;
+
+  hks_db_json_t *json;
+  esp_err_t err = hks_db_accessories( hks->db, &json );
+  if ( err )
+    return hks_http_response_write( &c->tx, 500, NULL, NULL, 0, NULL, NULL );
 
-  uint8_t buffer[256];
-  bzero( buffer, 256 );
-  int n = lwip_read( c->fd, buffer, 255 );
-  if (n < 0)
+  // the response holds a reference to the document until it has been sent
+  err = hks_http_response_write( &c->tx, 200, HKS_HTTP_CONTENT_TYPE_JSON,
+    json->data, json->len, hks_db_json_release, json );
+  if ( err )
+    hks_db_json_release( json );
+
+  return err;
+}
+
+esp_err_t _hk_server_characteristics( hk_server_t *hks, hks_client_t *c, hks_http_request_t *request, int put )
+{
+  if ( hks->db == NULL )
+    return hks_http_response_write( &c->tx, 404, NULL, NULL, 0, NULL, NULL );
+
+  // accessory callbacks run before the response is queued, so it has to fit
+  if ( !hks_http_response_fits( &c->tx, HKS_HTTP_CONTENT_TYPE_JSON ) )
+    return ESP_ERR_NO_MEM;
+
+  if ( !put )
+    return hks_characteristics_get( hks->db, &hks->batch, &c->events, request, &c->tx );
+
+  // the writer is not sent events for its own changes
+  hks->events.source = c->slot;
+  esp_err_t err = hks_characteristics_put( hks->db, &hks->batch, &c->events, request, &c->tx );
+  hks->events.source = HKS_CLIENT_SLOT_NONE;
+
+  return err;
+}
+
+#if CONFIG_HKS_STATS_ENDPOINT
+esp_err_t _hk_server_stats( hk_server_t *hks, hks_client_t *c )
+{
+  // measure, then render into a buffer the response owns
+  hks_json_writer_t w;
+  hks_json_writer_init( &w, NULL, 0 );
+  hks_stats_json( &w, &hks->stats, hks->clients.active );
+
+  uint8_t *body = hks_heap_alloc( &hks->heap, w.len );
+  if ( body == NULL )
+    return hks_http_response_write( &c->tx, 500, NULL, NULL, 0, NULL, NULL );
+
+  hks_json_writer_init( &w, body, w.len );
+  hks_stats_json( &w, &hks->stats, hks->clients.active );
+
+  esp_err_t err = hks_http_response_write( &c->tx, 200, HKS_HTTP_CONTENT_TYPE_JSON,
+    body, w.len, hks_heap_free, body );
+  if ( err )
+    hks_heap_free( body );
+
+  return err;
+}
+#endif
+
+esp_err_t _hk_server_pair( hk_server_t *hks, hks_client_t *c, hks_http_request_t *request, hks_pair_method_t method )
+{
+  // the response is built in the exchange and referenced by the queue, the
+  // next message may only overwrite it once it is out
+  if ( hks_client_tx_pending( c ) || !hks_http_response_fits( &c->tx, HKS_HTTP_CONTENT_TYPE_TLV8 ) )
+    return ESP_ERR_NO_MEM;
+
+  // a controller switching between the two starts over
+  if ( c->pair != NULL && c->pair->method != method )
   {
-    return ESP_FAIL;
+    hks_pair_free( &hks->pairings, c->pair );
+    c->pair = NULL;
+  }
+
+  if ( c->pair == NULL )
+  {
+    c->pair = hks_pair_new( &hks->heap, method );
+    if ( c->pair == NULL )
+      return hks_http_response_write( &c->tx, 500, NULL, NULL, 0, NULL, NULL );
   }
 
-  hks_http_request_t request;
-  err = hks_http_request_parse( &request, buffer, n );
+  hks_pair_t *pair = c->pair;
+  esp_err_t err = method == HKS_PAIR_SETUP
+    ? hks_pair_setup( &hks->pairings, pair, request->body, request->body_len )
+    : hks_pair_verify( &hks->pairings, &hks->resume, pair, request->body, request->body_len );
+  if ( err == ESP_ERR_INVALID_ARG )
+    return hks_http_response_write( &c->tx, 400, NULL, NULL, 0, NULL, NULL );
+
+  if ( err == HKS_ERR_PAIR_COMPUTE )
+  {
+    // seconds of SRP or curve arithmetic on the device: the client parks
+    // until a worker is done and the loop carries on with everyone else
+    pair->job.work = _hk_server_pair_work;
+    pair->job.arg = pair;
+    pair->job.owner = c;
+    if ( hks_worker_submit( &hks->worker, &pair->job ) )
+    {
+      hks_pair_free( &hks->pairings, pair );
+      c->pair = NULL;
+      return hks_http_response_write( &c->tx, 500, NULL, NULL, 0, NULL, NULL );
+    }
+
+    c->parked = 1;
+    return HKS_ERR_PAIR_COMPUTE;
+  }
+
+  return _hk_server_pair_respond( hks, c, pair );
+}
+
+esp_err_t _hk_server_pair_respond( hk_server_t *hks, hks_client_t *c, hks_pair_t *pair )
+{
+  if ( !pair->done )
+    return hks_http_response_write( &c->tx, 200, HKS_HTTP_CONTENT_TYPE_TLV8,
+      pair->response, pair->response_len, NULL, NULL );
+
+  // the last response takes the exchange with it
+  c->pair = NULL;
+  esp_err_t err = hks_http_response_write( &c->tx, 200, HKS_HTTP_CONTENT_TYPE_TLV8,
+    pair->response, pair->response_len, hks_pair_release, pair );
   if ( err )
+  {
+    hks_pair_release( pair );
     return err;
+  }
+
+  if ( pair->verified )
+  {
+    // the M4 response goes out in the clear, everything after it encrypted
+    hks_session_start( &c->session, &c->tx, pair->verify.read_key, pair->verify.write_key );
+    c->pairing = pair->controller;
 
+    // subscriptions made in the clear, or in an earlier session, do not
+    // carry over into this one
+    hks_subscriptions_clear( &c->events );
 
-  ESP_LOGI( TAG, "%.*s Request: %.*s",
-    request.method_len,
-    request.method,
-    request.path_len,
-    request.path
-  );
+    // the next connection may pick it up again with a pair-resume
+    hks_resume_put( &hks->resume, pair->verify.session_id, pair->verify.shared,
+      pair->controller_id, pair->controller_id_len );
+  }
+
+  if ( pair->added )
+  {
+    hks_txt_set_state_flags( &hks->txt, hks->pairings.count > 0 ? 0 : HKS_TXT_STATE_UNPAIRED );
+    _hk_server_update_txt( hks );
+
+    // committed before M6 goes out, the controller takes itself as paired
+    // from then on
+    if ( hks->store.backend.write != NULL )
+    {
+      hks_store_set_pairings( &hks->store, &hks->pairings );
+      _hk_server_store_commit( &hks->store_timer, hksu_now_ms(), hks );
+    }
+  }
 
   return ESP_OK;
-}
\ No newline at end of file
+}
+
+void _hk_server_pair_work( void *arg )
+{
+  hks_pair_compute( (hks_pair_t *)arg );
+}
+
+void _hk_server_pair_done( hk_server_t *hks )
+{
+  hks_job_t *job;
+  while ( ( job = hks_worker_done( &hks->worker ) ) != NULL )
+  {
+    hks_pair_t *pair = (hks_pair_t *)job->arg;
+    hks_client_t *c = (hks_client_t *)job->owner;
+
+    // closed while it was parked
+    if ( c == NULL )
+    {
+      hks_pair_free( &hks->pairings, pair );
+      continue;
+    }
+
+    // the queue was empty when it parked and events pass over a client
+    // that is pairing, the response fits
+    c->parked = 0;
+    hks_pair_finish( &hks->pairings, pair );
+    esp_err_t err = _hk_server_pair_respond( hks, c, pair );
+
+    // then the requests that queued up behind it
+    if ( !err )
+      err = _hk_server_process_client( hks, c );
+    if ( err )
+      _hk_server_close_client( hks, c );
+  }
+}
+
+uint32_t _hk_server_configuration( hk_server_t *hks )
+{
+  hks_store_t *store = &hks->store;
+  if ( store->backend.write == NULL )
+    return hks->db->configuration;
+
+  // the stored c#, moved on if the database is not the one it was counted for
+  uint32_t digest = hks_db_digest( hks->db );
+  uint32_t configuration = store->image.configuration;
+  if ( configuration == 0 )
+    configuration = hks->db->configuration;
+  else if ( store->image.digest != digest )
+    configuration = configuration >= UINT16_MAX ? 1 : configuration + 1;
+
+  hks_store_set_configuration( store, configuration, digest );
+  _hk_server_store_schedule( hks );
+  return configuration;
+}
+
+void _hk_server_store_schedule( hk_server_t *hks )
+{
+  // changes within the delay are written together
+  if ( hks->store.dirty && !hks_timer_armed( &hks->store_timer ) )
+    hks_timer_start( &hks->timers, &hks->store_timer, hksu_now_ms() + HKS_STORE_COMMIT_DELAY );
+}
+
+void _hk_server_store_commit( hks_timer_t *timer, uint32_t now, void *ctx )
+{
+  hk_server_t *hks = (hk_server_t *)ctx;
+
+  hks_timer_stop( &hks->timers, timer );
+  esp_err_t err = hks_store_commit( &hks->store );
+  if ( err )
+  {
+    ESP_LOGE( TAG, "Failed storing pairings: %d", err );
+    _hk_server_store_schedule( hks );
+  }
+}
+
+int _hk_server_request_is( hks_http_request_t *request, const char *method, const char *path )
+{
+  size_t method_len = strlen( method );
+  size_t path_len = strlen( path );
+
+  return request->method_len == method_len && memcmp( request->method, method, method_len ) == 0 &&
+    request->path_len == path_len && memcmp( request->path, path, path_len ) == 0;
+}
+
+void _hk_server_client_idle( hks_timer_t *timer, uint32_t now, void *ctx )
+{
+  hk_server_t *hks = (hk_server_t *)ctx;
+  hks_client_t *c = (hks_client_t *)timer->arg;
+
+  // a verified controller subscribed to events is waiting for them, a
+  // sensor may not change for hours
+  uint32_t deadline = c->last_read + HKS_CLIENT_IDLE_TIMEOUT_MS;
+  if ( c->session.active && hks_subscriptions_any( &c->events ) )
+    deadline = now + HKS_CLIENT_IDLE_TIMEOUT_MS;
+
+  if ( (int32_t)( deadline - now ) > 0 )
+  {
+    hks_timer_start( &hks->timers, timer, deadline );
+    return;
+  }
+
+  HKS_TRACEI( &hks->trace, HKS_TRACE_IDLE, c->fd, 0, 0 );
+
+  _hk_server_close_client( hks, c );
+}
+
+void _hk_server_sample_watermarks( hks_timer_t *timer, uint32_t now, void *ctx )
+{
+  hk_server_t *hks = (hk_server_t *)ctx;
+  hks_watermarks_t *w = &hks->watermarks;
+
+  // each of these but the largest block only ever goes down, the latest
+  // is the lowest
+  __atomic_store_n( &w->server_stack, uxTaskGetStackHighWaterMark( NULL ), __ATOMIC_RELAXED );
+  __atomic_store_n( &w->worker_stack, __atomic_load_n( &hks->worker.stack_free, __ATOMIC_RELAXED ), __ATOMIC_RELAXED );
+  __atomic_store_n( &w->heap, esp_get_minimum_free_heap_size(), __ATOMIC_RELAXED );
+  __atomic_store_n( &w->server_heap, hks->heap.size - hks->heap.peak, __ATOMIC_RELAXED );
+  __atomic_store_n( &w->server_heap_largest, hks_heap_largest( &hks->heap ), __ATOMIC_RELAXED );
+  __atomic_add_fetch( &w->samples, 1, __ATOMIC_RELEASE );
+
+  hks_timer_start( &hks->timers, timer, now + CONFIG_HKS_WATERMARK_PERIOD_MS );
+}
+
+void _hk_server_update_txt( hk_server_t *hks )
+{
+  // the responder picks up the new TXT record and announces it
+  if ( hks_mdns_refresh( &hks->mdns ) == ESP_OK )
+    _hk_server_mdns_schedule( hks );
+}
+
+void _hk_server_mdns_schedule( hk_server_t *hks )
+{
+  // announce straight away whenever the responder has news
+  if ( hks->mdns.announcements > 0 && !hks_timer_armed( &hks->mdns_timer ) )
+    hks_timer_start( &hks->timers, &hks->mdns_timer, hksu_now_ms() );
+}
+
+void _hk_server_mdns_announce( hks_timer_t *timer, uint32_t now, void *ctx )
+{
+  hk_server_t *hks = (hk_server_t *)ctx;
+
+  int32_t next = hks_mdns_announce( &hks->mdns, now );
+  if ( next >= 0 )
+    hks_timer_start( &hks->timers, timer, now + next );
+}
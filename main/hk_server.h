@@ -1,18 +1,101 @@
+#pragma once
+
 #include <stdio.h>
 #include <tcpip_adapter.h>
 #include <esp_err.h>
+#include "hks_arena.h"
+#include "hks_db.h"
+#include "hks_store.h"
+#include "hks_stats.h"
+#include "hks_trace.h"
 
 struct hk_server_s;
 typedef struct hk_server_s hk_server_t;
 
+// The least stack and heap the server had left, in bytes, sampled by its
+// loop every CONFIG_HKS_WATERMARK_PERIOD_MS.
+struct hks_watermarks_s {
+  uint32_t samples;
+  uint32_t server_stack; // on the task running the loop
+  uint32_t worker_stack; // on the crypto worker that went deepest
+  uint32_t heap;         // esp_get_minimum_free_heap_size
+  uint32_t server_heap;  // CONFIG_HKS_HEAP_SIZE less the most ever in use
+  uint32_t server_heap_largest; // the largest free block in it right now
+};
+typedef struct hks_watermarks_s hks_watermarks_t;
+
+// Everything the server uses lives in one region of hk_server_budget bytes,
+// taken from the heap here. What is sized at runtime (response bodies,
+// events, the /accessories document, pair exchanges) comes out of a heap of
+// CONFIG_HKS_HEAP_SIZE inside it, so nothing is allocated after init.
 extern esp_err_t hk_server_init( tcpip_adapter_if_t tcpip_if, hk_server_t **hks );
+
+// The same in `region` of `size` bytes, static storage of the caller's,
+// aligned to 8 and freed by the caller after hk_server_free.
+// ESP_ERR_INVALID_SIZE when it is short of hk_server_budget.
+extern esp_err_t hk_server_init_static( tcpip_adapter_if_t tcpip_if, void *region, size_t size, hk_server_t **hks );
+
+// stops the server and waits for hk_server_run, on whichever task, to leave
+// the loop before the region goes
 extern void hk_server_free( hk_server_t *hks );
 
+// The bytes a server takes with this configuration. Up to `*count` named
+// slices of them go to `slices`, `*count` is how many on the way out;
+// `slices` may be NULL for just the total.
+extern size_t hk_server_budget( hks_budget_t *slices, size_t *count );
+
+// The setters below may be called from any task while the loop runs, the
+// accessory callbacks it makes included; they hold the loop off while they
+// change its state and wake it after.
 extern esp_err_t hk_server_listen( hk_server_t *hks, uint16_t port );
+
+// Closes the listeners and every client, the loop ends at its next wakeup.
+// From any task but the one running the loop.
 extern esp_err_t hk_server_stop( hk_server_t *hks );
 
+// Advertise on `tcpip_if` too, say the AP next to the station. Connections
+// are taken on every interface over IPv4 and, with CONFIG_HKS_IPV6, IPv6.
+extern esp_err_t hk_server_add_interface( hk_server_t *hks, tcpip_adapter_if_t tcpip_if );
+
 extern esp_err_t hk_server_set_name( hk_server_t *hks, const char *name );
 
-// client accept loop
-extern esp_err_t hk_server_accept( hk_server_t *hks );
-extern esp_err_t hk_server_process_clients( hk_server_t *hks );
\ No newline at end of file
+// the XXX-XX-XXX code controllers pair with, pair-setup is refused until set
+extern esp_err_t hk_server_set_setup_code( hk_server_t *hks, const char *code );
+
+// serve `db`, call again after hks_db_schema_changed to publish the new c#
+extern esp_err_t hk_server_set_database( hk_server_t *hks, hks_db_t *db );
+
+// Keep the long-term key, pairings and c# in `backend` (hks_store_nvs_init,
+// hks_store_file_init on the host), restoring what it holds. Set it before
+// anyone pairs. Without a store nothing survives a restart. With one, c#
+// only moves on when the database differs from the last one served.
+extern esp_err_t hk_server_set_storage( hk_server_t *hks, const hks_store_backend_t *backend );
+
+// A copy of the server loop's counters and stage timings, safe from any
+// task. ESP_ERR_NOT_SUPPORTED when built without CONFIG_HKS_STATS.
+extern esp_err_t hk_server_get_stats( hk_server_t *hks, hks_stats_t *stats );
+
+// Events the server loop recorded since `*cursor`, which starts at 0 and
+// moves on. `*count` is the room in `records` on the way in and the records
+// read on the way out; those overwritten before they were read are added to
+// `*dropped`. Format them with hks_trace_format, best on a low priority
+// task. ESP_ERR_NOT_SUPPORTED when built with CONFIG_HKS_TRACE_LEVEL 0.
+extern esp_err_t hk_server_read_trace( hk_server_t *hks, uint32_t *cursor, hks_trace_record_t *records, size_t *count, uint32_t *dropped );
+
+// changes to a characteristic within `window_ms` go out as one event,
+// CONFIG_HKS_EVENT_COALESCE_MS until set
+extern esp_err_t hk_server_set_event_coalescing( hk_server_t *hks, uint32_t window_ms );
+
+// A copy of the latest watermarks, safe from any task. The loop samples its
+// own stack, so run it on a task (hk_server_start) for that one to count.
+extern esp_err_t hk_server_get_watermarks( hk_server_t *hks, hks_watermarks_t *watermarks );
+
+// event loop, a negative timeout sleeps until the next client deadline or activity
+extern esp_err_t hk_server_poll( hk_server_t *hks, int32_t timeout_ms );
+extern esp_err_t hk_server_run( hk_server_t *hks );
+
+// hk_server_run on a task of its own once listening, with a stack of
+// CONFIG_HKS_SERVER_TASK_STACK at CONFIG_HKS_SERVER_TASK_PRIORITY. The task
+// ends with the loop, after hk_server_stop say; ESP_ERR_INVALID_STATE while
+// it runs.
+extern esp_err_t hk_server_start( hk_server_t *hks );
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "hks_arena.h"
+#include <stdlib.h>
+
+struct hks_heap_block_s {
+  size_t size;            // the whole block, header included
+  hks_heap_t *heap;       // NULL for the system heap
+  hks_heap_block_t *next; // while free
+};
+
+#define HKS_HEAP_HEADER HKS_ARENA_ROUND( sizeof( hks_heap_block_t ) )
+
+// a remainder smaller than this stays with the block it was cut from
+#define HKS_HEAP_SPLIT ( HKS_HEAP_HEADER + HKS_ARENA_ALIGN )
+
+void hks_arena_init( hks_arena_t *arena, void *region, size_t size )
+{
+  // the region may start anywhere, slices are aligned from the first one
+  uintptr_t start = HKS_ARENA_ROUND( (uintptr_t)region );
+  size_t skip = start - (uintptr_t)region;
+
+  arena->base = (uint8_t *)start;
+  arena->size = size > skip ? size - skip : 0;
+  arena->used = 0;
+}
+
+void *hks_arena_alloc( hks_arena_t *arena, size_t size )
+{
+  size = HKS_ARENA_ROUND( size );
+  if ( size > arena->size - arena->used )
+    return NULL;
+
+  void *p = arena->base + arena->used;
+  arena->used += size;
+  return p;
+}
+
+void hks_heap_init( hks_heap_t *heap, void *region, size_t size )
+{
+  heap->free = NULL;
+  heap->size = size & ~(size_t)( HKS_ARENA_ALIGN - 1 );
+  heap->used = 0;
+  heap->peak = 0;
+  heap->failed = 0;
+
+  if ( heap->size >= HKS_HEAP_SPLIT )
+  {
+    heap->free = (hks_heap_block_t *)region;
+    heap->free->size = heap->size;
+    heap->free->heap = NULL;
+    heap->free->next = NULL;
+  }
+}
+
+void *hks_heap_alloc( hks_heap_t *heap, size_t size )
+{
+  size_t need = HKS_HEAP_HEADER + HKS_ARENA_ROUND( size );
+
+  hks_heap_block_t *block = NULL;
+  if ( heap == NULL )
+  {
+    block = (hks_heap_block_t *)malloc( need );
+    if ( block == NULL )
+      return NULL;
+    block->size = need;
+  }
+  else
+  {
+    hks_heap_block_t **link = &heap->free;
+    while ( *link != NULL && ( *link )->size < need )
+      link = &( *link )->next;
+
+    if ( *link == NULL )
+    {
+      heap->failed++;
+      return NULL;
+    }
+
+    // the tail of a larger block, so the free list keeps its links
+    block = *link;
+    if ( block->size - need >= HKS_HEAP_SPLIT )
+    {
+      block->size -= need;
+      block = (hks_heap_block_t *)( (uint8_t *)block + block->size );
+      block->size = need;
+    }
+    else
+      *link = block->next;
+
+    heap->used += block->size;
+    if ( heap->used > heap->peak )
+      heap->peak = heap->used;
+  }
+
+  block->heap = heap;
+  return (uint8_t *)block + HKS_HEAP_HEADER;
+}
+
+void hks_heap_free( void *p )
+{
+  if ( p == NULL )
+    return;
+
+  hks_heap_block_t *block = (hks_heap_block_t *)( (uint8_t *)p - HKS_HEAP_HEADER );
+  hks_heap_t *heap = block->heap;
+  if ( heap == NULL )
+  {
+    free( block );
+    return;
+  }
+
+  heap->used -= block->size;
+  block->heap = NULL;
+
+  hks_heap_block_t *prev = NULL;
+  hks_heap_block_t *next = heap->free;
+  while ( next != NULL && next < block )
+  {
+    prev = next;
+    next = next->next;
+  }
+
+  // merge with the free neighbours on either side
+  if ( next != NULL && (uint8_t *)block + block->size == (uint8_t *)next )
+  {
+    block->size += next->size;
+    next = next->next;
+  }
+  block->next = next;
+
+  if ( prev != NULL && (uint8_t *)prev + prev->size == (uint8_t *)block )
+  {
+    prev->size += block->size;
+    prev->next = block->next;
+  }
+  else if ( prev != NULL )
+    prev->next = block;
+  else
+    heap->free = block;
+}
+
+size_t hks_heap_largest( const hks_heap_t *heap )
+{
+  size_t largest = 0;
+  for ( const hks_heap_block_t *block = heap->free; block != NULL; block = block->next )
+    if ( block->size > largest )
+      largest = block->size;
+
+  return largest > HKS_HEAP_HEADER ? largest - HKS_HEAP_HEADER : 0;
+}
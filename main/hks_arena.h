@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HKS_ARENA_ALIGN 8
+#define HKS_ARENA_ROUND( n ) ( ( (size_t)( n ) + HKS_ARENA_ALIGN - 1 ) & ~(size_t)( HKS_ARENA_ALIGN - 1 ) )
+
+// A region carved front to back into the slices of a server at init. Slices
+// are never given back, the region goes as a whole.
+struct hks_arena_s {
+  uint8_t *base;
+  size_t size;
+  size_t used;
+};
+typedef struct hks_arena_s hks_arena_t;
+
+extern void hks_arena_init( hks_arena_t *arena, void *region, size_t size );
+
+// `size` bytes aligned to HKS_ARENA_ALIGN, NULL once the region runs out
+extern void *hks_arena_alloc( hks_arena_t *arena, size_t size );
+
+// A slice of the arena for what is sized at runtime: response bodies,
+// events, the /accessories document and pair exchanges. First fit over a
+// free list kept in address order, neighbours merge when freed. Only the
+// server loop uses it, nothing here is locked.
+//
+// Every block starts with its size and heap, so hks_heap_free needs no
+// heap and goes as a release callback wherever free did. A NULL heap is
+// the system one, for the modules used on their own.
+typedef struct hks_heap_block_s hks_heap_block_t;
+
+struct hks_heap_s {
+  hks_heap_block_t *free; // ascending address
+  size_t size;
+  size_t used;    // in blocks handed out, headers included
+  size_t peak;
+  uint32_t failed; // allocations that found no room
+};
+typedef struct hks_heap_s hks_heap_t;
+
+extern void hks_heap_init( hks_heap_t *heap, void *region, size_t size );
+extern void *hks_heap_alloc( hks_heap_t *heap, size_t size );
+extern void hks_heap_free( void *p );
+
+// the largest block an allocation could still get, less its header; far
+// below size - used once the free space is in pieces
+extern size_t hks_heap_largest( const hks_heap_t *heap );
+
+// A named part of the server's RAM, see hk_server_budget.
+struct hks_budget_s {
+  const char *name;
+  size_t size;
+};
+typedef struct hks_budget_s hks_budget_t;
@@ -0,0 +1,178 @@
+#include "hks_bignum.h"
+#include <string.h>
+
+static const hks_bn_t _hks_bn_one = { { 1 } };
+
+static void _hks_bn_mont_mul( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b );
+static uint32_t _hks_bn_add( hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b );
+static uint32_t _hks_bn_sub( hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b );
+static void _hks_bn_select( hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b, uint32_t pick_b );
+
+void hks_bn_from_bytes( hks_bn_t *a, const uint8_t *data, size_t len )
+{
+  memset( a, 0, sizeof( hks_bn_t ) );
+  for ( size_t i = 0; i < len; i++ )
+  {
+    size_t bit = ( len - 1 - i ) * 8;
+    a->v[bit / 32] |= (uint32_t)data[i] << ( bit % 32 );
+  }
+}
+
+void hks_bn_to_bytes( const hks_bn_t *a, uint8_t out[HKS_BN_BYTES] )
+{
+  for ( size_t i = 0; i < HKS_BN_BYTES; i++ )
+  {
+    size_t bit = ( HKS_BN_BYTES - 1 - i ) * 8;
+    out[i] = a->v[bit / 32] >> ( bit % 32 );
+  }
+}
+
+int hks_bn_is_zero( const hks_bn_t *a )
+{
+  uint32_t d = 0;
+  for ( int i = 0; i < HKS_BN_LIMBS; i++ )
+    d |= a->v[i];
+  return d == 0;
+}
+
+void hks_bn_mont_init( hks_bn_mont_t *m, const hks_bn_t *n )
+{
+  m->n = *n;
+
+  // Newton's iteration doubles the correct low bits each step
+  uint32_t inv = 1;
+  for ( int i = 0; i < 5; i++ )
+    inv *= 2 - n->v[0] * inv;
+  m->n0 = -inv;
+
+  // R^2 mod n by doubling 1, once per bit of R^2
+  hks_bn_t *x = &m->rr;
+  memset( x, 0, sizeof( hks_bn_t ) );
+  x->v[0] = 1;
+  for ( int i = 0; i < 2 * HKS_BN_BITS; i++ )
+  {
+    uint32_t carry = _hks_bn_add( x, x, x );
+    uint32_t borrow = _hks_bn_sub( &m->t[0], x, n );
+    _hks_bn_select( x, x, &m->t[0], carry | !borrow );
+  }
+}
+
+void hks_bn_mod( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a )
+{
+  // a R^-1, then times R^2 R^-1
+  _hks_bn_mont_mul( m, r, a, &_hks_bn_one );
+  _hks_bn_mont_mul( m, r, r, &m->rr );
+}
+
+void hks_bn_mod_add( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b )
+{
+  uint32_t carry = _hks_bn_add( r, a, b );
+  uint32_t borrow = _hks_bn_sub( &m->t[0], r, &m->n );
+  _hks_bn_select( r, r, &m->t[0], carry | !borrow );
+}
+
+void hks_bn_mod_sub( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b )
+{
+  uint32_t borrow = _hks_bn_sub( r, a, b );
+  _hks_bn_add( &m->t[0], r, &m->n );
+  _hks_bn_select( r, r, &m->t[0], borrow );
+}
+
+void hks_bn_mod_mul( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b )
+{
+  _hks_bn_mont_mul( m, r, a, b );
+  _hks_bn_mont_mul( m, r, r, &m->rr );
+}
+
+void hks_bn_mod_exp( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *base, const uint8_t *exp, size_t exp_len )
+{
+  // both in Montgomery form: base R and 1 R
+  hks_bn_t *x = &m->t[1];
+  _hks_bn_mont_mul( m, x, base, &m->rr );
+  _hks_bn_mont_mul( m, r, &_hks_bn_one, &m->rr );
+
+  for ( size_t i = 0; i < exp_len; i++ )
+  {
+    for ( int bit = 7; bit >= 0; bit-- )
+    {
+      _hks_bn_mont_mul( m, r, r, r );
+      if ( ( exp[i] >> bit ) & 1 )
+        _hks_bn_mont_mul( m, r, r, x );
+    }
+  }
+
+  _hks_bn_mont_mul( m, r, r, &_hks_bn_one );
+}
+
+void _hks_bn_mont_mul( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b )
+{
+  // CIOS: a word of b is multiplied in and a word reduced away per round
+  uint32_t *acc = m->acc;
+  const uint32_t *n = m->n.v;
+  memset( acc, 0, sizeof( m->acc ) );
+
+  for ( int i = 0; i < HKS_BN_LIMBS; i++ )
+  {
+    uint64_t c = 0;
+    uint32_t bi = b->v[i];
+    for ( int j = 0; j < HKS_BN_LIMBS; j++ )
+    {
+      c += (uint64_t)a->v[j] * bi + acc[j];
+      acc[j] = (uint32_t)c;
+      c >>= 32;
+    }
+    c += acc[HKS_BN_LIMBS];
+    acc[HKS_BN_LIMBS] = (uint32_t)c;
+    acc[HKS_BN_LIMBS + 1] = (uint32_t)( c >> 32 );
+
+    uint32_t q = acc[0] * m->n0;
+    c = ( (uint64_t)q * n[0] + acc[0] ) >> 32;
+    for ( int j = 1; j < HKS_BN_LIMBS; j++ )
+    {
+      c += (uint64_t)q * n[j] + acc[j];
+      acc[j - 1] = (uint32_t)c;
+      c >>= 32;
+    }
+    c += acc[HKS_BN_LIMBS];
+    acc[HKS_BN_LIMBS - 1] = (uint32_t)c;
+    acc[HKS_BN_LIMBS] = acc[HKS_BN_LIMBS + 1] + (uint32_t)( c >> 32 );
+  }
+
+  // below 2n, one subtraction at most
+  hks_bn_t *t = &m->t[0];
+  memcpy( r->v, acc, sizeof( r->v ) );
+  uint32_t borrow = _hks_bn_sub( t, r, &m->n );
+  _hks_bn_select( r, r, t, acc[HKS_BN_LIMBS] | !borrow );
+}
+
+uint32_t _hks_bn_add( hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b )
+{
+  uint64_t c = 0;
+  for ( int i = 0; i < HKS_BN_LIMBS; i++ )
+  {
+    c += (uint64_t)a->v[i] + b->v[i];
+    r->v[i] = (uint32_t)c;
+    c >>= 32;
+  }
+  return (uint32_t)c;
+}
+
+uint32_t _hks_bn_sub( hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b )
+{
+  uint32_t borrow = 0;
+  for ( int i = 0; i < HKS_BN_LIMBS; i++ )
+  {
+    uint64_t d = (uint64_t)a->v[i] - b->v[i] - borrow;
+    r->v[i] = (uint32_t)d;
+    borrow = (uint32_t)( d >> 63 );
+  }
+  return borrow;
+}
+
+void _hks_bn_select( hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b, uint32_t pick_b )
+{
+  // no branch on secret values
+  uint32_t mask = -(uint32_t)( pick_b != 0 );
+  for ( int i = 0; i < HKS_BN_LIMBS; i++ )
+    r->v[i] = ( a->v[i] & ~mask ) | ( b->v[i] & mask );
+}
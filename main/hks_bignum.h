@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-width unsigned integers for SRP, no larger modulus is ever needed.
+// Limbs are 32 bits, least significant first, so the products fit the
+// 64-bit multiply every target has.
+
+#define HKS_BN_BITS   3072
+#define HKS_BN_LIMBS  ( HKS_BN_BITS / 32 )
+#define HKS_BN_BYTES  ( HKS_BN_BITS / 8 )
+
+struct hks_bn_s {
+  uint32_t v[HKS_BN_LIMBS];
+};
+typedef struct hks_bn_s hks_bn_t;
+
+// Montgomery arithmetic modulo an odd `n`. The working space lives here and
+// not on the stack, the device task that pairs has little of it.
+struct hks_bn_mont_s {
+  hks_bn_t n;
+  hks_bn_t rr;  // R^2 mod n, R = 2^HKS_BN_BITS
+  uint32_t n0;  // -n^-1 mod 2^32
+  hks_bn_t t[2];
+  uint32_t acc[HKS_BN_LIMBS + 2];
+};
+typedef struct hks_bn_mont_s hks_bn_mont_t;
+
+// big endian, `len` up to HKS_BN_BYTES
+extern void hks_bn_from_bytes( hks_bn_t *a, const uint8_t *data, size_t len );
+// big endian, zero padded to HKS_BN_BYTES
+extern void hks_bn_to_bytes( const hks_bn_t *a, uint8_t out[HKS_BN_BYTES] );
+extern int hks_bn_is_zero( const hks_bn_t *a );
+
+extern void hks_bn_mont_init( hks_bn_mont_t *m, const hks_bn_t *n );
+
+// results may alias the operands; `a` and `b` below n unless noted
+extern void hks_bn_mod( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a ); // any `a`
+extern void hks_bn_mod_add( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b );
+extern void hks_bn_mod_sub( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b );
+extern void hks_bn_mod_mul( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *a, const hks_bn_t *b );
+
+// `base` to the big endian `exp`, left to right a bit at a time: the SRP
+// exponents are 256 to 512 bits where a window saves little
+extern void hks_bn_mod_exp( hks_bn_mont_t *m, hks_bn_t *r, const hks_bn_t *base, const uint8_t *exp, size_t exp_len );
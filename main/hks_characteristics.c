@@ -0,0 +1,475 @@
+#include "hks_characteristics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hks_json.h"
+
+#define HKS_CHARACTERISTICS_MAX_LEN_DEFAULT 64
+
+static esp_err_t _hks_characteristics_parse_query( hks_db_t *db, hks_characteristics_batch_t *batch, const uint8_t *query, size_t len );
+static esp_err_t _hks_characteristics_parse_ids( hks_db_t *db, hks_characteristics_batch_t *batch, const uint8_t *p, const uint8_t *end );
+static esp_err_t _hks_characteristics_parse_body( hks_db_t *db, hks_characteristics_batch_t *batch, uint8_t *body, size_t len );
+static esp_err_t _hks_characteristics_parse_item( hks_db_t *db, hks_characteristics_batch_t *batch, hks_json_reader_t *r );
+static int32_t _hks_characteristics_value( const hks_characteristic_meta_t *meta, hks_json_token_t *token, hks_value_t *value );
+static int _hks_characteristics_parse_uint( const uint8_t **p, const uint8_t *end, uint32_t *v );
+static int _hks_characteristics_flag( const uint8_t *p, const uint8_t *end );
+static esp_err_t _hks_characteristics_add( hks_db_t *db, hks_characteristics_batch_t *batch, uint32_t aid, uint32_t iid );
+static void _hks_characteristics_subscribe( hks_characteristics_batch_t *batch );
+static uint16_t _hks_characteristics_partition( hks_characteristics_batch_t *batch, uint8_t items );
+static esp_err_t _hks_characteristics_respond( hks_db_t *db, hks_characteristics_batch_t *batch, hks_send_queue_t *queue, int values );
+static void _hks_characteristics_write( hks_json_writer_t *w, hks_db_t *db, hks_characteristics_batch_t *batch, int values, int multi );
+
+esp_err_t hks_characteristics_get(
+  hks_db_t *db,
+  hks_characteristics_batch_t *batch,
+  hks_subscriptions_t *subscriptions,
+  const hks_http_request_t *request,
+  hks_send_queue_t *queue
+)
+{
+  batch->subscriptions = subscriptions;
+  esp_err_t err = _hks_characteristics_parse_query( db, batch, request->query, request->query_len );
+  if ( err == ESP_ERR_INVALID_SIZE )
+    return hks_http_response_write( queue, 413, NULL, NULL, 0, NULL, NULL );
+  if ( err )
+    return hks_http_response_write( queue, 400, NULL, NULL, 0, NULL, NULL );
+
+  // one call for everything readable
+  uint16_t n = _hks_characteristics_partition( batch, 0 );
+  if ( db->read != NULL && n > 0 )
+    db->read( db, batch->slots, batch->status, n, db->ctx );
+
+  return _hks_characteristics_respond( db, batch, queue, 1 );
+}
+
+esp_err_t hks_characteristics_put(
+  hks_db_t *db,
+  hks_characteristics_batch_t *batch,
+  hks_subscriptions_t *subscriptions,
+  hks_http_request_t *request,
+  hks_send_queue_t *queue
+)
+{
+  batch->subscriptions = subscriptions;
+  esp_err_t err = _hks_characteristics_parse_body( db, batch, request->body, request->body_len );
+  if ( err == ESP_ERR_INVALID_SIZE )
+    return hks_http_response_write( queue, 413, NULL, NULL, 0, NULL, NULL );
+  if ( err )
+    return hks_http_response_write( queue, 400, NULL, NULL, 0, NULL, NULL );
+
+  _hks_characteristics_subscribe( batch );
+
+  // one call for every valid write, then store what the accessory accepted
+  uint16_t n = _hks_characteristics_partition( batch, HKS_CHARACTERISTICS_ITEM_VALUE );
+  if ( db->write != NULL && n > 0 )
+    db->write( db, batch->slots, batch->values, batch->status, n, db->ctx );
+
+  for ( uint16_t i = 0; i < n; i++ )
+  {
+    if ( batch->status[i] != HKS_STATUS_SUCCESS )
+      continue;
+
+    hks_format_t format = hks_db_meta( db, batch->slots[i] )->format;
+    if ( format != HKS_FORMAT_STRING && format != HKS_FORMAT_TLV8 && format != HKS_FORMAT_DATA )
+      hks_db_set_value( db, batch->slots[i], &batch->values[i] );
+  }
+
+  return _hks_characteristics_respond( db, batch, queue, 0 );
+}
+
+esp_err_t _hks_characteristics_parse_query( hks_db_t *db, hks_characteristics_batch_t *batch, const uint8_t *query, size_t len )
+{
+  batch->count = 0;
+  batch->flags = 0;
+
+  const uint8_t *p = query;
+  const uint8_t *end = query + len;
+  int ids = 0;
+
+  // name=value pairs, the ids are resolved as they are read
+  while ( p < end )
+  {
+    const uint8_t *next = memchr( p, '&', end - p );
+    if ( next == NULL )
+      next = end;
+
+    const uint8_t *value = memchr( p, '=', next - p );
+    if ( value == NULL )
+      return ESP_ERR_INVALID_ARG;
+
+    size_t name_len = value++ - p;
+    if ( name_len == 2 && memcmp( p, "id", 2 ) == 0 )
+    {
+      esp_err_t err = _hks_characteristics_parse_ids( db, batch, value, next );
+      if ( err )
+        return err;
+      ids = 1;
+    }
+    else if ( name_len == 4 && memcmp( p, "meta", 4 ) == 0 )
+      batch->flags |= _hks_characteristics_flag( value, next ) ? HKS_CHARACTERISTICS_META : 0;
+    else if ( name_len == 5 && memcmp( p, "perms", 5 ) == 0 )
+      batch->flags |= _hks_characteristics_flag( value, next ) ? HKS_CHARACTERISTICS_PERMS : 0;
+    else if ( name_len == 4 && memcmp( p, "type", 4 ) == 0 )
+      batch->flags |= _hks_characteristics_flag( value, next ) ? HKS_CHARACTERISTICS_TYPE : 0;
+    else if ( name_len == 2 && memcmp( p, "ev", 2 ) == 0 )
+      batch->flags |= _hks_characteristics_flag( value, next ) ? HKS_CHARACTERISTICS_EV : 0;
+
+    p = next + 1;
+  }
+
+  if ( !ids || batch->count == 0 )
+    return ESP_ERR_INVALID_ARG;
+
+  return ESP_OK;
+}
+
+esp_err_t _hks_characteristics_parse_ids( hks_db_t *db, hks_characteristics_batch_t *batch, const uint8_t *p, const uint8_t *end )
+{
+  // aid.iid[,aid.iid...]
+  while ( p < end )
+  {
+    uint32_t aid, iid;
+    if ( !_hks_characteristics_parse_uint( &p, end, &aid ) || p == end || *p++ != '.' )
+      return ESP_ERR_INVALID_ARG;
+    if ( !_hks_characteristics_parse_uint( &p, end, &iid ) )
+      return ESP_ERR_INVALID_ARG;
+    if ( p < end && *p++ != ',' )
+      return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = _hks_characteristics_add( db, batch, aid, iid );
+    if ( err )
+      return err;
+
+    uint16_t i = batch->count - 1;
+    if ( batch->slots[i] != HKS_DB_SLOT_NONE && !( hks_db_meta( db, batch->slots[i] )->perms & HKS_PERM_READ ) )
+      batch->status[i] = HKS_STATUS_WRITE_ONLY;
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t _hks_characteristics_parse_body( hks_db_t *db, hks_characteristics_batch_t *batch, uint8_t *body, size_t len )
+{
+  batch->count = 0;
+  batch->flags = 0;
+
+  hks_json_reader_t r;
+  hks_json_token_t token;
+  hks_json_reader_init( &r, body, len );
+
+  if ( hks_json_next( &r, &token ) != HKS_JSON_OBJECT )
+    return ESP_ERR_INVALID_ARG;
+
+  int characteristics = 0;
+  while ( hks_json_next( &r, &token ) == HKS_JSON_STRING )
+  {
+    if ( !hks_json_token_equals( &token, "characteristics" ) )
+    {
+      // "pid" of a timed write and anything newer
+      hks_json_next( &r, &token );
+      if ( !hks_json_skip( &r, &token ) )
+        return ESP_ERR_INVALID_ARG;
+      continue;
+    }
+
+    if ( hks_json_next( &r, &token ) != HKS_JSON_ARRAY )
+      return ESP_ERR_INVALID_ARG;
+
+    while ( hks_json_next( &r, &token ) == HKS_JSON_OBJECT )
+    {
+      esp_err_t err = _hks_characteristics_parse_item( db, batch, &r );
+      if ( err )
+        return err;
+    }
+    if ( token.type != HKS_JSON_ARRAY_END )
+      return ESP_ERR_INVALID_ARG;
+
+    characteristics = 1;
+  }
+
+  if ( token.type != HKS_JSON_OBJECT_END || !characteristics || batch->count == 0 )
+    return ESP_ERR_INVALID_ARG;
+
+  return ESP_OK;
+}
+
+esp_err_t _hks_characteristics_parse_item( hks_db_t *db, hks_characteristics_batch_t *batch, hks_json_reader_t *r )
+{
+  hks_json_token_t token;
+  hks_json_token_t value = { .type = HKS_JSON_END };
+  hks_json_token_t ev = { .type = HKS_JSON_END };
+  int64_t aid = -1, iid = -1;
+
+  // members come in any order, the value is converted once the id is known
+  while ( hks_json_next( r, &token ) == HKS_JSON_STRING )
+  {
+    hks_json_token_t key = token;
+    hks_json_next( r, &token );
+
+    if ( hks_json_token_equals( &key, "aid" ) )
+    {
+      if ( !hks_json_token_int( &token, &aid ) )
+        return ESP_ERR_INVALID_ARG;
+    }
+    else if ( hks_json_token_equals( &key, "iid" ) )
+    {
+      if ( !hks_json_token_int( &token, &iid ) )
+        return ESP_ERR_INVALID_ARG;
+    }
+    else if ( hks_json_token_equals( &key, "value" ) )
+      value = token;
+    else if ( hks_json_token_equals( &key, "ev" ) )
+      ev = token;
+
+    if ( !hks_json_skip( r, &token ) )
+      return ESP_ERR_INVALID_ARG;
+  }
+
+  if ( token.type != HKS_JSON_OBJECT_END || aid < 0 || aid > UINT32_MAX || iid < 0 || iid > UINT16_MAX )
+    return ESP_ERR_INVALID_ARG;
+
+  esp_err_t err = _hks_characteristics_add( db, batch, aid, iid );
+  if ( err )
+    return err;
+
+  uint16_t i = batch->count - 1;
+  uint16_t slot = batch->slots[i];
+  if ( slot == HKS_DB_SLOT_NONE )
+    return ESP_OK;
+
+  const hks_characteristic_meta_t *meta = hks_db_meta( db, slot );
+  if ( value.type != HKS_JSON_END )
+  {
+    batch->items[i] |= HKS_CHARACTERISTICS_ITEM_VALUE;
+    if ( !( meta->perms & HKS_PERM_WRITE ) )
+      batch->status[i] = HKS_STATUS_READ_ONLY;
+    else
+      batch->status[i] = _hks_characteristics_value( meta, &value, &batch->values[i] );
+  }
+
+  if ( ev.type != HKS_JSON_END && batch->status[i] == HKS_STATUS_SUCCESS )
+  {
+    batch->items[i] |= HKS_CHARACTERISTICS_ITEM_EV;
+    if ( !( meta->perms & HKS_PERM_EVENTS ) )
+      batch->status[i] = HKS_STATUS_NO_NOTIFICATION;
+    else if ( ev.type != HKS_JSON_TRUE && ev.type != HKS_JSON_FALSE )
+      batch->status[i] = HKS_STATUS_INVALID_VALUE;
+    else if ( ev.type == HKS_JSON_TRUE )
+      batch->items[i] |= HKS_CHARACTERISTICS_ITEM_ON;
+  }
+
+  return ESP_OK;
+}
+
+int32_t _hks_characteristics_value( const hks_characteristic_meta_t *meta, hks_json_token_t *token, hks_value_t *value )
+{
+  int64_t i;
+  double d;
+
+  switch ( meta->format )
+  {
+    case HKS_FORMAT_BOOL:
+      // controllers send 0 and 1 as often as false and true
+      if ( token->type == HKS_JSON_TRUE || token->type == HKS_JSON_FALSE )
+        value->b = token->type == HKS_JSON_TRUE;
+      else if ( hks_json_token_int( token, &i ) && ( i == 0 || i == 1 ) )
+        value->b = (int)i;
+      else
+        return HKS_STATUS_INVALID_VALUE;
+      return HKS_STATUS_SUCCESS;
+
+    case HKS_FORMAT_UINT8:
+    case HKS_FORMAT_UINT16:
+    case HKS_FORMAT_UINT32:
+    case HKS_FORMAT_UINT64:
+    {
+      static const uint64_t limits[] = { UINT8_MAX, UINT16_MAX, UINT32_MAX, INT64_MAX };
+      if ( !hks_json_token_int( token, &i ) || i < 0 || (uint64_t)i > limits[meta->format - HKS_FORMAT_UINT8] )
+        return HKS_STATUS_INVALID_VALUE;
+      if ( meta->has_range && ( i < meta->min || i > meta->max ) )
+        return HKS_STATUS_INVALID_VALUE;
+      value->u = (uint64_t)i;
+      return HKS_STATUS_SUCCESS;
+    }
+
+    case HKS_FORMAT_INT:
+      if ( !hks_json_token_int( token, &i ) || i < INT32_MIN || i > INT32_MAX )
+        return HKS_STATUS_INVALID_VALUE;
+      if ( meta->has_range && ( i < meta->min || i > meta->max ) )
+        return HKS_STATUS_INVALID_VALUE;
+      value->i = (int32_t)i;
+      return HKS_STATUS_SUCCESS;
+
+    case HKS_FORMAT_FLOAT:
+      if ( !hks_json_token_double( token, &d ) || !isfinite( d ) )
+        return HKS_STATUS_INVALID_VALUE;
+      if ( meta->has_range && ( d < meta->min || d > meta->max ) )
+        return HKS_STATUS_INVALID_VALUE;
+      value->f = (float)d;
+      return HKS_STATUS_SUCCESS;
+
+    case HKS_FORMAT_STRING:
+    case HKS_FORMAT_TLV8:
+    case HKS_FORMAT_DATA:
+    {
+      size_t max_len = meta->max_len ? meta->max_len : HKS_CHARACTERISTICS_MAX_LEN_DEFAULT;
+      const char *s = hks_json_token_string( token );
+      if ( s == NULL || ( meta->format == HKS_FORMAT_STRING && token->len > max_len ) )
+        return HKS_STATUS_INVALID_VALUE;
+      value->s = s;
+      return HKS_STATUS_SUCCESS;
+    }
+  }
+
+  return HKS_STATUS_INVALID_VALUE;
+}
+
+int _hks_characteristics_parse_uint( const uint8_t **p, const uint8_t *end, uint32_t *v )
+{
+  const uint8_t *s = *p;
+  uint64_t n = 0;
+
+  while ( s < end && *s >= '0' && *s <= '9' && n <= UINT32_MAX )
+    n = n * 10 + ( *s++ - '0' );
+
+  if ( s == *p || n > UINT32_MAX )
+    return 0;
+
+  *p = s;
+  *v = (uint32_t)n;
+  return 1;
+}
+
+int _hks_characteristics_flag( const uint8_t *p, const uint8_t *end )
+{
+  size_t len = end - p;
+  return ( len == 1 && *p == '1' ) || ( len == 4 && memcmp( p, "true", 4 ) == 0 );
+}
+
+esp_err_t _hks_characteristics_add( hks_db_t *db, hks_characteristics_batch_t *batch, uint32_t aid, uint32_t iid )
+{
+  if ( batch->count == HKS_CHARACTERISTICS_MAX_BATCH )
+    return ESP_ERR_INVALID_SIZE;
+
+  uint16_t i = batch->count++;
+  batch->aids[i] = aid;
+  batch->iids[i] = iid > UINT16_MAX ? 0 : iid;
+  batch->slots[i] = iid > UINT16_MAX ? HKS_DB_SLOT_NONE : hks_db_find( db, aid, iid );
+  batch->status[i] = batch->slots[i] == HKS_DB_SLOT_NONE ? HKS_STATUS_NOT_FOUND : HKS_STATUS_SUCCESS;
+  batch->items[i] = 0;
+
+  return ESP_OK;
+}
+
+void _hks_characteristics_subscribe( hks_characteristics_batch_t *batch )
+{
+  // only once the body parsed as a whole, a later bad item leaves them be
+  for ( uint16_t i = 0; i < batch->count; i++ )
+  {
+    if ( !( batch->items[i] & HKS_CHARACTERISTICS_ITEM_EV ) || batch->status[i] != HKS_STATUS_SUCCESS )
+      continue;
+
+    if ( hks_subscriptions_set( batch->subscriptions, batch->slots[i], batch->items[i] & HKS_CHARACTERISTICS_ITEM_ON ) )
+      batch->status[i] = HKS_STATUS_OUT_OF_RESOURCES;
+  }
+}
+
+uint16_t _hks_characteristics_partition( hks_characteristics_batch_t *batch, uint8_t items )
+{
+  // move the items to hand to the accessory to the front; responses are
+  // matched by aid and iid so the order does not matter
+  uint16_t n = 0;
+  for ( uint16_t i = 0; i < batch->count; i++ )
+  {
+    if ( batch->status[i] != HKS_STATUS_SUCCESS || ( batch->items[i] & items ) != items )
+      continue;
+
+    if ( i != n )
+    {
+      uint32_t aid = batch->aids[n]; batch->aids[n] = batch->aids[i]; batch->aids[i] = aid;
+      uint16_t iid = batch->iids[n]; batch->iids[n] = batch->iids[i]; batch->iids[i] = iid;
+      uint16_t slot = batch->slots[n]; batch->slots[n] = batch->slots[i]; batch->slots[i] = slot;
+      hks_value_t value = batch->values[n]; batch->values[n] = batch->values[i]; batch->values[i] = value;
+      int32_t status = batch->status[n]; batch->status[n] = batch->status[i]; batch->status[i] = status;
+      uint8_t item = batch->items[n]; batch->items[n] = batch->items[i]; batch->items[i] = item;
+    }
+    n++;
+  }
+
+  return n;
+}
+
+esp_err_t _hks_characteristics_respond( hks_db_t *db, hks_characteristics_batch_t *batch, hks_send_queue_t *queue, int values )
+{
+  int multi = 0;
+  for ( uint16_t i = 0; i < batch->count; i++ )
+    multi |= batch->status[i] != HKS_STATUS_SUCCESS;
+
+  // a write without failures has nothing to report
+  if ( !values && !multi )
+    return hks_http_response_write( queue, 204, NULL, NULL, 0, NULL, NULL );
+
+  // measure, then render into a buffer the response owns
+  hks_json_writer_t w;
+  hks_json_writer_init( &w, NULL, 0 );
+  _hks_characteristics_write( &w, db, batch, values, multi );
+
+  uint8_t *body = hks_heap_alloc( batch->heap, w.len );
+  if ( body == NULL )
+    return hks_http_response_write( queue, 500, NULL, NULL, 0, NULL, NULL );
+
+  hks_json_writer_init( &w, body, w.len );
+  _hks_characteristics_write( &w, db, batch, values, multi );
+
+  esp_err_t err = hks_http_response_write( queue, multi ? 207 : 200, HKS_HTTP_CONTENT_TYPE_JSON,
+    body, w.len, hks_heap_free, body );
+  if ( err )
+    hks_heap_free( body );
+
+  return err;
+}
+
+void _hks_characteristics_write( hks_json_writer_t *w, hks_db_t *db, hks_characteristics_batch_t *batch, int values, int multi )
+{
+  uint8_t parts = 0;
+  if ( batch->flags & HKS_CHARACTERISTICS_META )
+    parts |= HKS_DB_META_FORMAT | HKS_DB_META_RANGE;
+  if ( batch->flags & HKS_CHARACTERISTICS_PERMS )
+    parts |= HKS_DB_META_PERMS;
+  if ( batch->flags & HKS_CHARACTERISTICS_TYPE )
+    parts |= HKS_DB_META_TYPE;
+
+  hks_json_literal( w, "{\"characteristics\":[" );
+  for ( uint16_t i = 0; i < batch->count; i++ )
+  {
+    if ( i > 0 )
+      hks_json_raw( w, ",", 1 );
+
+    hks_json_literal( w, "{\"aid\":" );
+    hks_json_uint( w, batch->aids[i] );
+    hks_json_literal( w, ",\"iid\":" );
+    hks_json_uint( w, batch->iids[i] );
+
+    if ( values && batch->status[i] == HKS_STATUS_SUCCESS )
+    {
+      hks_json_literal( w, ",\"value\":" );
+      hks_db_write_value( w, db, batch->slots[i] );
+      hks_db_write_meta( w, db, batch->slots[i], parts );
+
+      if ( batch->flags & HKS_CHARACTERISTICS_EV )
+      {
+        hks_json_literal( w, ",\"ev\":" );
+        hks_json_bool( w, hks_subscribed( batch->subscriptions, batch->slots[i] ) );
+      }
+    }
+
+    if ( multi )
+    {
+      hks_json_literal( w, ",\"status\":" );
+      hks_json_int( w, batch->status[i] );
+    }
+
+    hks_json_raw( w, "}", 1 );
+  }
+  hks_json_literal( w, "]}" );
+}
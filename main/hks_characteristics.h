@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+#include "hks_db.h"
+#include "hks_http.h"
+#include "hks_send.h"
+#include "hks_events.h"
+
+#define HKS_CHARACTERISTICS_MAX_BATCH  CONFIG_HKS_MAX_BATCH
+
+// what a GET asked for besides the values
+#define HKS_CHARACTERISTICS_META   0x01 // meta=1
+#define HKS_CHARACTERISTICS_PERMS  0x02 // perms=1
+#define HKS_CHARACTERISTICS_TYPE   0x04 // type=1
+#define HKS_CHARACTERISTICS_EV     0x08 // ev=1
+
+// per item
+#define HKS_CHARACTERISTICS_ITEM_VALUE  0x01 // a value to write
+#define HKS_CHARACTERISTICS_ITEM_EV     0x02 // an event subscription change
+#define HKS_CHARACTERISTICS_ITEM_ON     0x04 // with ITEM_EV, subscribe rather than leave
+
+// Working set of one /characteristics request. Every id is resolved to a
+// slot while the request is parsed so the accessory sees the whole batch in
+// one read or write callback. Large, keep it with the server and not on the
+// stack.
+struct hks_characteristics_batch_s {
+  uint32_t aids[HKS_CHARACTERISTICS_MAX_BATCH];
+  uint16_t iids[HKS_CHARACTERISTICS_MAX_BATCH];
+  uint16_t slots[HKS_CHARACTERISTICS_MAX_BATCH]; // HKS_DB_SLOT_NONE if unknown
+  hks_value_t values[HKS_CHARACTERISTICS_MAX_BATCH];
+  int32_t status[HKS_CHARACTERISTICS_MAX_BATCH];
+  uint8_t items[HKS_CHARACTERISTICS_MAX_BATCH]; // HKS_CHARACTERISTICS_ITEM_*
+  uint16_t count;
+  uint8_t flags; // HKS_CHARACTERISTICS_*
+
+  hks_subscriptions_t *subscriptions; // of the controller asking
+  hks_heap_t *heap;                    // response bodies
+};
+typedef struct hks_characteristics_batch_s hks_characteristics_batch_t;
+
+// GET /characteristics?id=1.9,2.9[&meta=1][&perms=1][&type=1][&ev=1]
+//
+// Queues 200 with every value, 207 with a status per characteristic if any
+// of them failed, or 400/413 for a malformed or oversized request. The
+// caller checks hks_http_response_fits first, the accessory callbacks may
+// have run by the time the response is queued.
+extern esp_err_t hks_characteristics_get(
+  hks_db_t *db,
+  hks_characteristics_batch_t *batch,
+  hks_subscriptions_t *subscriptions,
+  const hks_http_request_t *request,
+  hks_send_queue_t *queue
+);
+
+// PUT /characteristics {"characteristics":[{"aid":1,"iid":9,"value":true},...]}
+//
+// Queues 204 if every write succeeded and 207 otherwise. "ev" members update
+// `subscriptions` once the whole body has parsed, a request answered 400 or
+// 413 changes none of them. String values are unescaped in place, so the
+// request body is modified.
+extern esp_err_t hks_characteristics_put(
+  hks_db_t *db,
+  hks_characteristics_batch_t *batch,
+  hks_subscriptions_t *subscriptions,
+  hks_http_request_t *request,
+  hks_send_queue_t *queue
+);
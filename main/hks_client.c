@@ -7,28 +7,91 @@
 #include <esp_log.h>
 #include <lwip/sockets.h>
 
-esp_err_t hks_client_new( int fd, hks_client_t **client )
+void hks_client_pool_init( hks_client_pool_t *pool )
 {
-  hks_client_t *new_client = (hks_client_t *)malloc( sizeof( hks_client_t ) );
-  if ( !new_client )
+  pool->active = 0;
+  memset( pool->fd_slot, HKS_CLIENT_SLOT_NONE, sizeof( pool->fd_slot ) );
+
+  for ( uint8_t i = 0; i < HKS_CLIENT_MAX; i++ )
+  {
+    hks_client_t *c = &pool->clients[i];
+    c->fd = -1;
+    c->slot = i;
+    c->next_free = ( i + 1 < HKS_CLIENT_MAX ) ? i + 1 : HKS_CLIENT_SLOT_NONE;
+  }
+  pool->free_head = 0;
+}
+
+esp_err_t hks_client_new( hks_client_pool_t *pool, int fd, hks_client_t **client )
+{
+  if ( fd < 0 || fd >= FD_SETSIZE )
+    return ESP_ERR_INVALID_ARG;
+
+  if ( pool->free_head == HKS_CLIENT_SLOT_NONE )
     return ESP_ERR_NO_MEM;
 
+  hks_client_t *new_client = &pool->clients[pool->free_head];
+  pool->free_head = new_client->next_free;
+  new_client->next_free = HKS_CLIENT_SLOT_NONE;
+
   new_client->fd = fd;
+  hks_ring_init( &new_client->rx, new_client->rx_data, sizeof( new_client->rx_data ) );
+  hks_http_parser_reset( &new_client->parser );
+  hks_send_queue_init( &new_client->tx );
+  hks_session_init( &new_client->session );
+  new_client->rx_plain = 0;
+  new_client->pair = NULL;
+  new_client->parked = 0;
+  new_client->pairing = HKS_PAIRING_NONE;
+  new_client->closing = 0;
+  hks_subscriptions_clear( &new_client->events );
 
-  gettimeofday( &new_client->last_read, NULL );
+  pool->active |= 1u << new_client->slot;
+  pool->fd_slot[fd] = new_client->slot;
 
   if ( client != NULL )
-  {
-    new_client->next = *client;
     *client = new_client;
-  }
 
   return ESP_OK;
 }
 
-void hks_client_free( hks_client_t *c )
+void hks_client_free( hks_client_pool_t *pool, hks_client_t *c )
 {
-  free( c );
+  if ( c == NULL || !( pool->active & ( 1u << c->slot ) ) )
+    return;
+
+  pool->active &= ~( 1u << c->slot );
+  c->fd = -1;
+  c->next_free = pool->free_head;
+  pool->free_head = c->slot;
+}
+
+hks_client_t *hks_client_find( hks_client_pool_t *pool, int fd )
+{
+  if ( fd < 0 || fd >= FD_SETSIZE )
+    return NULL;
+
+  // stale entries are left behind by hks_client_free and caught here
+  uint8_t slot = pool->fd_slot[fd];
+  if ( slot == HKS_CLIENT_SLOT_NONE || pool->clients[slot].fd != fd )
+    return NULL;
+
+  return &pool->clients[slot];
+}
+
+hks_client_t *hks_client_evictable( hks_client_pool_t *pool, uint32_t now, uint32_t idle_ms )
+{
+  hks_client_t *c, *oldest = NULL;
+  HKS_CLIENT_POOL_FOREACH( pool, c )
+  {
+    if ( c->session.active || c->parked || (int32_t)( now - c->last_read ) < (int32_t)idle_ms )
+      continue;
+
+    if ( oldest == NULL || (int32_t)( c->last_read - oldest->last_read ) < 0 )
+      oldest = c;
+  }
+
+  return oldest;
 }
 
 esp_err_t hks_client_close( hks_client_t *c )
@@ -36,6 +99,11 @@ esp_err_t hks_client_close( hks_client_t *c )
   if ( c == NULL || c->fd < 0 )
     return ESP_ERR_INVALID_STATE;
 
+  // unsent responses are dropped, borrowed buffers go back to their owners
+  hks_send_queue_clear( &c->tx );
+  hks_session_init( &c->session ); // forget the keys
+  c->pairing = HKS_PAIRING_NONE;
+
   if ( lwip_close( c->fd ) )
     return ESP_FAIL;
 
@@ -43,3 +111,11 @@ esp_err_t hks_client_close( hks_client_t *c )
 
   return ESP_OK;
 }
+
+esp_err_t hks_client_flush( hks_client_t *c )
+{
+  if ( c->session.active )
+    return hks_session_flush( &c->session, &c->tx, c->fd );
+
+  return hks_send_queue_flush( &c->tx, c->fd );
+}
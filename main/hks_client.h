@@ -1,14 +1,83 @@
+#pragma once
+
 #include <sys/time.h>
 #include <esp_err.h>
+#include <sdkconfig.h>
+#include <lwip/sockets.h>
+#include "hks_http.h"
+#include "hks_ring.h"
+#include "hks_timer.h"
+#include "hks_send.h"
+#include "hks_events.h"
+#include "hks_session.h"
+#include "hks_pairing.h"
+
+#define HKS_CLIENT_MAX        CONFIG_HKS_MAX_CLIENTS
+#define HKS_CLIENT_SLOT_NONE  0xFF
+
+// the longest request line the parser takes, decrypted, with the frame that
+// completes it still sealed behind it
+#define HKS_CLIENT_RX_MIN ( HKS_HTTP_MAX_REQUEST_LINE + 4 + HKS_SESSION_FRAME_LENGTH + HKS_SESSION_FRAME_OVERHEAD )
+
+_Static_assert( CONFIG_HKS_CLIENT_RX_BUFFER_SIZE >= HKS_CLIENT_RX_MIN,
+  "CONFIG_HKS_CLIENT_RX_BUFFER_SIZE cannot hold a whole request line and an encrypted frame" );
 
 struct hks_client_s {
   int fd;
-  struct timeval last_read;
-  struct hks_client_s *next;
+  uint8_t slot;
+  uint8_t next_free;
+  uint32_t last_read; // hksu_now_ms()
+  hks_timer_t idle_timer;
+
+  hks_http_parser_t parser;
+  hks_ring_t rx;
+  uint8_t rx_data[CONFIG_HKS_CLIENT_RX_BUFFER_SIZE];
+  size_t rx_plain; // leading bytes of `rx` already decrypted
+
+  hks_send_queue_t tx;
+  hks_session_t session;
+  hks_pair_t *pair;  // pair-setup or pair-verify in progress
+  uint8_t parked;    // waiting for `pair` on a worker, requests behind it wait
+  uint8_t pairing;   // controller the session was verified for, HKS_PAIRING_NONE
+  uint8_t closing;   // the last request handled asked to close the connection
+
+  hks_subscriptions_t events;
 };
 typedef struct hks_client_s hks_client_t;
 
-esp_err_t hks_client_new( int fd, hks_client_t **client );
-void hks_client_free( hks_client_t *client );
+// Statically sized client table. Slots are handed out from a free list and
+// found by fd through a direct map, so nothing is allocated per connection.
+struct hks_client_pool_s {
+  hks_client_t clients[HKS_CLIENT_MAX];
+  uint32_t active;    // bitmap of slots in use
+  uint8_t free_head;  // first free slot or HKS_CLIENT_SLOT_NONE
+  uint8_t fd_slot[FD_SETSIZE];
+};
+typedef struct hks_client_pool_s hks_client_pool_t;
+
+// iterate every active slot; clients may be freed inside the loop
+#define HKS_CLIENT_POOL_FOREACH( pool, client ) \
+  for ( uint32_t _m = (pool)->active; \
+        _m && ( ( client ) = &(pool)->clients[__builtin_ctz( _m )], 1 ); \
+        _m &= _m - 1 )
+
+void hks_client_pool_init( hks_client_pool_t *pool );
+
+esp_err_t hks_client_new( hks_client_pool_t *pool, int fd, hks_client_t **client );
+void hks_client_free( hks_client_pool_t *pool, hks_client_t *client );
+hks_client_t *hks_client_find( hks_client_pool_t *pool, int fd );
+
+// The client without a verified session that has sent nothing for longest,
+// at least `idle_ms` up to `now`, and is not waiting on a worker. NULL if
+// there is none.
+hks_client_t *hks_client_evictable( hks_client_pool_t *pool, uint32_t now, uint32_t idle_ms );
 
 esp_err_t hks_client_close( hks_client_t *client );
+
+// write queued responses, through the session once it is secured
+esp_err_t hks_client_flush( hks_client_t *client );
+
+static inline int hks_client_tx_pending( const hks_client_t *client )
+{
+  return hks_session_pending( &client->session, &client->tx );
+}
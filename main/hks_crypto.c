@@ -0,0 +1,562 @@
+#include "hks_crypto.h"
+#include <string.h>
+
+#define _HKS_ROTL32( v, n ) ( ( ( v ) << ( n ) ) | ( ( v ) >> ( 32 - ( n ) ) ) )
+
+#define _HKS_QUARTER_ROUND( a, b, c, d ) \
+  a += b; d ^= a; d = _HKS_ROTL32( d, 16 ); \
+  c += d; b ^= c; b = _HKS_ROTL32( b, 12 ); \
+  a += b; d ^= a; d = _HKS_ROTL32( d, 8 ); \
+  c += d; b ^= c; b = _HKS_ROTL32( b, 7 )
+
+static uint32_t _hks_crypto_load32( const uint8_t *p );
+static void _hks_crypto_store32( uint8_t *p, uint32_t v );
+static void _hks_chacha20_block( hks_chacha20_t *ctx, uint8_t out[64] );
+static void _hks_poly1305_blocks( hks_poly1305_t *ctx, const uint8_t *m, size_t len, uint32_t hibit );
+static void _hks_aead_pad( hks_poly1305_t *poly, uint64_t len );
+static void _hks_sha512_block( hks_sha512_t *ctx, const uint8_t block[128] );
+static uint64_t _hks_crypto_load64_be( const uint8_t *p );
+static void _hks_crypto_store64_be( uint8_t *p, uint64_t v );
+
+static const uint64_t _hks_sha512_k[80] = {
+  0x428a2f98d728ae22ull, 0x7137449123ef65cdull, 0xb5c0fbcfec4d3b2full, 0xe9b5dba58189dbbcull,
+  0x3956c25bf348b538ull, 0x59f111f1b605d019ull, 0x923f82a4af194f9bull, 0xab1c5ed5da6d8118ull,
+  0xd807aa98a3030242ull, 0x12835b0145706fbeull, 0x243185be4ee4b28cull, 0x550c7dc3d5ffb4e2ull,
+  0x72be5d74f27b896full, 0x80deb1fe3b1696b1ull, 0x9bdc06a725c71235ull, 0xc19bf174cf692694ull,
+  0xe49b69c19ef14ad2ull, 0xefbe4786384f25e3ull, 0x0fc19dc68b8cd5b5ull, 0x240ca1cc77ac9c65ull,
+  0x2de92c6f592b0275ull, 0x4a7484aa6ea6e483ull, 0x5cb0a9dcbd41fbd4ull, 0x76f988da831153b5ull,
+  0x983e5152ee66dfabull, 0xa831c66d2db43210ull, 0xb00327c898fb213full, 0xbf597fc7beef0ee4ull,
+  0xc6e00bf33da88fc2ull, 0xd5a79147930aa725ull, 0x06ca6351e003826full, 0x142929670a0e6e70ull,
+  0x27b70a8546d22ffcull, 0x2e1b21385c26c926ull, 0x4d2c6dfc5ac42aedull, 0x53380d139d95b3dfull,
+  0x650a73548baf63deull, 0x766a0abb3c77b2a8ull, 0x81c2c92e47edaee6ull, 0x92722c851482353bull,
+  0xa2bfe8a14cf10364ull, 0xa81a664bbc423001ull, 0xc24b8b70d0f89791ull, 0xc76c51a30654be30ull,
+  0xd192e819d6ef5218ull, 0xd69906245565a910ull, 0xf40e35855771202aull, 0x106aa07032bbd1b8ull,
+  0x19a4c116b8d2d0c8ull, 0x1e376c085141ab53ull, 0x2748774cdf8eeb99ull, 0x34b0bcb5e19b48a8ull,
+  0x391c0cb3c5c95a63ull, 0x4ed8aa4ae3418acbull, 0x5b9cca4f7763e373ull, 0x682e6ff3d6b2b8a3ull,
+  0x748f82ee5defb2fcull, 0x78a5636f43172f60ull, 0x84c87814a1f0ab72ull, 0x8cc702081a6439ecull,
+  0x90befffa23631e28ull, 0xa4506cebde82bde9ull, 0xbef9a3f7b2c67915ull, 0xc67178f2e372532bull,
+  0xca273eceea26619cull, 0xd186b8c721c0c207ull, 0xeada7dd6cde0eb1eull, 0xf57d4f7fee6ed178ull,
+  0x06f067aa72176fbaull, 0x0a637dc5a2c898a6ull, 0x113f9804bef90daeull, 0x1b710b35131c471bull,
+  0x28db77f523047d84ull, 0x32caab7b40c72493ull, 0x3c9ebe0a15c9bebcull, 0x431d67c49c100d4cull,
+  0x4cc5d4becb3e42b6ull, 0x597f299cfc657e2aull, 0x5fcb6fab3ad6faecull, 0x6c44198c4a475817ull
+};
+
+void hks_chacha20_init(
+  hks_chacha20_t *ctx,
+  const uint8_t key[HKS_CHACHA20_KEY_LENGTH],
+  const uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH],
+  uint32_t counter
+)
+{
+  // "expand 32-byte k"
+  ctx->state[0] = 0x61707865;
+  ctx->state[1] = 0x3320646e;
+  ctx->state[2] = 0x79622d32;
+  ctx->state[3] = 0x6b206574;
+  for ( int i = 0; i < 8; i++ )
+    ctx->state[4 + i] = _hks_crypto_load32( key + i * 4 );
+  ctx->state[12] = counter;
+  for ( int i = 0; i < 3; i++ )
+    ctx->state[13 + i] = _hks_crypto_load32( nonce + i * 4 );
+
+  ctx->used = 64;
+}
+
+void hks_chacha20_xor( hks_chacha20_t *ctx, uint8_t *out, const uint8_t *in, size_t len )
+{
+  while ( len > 0 )
+  {
+    if ( ctx->used == 64 )
+    {
+      _hks_chacha20_block( ctx, ctx->stream );
+      ctx->used = 0;
+    }
+
+    size_t n = 64 - ctx->used;
+    if ( n > len )
+      n = len;
+
+    // eight bytes at a time, each word is loaded before anything below it
+    // is stored so `out` may trail `in`
+    const uint8_t *k = ctx->stream + ctx->used;
+    size_t i = 0;
+    for ( ; i + 8 <= n; i += 8 )
+    {
+      uint64_t a, b;
+      memcpy( &a, in + i, 8 );
+      memcpy( &b, k + i, 8 );
+      a ^= b;
+      memcpy( out + i, &a, 8 );
+    }
+    for ( ; i < n; i++ )
+      out[i] = in[i] ^ k[i];
+
+    ctx->used += n;
+    out += n;
+    in += n;
+    len -= n;
+  }
+}
+
+void hks_poly1305_init( hks_poly1305_t *ctx, const uint8_t key[32] )
+{
+  // r is clamped as it is split into 26-bit limbs
+  ctx->r[0] = ( _hks_crypto_load32( key + 0 ) ) & 0x3ffffff;
+  ctx->r[1] = ( _hks_crypto_load32( key + 3 ) >> 2 ) & 0x3ffff03;
+  ctx->r[2] = ( _hks_crypto_load32( key + 6 ) >> 4 ) & 0x3ffc0ff;
+  ctx->r[3] = ( _hks_crypto_load32( key + 9 ) >> 6 ) & 0x3f03fff;
+  ctx->r[4] = ( _hks_crypto_load32( key + 12 ) >> 8 ) & 0x00fffff;
+
+  memset( ctx->h, 0, sizeof( ctx->h ) );
+  for ( int i = 0; i < 4; i++ )
+    ctx->pad[i] = _hks_crypto_load32( key + 16 + i * 4 );
+
+  ctx->leftover = 0;
+}
+
+void hks_poly1305_update( hks_poly1305_t *ctx, const uint8_t *data, size_t len )
+{
+  if ( ctx->leftover > 0 )
+  {
+    size_t want = 16 - ctx->leftover;
+    if ( want > len )
+      want = len;
+
+    memcpy( ctx->buffer + ctx->leftover, data, want );
+    ctx->leftover += want;
+    data += want;
+    len -= want;
+    if ( ctx->leftover < 16 )
+      return;
+
+    _hks_poly1305_blocks( ctx, ctx->buffer, 16, 1 << 24 );
+    ctx->leftover = 0;
+  }
+
+  size_t full = len & ~(size_t)15;
+  if ( full > 0 )
+  {
+    _hks_poly1305_blocks( ctx, data, full, 1 << 24 );
+    data += full;
+    len -= full;
+  }
+
+  if ( len > 0 )
+  {
+    memcpy( ctx->buffer, data, len );
+    ctx->leftover = len;
+  }
+}
+
+void hks_poly1305_finish( hks_poly1305_t *ctx, uint8_t tag[HKS_POLY1305_TAG_LENGTH] )
+{
+  // the last partial block carries its own 1 bit
+  if ( ctx->leftover > 0 )
+  {
+    ctx->buffer[ctx->leftover] = 1;
+    memset( ctx->buffer + ctx->leftover + 1, 0, 15 - ctx->leftover );
+    _hks_poly1305_blocks( ctx, ctx->buffer, 16, 0 );
+  }
+
+  uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], h3 = ctx->h[3], h4 = ctx->h[4];
+  uint32_t c;
+
+  c = h1 >> 26; h1 &= 0x3ffffff;
+  h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+  h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+  h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+  h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+  h1 += c;
+
+  // h - p, kept if it did not go negative
+  uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+  uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+  uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+  uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+  uint32_t g4 = h4 + c - ( 1 << 26 );
+
+  uint32_t mask = ( g4 >> 31 ) - 1;
+  h0 = ( h0 & ~mask ) | ( g0 & mask );
+  h1 = ( h1 & ~mask ) | ( g1 & mask );
+  h2 = ( h2 & ~mask ) | ( g2 & mask );
+  h3 = ( h3 & ~mask ) | ( g3 & mask );
+  h4 = ( h4 & ~mask ) | ( g4 & mask );
+
+  // to 2^128 and add the pad
+  h0 = h0 | ( h1 << 26 );
+  h1 = ( h1 >> 6 ) | ( h2 << 20 );
+  h2 = ( h2 >> 12 ) | ( h3 << 14 );
+  h3 = ( h3 >> 18 ) | ( h4 << 8 );
+
+  uint64_t f;
+  f = (uint64_t)h0 + ctx->pad[0]; h0 = (uint32_t)f;
+  f = (uint64_t)h1 + ctx->pad[1] + ( f >> 32 ); h1 = (uint32_t)f;
+  f = (uint64_t)h2 + ctx->pad[2] + ( f >> 32 ); h2 = (uint32_t)f;
+  f = (uint64_t)h3 + ctx->pad[3] + ( f >> 32 ); h3 = (uint32_t)f;
+
+  _hks_crypto_store32( tag + 0, h0 );
+  _hks_crypto_store32( tag + 4, h1 );
+  _hks_crypto_store32( tag + 8, h2 );
+  _hks_crypto_store32( tag + 12, h3 );
+}
+
+void hks_aead_init(
+  hks_aead_t *ctx,
+  const uint8_t key[HKS_CHACHA20_KEY_LENGTH],
+  const uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH],
+  const uint8_t *aad,
+  size_t aad_len
+)
+{
+  // block 0 keys Poly1305, the message starts at block 1
+  hks_chacha20_init( &ctx->chacha, key, nonce, 0 );
+  _hks_chacha20_block( &ctx->chacha, ctx->chacha.stream );
+  hks_poly1305_init( &ctx->poly, ctx->chacha.stream );
+  ctx->chacha.used = 64;
+
+  hks_poly1305_update( &ctx->poly, aad, aad_len );
+  _hks_aead_pad( &ctx->poly, aad_len );
+
+  ctx->aad_len = aad_len;
+  ctx->len = 0;
+}
+
+void hks_aead_encrypt( hks_aead_t *ctx, uint8_t *out, const uint8_t *in, size_t len )
+{
+  hks_chacha20_xor( &ctx->chacha, out, in, len );
+  hks_poly1305_update( &ctx->poly, out, len );
+  ctx->len += len;
+}
+
+void hks_aead_decrypt( hks_aead_t *ctx, uint8_t *out, const uint8_t *in, size_t len )
+{
+  hks_poly1305_update( &ctx->poly, in, len );
+  hks_chacha20_xor( &ctx->chacha, out, in, len );
+  ctx->len += len;
+}
+
+void hks_aead_finish( hks_aead_t *ctx, uint8_t tag[HKS_POLY1305_TAG_LENGTH] )
+{
+  _hks_aead_pad( &ctx->poly, ctx->len );
+
+  uint8_t lengths[16];
+  _hks_crypto_store32( lengths + 0, (uint32_t)ctx->aad_len );
+  _hks_crypto_store32( lengths + 4, (uint32_t)( ctx->aad_len >> 32 ) );
+  _hks_crypto_store32( lengths + 8, (uint32_t)ctx->len );
+  _hks_crypto_store32( lengths + 12, (uint32_t)( ctx->len >> 32 ) );
+  hks_poly1305_update( &ctx->poly, lengths, sizeof( lengths ) );
+
+  hks_poly1305_finish( &ctx->poly, tag );
+}
+
+void hks_sha512_init( hks_sha512_t *ctx )
+{
+  static const uint64_t iv[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+  };
+  memcpy( ctx->state, iv, sizeof( iv ) );
+  ctx->count = 0;
+}
+
+void hks_sha512_update( hks_sha512_t *ctx, const void *data, size_t len )
+{
+  const uint8_t *p = (const uint8_t *)data;
+  size_t used = ctx->count % 128;
+  ctx->count += len;
+
+  if ( used > 0 )
+  {
+    size_t want = 128 - used;
+    if ( want > len )
+    {
+      memcpy( ctx->buffer + used, p, len );
+      return;
+    }
+
+    memcpy( ctx->buffer + used, p, want );
+    _hks_sha512_block( ctx, ctx->buffer );
+    p += want;
+    len -= want;
+  }
+
+  for ( ; len >= 128; p += 128, len -= 128 )
+    _hks_sha512_block( ctx, p );
+
+  memcpy( ctx->buffer, p, len );
+}
+
+void hks_sha512_finish( hks_sha512_t *ctx, uint8_t digest[HKS_SHA512_LENGTH] )
+{
+  size_t used = ctx->count % 128;
+  uint64_t bits = ctx->count * 8;
+
+  ctx->buffer[used++] = 0x80;
+  if ( used > 112 )
+  {
+    memset( ctx->buffer + used, 0, 128 - used );
+    _hks_sha512_block( ctx, ctx->buffer );
+    used = 0;
+  }
+  memset( ctx->buffer + used, 0, 120 - used );
+  _hks_crypto_store64_be( ctx->buffer + 120, bits );
+  _hks_sha512_block( ctx, ctx->buffer );
+
+  for ( int i = 0; i < 8; i++ )
+    _hks_crypto_store64_be( digest + i * 8, ctx->state[i] );
+}
+
+void hks_sha512( const void *data, size_t len, uint8_t digest[HKS_SHA512_LENGTH] )
+{
+  hks_sha512_t ctx;
+  hks_sha512_init( &ctx );
+  hks_sha512_update( &ctx, data, len );
+  hks_sha512_finish( &ctx, digest );
+}
+
+void hks_hmac_sha512_init( hks_hmac_sha512_t *ctx, const uint8_t *key, size_t key_len )
+{
+  uint8_t pad[128];
+  memset( pad, 0, sizeof( pad ) );
+  if ( key_len > sizeof( pad ) )
+    hks_sha512( key, key_len, pad );
+  else
+    memcpy( pad, key, key_len );
+
+  for ( int i = 0; i < 128; i++ )
+    pad[i] ^= 0x36;
+  hks_sha512_init( &ctx->inner );
+  hks_sha512_update( &ctx->inner, pad, sizeof( pad ) );
+
+  for ( int i = 0; i < 128; i++ )
+    pad[i] ^= 0x36 ^ 0x5c;
+  hks_sha512_init( &ctx->outer );
+  hks_sha512_update( &ctx->outer, pad, sizeof( pad ) );
+}
+
+void hks_hmac_sha512_update( hks_hmac_sha512_t *ctx, const void *data, size_t len )
+{
+  hks_sha512_update( &ctx->inner, data, len );
+}
+
+void hks_hmac_sha512_finish( hks_hmac_sha512_t *ctx, uint8_t mac[HKS_SHA512_LENGTH] )
+{
+  uint8_t inner[HKS_SHA512_LENGTH];
+  hks_sha512_finish( &ctx->inner, inner );
+  hks_sha512_update( &ctx->outer, inner, sizeof( inner ) );
+  hks_sha512_finish( &ctx->outer, mac );
+}
+
+void hks_hkdf_sha512(
+  const uint8_t *ikm,
+  size_t ikm_len,
+  const char *salt,
+  const char *info,
+  uint8_t *out,
+  size_t out_len
+)
+{
+  hks_hkdf_sha512_salt( ikm, ikm_len, (const uint8_t *)salt, strlen( salt ), info, out, out_len );
+}
+
+void hks_hkdf_sha512_salt(
+  const uint8_t *ikm,
+  size_t ikm_len,
+  const uint8_t *salt,
+  size_t salt_len,
+  const char *info,
+  uint8_t *out,
+  size_t out_len
+)
+{
+  hks_hmac_sha512_t hmac;
+  uint8_t prk[HKS_SHA512_LENGTH];
+  hks_hmac_sha512_init( &hmac, salt, salt_len );
+  hks_hmac_sha512_update( &hmac, ikm, ikm_len );
+  hks_hmac_sha512_finish( &hmac, prk );
+
+  uint8_t t[HKS_SHA512_LENGTH];
+  size_t info_len = strlen( info );
+  for ( uint8_t i = 1; out_len > 0; i++ )
+  {
+    hks_hmac_sha512_init( &hmac, prk, sizeof( prk ) );
+    if ( i > 1 )
+      hks_hmac_sha512_update( &hmac, t, sizeof( t ) );
+    hks_hmac_sha512_update( &hmac, info, info_len );
+    hks_hmac_sha512_update( &hmac, &i, 1 );
+    hks_hmac_sha512_finish( &hmac, t );
+
+    size_t n = out_len < sizeof( t ) ? out_len : sizeof( t );
+    memcpy( out, t, n );
+    out += n;
+    out_len -= n;
+  }
+}
+
+int hks_crypto_equal( const uint8_t *a, const uint8_t *b, size_t len )
+{
+  uint8_t d = 0;
+  for ( size_t i = 0; i < len; i++ )
+    d |= a[i] ^ b[i];
+  return d == 0;
+}
+
+uint32_t _hks_crypto_load32( const uint8_t *p )
+{
+  return (uint32_t)p[0] | ( (uint32_t)p[1] << 8 ) | ( (uint32_t)p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+}
+
+void _hks_crypto_store32( uint8_t *p, uint32_t v )
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+void _hks_chacha20_block( hks_chacha20_t *ctx, uint8_t out[64] )
+{
+  uint32_t x0 = ctx->state[0], x1 = ctx->state[1], x2 = ctx->state[2], x3 = ctx->state[3];
+  uint32_t x4 = ctx->state[4], x5 = ctx->state[5], x6 = ctx->state[6], x7 = ctx->state[7];
+  uint32_t x8 = ctx->state[8], x9 = ctx->state[9], x10 = ctx->state[10], x11 = ctx->state[11];
+  uint32_t x12 = ctx->state[12], x13 = ctx->state[13], x14 = ctx->state[14], x15 = ctx->state[15];
+
+  for ( int i = 0; i < 10; i++ )
+  {
+    _HKS_QUARTER_ROUND( x0, x4, x8, x12 );
+    _HKS_QUARTER_ROUND( x1, x5, x9, x13 );
+    _HKS_QUARTER_ROUND( x2, x6, x10, x14 );
+    _HKS_QUARTER_ROUND( x3, x7, x11, x15 );
+    _HKS_QUARTER_ROUND( x0, x5, x10, x15 );
+    _HKS_QUARTER_ROUND( x1, x6, x11, x12 );
+    _HKS_QUARTER_ROUND( x2, x7, x8, x13 );
+    _HKS_QUARTER_ROUND( x3, x4, x9, x14 );
+  }
+
+  _hks_crypto_store32( out + 0, x0 + ctx->state[0] );
+  _hks_crypto_store32( out + 4, x1 + ctx->state[1] );
+  _hks_crypto_store32( out + 8, x2 + ctx->state[2] );
+  _hks_crypto_store32( out + 12, x3 + ctx->state[3] );
+  _hks_crypto_store32( out + 16, x4 + ctx->state[4] );
+  _hks_crypto_store32( out + 20, x5 + ctx->state[5] );
+  _hks_crypto_store32( out + 24, x6 + ctx->state[6] );
+  _hks_crypto_store32( out + 28, x7 + ctx->state[7] );
+  _hks_crypto_store32( out + 32, x8 + ctx->state[8] );
+  _hks_crypto_store32( out + 36, x9 + ctx->state[9] );
+  _hks_crypto_store32( out + 40, x10 + ctx->state[10] );
+  _hks_crypto_store32( out + 44, x11 + ctx->state[11] );
+  _hks_crypto_store32( out + 48, x12 + ctx->state[12] );
+  _hks_crypto_store32( out + 52, x13 + ctx->state[13] );
+  _hks_crypto_store32( out + 56, x14 + ctx->state[14] );
+  _hks_crypto_store32( out + 60, x15 + ctx->state[15] );
+
+  ctx->state[12]++;
+}
+
+void _hks_poly1305_blocks( hks_poly1305_t *ctx, const uint8_t *m, size_t len, uint32_t hibit )
+{
+  uint32_t r0 = ctx->r[0], r1 = ctx->r[1], r2 = ctx->r[2], r3 = ctx->r[3], r4 = ctx->r[4];
+  uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+  uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], h3 = ctx->h[3], h4 = ctx->h[4];
+
+  for ( ; len >= 16; m += 16, len -= 16 )
+  {
+    h0 += ( _hks_crypto_load32( m + 0 ) ) & 0x3ffffff;
+    h1 += ( _hks_crypto_load32( m + 3 ) >> 2 ) & 0x3ffffff;
+    h2 += ( _hks_crypto_load32( m + 6 ) >> 4 ) & 0x3ffffff;
+    h3 += ( _hks_crypto_load32( m + 9 ) >> 6 ) & 0x3ffffff;
+    h4 += ( _hks_crypto_load32( m + 12 ) >> 8 ) | hibit;
+
+    uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+    uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+    uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+    uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+    uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+    uint32_t c;
+    c = (uint32_t)( d0 >> 26 ); h0 = (uint32_t)d0 & 0x3ffffff;
+    d1 += c; c = (uint32_t)( d1 >> 26 ); h1 = (uint32_t)d1 & 0x3ffffff;
+    d2 += c; c = (uint32_t)( d2 >> 26 ); h2 = (uint32_t)d2 & 0x3ffffff;
+    d3 += c; c = (uint32_t)( d3 >> 26 ); h3 = (uint32_t)d3 & 0x3ffffff;
+    d4 += c; c = (uint32_t)( d4 >> 26 ); h4 = (uint32_t)d4 & 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+  }
+
+  ctx->h[0] = h0;
+  ctx->h[1] = h1;
+  ctx->h[2] = h2;
+  ctx->h[3] = h3;
+  ctx->h[4] = h4;
+}
+
+void _hks_aead_pad( hks_poly1305_t *poly, uint64_t len )
+{
+  static const uint8_t zeros[16] = { 0 };
+  if ( len % 16 )
+    hks_poly1305_update( poly, zeros, 16 - len % 16 );
+}
+
+#define _HKS_ROTR64( v, n ) ( ( ( v ) >> ( n ) ) | ( ( v ) << ( 64 - ( n ) ) ) )
+
+void _hks_sha512_block( hks_sha512_t *ctx, const uint8_t block[128] )
+{
+  // the message schedule is kept as a rolling window of 16 words
+  uint64_t w[16];
+  for ( int i = 0; i < 16; i++ )
+    w[i] = _hks_crypto_load64_be( block + i * 8 );
+
+  uint64_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+  uint64_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+
+  for ( int i = 0; i < 80; i++ )
+  {
+    if ( i >= 16 )
+    {
+      uint64_t w15 = w[( i - 15 ) & 15], w2 = w[( i - 2 ) & 15];
+      uint64_t s0 = _HKS_ROTR64( w15, 1 ) ^ _HKS_ROTR64( w15, 8 ) ^ ( w15 >> 7 );
+      uint64_t s1 = _HKS_ROTR64( w2, 19 ) ^ _HKS_ROTR64( w2, 61 ) ^ ( w2 >> 6 );
+      w[i & 15] += s0 + w[( i - 7 ) & 15] + s1;
+    }
+
+    uint64_t t1 = h + ( _HKS_ROTR64( e, 14 ) ^ _HKS_ROTR64( e, 18 ) ^ _HKS_ROTR64( e, 41 ) ) +
+      ( ( e & f ) ^ ( ~e & g ) ) + _hks_sha512_k[i] + w[i & 15];
+    uint64_t t2 = ( _HKS_ROTR64( a, 28 ) ^ _HKS_ROTR64( a, 34 ) ^ _HKS_ROTR64( a, 39 ) ) +
+      ( ( a & b ) ^ ( a & c ) ^ ( b & c ) );
+
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  ctx->state[0] += a;
+  ctx->state[1] += b;
+  ctx->state[2] += c;
+  ctx->state[3] += d;
+  ctx->state[4] += e;
+  ctx->state[5] += f;
+  ctx->state[6] += g;
+  ctx->state[7] += h;
+}
+
+uint64_t _hks_crypto_load64_be( const uint8_t *p )
+{
+  uint64_t v = 0;
+  for ( int i = 0; i < 8; i++ )
+    v = ( v << 8 ) | p[i];
+  return v;
+}
+
+void _hks_crypto_store64_be( uint8_t *p, uint64_t v )
+{
+  for ( int i = 7; i >= 0; i-- )
+  {
+    p[i] = (uint8_t)v;
+    v >>= 8;
+  }
+}
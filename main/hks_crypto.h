@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ChaCha20-Poly1305 (RFC 8439) and SHA-512 with its HMAC and HKDF in
+// portable C, incremental so a frame can be sealed from several buffers.
+// Nothing is allocated.
+
+#define HKS_CHACHA20_KEY_LENGTH    32
+#define HKS_CHACHA20_NONCE_LENGTH  12
+#define HKS_POLY1305_TAG_LENGTH    16
+#define HKS_SHA512_LENGTH          64
+
+struct hks_chacha20_s {
+  uint32_t state[16];
+  uint8_t stream[64];
+  uint8_t used; // bytes of `stream` consumed, 64 when a new block is due
+};
+typedef struct hks_chacha20_s hks_chacha20_t;
+
+extern void hks_chacha20_init(
+  hks_chacha20_t *ctx,
+  const uint8_t key[HKS_CHACHA20_KEY_LENGTH],
+  const uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH],
+  uint32_t counter
+);
+
+// `out` may be `in` or start before it, so data can be moved down while it
+// is being decrypted
+extern void hks_chacha20_xor( hks_chacha20_t *ctx, uint8_t *out, const uint8_t *in, size_t len );
+
+struct hks_poly1305_s {
+  uint32_t r[5];
+  uint32_t h[5];
+  uint32_t pad[4];
+  uint8_t buffer[16];
+  uint8_t leftover;
+};
+typedef struct hks_poly1305_s hks_poly1305_t;
+
+extern void hks_poly1305_init( hks_poly1305_t *ctx, const uint8_t key[32] );
+extern void hks_poly1305_update( hks_poly1305_t *ctx, const uint8_t *data, size_t len );
+extern void hks_poly1305_finish( hks_poly1305_t *ctx, uint8_t tag[HKS_POLY1305_TAG_LENGTH] );
+
+// AEAD_CHACHA20_POLY1305: init with the additional data, then encrypt or
+// decrypt the message in any number of pieces and finish for the tag.
+struct hks_aead_s {
+  hks_chacha20_t chacha;
+  hks_poly1305_t poly;
+  uint64_t aad_len;
+  uint64_t len;
+};
+typedef struct hks_aead_s hks_aead_t;
+
+extern void hks_aead_init(
+  hks_aead_t *ctx,
+  const uint8_t key[HKS_CHACHA20_KEY_LENGTH],
+  const uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH],
+  const uint8_t *aad,
+  size_t aad_len
+);
+extern void hks_aead_encrypt( hks_aead_t *ctx, uint8_t *out, const uint8_t *in, size_t len );
+extern void hks_aead_decrypt( hks_aead_t *ctx, uint8_t *out, const uint8_t *in, size_t len );
+extern void hks_aead_finish( hks_aead_t *ctx, uint8_t tag[HKS_POLY1305_TAG_LENGTH] );
+
+struct hks_sha512_s {
+  uint64_t state[8];
+  uint64_t count; // bytes hashed so far
+  uint8_t buffer[128];
+};
+typedef struct hks_sha512_s hks_sha512_t;
+
+extern void hks_sha512_init( hks_sha512_t *ctx );
+extern void hks_sha512_update( hks_sha512_t *ctx, const void *data, size_t len );
+extern void hks_sha512_finish( hks_sha512_t *ctx, uint8_t digest[HKS_SHA512_LENGTH] );
+extern void hks_sha512( const void *data, size_t len, uint8_t digest[HKS_SHA512_LENGTH] );
+
+struct hks_hmac_sha512_s {
+  hks_sha512_t inner;
+  hks_sha512_t outer;
+};
+typedef struct hks_hmac_sha512_s hks_hmac_sha512_t;
+
+extern void hks_hmac_sha512_init( hks_hmac_sha512_t *ctx, const uint8_t *key, size_t key_len );
+extern void hks_hmac_sha512_update( hks_hmac_sha512_t *ctx, const void *data, size_t len );
+extern void hks_hmac_sha512_finish( hks_hmac_sha512_t *ctx, uint8_t mac[HKS_SHA512_LENGTH] );
+
+// RFC 5869 extract and expand, `out_len` up to 255 * 64 bytes
+extern void hks_hkdf_sha512(
+  const uint8_t *ikm,
+  size_t ikm_len,
+  const char *salt,
+  const char *info,
+  uint8_t *out,
+  size_t out_len
+);
+
+// the same with a binary salt
+extern void hks_hkdf_sha512_salt(
+  const uint8_t *ikm,
+  size_t ikm_len,
+  const uint8_t *salt,
+  size_t salt_len,
+  const char *info,
+  uint8_t *out,
+  size_t out_len
+);
+
+// constant time
+extern int hks_crypto_equal( const uint8_t *a, const uint8_t *b, size_t len );
@@ -0,0 +1,496 @@
+#include "hks_curve25519.h"
+#include <string.h>
+#include "hks_crypto.h"
+
+// an element of GF(2^255 - 19), limbs may run over 16 bits between carries
+typedef int64_t hks_fe_t[16];
+
+static const hks_fe_t _hks_fe_zero = { 0 };
+static const hks_fe_t _hks_fe_one = { 1 };
+static const hks_fe_t _hks_fe_121665 = { 0xdb41, 1 };
+static const hks_fe_t _hks_ed25519_d = {
+  0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070,
+  0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203
+};
+static const hks_fe_t _hks_ed25519_d2 = {
+  0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+  0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406
+};
+static const hks_fe_t _hks_ed25519_x = {
+  0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+  0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169
+};
+static const hks_fe_t _hks_ed25519_y = {
+  0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+  0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666
+};
+static const hks_fe_t _hks_fe_sqrtm1 = {
+  0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43,
+  0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83
+};
+
+// the group order, little endian
+static const uint8_t _hks_ed25519_l[32] = {
+  0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+static void _hks_fe_copy( hks_fe_t r, const hks_fe_t a );
+static void _hks_fe_carry( hks_fe_t o );
+static void _hks_fe_select( hks_fe_t p, hks_fe_t q, int b );
+static void _hks_fe_pack( uint8_t o[32], const hks_fe_t n );
+static void _hks_fe_unpack( hks_fe_t o, const uint8_t n[32] );
+static int _hks_fe_equal( const hks_fe_t a, const hks_fe_t b );
+static int _hks_fe_parity( const hks_fe_t a );
+static void _hks_fe_add( hks_fe_t o, const hks_fe_t a, const hks_fe_t b );
+static void _hks_fe_sub( hks_fe_t o, const hks_fe_t a, const hks_fe_t b );
+static void _hks_fe_mul( hks_fe_t o, const hks_fe_t a, const hks_fe_t b );
+static void _hks_fe_invert( hks_fe_t o, const hks_fe_t i );
+static void _hks_fe_pow2523( hks_fe_t o, const hks_fe_t i );
+static void _hks_ge_add( hks_fe_t p[4], hks_fe_t q[4] );
+static void _hks_ge_pack( uint8_t r[32], hks_fe_t p[4] );
+static int _hks_ge_unpack_negative( hks_fe_t r[4], const uint8_t p[32] );
+static void _hks_ge_scalarmult( hks_fe_t p[4], hks_fe_t q[4], const uint8_t s[32] );
+static void _hks_ge_scalarmult_base( hks_fe_t p[4], const uint8_t s[32] );
+static void _hks_sc_reduce_wide( uint8_t r[32], int64_t x[64] );
+static void _hks_sc_reduce( uint8_t r[64] );
+static void _hks_ed25519_expand( uint8_t d[64], const uint8_t seed[32] );
+
+void hks_x25519( uint8_t out[HKS_X25519_KEY_LENGTH], const uint8_t scalar[HKS_X25519_KEY_LENGTH], const uint8_t point[HKS_X25519_KEY_LENGTH] )
+{
+  uint8_t z[32];
+  memcpy( z, scalar, 32 );
+  z[31] = ( z[31] & 127 ) | 64;
+  z[0] &= 248;
+
+  // Montgomery ladder over projective x: (a : c) and (b : d)
+  hks_fe_t x, a, b, c, d, e, f;
+  _hks_fe_unpack( x, point );
+  _hks_fe_copy( b, x );
+  _hks_fe_copy( a, _hks_fe_one );
+  _hks_fe_copy( c, _hks_fe_zero );
+  _hks_fe_copy( d, _hks_fe_one );
+
+  for ( int i = 254; i >= 0; i-- )
+  {
+    int r = ( z[i >> 3] >> ( i & 7 ) ) & 1;
+    _hks_fe_select( a, b, r );
+    _hks_fe_select( c, d, r );
+    _hks_fe_add( e, a, c );
+    _hks_fe_sub( a, a, c );
+    _hks_fe_add( c, b, d );
+    _hks_fe_sub( b, b, d );
+    _hks_fe_mul( d, e, e );
+    _hks_fe_mul( f, a, a );
+    _hks_fe_mul( a, c, a );
+    _hks_fe_mul( c, b, e );
+    _hks_fe_add( e, a, c );
+    _hks_fe_sub( a, a, c );
+    _hks_fe_mul( b, a, a );
+    _hks_fe_sub( c, d, f );
+    _hks_fe_mul( a, c, _hks_fe_121665 );
+    _hks_fe_add( a, a, d );
+    _hks_fe_mul( c, c, a );
+    _hks_fe_mul( a, d, f );
+    _hks_fe_mul( d, b, x );
+    _hks_fe_mul( b, e, e );
+    _hks_fe_select( a, b, r );
+    _hks_fe_select( c, d, r );
+  }
+
+  _hks_fe_invert( c, c );
+  _hks_fe_mul( a, a, c );
+  _hks_fe_pack( out, a );
+}
+
+void hks_x25519_public( uint8_t out[HKS_X25519_KEY_LENGTH], const uint8_t scalar[HKS_X25519_KEY_LENGTH] )
+{
+  static const uint8_t base[32] = { 9 };
+  hks_x25519( out, scalar, base );
+}
+
+void hks_ed25519_public( uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH], const uint8_t seed[HKS_ED25519_SEED_LENGTH] )
+{
+  uint8_t d[64];
+  hks_fe_t p[4];
+  _hks_ed25519_expand( d, seed );
+  _hks_ge_scalarmult_base( p, d );
+  _hks_ge_pack( public_key, p );
+}
+
+void hks_ed25519_sign(
+  uint8_t signature[HKS_ED25519_SIGNATURE_LENGTH],
+  const uint8_t *message,
+  size_t len,
+  const uint8_t seed[HKS_ED25519_SEED_LENGTH],
+  const uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH]
+)
+{
+  uint8_t d[64], r[64], h[64];
+  hks_fe_t p[4];
+  _hks_ed25519_expand( d, seed );
+
+  // r = H(prefix | M), R = rB
+  hks_sha512_t sha;
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, d + 32, 32 );
+  hks_sha512_update( &sha, message, len );
+  hks_sha512_finish( &sha, r );
+  _hks_sc_reduce( r );
+  _hks_ge_scalarmult_base( p, r );
+  _hks_ge_pack( signature, p );
+
+  // S = r + H(R | A | M) s
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, signature, 32 );
+  hks_sha512_update( &sha, public_key, 32 );
+  hks_sha512_update( &sha, message, len );
+  hks_sha512_finish( &sha, h );
+  _hks_sc_reduce( h );
+
+  int64_t x[64];
+  memset( x, 0, sizeof( x ) );
+  for ( int i = 0; i < 32; i++ )
+    x[i] = r[i];
+  for ( int i = 0; i < 32; i++ )
+    for ( int j = 0; j < 32; j++ )
+      x[i + j] += h[i] * (int64_t)d[j];
+  _hks_sc_reduce_wide( signature + 32, x );
+}
+
+int hks_ed25519_verify(
+  const uint8_t signature[HKS_ED25519_SIGNATURE_LENGTH],
+  const uint8_t *message,
+  size_t len,
+  const uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH]
+)
+{
+  // S must be below the group order
+  for ( int i = 31; i >= 0; i-- )
+  {
+    if ( signature[32 + i] < _hks_ed25519_l[i] )
+      break;
+    if ( signature[32 + i] > _hks_ed25519_l[i] || i == 0 )
+      return 0;
+  }
+
+  hks_fe_t p[4], q[4];
+  if ( _hks_ge_unpack_negative( q, public_key ) )
+    return 0;
+
+  uint8_t h[64];
+  hks_sha512_t sha;
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, signature, 32 );
+  hks_sha512_update( &sha, public_key, 32 );
+  hks_sha512_update( &sha, message, len );
+  hks_sha512_finish( &sha, h );
+  _hks_sc_reduce( h );
+
+  // SB - hA must come out as R
+  _hks_ge_scalarmult( p, q, h );
+  _hks_ge_scalarmult_base( q, signature + 32 );
+  _hks_ge_add( p, q );
+
+  uint8_t t[32];
+  _hks_ge_pack( t, p );
+  return hks_crypto_equal( signature, t, 32 );
+}
+
+void _hks_fe_copy( hks_fe_t r, const hks_fe_t a )
+{
+  memcpy( r, a, sizeof( hks_fe_t ) );
+}
+
+void _hks_fe_carry( hks_fe_t o )
+{
+  // the carry out of the top limb wraps around times 38 = 2 * 19
+  for ( int i = 0; i < 16; i++ )
+  {
+    o[i] += 1 << 16;
+    int64_t c = o[i] >> 16;
+    if ( i < 15 )
+      o[i + 1] += c - 1;
+    else
+      o[0] += 38 * ( c - 1 );
+    o[i] -= c * 65536;
+  }
+}
+
+void _hks_fe_select( hks_fe_t p, hks_fe_t q, int b )
+{
+  // swap when b is 1, without a branch
+  int64_t mask = ~( (int64_t)b - 1 );
+  for ( int i = 0; i < 16; i++ )
+  {
+    int64_t t = mask & ( p[i] ^ q[i] );
+    p[i] ^= t;
+    q[i] ^= t;
+  }
+}
+
+void _hks_fe_pack( uint8_t o[32], const hks_fe_t n )
+{
+  hks_fe_t m, t;
+  _hks_fe_copy( t, n );
+  _hks_fe_carry( t );
+  _hks_fe_carry( t );
+  _hks_fe_carry( t );
+
+  // subtract p at most twice to get the canonical value
+  for ( int j = 0; j < 2; j++ )
+  {
+    m[0] = t[0] - 0xffed;
+    for ( int i = 1; i < 15; i++ )
+    {
+      m[i] = t[i] - 0xffff - ( ( m[i - 1] >> 16 ) & 1 );
+      m[i - 1] &= 0xffff;
+    }
+    m[15] = t[15] - 0x7fff - ( ( m[14] >> 16 ) & 1 );
+    int b = ( m[15] >> 16 ) & 1;
+    m[14] &= 0xffff;
+    _hks_fe_select( t, m, 1 - b );
+  }
+
+  for ( int i = 0; i < 16; i++ )
+  {
+    o[2 * i] = t[i] & 0xff;
+    o[2 * i + 1] = t[i] >> 8;
+  }
+}
+
+void _hks_fe_unpack( hks_fe_t o, const uint8_t n[32] )
+{
+  for ( int i = 0; i < 16; i++ )
+    o[i] = n[2 * i] + ( (int64_t)n[2 * i + 1] << 8 );
+  o[15] &= 0x7fff;
+}
+
+int _hks_fe_equal( const hks_fe_t a, const hks_fe_t b )
+{
+  uint8_t c[32], d[32];
+  _hks_fe_pack( c, a );
+  _hks_fe_pack( d, b );
+  return hks_crypto_equal( c, d, 32 );
+}
+
+int _hks_fe_parity( const hks_fe_t a )
+{
+  uint8_t d[32];
+  _hks_fe_pack( d, a );
+  return d[0] & 1;
+}
+
+void _hks_fe_add( hks_fe_t o, const hks_fe_t a, const hks_fe_t b )
+{
+  for ( int i = 0; i < 16; i++ )
+    o[i] = a[i] + b[i];
+}
+
+void _hks_fe_sub( hks_fe_t o, const hks_fe_t a, const hks_fe_t b )
+{
+  for ( int i = 0; i < 16; i++ )
+    o[i] = a[i] - b[i];
+}
+
+void _hks_fe_mul( hks_fe_t o, const hks_fe_t a, const hks_fe_t b )
+{
+  int64_t t[31];
+  memset( t, 0, sizeof( t ) );
+  for ( int i = 0; i < 16; i++ )
+    for ( int j = 0; j < 16; j++ )
+      t[i + j] += a[i] * b[j];
+
+  // 2^256 = 38 mod p
+  for ( int i = 0; i < 15; i++ )
+    t[i] += 38 * t[i + 16];
+  for ( int i = 0; i < 16; i++ )
+    o[i] = t[i];
+
+  _hks_fe_carry( o );
+  _hks_fe_carry( o );
+}
+
+void _hks_fe_invert( hks_fe_t o, const hks_fe_t i )
+{
+  // i^(p - 2)
+  hks_fe_t c;
+  _hks_fe_copy( c, i );
+  for ( int a = 253; a >= 0; a-- )
+  {
+    _hks_fe_mul( c, c, c );
+    if ( a != 2 && a != 4 )
+      _hks_fe_mul( c, c, i );
+  }
+  _hks_fe_copy( o, c );
+}
+
+void _hks_fe_pow2523( hks_fe_t o, const hks_fe_t i )
+{
+  // i^((p - 5) / 8)
+  hks_fe_t c;
+  _hks_fe_copy( c, i );
+  for ( int a = 250; a >= 0; a-- )
+  {
+    _hks_fe_mul( c, c, c );
+    if ( a != 1 )
+      _hks_fe_mul( c, c, i );
+  }
+  _hks_fe_copy( o, c );
+}
+
+void _hks_ge_add( hks_fe_t p[4], hks_fe_t q[4] )
+{
+  // extended coordinates (X : Y : Z : T), p += q
+  hks_fe_t a, b, c, d, t, e, f, g, h;
+  _hks_fe_sub( a, p[1], p[0] );
+  _hks_fe_sub( t, q[1], q[0] );
+  _hks_fe_mul( a, a, t );
+  _hks_fe_add( b, p[0], p[1] );
+  _hks_fe_add( t, q[0], q[1] );
+  _hks_fe_mul( b, b, t );
+  _hks_fe_mul( c, p[3], q[3] );
+  _hks_fe_mul( c, c, _hks_ed25519_d2 );
+  _hks_fe_mul( d, p[2], q[2] );
+  _hks_fe_add( d, d, d );
+  _hks_fe_sub( e, b, a );
+  _hks_fe_sub( f, d, c );
+  _hks_fe_add( g, d, c );
+  _hks_fe_add( h, b, a );
+
+  _hks_fe_mul( p[0], e, f );
+  _hks_fe_mul( p[1], h, g );
+  _hks_fe_mul( p[2], g, f );
+  _hks_fe_mul( p[3], e, h );
+}
+
+void _hks_ge_pack( uint8_t r[32], hks_fe_t p[4] )
+{
+  hks_fe_t tx, ty, zi;
+  _hks_fe_invert( zi, p[2] );
+  _hks_fe_mul( tx, p[0], zi );
+  _hks_fe_mul( ty, p[1], zi );
+  _hks_fe_pack( r, ty );
+  r[31] ^= _hks_fe_parity( tx ) << 7;
+}
+
+int _hks_ge_unpack_negative( hks_fe_t r[4], const uint8_t p[32] )
+{
+  // x^2 = (y^2 - 1) / (d y^2 + 1), the root through (p - 5) / 8
+  hks_fe_t t, chk, num, den, den2, den4, den6;
+  _hks_fe_copy( r[2], _hks_fe_one );
+  _hks_fe_unpack( r[1], p );
+  _hks_fe_mul( num, r[1], r[1] );
+  _hks_fe_mul( den, num, _hks_ed25519_d );
+  _hks_fe_sub( num, num, r[2] );
+  _hks_fe_add( den, r[2], den );
+
+  _hks_fe_mul( den2, den, den );
+  _hks_fe_mul( den4, den2, den2 );
+  _hks_fe_mul( den6, den4, den2 );
+  _hks_fe_mul( t, den6, num );
+  _hks_fe_mul( t, t, den );
+
+  _hks_fe_pow2523( t, t );
+  _hks_fe_mul( t, t, num );
+  _hks_fe_mul( t, t, den );
+  _hks_fe_mul( t, t, den );
+  _hks_fe_mul( r[0], t, den );
+
+  _hks_fe_mul( chk, r[0], r[0] );
+  _hks_fe_mul( chk, chk, den );
+  if ( !_hks_fe_equal( chk, num ) )
+    _hks_fe_mul( r[0], r[0], _hks_fe_sqrtm1 );
+
+  _hks_fe_mul( chk, r[0], r[0] );
+  _hks_fe_mul( chk, chk, den );
+  if ( !_hks_fe_equal( chk, num ) )
+    return -1; // not on the curve
+
+  // the negated point, verification subtracts hA
+  if ( _hks_fe_parity( r[0] ) == ( p[31] >> 7 ) )
+    _hks_fe_sub( r[0], _hks_fe_zero, r[0] );
+
+  _hks_fe_mul( r[3], r[0], r[1] );
+  return 0;
+}
+
+void _hks_ge_scalarmult( hks_fe_t p[4], hks_fe_t q[4], const uint8_t s[32] )
+{
+  _hks_fe_copy( p[0], _hks_fe_zero );
+  _hks_fe_copy( p[1], _hks_fe_one );
+  _hks_fe_copy( p[2], _hks_fe_one );
+  _hks_fe_copy( p[3], _hks_fe_zero );
+
+  for ( int i = 255; i >= 0; i-- )
+  {
+    int b = ( s[i / 8] >> ( i & 7 ) ) & 1;
+    for ( int k = 0; k < 4; k++ )
+      _hks_fe_select( p[k], q[k], b );
+    _hks_ge_add( q, p );
+    _hks_ge_add( p, p );
+    for ( int k = 0; k < 4; k++ )
+      _hks_fe_select( p[k], q[k], b );
+  }
+}
+
+void _hks_ge_scalarmult_base( hks_fe_t p[4], const uint8_t s[32] )
+{
+  hks_fe_t q[4];
+  _hks_fe_copy( q[0], _hks_ed25519_x );
+  _hks_fe_copy( q[1], _hks_ed25519_y );
+  _hks_fe_copy( q[2], _hks_fe_one );
+  _hks_fe_mul( q[3], _hks_ed25519_x, _hks_ed25519_y );
+  _hks_ge_scalarmult( p, q, s );
+}
+
+void _hks_sc_reduce_wide( uint8_t r[32], int64_t x[64] )
+{
+  // x mod l, folding the top bytes down with 2^252 = -(l - 2^252)
+  int64_t carry;
+  for ( int i = 63; i >= 32; i-- )
+  {
+    int j;
+    carry = 0;
+    for ( j = i - 32; j < i - 12; j++ )
+    {
+      x[j] += carry - 16 * x[i] * _hks_ed25519_l[j - ( i - 32 )];
+      carry = ( x[j] + 128 ) >> 8;
+      x[j] -= carry * 256;
+    }
+    x[j] += carry;
+    x[i] = 0;
+  }
+
+  carry = 0;
+  for ( int j = 0; j < 32; j++ )
+  {
+    x[j] += carry - ( x[31] >> 4 ) * _hks_ed25519_l[j];
+    carry = x[j] >> 8;
+    x[j] &= 255;
+  }
+  for ( int j = 0; j < 32; j++ )
+    x[j] -= carry * _hks_ed25519_l[j];
+  for ( int i = 0; i < 32; i++ )
+  {
+    x[i + 1] += x[i] >> 8;
+    r[i] = x[i] & 255;
+  }
+}
+
+void _hks_sc_reduce( uint8_t r[64] )
+{
+  int64_t x[64];
+  for ( int i = 0; i < 64; i++ )
+    x[i] = r[i];
+  memset( r, 0, 64 );
+  _hks_sc_reduce_wide( r, x );
+}
+
+void _hks_ed25519_expand( uint8_t d[64], const uint8_t seed[32] )
+{
+  hks_sha512( seed, 32, d );
+  d[0] &= 248;
+  d[31] &= 127;
+  d[31] |= 64;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HKS_X25519_KEY_LENGTH         32
+#define HKS_ED25519_SEED_LENGTH       32
+#define HKS_ED25519_PUBLIC_LENGTH     32
+#define HKS_ED25519_SIGNATURE_LENGTH  64
+
+// X25519 (RFC 7748) and Ed25519 (RFC 8032) in the compact TweetNaCl style:
+// field elements are 16 limbs of 16 bits held in int64_t. Slower than the
+// radix 2^25.5 code but small and easy to audit; a connection needs one
+// X25519, one signature and one verification.
+
+extern void hks_x25519( uint8_t out[HKS_X25519_KEY_LENGTH], const uint8_t scalar[HKS_X25519_KEY_LENGTH], const uint8_t point[HKS_X25519_KEY_LENGTH] );
+extern void hks_x25519_public( uint8_t out[HKS_X25519_KEY_LENGTH], const uint8_t scalar[HKS_X25519_KEY_LENGTH] );
+
+// keys are the 32-byte seed of RFC 8032 and the public key derived from it
+extern void hks_ed25519_public( uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH], const uint8_t seed[HKS_ED25519_SEED_LENGTH] );
+extern void hks_ed25519_sign(
+  uint8_t signature[HKS_ED25519_SIGNATURE_LENGTH],
+  const uint8_t *message,
+  size_t len,
+  const uint8_t seed[HKS_ED25519_SEED_LENGTH],
+  const uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH]
+);
+// 1 for a valid signature
+extern int hks_ed25519_verify(
+  const uint8_t signature[HKS_ED25519_SIGNATURE_LENGTH],
+  const uint8_t *message,
+  size_t len,
+  const uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH]
+);
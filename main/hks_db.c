@@ -0,0 +1,547 @@
+#include "hks_db.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *_HKS_DB_FORMATS[] = {
+  [HKS_FORMAT_BOOL]   = "bool",
+  [HKS_FORMAT_UINT8]  = "uint8",
+  [HKS_FORMAT_UINT16] = "uint16",
+  [HKS_FORMAT_UINT32] = "uint32",
+  [HKS_FORMAT_UINT64] = "uint64",
+  [HKS_FORMAT_INT]    = "int",
+  [HKS_FORMAT_FLOAT]  = "float",
+  [HKS_FORMAT_STRING] = "string",
+  [HKS_FORMAT_TLV8]   = "tlv8",
+  [HKS_FORMAT_DATA]   = "data",
+};
+
+// widest rendering of each fixed size format, strings get what they need
+static const uint8_t _HKS_DB_WIDTHS[] = {
+  [HKS_FORMAT_BOOL]   = 5,  // false
+  [HKS_FORMAT_UINT8]  = 3,
+  [HKS_FORMAT_UINT16] = 5,
+  [HKS_FORMAT_UINT32] = 10,
+  [HKS_FORMAT_UINT64] = 20,
+  [HKS_FORMAT_INT]    = 11, // -2147483648
+  [HKS_FORMAT_FLOAT]  = 14, // -1.234567e+38
+};
+
+static const char *_HKS_DB_PERMS[] = { "pr", "pw", "ev", "aa", "tw", "hd", "wr" };
+
+static void _hks_db_drop_json( hks_db_t *db );
+static void _hks_db_patch_json( hks_db_t *db, uint16_t slot );
+static esp_err_t _hks_db_render( hks_db_t *db );
+static void _hks_db_write_accessories( hks_db_t *db, hks_json_writer_t *w );
+static void _hks_db_write_characteristic( hks_json_writer_t *w, hks_db_t *db, uint16_t slot, uint16_t iid );
+static size_t _hks_db_value_width( const hks_db_t *db, uint16_t slot );
+static int _hks_db_value_equals( const hks_db_t *db, uint16_t slot, const hks_value_t *value );
+static int32_t _hks_db_accessory( const hks_db_t *db, uint32_t aid );
+static uint32_t _hks_db_hash( uint32_t hash, const void *data, size_t len );
+
+esp_err_t hks_db_init(
+  hks_db_t *db,
+  const hks_db_entry_t *entries,
+  uint16_t count,
+  hks_db_slot_t *slots,
+  uint16_t *accessories,
+  uint16_t max_accessories
+)
+{
+  if ( db == NULL || entries == NULL || slots == NULL || accessories == NULL )
+    return ESP_ERR_INVALID_ARG;
+
+  if ( count == 0 || count == HKS_DB_SLOT_NONE || entries[0].kind != HKS_DB_KIND_ACCESSORY )
+    return ESP_ERR_INVALID_ARG;
+
+  // characteristics belong to a service, services to an accessory, and
+  // accessories come in ascending aid order so they can be bisected
+  uint16_t accessory_count = 0;
+  for ( uint16_t i = 0; i < count; i++ )
+  {
+    const hks_db_entry_t *entry = &entries[i];
+    switch ( entry->kind )
+    {
+      case HKS_DB_KIND_ACCESSORY:
+        if ( accessory_count == max_accessories || entry->aid == 0 )
+          return ESP_ERR_INVALID_ARG;
+        if ( i > 0 && entries[i - 1].kind == HKS_DB_KIND_ACCESSORY )
+          return ESP_ERR_INVALID_ARG; // no services
+        if ( accessory_count > 0 && entries[accessories[accessory_count - 1]].aid >= entry->aid )
+          return ESP_ERR_INVALID_ARG;
+        accessories[accessory_count++] = i;
+        break;
+
+      case HKS_DB_KIND_SERVICE:
+        if ( entry->service == NULL )
+          return ESP_ERR_INVALID_ARG;
+        break;
+
+      case HKS_DB_KIND_CHARACTERISTIC:
+        if ( entries[i - 1].kind == HKS_DB_KIND_ACCESSORY || entry->characteristic == NULL )
+          return ESP_ERR_INVALID_ARG;
+        break;
+
+      default:
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    slots[i].value = entry->initial;
+    slots[i].offset = 0;
+    slots[i].width = 0;
+  }
+
+  if ( entries[count - 1].kind == HKS_DB_KIND_ACCESSORY )
+    return ESP_ERR_INVALID_ARG;
+
+  db->entries = entries;
+  db->slots = slots;
+  db->count = count;
+  db->accessories = accessories;
+  db->accessory_count = accessory_count;
+  db->configuration = 1;
+  db->json = NULL;
+  db->heap = NULL;
+  db->read = NULL;
+  db->write = NULL;
+  db->ctx = NULL;
+  db->changed = NULL;
+  db->changed_ctx = NULL;
+
+  return ESP_OK;
+}
+
+void hks_db_free( hks_db_t *db )
+{
+  _hks_db_drop_json( db );
+}
+
+void hks_db_set_handlers( hks_db_t *db, hks_db_read_t read, hks_db_write_t write, void *ctx )
+{
+  db->read = read;
+  db->write = write;
+  db->ctx = ctx;
+}
+
+void hks_db_set_heap( hks_db_t *db, hks_heap_t *heap )
+{
+  // responses still sending the old copy give it back where it came from
+  _hks_db_drop_json( db );
+  db->heap = heap;
+}
+
+void hks_db_set_observer( hks_db_t *db, hks_db_changed_t changed, void *ctx )
+{
+  db->changed = changed;
+  db->changed_ctx = ctx;
+}
+
+void hks_db_schema_changed( hks_db_t *db )
+{
+  _hks_db_drop_json( db );
+
+  // c# is 1..65535 and wraps back to 1
+  db->configuration = db->configuration >= UINT16_MAX ? 1 : db->configuration + 1;
+}
+
+uint32_t hks_db_digest( const hks_db_t *db )
+{
+  // each entry's kind, flags and what it is
+  uint32_t hash = 2166136261u;
+  for ( uint16_t i = 0; i < db->count; i++ )
+  {
+    const hks_db_entry_t *e = &db->entries[i];
+    hash = _hks_db_hash( hash, &e->kind, 1 );
+    hash = _hks_db_hash( hash, &e->flags, 1 );
+
+    if ( e->kind == HKS_DB_KIND_ACCESSORY )
+      hash = _hks_db_hash( hash, &e->aid, sizeof( e->aid ) );
+    else if ( e->kind == HKS_DB_KIND_SERVICE )
+      hash = _hks_db_hash( hash, e->service, strlen( e->service ) + 1 );
+    else
+    {
+      const hks_characteristic_meta_t *meta = e->characteristic;
+      hash = _hks_db_hash( hash, meta->type, strlen( meta->type ) + 1 );
+      hash = _hks_db_hash( hash, &meta->format, sizeof( meta->format ) );
+      hash = _hks_db_hash( hash, &meta->perms, 1 );
+    }
+  }
+
+  return hash;
+}
+
+uint16_t hks_db_find( const hks_db_t *db, uint32_t aid, uint16_t iid )
+{
+  int32_t a = _hks_db_accessory( db, aid );
+  if ( a < 0 || iid == 0 )
+    return HKS_DB_SLOT_NONE;
+
+  uint32_t slot = db->accessories[a] + iid;
+  uint32_t end = a + 1 < db->accessory_count ? db->accessories[a + 1] : db->count;
+  if ( slot >= end || db->entries[slot].kind != HKS_DB_KIND_CHARACTERISTIC )
+    return HKS_DB_SLOT_NONE;
+
+  return slot;
+}
+
+esp_err_t hks_db_locate( const hks_db_t *db, uint16_t slot, uint32_t *aid, uint16_t *iid )
+{
+  if ( slot >= db->count )
+    return ESP_ERR_INVALID_ARG;
+
+  // last accessory starting at or before the slot
+  uint16_t lo = 0, hi = db->accessory_count;
+  while ( hi - lo > 1 )
+  {
+    uint16_t mid = ( lo + hi ) / 2;
+    if ( db->accessories[mid] <= slot )
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  *aid = db->entries[db->accessories[lo]].aid;
+  *iid = slot - db->accessories[lo];
+
+  return ESP_OK;
+}
+
+esp_err_t hks_db_set_value( hks_db_t *db, uint16_t slot, const hks_value_t *value )
+{
+  if ( db == NULL || slot >= db->count || value == NULL )
+    return ESP_ERR_INVALID_ARG;
+
+  if ( db->entries[slot].kind != HKS_DB_KIND_CHARACTERISTIC )
+    return ESP_ERR_INVALID_ARG;
+
+  if ( _hks_db_value_equals( db, slot, value ) )
+    return ESP_OK;
+
+  db->slots[slot].value = *value;
+  _hks_db_patch_json( db, slot );
+
+  if ( db->changed != NULL && ( db->entries[slot].characteristic->perms & HKS_PERM_EVENTS ) )
+    db->changed( db, slot, db->changed_ctx );
+
+  return ESP_OK;
+}
+
+esp_err_t hks_db_accessories( hks_db_t *db, hks_db_json_t **json )
+{
+  if ( db == NULL || json == NULL )
+    return ESP_ERR_INVALID_ARG;
+
+  if ( db->json == NULL )
+  {
+    esp_err_t err = _hks_db_render( db );
+    if ( err )
+      return err;
+  }
+
+  db->json->refs++;
+  *json = db->json;
+
+  return ESP_OK;
+}
+
+void hks_db_json_release( void *arg )
+{
+  hks_db_json_t *json = (hks_db_json_t *)arg;
+  if ( json != NULL && --json->refs == 0 )
+    hks_heap_free( json );
+}
+
+void hks_db_write_value( hks_json_writer_t *w, const hks_db_t *db, uint16_t slot )
+{
+  const hks_value_t *value = &db->slots[slot].value;
+
+  switch ( db->entries[slot].characteristic->format )
+  {
+    case HKS_FORMAT_BOOL:
+      hks_json_bool( w, value->b );
+      break;
+
+    case HKS_FORMAT_UINT8:
+    case HKS_FORMAT_UINT16:
+    case HKS_FORMAT_UINT32:
+    case HKS_FORMAT_UINT64:
+      hks_json_uint( w, value->u );
+      break;
+
+    case HKS_FORMAT_INT:
+      hks_json_int( w, value->i );
+      break;
+
+    case HKS_FORMAT_FLOAT:
+      hks_json_float( w, value->f );
+      break;
+
+    case HKS_FORMAT_STRING:
+    case HKS_FORMAT_TLV8:
+    case HKS_FORMAT_DATA:
+      hks_json_string( w, value->s ? value->s : "" );
+      break;
+  }
+}
+
+void hks_db_write_meta( hks_json_writer_t *w, const hks_db_t *db, uint16_t slot, uint8_t parts )
+{
+  const hks_characteristic_meta_t *meta = db->entries[slot].characteristic;
+
+  if ( parts & HKS_DB_META_TYPE )
+  {
+    hks_json_literal( w, ",\"type\":" );
+    hks_json_string( w, meta->type );
+  }
+
+  if ( parts & HKS_DB_META_PERMS )
+  {
+    hks_json_literal( w, ",\"perms\":[" );
+    int first = 1;
+    for ( uint8_t i = 0; i < sizeof( _HKS_DB_PERMS ) / sizeof( _HKS_DB_PERMS[0] ); i++ )
+    {
+      if ( !( meta->perms & ( 1 << i ) ) )
+        continue;
+      if ( !first )
+        hks_json_raw( w, ",", 1 );
+      hks_json_string( w, _HKS_DB_PERMS[i] );
+      first = 0;
+    }
+    hks_json_raw( w, "]", 1 );
+  }
+
+  if ( parts & HKS_DB_META_FORMAT )
+  {
+    hks_json_literal( w, ",\"format\":" );
+    hks_json_string( w, _HKS_DB_FORMATS[meta->format] );
+  }
+
+  if ( parts & HKS_DB_META_RANGE )
+  {
+    if ( meta->has_range )
+    {
+      hks_json_literal( w, ",\"minValue\":" );
+      hks_json_float( w, meta->min );
+      hks_json_literal( w, ",\"maxValue\":" );
+      hks_json_float( w, meta->max );
+      hks_json_literal( w, ",\"minStep\":" );
+      hks_json_float( w, meta->step );
+    }
+
+    if ( meta->format == HKS_FORMAT_STRING && meta->max_len > 0 )
+    {
+      hks_json_literal( w, ",\"maxLen\":" );
+      hks_json_uint( w, meta->max_len );
+    }
+  }
+}
+
+void _hks_db_drop_json( hks_db_t *db )
+{
+  hks_db_json_release( db->json );
+  db->json = NULL;
+}
+
+void _hks_db_patch_json( hks_db_t *db, uint16_t slot )
+{
+  hks_db_slot_t *s = &db->slots[slot];
+  if ( db->json == NULL || s->width == 0 )
+    return;
+
+  // responses still sending the document keep the old copy, patching it
+  // under them could tear a value
+  if ( db->json->refs > 1 )
+  {
+    hks_db_json_t *copy = hks_heap_alloc( db->heap, sizeof( hks_db_json_t ) + db->json->len );
+    if ( copy == NULL )
+    {
+      _hks_db_drop_json( db );
+      return;
+    }
+
+    copy->refs = 1;
+    copy->len = db->json->len;
+    memcpy( copy->data, db->json->data, copy->len );
+
+    hks_db_json_release( db->json );
+    db->json = copy;
+  }
+
+  hks_json_writer_t w;
+  hks_json_writer_init( &w, db->json->data + s->offset, s->width );
+  hks_db_write_value( &w, db, slot );
+
+  // a longer string than the reserved room needs a new rendering
+  if ( hks_json_overflow( &w ) )
+  {
+    _hks_db_drop_json( db );
+    return;
+  }
+
+  hks_json_pad( &w, s->width - w.len );
+}
+
+esp_err_t _hks_db_render( hks_db_t *db )
+{
+  // measure first so the document is a single allocation of the exact size
+  hks_json_writer_t w;
+  hks_json_writer_init( &w, NULL, 0 );
+  _hks_db_write_accessories( db, &w );
+
+  hks_db_json_t *json = hks_heap_alloc( db->heap, sizeof( hks_db_json_t ) + w.len );
+  if ( json == NULL )
+    return ESP_ERR_NO_MEM;
+
+  json->refs = 1;
+  json->len = w.len;
+
+  hks_json_writer_init( &w, json->data, json->len );
+  _hks_db_write_accessories( db, &w );
+
+  db->json = json;
+
+  return ESP_OK;
+}
+
+void _hks_db_write_accessories( hks_db_t *db, hks_json_writer_t *w )
+{
+  uint16_t accessory = 0;
+  uint16_t characteristics = 0; // in the current service
+
+  hks_json_literal( w, "{\"accessories\":[" );
+  for ( uint16_t slot = 0; slot < db->count; slot++ )
+  {
+    const hks_db_entry_t *entry = &db->entries[slot];
+    switch ( entry->kind )
+    {
+      case HKS_DB_KIND_ACCESSORY:
+        if ( slot > 0 )
+          hks_json_literal( w, "]}]}," );
+        accessory = slot;
+        characteristics = 0;
+
+        hks_json_literal( w, "{\"aid\":" );
+        hks_json_uint( w, entry->aid );
+        hks_json_literal( w, ",\"services\":[" );
+        break;
+
+      case HKS_DB_KIND_SERVICE:
+        if ( slot > accessory + 1 )
+          hks_json_literal( w, "]}," );
+        characteristics = 0;
+
+        hks_json_literal( w, "{\"iid\":" );
+        hks_json_uint( w, slot - accessory );
+        hks_json_literal( w, ",\"type\":" );
+        hks_json_string( w, entry->service );
+        if ( entry->flags & HKS_DB_PRIMARY )
+          hks_json_literal( w, ",\"primary\":true" );
+        if ( entry->flags & HKS_DB_HIDDEN )
+          hks_json_literal( w, ",\"hidden\":true" );
+        hks_json_literal( w, ",\"characteristics\":[" );
+        break;
+
+      case HKS_DB_KIND_CHARACTERISTIC:
+        if ( characteristics++ > 0 )
+          hks_json_raw( w, ",", 1 );
+        _hks_db_write_characteristic( w, db, slot, slot - accessory );
+        break;
+    }
+  }
+  hks_json_literal( w, "]}]}]}" );
+}
+
+void _hks_db_write_characteristic( hks_json_writer_t *w, hks_db_t *db, uint16_t slot, uint16_t iid )
+{
+  const hks_characteristic_meta_t *meta = db->entries[slot].characteristic;
+  hks_db_slot_t *s = &db->slots[slot];
+
+  hks_json_literal( w, "{\"iid\":" );
+  hks_json_uint( w, iid );
+  hks_db_write_meta( w, db, slot, HKS_DB_META_TYPE | HKS_DB_META_PERMS | HKS_DB_META_FORMAT );
+
+  // write-only characteristics have no value to report
+  s->offset = 0;
+  s->width = 0;
+  if ( meta->perms & HKS_PERM_READ )
+  {
+    hks_json_literal( w, ",\"value\":" );
+
+    size_t start = w->len;
+    size_t width = _hks_db_value_width( db, slot );
+    hks_db_write_value( w, db, slot );
+    hks_json_pad( w, width - ( w->len - start ) );
+
+    s->offset = start;
+    s->width = width;
+  }
+
+  hks_db_write_meta( w, db, slot, HKS_DB_META_RANGE );
+  hks_json_raw( w, "}", 1 );
+}
+
+size_t _hks_db_value_width( const hks_db_t *db, uint16_t slot )
+{
+  hks_format_t format = db->entries[slot].characteristic->format;
+  if ( format < sizeof( _HKS_DB_WIDTHS ) )
+    return _HKS_DB_WIDTHS[format];
+
+  const char *s = db->slots[slot].value.s;
+  return hks_json_string_length( s ? s : "" );
+}
+
+int _hks_db_value_equals( const hks_db_t *db, uint16_t slot, const hks_value_t *value )
+{
+  const hks_value_t *current = &db->slots[slot].value;
+
+  switch ( db->entries[slot].characteristic->format )
+  {
+    case HKS_FORMAT_BOOL:
+      return !current->b == !value->b;
+
+    case HKS_FORMAT_INT:
+      return current->i == value->i;
+
+    case HKS_FORMAT_FLOAT:
+      return current->f == value->f;
+
+    case HKS_FORMAT_STRING:
+    case HKS_FORMAT_TLV8:
+    case HKS_FORMAT_DATA:
+      if ( current->s == NULL || value->s == NULL )
+        return current->s == value->s;
+      return strcmp( current->s, value->s ) == 0;
+
+    default:
+      return current->u == value->u;
+  }
+}
+
+int32_t _hks_db_accessory( const hks_db_t *db, uint32_t aid )
+{
+  // aids are usually 1..n, try the direct position first
+  if ( aid > 0 && aid <= db->accessory_count && db->entries[db->accessories[aid - 1]].aid == aid )
+    return aid - 1;
+
+  uint16_t lo = 0, hi = db->accessory_count;
+  while ( lo < hi )
+  {
+    uint16_t mid = ( lo + hi ) / 2;
+    uint32_t found = db->entries[db->accessories[mid]].aid;
+    if ( found == aid )
+      return mid;
+    if ( found < aid )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return -1;
+}
+
+uint32_t _hks_db_hash( uint32_t hash, const void *data, size_t len )
+{
+  // FNV-1a
+  for ( size_t i = 0; i < len; i++ )
+    hash = ( hash ^ ( (const uint8_t *)data )[i] ) * 16777619u;
+  return hash;
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "hks_types.h"
+#include "hks_arena.h"
+#include "hks_json.h"
+
+typedef enum {
+  HKS_FORMAT_BOOL = 0,
+  HKS_FORMAT_UINT8,
+  HKS_FORMAT_UINT16,
+  HKS_FORMAT_UINT32,
+  HKS_FORMAT_UINT64,
+  HKS_FORMAT_INT,
+  HKS_FORMAT_FLOAT,
+  HKS_FORMAT_STRING,
+  HKS_FORMAT_TLV8,
+  HKS_FORMAT_DATA,
+} hks_format_t;
+
+// characteristic permissions
+#define HKS_PERM_READ             0x01 // pr
+#define HKS_PERM_WRITE            0x02 // pw
+#define HKS_PERM_EVENTS           0x04 // ev
+#define HKS_PERM_ADDITIONAL_AUTH  0x08 // aa
+#define HKS_PERM_TIMED_WRITE      0x10 // tw
+#define HKS_PERM_HIDDEN           0x20 // hd
+#define HKS_PERM_WRITE_RESPONSE   0x40 // wr
+
+// HAP status codes, per characteristic in multi-status responses
+#define HKS_STATUS_SUCCESS                  0
+#define HKS_STATUS_INSUFFICIENT_PRIVILEGES  -70401
+#define HKS_STATUS_UNABLE_TO_COMMUNICATE    -70402
+#define HKS_STATUS_BUSY                     -70403
+#define HKS_STATUS_READ_ONLY                -70404
+#define HKS_STATUS_WRITE_ONLY               -70405
+#define HKS_STATUS_NO_NOTIFICATION          -70406
+#define HKS_STATUS_OUT_OF_RESOURCES         -70407
+#define HKS_STATUS_TIMED_OUT                -70408
+#define HKS_STATUS_NOT_FOUND                -70409
+#define HKS_STATUS_INVALID_VALUE            -70410
+
+typedef union {
+  int b;
+  uint64_t u;       // every unsigned format
+  int32_t i;
+  float f;
+  const char *s;    // string, tlv8 and data (base64), not copied
+} hks_value_t;
+
+// Everything about a characteristic that does not change at runtime.
+struct hks_characteristic_meta_s {
+  const char *type; // short form UUID, "25" for On
+  hks_format_t format;
+  uint8_t perms;
+  uint8_t has_range;
+  float min;
+  float max;
+  float step;
+  uint16_t max_len; // strings, 0 for the default of 64
+};
+typedef struct hks_characteristic_meta_s hks_characteristic_meta_t;
+
+typedef enum {
+  HKS_DB_KIND_ACCESSORY = 0,
+  HKS_DB_KIND_SERVICE,
+  HKS_DB_KIND_CHARACTERISTIC,
+} hks_db_kind_t;
+
+// service flags
+#define HKS_DB_PRIMARY  0x01
+#define HKS_DB_HIDDEN   0x02
+
+// One entry of the database description, a const table in flash written
+// with the HKS_DB_* macros from hks_schema.h:
+//
+//   HKS_DB_ACCESSORY( 1 ),
+//     HKS_DB_SERVICE( accessory_information, 0 ),
+//       HKS_DB_CHARACTERISTIC( identify ),
+//       HKS_DB_CHARACTERISTIC( name, .s = "Lamp" ),
+//       ...
+//     HKS_DB_SERVICE( lightbulb, HKS_DB_PRIMARY ),
+//       HKS_DB_CHARACTERISTIC( on ),
+//
+// Instance ids are implied by position: the n-th entry after an accessory
+// has iid n, so (aid, iid) maps to a table slot by arithmetic alone.
+struct hks_db_entry_s {
+  uint8_t kind;
+  uint8_t flags;
+  union {
+    uint32_t aid;
+    const char *service; // type
+    const hks_characteristic_meta_t *characteristic;
+  };
+  hks_value_t initial;
+};
+typedef struct hks_db_entry_s hks_db_entry_t;
+
+// The part of a slot that lives in RAM.
+struct hks_db_slot_s {
+  hks_value_t value;
+
+  // where the value sits in the cached /accessories document, 0 if absent
+  uint32_t offset;
+  uint16_t width;
+};
+typedef struct hks_db_slot_s hks_db_slot_t;
+
+// Rendered /accessories document, shared by reference with every response
+// still sending it.
+struct hks_db_json_s {
+  uint32_t refs;
+  size_t len;
+  uint8_t data[];
+};
+typedef struct hks_db_json_s hks_db_json_t;
+
+typedef struct hks_db_s hks_db_t;
+
+// Called once per request with every readable characteristic it asks for,
+// before the values are reported. Refresh them with hks_db_set_value; a
+// status[i] left at HKS_STATUS_SUCCESS reports the stored value.
+typedef void (*hks_db_read_t)(
+  hks_db_t *db,
+  const uint16_t *slots,
+  int32_t *status,
+  size_t count,
+  void *ctx
+);
+
+// Called once per request with every valid write in it. Accepted values are
+// stored afterwards, except strings: those point into the request and are
+// only valid during the call, set them with storage of your own.
+typedef void (*hks_db_write_t)(
+  hks_db_t *db,
+  const uint16_t *slots,
+  const hks_value_t *values,
+  int32_t *status,
+  size_t count,
+  void *ctx
+);
+
+// A characteristic that supports events took a new value, see
+// hks_db_set_observer.
+typedef void (*hks_db_changed_t)( hks_db_t *db, uint16_t slot, void *ctx );
+
+// The accessory database: a const entry table plus one RAM slot per entry
+// for the value. Every lookup is by slot index.
+//
+// GET /accessories is served from a single rendered buffer. Every value is
+// rendered padded to a fixed width so a value change overwrites its bytes
+// in place; the document is only rendered again after the schema changed
+// (hks_db_schema_changed), which also moves the configuration number on.
+struct hks_db_s {
+  const hks_db_entry_t *entries;
+  hks_db_slot_t *slots;
+  uint16_t count;
+
+  uint16_t *accessories; // slot of each accessory, ascending aid
+  uint16_t accessory_count;
+
+  uint32_t configuration; // c# in the TXT record
+
+  hks_db_json_t *json; // NULL until requested or after a schema change
+  hks_heap_t *heap;    // the document's, NULL for the system heap
+
+  hks_db_read_t read;
+  hks_db_write_t write;
+  void *ctx;
+
+  hks_db_changed_t changed;
+  void *changed_ctx;
+};
+
+#define HKS_DB_SLOT_NONE  0xFFFF
+
+// static storage for a database over `entries`, holding up to `max_accessories`
+#define HKS_DB_STORAGE( name, entries, max_accessories ) \
+  static hks_db_slot_t name##_slots[sizeof( entries ) / sizeof( entries[0] )]; \
+  static uint16_t name##_accessories[max_accessories]
+
+#define HKS_DB_INIT_STATIC( db, name, entries ) \
+  hks_db_init( db, entries, sizeof( entries ) / sizeof( entries[0] ), \
+    name##_slots, name##_accessories, sizeof( name##_accessories ) / sizeof( uint16_t ) )
+
+// `slots` has room for `count` entries, `accessories` for `max_accessories`;
+// the table is checked and the initial values copied
+extern esp_err_t hks_db_init(
+  hks_db_t *db,
+  const hks_db_entry_t *entries,
+  uint16_t count,
+  hks_db_slot_t *slots,
+  uint16_t *accessories,
+  uint16_t max_accessories
+);
+extern void hks_db_free( hks_db_t *db );
+
+// accessory callbacks for /characteristics, either may be NULL
+extern void hks_db_set_handlers( hks_db_t *db, hks_db_read_t read, hks_db_write_t write, void *ctx );
+
+// told about every changed value, the server uses it to send events
+extern void hks_db_set_observer( hks_db_t *db, hks_db_changed_t changed, void *ctx );
+
+// render the document from `heap` from now on, the server points it at its own
+extern void hks_db_set_heap( hks_db_t *db, hks_heap_t *heap );
+
+// accessories, services or characteristics were added, removed or changed
+extern void hks_db_schema_changed( hks_db_t *db );
+
+// hash of what the schema describes, not of the values; a stored c# is kept
+// while it stays the same
+extern uint32_t hks_db_digest( const hks_db_t *db );
+
+// slot of characteristic (aid, iid) or HKS_DB_SLOT_NONE
+extern uint16_t hks_db_find( const hks_db_t *db, uint32_t aid, uint16_t iid );
+
+// aid and iid of a slot
+extern esp_err_t hks_db_locate( const hks_db_t *db, uint16_t slot, uint32_t *aid, uint16_t *iid );
+
+static inline const hks_characteristic_meta_t *hks_db_meta( const hks_db_t *db, uint16_t slot )
+{
+  return db->entries[slot].characteristic;
+}
+
+static inline const hks_value_t *hks_db_value( const hks_db_t *db, uint16_t slot )
+{
+  return &db->slots[slot].value;
+}
+
+// update a value and the cached document with it; values change on the
+// server task, from the accessory callbacks or between hk_server_poll calls
+extern esp_err_t hks_db_set_value( hks_db_t *db, uint16_t slot, const hks_value_t *value );
+
+// The /accessories document, rendered if needed. The caller holds a
+// reference until it calls hks_db_json_release.
+extern esp_err_t hks_db_accessories( hks_db_t *db, hks_db_json_t **json );
+extern void hks_db_json_release( void *json );
+
+// the current value of a characteristic as JSON, unpadded
+extern void hks_db_write_value( hks_json_writer_t *w, const hks_db_t *db, uint16_t slot );
+
+// parts of a characteristic's metadata for hks_db_write_meta
+#define HKS_DB_META_TYPE    0x01 // "type"
+#define HKS_DB_META_PERMS   0x02 // "perms"
+#define HKS_DB_META_FORMAT  0x04 // "format"
+#define HKS_DB_META_RANGE   0x08 // "minValue", "maxValue", "minStep", "maxLen"
+
+// the requested metadata as object members, each preceded by a comma
+extern void hks_db_write_meta( hks_json_writer_t *w, const hks_db_t *db, uint16_t slot, uint8_t parts );
@@ -0,0 +1,236 @@
+#include "hks_events.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hks_client.h"
+#include "hks_http.h"
+#include "hks_json.h"
+#include "hks_utils.h"
+
+#define HKS_EVENTS_HEADER \
+  "EVENT/1.0 200 OK\r\nContent-Type: " HKS_HTTP_CONTENT_TYPE_JSON "\r\nContent-Length: %zu\r\n\r\n"
+
+// a bit per queue entry
+typedef struct {
+  uint64_t bits[HKS_EVENTS_QUEUE / 64];
+} hks_events_mask_t;
+
+static void _hks_events_timer( hks_timer_t *timer, uint32_t now, void *ctx );
+static hks_event_t *_hks_events_render( hks_events_t *ev, const hks_events_mask_t *mask );
+static void _hks_events_write( hks_json_writer_t *w, hks_events_t *ev, const hks_events_mask_t *mask );
+
+esp_err_t hks_subscriptions_set( hks_subscriptions_t *s, uint16_t slot, int subscribed )
+{
+  if ( slot >= HKS_EVENTS_SLOTS )
+    return ESP_ERR_INVALID_SIZE;
+
+  if ( subscribed )
+    s->bits[slot / 32] |= 1u << ( slot % 32 );
+  else
+    s->bits[slot / 32] &= ~( 1u << ( slot % 32 ) );
+
+  return ESP_OK;
+}
+
+void hks_subscriptions_clear( hks_subscriptions_t *s )
+{
+  memset( s->bits, 0, sizeof( s->bits ) );
+}
+
+int hks_subscriptions_any( const hks_subscriptions_t *s )
+{
+  for ( size_t i = 0; i < sizeof( s->bits ) / sizeof( s->bits[0] ); i++ )
+    if ( s->bits[i] )
+      return 1;
+  return 0;
+}
+
+void hks_event_release( void *arg )
+{
+  hks_event_t *event = (hks_event_t *)arg;
+  if ( --event->refs == 0 )
+    hks_heap_free( event );
+}
+
+void hks_events_init( hks_events_t *ev, struct hks_client_pool_s *clients, hks_timers_t *timers, hks_heap_t *heap )
+{
+  memset( ev, 0, sizeof( hks_events_t ) );
+  ev->clients = clients;
+  ev->timers = timers;
+  ev->heap = heap;
+  ev->window_ms = CONFIG_HKS_EVENT_COALESCE_MS;
+  ev->source = HKS_CLIENT_SLOT_NONE;
+  hks_timer_init( &ev->timer, _hks_events_timer, ev );
+}
+
+void hks_events_set_database( hks_events_t *ev, hks_db_t *db )
+{
+  hks_timer_stop( ev->timers, &ev->timer );
+  memset( ev->pending, 0, sizeof( ev->pending ) );
+  ev->count = 0;
+  ev->db = db;
+}
+
+void hks_events_changed( hks_db_t *db, uint16_t slot, void *arg )
+{
+  hks_events_t *ev = (hks_events_t *)arg;
+  if ( slot >= HKS_EVENTS_SLOTS )
+    return;
+
+  ev->changes++;
+
+  // already queued, it goes out with the latest value
+  if ( ev->pending[slot / 32] & ( 1u << ( slot % 32 ) ) )
+  {
+    ev->coalesced++;
+    for ( uint16_t i = 0; i < ev->count; i++ )
+    {
+      if ( ev->queue[i] == slot && ev->sources[i] != ev->source )
+        ev->sources[i] = HKS_CLIENT_SLOT_NONE;
+    }
+    return;
+  }
+
+  if ( ev->count == HKS_EVENTS_QUEUE )
+    hks_events_flush( ev );
+
+  ev->pending[slot / 32] |= 1u << ( slot % 32 );
+  ev->queue[ev->count] = slot;
+  ev->sources[ev->count] = ev->source;
+  ev->count++;
+
+  if ( !hks_timer_armed( &ev->timer ) )
+    hks_timer_start( ev->timers, &ev->timer, hksu_now_ms() + ev->window_ms );
+}
+
+void hks_events_flush( hks_events_t *ev )
+{
+  hks_timer_stop( ev->timers, &ev->timer );
+  if ( ev->count == 0 )
+    return;
+
+  // one message per distinct subset of the queue, shared by every
+  // controller that subscribed to exactly that subset
+  hks_events_mask_t masks[HKS_CLIENT_MAX];
+  hks_event_t *events[HKS_CLIENT_MAX];
+  uint8_t rendered = 0;
+
+  hks_client_t *c;
+  HKS_CLIENT_POOL_FOREACH( ev->clients, c )
+  {
+    // not in the middle of a pairing exchange, its responses are built
+    // against an empty queue and go out before any session starts
+    if ( c->pair != NULL )
+      continue;
+
+    hks_events_mask_t *mask = &masks[rendered];
+    memset( mask, 0, sizeof( hks_events_mask_t ) );
+
+    uint32_t count = 0;
+    for ( uint16_t i = 0; i < ev->count; i++ )
+    {
+      if ( ev->sources[i] != c->slot && hks_subscribed( &c->events, ev->queue[i] ) )
+      {
+        mask->bits[i / 64] |= 1ull << ( i % 64 );
+        count++;
+      }
+    }
+    if ( count == 0 )
+      continue;
+
+    hks_event_t *event = NULL;
+    for ( uint8_t i = 0; i < rendered && event == NULL; i++ )
+    {
+      if ( memcmp( &masks[i], mask, sizeof( hks_events_mask_t ) ) == 0 )
+        event = events[i];
+    }
+
+    if ( event == NULL )
+    {
+      event = _hks_events_render( ev, mask );
+      if ( event == NULL )
+      {
+        ev->dropped++;
+        continue;
+      }
+      events[rendered++] = event;
+    }
+
+    // whole messages only, so an event never splits a response
+    event->refs++;
+    if ( hks_send_queue_push( &c->tx, event->data, event->len, hks_event_release, event ) )
+    {
+      event->refs--;
+      ev->dropped++;
+      continue;
+    }
+
+    ev->messages++;
+    ev->notifications += count;
+  }
+
+  // drop the references taken when rendering
+  for ( uint8_t i = 0; i < rendered; i++ )
+    hks_event_release( events[i] );
+
+  for ( uint16_t i = 0; i < ev->count; i++ )
+    ev->pending[ev->queue[i] / 32] &= ~( 1u << ( ev->queue[i] % 32 ) );
+  ev->count = 0;
+}
+
+void _hks_events_timer( hks_timer_t *timer, uint32_t now, void *ctx )
+{
+  hks_events_flush( (hks_events_t *)timer->arg );
+}
+
+hks_event_t *_hks_events_render( hks_events_t *ev, const hks_events_mask_t *mask )
+{
+  hks_json_writer_t w;
+  hks_json_writer_init( &w, NULL, 0 );
+  _hks_events_write( &w, ev, mask );
+
+  char header[sizeof( HKS_EVENTS_HEADER ) + 20];
+  size_t header_len = snprintf( header, sizeof( header ), HKS_EVENTS_HEADER, w.len );
+
+  hks_event_t *event = hks_heap_alloc( ev->heap, sizeof( hks_event_t ) + header_len + w.len );
+  if ( event == NULL )
+    return NULL;
+
+  memcpy( event->data, header, header_len );
+  hks_json_writer_init( &w, event->data + header_len, w.len );
+  _hks_events_write( &w, ev, mask );
+
+  event->refs = 1;
+  event->len = header_len + w.len;
+  ev->renders++;
+
+  return event;
+}
+
+void _hks_events_write( hks_json_writer_t *w, hks_events_t *ev, const hks_events_mask_t *mask )
+{
+  hks_json_literal( w, "{\"characteristics\":[" );
+  int first = 1;
+  for ( uint16_t i = 0; i < ev->count; i++ )
+  {
+    if ( !( mask->bits[i / 64] & ( 1ull << ( i % 64 ) ) ) )
+      continue;
+
+    uint32_t aid;
+    uint16_t iid;
+    hks_db_locate( ev->db, ev->queue[i], &aid, &iid );
+
+    if ( !first )
+      hks_json_raw( w, ",", 1 );
+    first = 0;
+
+    hks_json_literal( w, "{\"aid\":" );
+    hks_json_uint( w, aid );
+    hks_json_literal( w, ",\"iid\":" );
+    hks_json_uint( w, iid );
+    hks_json_literal( w, ",\"value\":" );
+    hks_db_write_value( w, ev->db, ev->queue[i] );
+    hks_json_raw( w, "}", 1 );
+  }
+  hks_json_literal( w, "]}" );
+}
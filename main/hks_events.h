@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+#include "hks_arena.h"
+#include "hks_db.h"
+#include "hks_timer.h"
+
+#define HKS_EVENTS_SLOTS  CONFIG_HKS_EVENT_SLOTS
+#define HKS_EVENTS_QUEUE  256 // characteristics changed per window, sent early when full
+
+// Characteristics a controller subscribed to, a bit per database slot.
+struct hks_subscriptions_s {
+  uint32_t bits[( HKS_EVENTS_SLOTS + 31 ) / 32];
+};
+typedef struct hks_subscriptions_s hks_subscriptions_t;
+
+static inline int hks_subscribed( const hks_subscriptions_t *s, uint16_t slot )
+{
+  return slot < HKS_EVENTS_SLOTS && ( s->bits[slot / 32] >> ( slot % 32 ) & 1 );
+}
+
+// ESP_ERR_INVALID_SIZE for a slot past HKS_EVENTS_SLOTS
+extern esp_err_t hks_subscriptions_set( hks_subscriptions_t *s, uint16_t slot, int subscribed );
+extern void hks_subscriptions_clear( hks_subscriptions_t *s );
+
+// whether any characteristic is subscribed to
+extern int hks_subscriptions_any( const hks_subscriptions_t *s );
+
+// An EVENT/1.0 message, rendered once and shared by reference with every
+// controller it is queued for.
+struct hks_event_s {
+  uint32_t refs;
+  size_t len;
+  uint8_t data[];
+};
+typedef struct hks_event_s hks_event_t;
+
+extern void hks_event_release( void *event );
+
+struct hks_client_pool_s;
+
+// Value changes waiting to be sent. A characteristic that changes again
+// within the coalescing window keeps its place in the queue and is sent once
+// with its latest value; when the window closes every controller receives one
+// message with the changes it subscribed to, and controllers with the same
+// subset share the same rendered message.
+struct hks_events_s {
+  hks_db_t *db;
+  struct hks_client_pool_s *clients;
+  hks_timers_t *timers;
+  hks_heap_t *heap; // the messages
+  hks_timer_t timer;
+  uint32_t window_ms;
+
+  uint32_t pending[( HKS_EVENTS_SLOTS + 31 ) / 32]; // slots in the queue
+  uint16_t queue[HKS_EVENTS_QUEUE];
+  uint8_t sources[HKS_EVENTS_QUEUE]; // client that made the change, not told about it
+  uint16_t count;
+
+  uint8_t source; // client whose request is being handled, or HKS_CLIENT_SLOT_NONE
+
+  // totals since init
+  uint32_t changes;
+  uint32_t coalesced;     // changes merged into one already queued
+  uint32_t renders;       // messages rendered
+  uint32_t messages;      // messages queued to controllers
+  uint32_t notifications; // characteristic values in them
+  uint32_t dropped;       // messages a controller had no room for
+};
+typedef struct hks_events_s hks_events_t;
+
+extern void hks_events_init( hks_events_t *ev, struct hks_client_pool_s *clients, hks_timers_t *timers, hks_heap_t *heap );
+
+// start watching `db`, dropping whatever was queued for the previous one
+extern void hks_events_set_database( hks_events_t *ev, hks_db_t *db );
+
+// queue a change, installed as the database's change observer
+extern void hks_events_changed( hks_db_t *db, uint16_t slot, void *ev );
+
+// send everything queued now, passing over clients in a pairing exchange
+extern void hks_events_flush( hks_events_t *ev );
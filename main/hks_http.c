@@ -1,32 +1,489 @@
 #include "hks_http.h"
+#include <string.h>
 
-esp_err_t hks_http_request_parse( hks_http_request_t *request, uint8_t *buffer, size_t buffer_len )
+#define HKS_HTTP_MAX_METHOD 16
+
+static const char *_HKS_HTTP_CONTENT_LENGTH = "Content-Length";
+static const char *_HKS_HTTP_CONNECTION = "Connection";
+
+struct _hks_http_status_s {
+  uint16_t code;
+  const char *line;
+};
+
+static const struct _hks_http_status_s _HKS_HTTP_STATUS[] = {
+  { 200, "HTTP/1.1 200 OK\r\n" },
+  { 204, "HTTP/1.1 204 No Content\r\n" },
+  { 207, "HTTP/1.1 207 Multi-Status\r\n" },
+  { 400, "HTTP/1.1 400 Bad Request\r\n" },
+  { 404, "HTTP/1.1 404 Not Found\r\n" },
+  { 405, "HTTP/1.1 405 Method Not Allowed\r\n" },
+  { 413, "HTTP/1.1 413 Payload Too Large\r\n" },
+  { 422, "HTTP/1.1 422 Unprocessable Entity\r\n" },
+  { 429, "HTTP/1.1 429 Too Many Requests\r\n" },
+  { 431, "HTTP/1.1 431 Request Header Fields Too Large\r\n" },
+  { 470, "HTTP/1.1 470 Connection Authorization Required\r\n" },
+  { 500, "HTTP/1.1 500 Internal Server Error\r\n" },
+  { 503, "HTTP/1.1 503 Service Unavailable\r\n" },
+  { 505, "HTTP/1.1 505 HTTP Version Not Supported\r\n" },
+};
+
+static int _hks_http_token_equals( const uint8_t *token, size_t len, const char *s );
+static int _hks_http_token_visible( const uint8_t *token, size_t len );
+static int _hks_http_list_contains( const uint8_t *list, size_t len, const char *s );
+static size_t _hks_http_format_header( uint8_t *dst, const char *name, const char *value );
+static size_t _hks_http_format_uint( uint8_t *dst, size_t value );
+static void _hks_http_request_fill(
+  const hks_http_parser_t *parser,
+  hks_http_request_t *request,
+  uint8_t *buffer
+);
+
+void hks_http_parser_reset( hks_http_parser_t *parser )
 {
-  uint8_t c;
-  uint8_t *ptr = buffer;
-  const uint8_t *end = buffer + buffer_len;
+  memset( parser, 0, sizeof( hks_http_parser_t ) );
+  parser->state = HKS_HTTP_PARSER_METHOD;
+}
 
-  request->content = buffer;
-  request->content_len = buffer_len;
-  request->method = buffer;
-  request->method_len = 0;
-  request->path = NULL;
-  request->path_len = 0;
-
-  // find space after the method
-  while( ( ptr < end ) && ( *ptr != ' ' ) ) ptr++;
-  request->method_len = (size_t)( ptr - request->method );
-  ptr++;
-
-  // find the space after the path (hope it's URL encoded)
-  request->path = ptr;
-  while( ( ptr < end ) && ( *ptr != ' ' ) ) ptr++;
-  request->path_len = (size_t)( ptr - request->path );
-  ptr++;
-
-  // Skip the protocol and version
-  while( ( ptr < end ) && ( ( c = *ptr ) != '\r' ) && ( c != '\n' ) ) ptr++;
-  ptr++;
+esp_err_t hks_http_request_parse(
+  hks_http_parser_t *parser,
+  hks_http_request_t *request,
+  uint8_t *buffer,
+  size_t buffer_len
+)
+{
+  if ( parser == NULL || request == NULL || ( buffer == NULL && buffer_len > 0 ) )
+    return ESP_ERR_INVALID_ARG;
+
+  // offsets are 16-bit, anything beyond belongs to a later request anyway
+  size_t len = buffer_len > UINT16_MAX ? UINT16_MAX : buffer_len;
+  size_t pos = parser->pos;
+  uint8_t *p;
+
+  while ( pos < len )
+  {
+    switch ( parser->state )
+    {
+      case HKS_HTTP_PARSER_METHOD:
+        // tolerate empty lines between pipelined requests
+        if ( pos == parser->mark && ( buffer[pos] == '\r' || buffer[pos] == '\n' ) )
+        {
+          parser->mark = ++pos;
+          break;
+        }
+
+        p = memchr( buffer + pos, ' ', len - pos );
+        if ( p == NULL )
+        {
+          if ( len - parser->mark > HKS_HTTP_MAX_METHOD )
+            return ESP_ERR_INVALID_ARG;
+          pos = len;
+          break;
+        }
+
+        if ( p == buffer + parser->mark || p - buffer - parser->mark > HKS_HTTP_MAX_METHOD ||
+             !_hks_http_token_visible( buffer + parser->mark, p - buffer - parser->mark ) )
+          return ESP_ERR_INVALID_ARG;
+
+        parser->method.offset = parser->mark;
+        parser->method.len = (uint16_t)( p - buffer - parser->mark );
+        pos = p - buffer + 1;
+        parser->mark = pos;
+        parser->state = HKS_HTTP_PARSER_PATH;
+        break;
+
+      case HKS_HTTP_PARSER_PATH:
+        p = memchr( buffer + pos, ' ', len - pos );
+        if ( p == NULL )
+        {
+          pos = len;
+          break;
+        }
+
+        if ( p == buffer + parser->mark || !_hks_http_token_visible( buffer + parser->mark, p - buffer - parser->mark ) )
+          return ESP_ERR_INVALID_ARG;
+
+        parser->path.offset = parser->mark;
+        parser->path.len = (uint16_t)( p - buffer - parser->mark );
+        pos = p - buffer + 1;
+        parser->mark = pos;
+        parser->state = HKS_HTTP_PARSER_PROTOCOL;
+        break;
+
+      case HKS_HTTP_PARSER_PROTOCOL:
+        p = memchr( buffer + pos, '\n', len - pos );
+        if ( p == NULL )
+        {
+          pos = len;
+          break;
+        }
+
+        // a line that arrived whole is held to the limit a partial one is
+        if ( p - buffer > HKS_HTTP_MAX_REQUEST_LINE )
+          return ESP_ERR_INVALID_SIZE;
+
+        parser->protocol.offset = parser->mark;
+        parser->protocol.len = (uint16_t)( p - buffer - parser->mark );
+        if ( parser->protocol.len > 0 && p[-1] == '\r' )
+          parser->protocol.len--;
+
+        // only a well-formed HTTP/d.d is a version we do not speak, anything
+        // else is a bad request
+        {
+          const uint8_t *v = buffer + parser->mark;
+          if ( parser->protocol.len != 8 || memcmp( v, "HTTP/", 5 ) != 0 ||
+               v[5] < '0' || v[5] > '9' || v[6] != '.' || v[7] < '0' || v[7] > '9' )
+            return ESP_ERR_INVALID_ARG;
+
+          // HTTP/1.1 connections persist unless closed, HTTP/1.0 ones the other way round
+          if ( memcmp( v + 5, "1.1", 3 ) == 0 )
+            parser->keep_alive = 1;
+          else if ( memcmp( v + 5, "1.0", 3 ) != 0 )
+            return HKS_ERR_HTTP_VERSION;
+        }
+
+        pos = p - buffer + 1;
+        parser->mark = pos;
+        parser->state = HKS_HTTP_PARSER_HEADER_START;
+        break;
+
+      case HKS_HTTP_PARSER_HEADER_START:
+        if ( buffer[pos] == '\r' || buffer[pos] == '\n' )
+        {
+          // blank line terminates the headers
+          if ( buffer[pos] == '\r' )
+          {
+            if ( pos + 1 >= len )
+              goto incomplete;
+            if ( buffer[pos + 1] != '\n' )
+              return ESP_ERR_INVALID_ARG;
+            pos++;
+          }
+          pos++;
+
+          if ( pos + parser->content_length > UINT16_MAX )
+            return ESP_ERR_INVALID_SIZE;
+
+          parser->body_offset = pos;
+          parser->state = HKS_HTTP_PARSER_BODY;
+          break;
+        }
+
+        parser->mark = pos;
+        parser->state = HKS_HTTP_PARSER_HEADER_NAME;
+        break;
+
+      case HKS_HTTP_PARSER_HEADER_NAME:
+        while ( pos < len && buffer[pos] != ':' )
+        {
+          if ( buffer[pos] == '\n' )
+            return ESP_ERR_INVALID_ARG;
+          if ( pos - parser->mark >= HKS_HTTP_MAX_HEADER_LINE )
+            return ESP_ERR_INVALID_SIZE;
+          pos++;
+        }
+
+        if ( pos == len )
+          break;
+
+        if ( pos == parser->mark )
+          return ESP_ERR_INVALID_ARG;
+
+        parser->name.offset = parser->mark;
+        parser->name.len = (uint16_t)( pos - parser->mark );
+        pos++;
+        parser->state = HKS_HTTP_PARSER_HEADER_VALUE;
+        break;
+
+      case HKS_HTTP_PARSER_HEADER_VALUE:
+      {
+        p = memchr( buffer + pos, '\n', len - pos );
+        if ( p == NULL )
+        {
+          pos = len;
+          break;
+        }
+
+        if ( (size_t)( p - buffer ) - parser->mark > HKS_HTTP_MAX_HEADER_LINE )
+          return ESP_ERR_INVALID_SIZE;
+
+        // trim optional whitespace around the value
+        size_t start = parser->name.offset + parser->name.len + 1;
+        size_t end = p - buffer;
+        while ( start < end && ( buffer[start] == ' ' || buffer[start] == '\t' ) ) start++;
+        while ( end > start && ( buffer[end - 1] == '\r' || buffer[end - 1] == ' ' || buffer[end - 1] == '\t' ) ) end--;
+
+        if ( _hks_http_token_equals( buffer + parser->name.offset, parser->name.len, _HKS_HTTP_CONTENT_LENGTH ) )
+        {
+          if ( start == end )
+            return ESP_ERR_INVALID_ARG;
+
+          size_t content_length = 0;
+          for ( size_t i = start; i < end; i++ )
+          {
+            if ( buffer[i] < '0' || buffer[i] > '9' )
+              return ESP_ERR_INVALID_ARG;
+            content_length = content_length * 10 + ( buffer[i] - '0' );
+            if ( content_length > UINT16_MAX )
+              return ESP_ERR_INVALID_SIZE;
+          }
+          // a second Content-Length that disagrees is a smuggling attempt
+          if ( parser->content_length_seen && content_length != parser->content_length )
+            return ESP_ERR_INVALID_ARG;
+          parser->content_length = content_length;
+          parser->content_length_seen = 1;
+        }
+        else if ( _hks_http_token_equals( buffer + parser->name.offset, parser->name.len, _HKS_HTTP_CONNECTION ) )
+        {
+          if ( _hks_http_list_contains( buffer + start, end - start, "close" ) )
+            parser->keep_alive = 0;
+          else if ( _hks_http_list_contains( buffer + start, end - start, "keep-alive" ) )
+            parser->keep_alive = 1;
+        }
+
+        // headers beyond the table are validated but not reported
+        if ( parser->header_count < HKS_HTTP_MAX_HEADERS )
+        {
+          parser->header_names[parser->header_count] = parser->name;
+          parser->header_values[parser->header_count].offset = (uint16_t)start;
+          parser->header_values[parser->header_count].len = (uint16_t)( end - start );
+          parser->header_count++;
+        }
+
+        pos = p - buffer + 1;
+        parser->mark = pos;
+        parser->state = HKS_HTTP_PARSER_HEADER_START;
+        break;
+      }
+
+      case HKS_HTTP_PARSER_BODY:
+        goto body;
+    }
+
+    if ( parser->state <= HKS_HTTP_PARSER_PROTOCOL && pos > HKS_HTTP_MAX_REQUEST_LINE )
+      return ESP_ERR_INVALID_SIZE;
+
+    if ( parser->state >= HKS_HTTP_PARSER_HEADER_NAME && pos - parser->mark > HKS_HTTP_MAX_HEADER_LINE )
+      return ESP_ERR_INVALID_SIZE;
+  }
+
+  if ( parser->state != HKS_HTTP_PARSER_BODY )
+    goto incomplete;
+
+body:
+  if ( len - parser->body_offset < parser->content_length )
+  {
+    pos = len;
+    goto incomplete;
+  }
+
+  _hks_http_request_fill( parser, request, buffer );
+  hks_http_parser_reset( parser );
+
+  return ESP_OK;
+
+incomplete:
+  parser->pos = (uint16_t)pos;
+  return HKS_ERR_HTTP_INCOMPLETE;
+}
+
+const hks_http_header_t *hks_http_request_header( const hks_http_request_t *request, const char *name )
+{
+  for ( uint8_t i = 0; i < request->header_count; i++ )
+  {
+    const hks_http_header_t *header = &request->headers[i];
+    if ( _hks_http_token_equals( header->name, header->name_len, name ) )
+      return header;
+  }
+
+  return NULL;
+}
+
+int hks_http_response_fits( const hks_send_queue_t *queue, const char *content_type )
+{
+  if ( hks_send_queue_available( queue ) < 3 )
+    return 0;
+
+  size_t space = HKS_SEND_SCRATCH_LENGTH - queue->scratch_used;
+  size_t type_len = content_type ? strlen( content_type ) : 0;
+  return space >= sizeof( "Content-Type: \r\nContent-Length: 18446744073709551615\r\n\r\n" ) + type_len;
+}
+
+esp_err_t hks_http_response_write(
+  hks_send_queue_t *queue,
+  uint16_t status,
+  const char *content_type,
+  const void *body,
+  size_t body_len,
+  hks_send_release_t release,
+  void *arg
+)
+{
+  const char *line = NULL;
+  for ( size_t i = 0; i < sizeof( _HKS_HTTP_STATUS ) / sizeof( _HKS_HTTP_STATUS[0] ); i++ )
+  {
+    if ( _HKS_HTTP_STATUS[i].code == status )
+    {
+      line = _HKS_HTTP_STATUS[i].line;
+      break;
+    }
+  }
+
+  if ( line == NULL || ( body == NULL && body_len > 0 ) )
+    return ESP_ERR_INVALID_ARG;
+
+  if ( !hks_http_response_fits( queue, content_type ) )
+    return ESP_ERR_NO_MEM;
+
+  // status line, header lines and the body if there is one
+  int with_body = body_len > 0 || release != NULL;
+  size_t space;
+  uint8_t *headers = hks_send_queue_scratch( queue, &space );
+
+  uint8_t *p = headers;
+  if ( content_type != NULL )
+    p += _hks_http_format_header( p, "Content-Type", content_type );
+
+  // 204 must not carry a length
+  if ( status != 204 )
+  {
+    p += _hks_http_format_header( p, _HKS_HTTP_CONTENT_LENGTH, "" ) - 2;
+    p += _hks_http_format_uint( p, body_len );
+    *p++ = '\r';
+    *p++ = '\n';
+  }
+  *p++ = '\r';
+  *p++ = '\n';
+
+  hks_send_queue_push( queue, line, strlen( line ), NULL, NULL );
+  hks_send_queue_commit( queue, p - headers );
+  if ( with_body )
+    hks_send_queue_push( queue, body, body_len, release, arg );
 
   return ESP_OK;
-}
\ No newline at end of file
+}
+
+// whether the comma separated `list` has `s` among its elements
+int _hks_http_list_contains( const uint8_t *list, size_t len, const char *s )
+{
+  size_t start = 0;
+  while ( start < len )
+  {
+    size_t end = start;
+    while ( end < len && list[end] != ',' ) end++;
+
+    size_t next = end + 1;
+    while ( start < end && ( list[start] == ' ' || list[start] == '\t' ) ) start++;
+    while ( end > start && ( list[end - 1] == ' ' || list[end - 1] == '\t' ) ) end--;
+    if ( _hks_http_token_equals( list + start, end - start, s ) )
+      return 1;
+
+    start = next;
+  }
+
+  return 0;
+}
+
+int _hks_http_token_equals( const uint8_t *token, size_t len, const char *s )
+{
+  for ( size_t i = 0; i < len; i++, s++ )
+  {
+    uint8_t a = token[i];
+    uint8_t b = (uint8_t)*s;
+    if ( b == 0 )
+      return 0;
+    if ( a >= 'A' && a <= 'Z' ) a += 'a' - 'A';
+    if ( b >= 'A' && b <= 'Z' ) b += 'a' - 'A';
+    if ( a != b )
+      return 0;
+  }
+
+  return *s == 0;
+}
+
+int _hks_http_token_visible( const uint8_t *token, size_t len )
+{
+  // no controls, and no line break ending the request line early
+  for ( size_t i = 0; i < len; i++ )
+    if ( token[i] <= ' ' || token[i] == 0x7f )
+      return 0;
+
+  return 1;
+}
+
+size_t _hks_http_format_header( uint8_t *dst, const char *name, const char *value )
+{
+  size_t name_len = strlen( name );
+  size_t value_len = strlen( value );
+
+  memcpy( dst, name, name_len );
+  dst[name_len] = ':';
+  dst[name_len + 1] = ' ';
+  memcpy( dst + name_len + 2, value, value_len );
+  dst[name_len + 2 + value_len] = '\r';
+  dst[name_len + 3 + value_len] = '\n';
+
+  return name_len + value_len + 4;
+}
+
+size_t _hks_http_format_uint( uint8_t *dst, size_t value )
+{
+  uint8_t digits[20];
+  size_t n = 0;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while ( value > 0 );
+
+  for ( size_t i = 0; i < n; i++ )
+    dst[i] = digits[n - 1 - i];
+
+  return n;
+}
+
+void _hks_http_request_fill(
+  const hks_http_parser_t *parser,
+  hks_http_request_t *request,
+  uint8_t *buffer
+)
+{
+  request->content = buffer;
+  request->content_len = parser->body_offset + parser->content_length;
+
+  request->method = buffer + parser->method.offset;
+  request->method_len = (uint8_t)parser->method.len;
+
+  request->path = buffer + parser->path.offset;
+  request->path_len = parser->path.len;
+
+  // split off the query string, without the '?'
+  uint8_t *query = memchr( request->path, '?', request->path_len );
+  if ( query != NULL )
+  {
+    request->query = query + 1;
+    request->query_len = request->path_len - ( query + 1 - request->path );
+    request->path_len = query - request->path;
+  }
+  else
+  {
+    request->query = request->path + request->path_len;
+    request->query_len = 0;
+  }
+
+  request->protocol = buffer + parser->protocol.offset;
+  request->protocol_len = (uint8_t)parser->protocol.len;
+  request->keep_alive = parser->keep_alive;
+
+  request->header_count = parser->header_count;
+  for ( uint8_t i = 0; i < parser->header_count; i++ )
+  {
+    request->headers[i].name = buffer + parser->header_names[i].offset;
+    request->headers[i].name_len = parser->header_names[i].len;
+    request->headers[i].value = buffer + parser->header_values[i].offset;
+    request->headers[i].value_len = parser->header_values[i].len;
+  }
+
+  request->body = buffer + parser->body_offset;
+  request->body_len = parser->content_length;
+}
@@ -1,17 +1,127 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
 #include <esp_err.h>
+#include "hks_types.h"
+#include "hks_send.h"
+
+#define HKS_HTTP_MAX_HEADERS        12
+#define HKS_HTTP_MAX_REQUEST_LINE   1536  // method + path + protocol, fits a batched id= query
+#define HKS_HTTP_MAX_HEADER_LINE    512
+
+#define HKS_HTTP_CONTENT_TYPE_JSON  "application/hap+json"
+#define HKS_HTTP_CONTENT_TYPE_TLV8  "application/pairing+tlv8"
+
+struct hks_http_header_s {
+  uint8_t *name;
+  uint16_t name_len;
+
+  uint8_t *value;
+  uint16_t value_len;
+};
+typedef struct hks_http_header_s hks_http_header_t;
 
+// Slices point into the buffer handed to hks_http_request_parse and are only
+// valid until those bytes are consumed.
 struct hks_http_request_s {
   uint8_t *content;
-  size_t content_len;
+  size_t content_len; // length of the whole request, including the body
 
   uint8_t *method;
   uint8_t method_len;
 
-  uint8_t *path;
+  uint8_t *path; // without the query string
   uint16_t path_len;
 
+  uint8_t *query; // after the '?', empty if there is none
+  uint16_t query_len;
+
+  uint8_t *protocol; // HTTP/1.1 or HTTP/1.0
+  uint8_t protocol_len;
+  uint8_t keep_alive; // the connection stays open after the response
+
+  hks_http_header_t headers[HKS_HTTP_MAX_HEADERS];
+  uint8_t header_count;
+
   uint8_t *body;
+  size_t body_len;
 };
 typedef struct hks_http_request_s hks_http_request_t;
 
-extern esp_err_t hks_http_request_parse( hks_http_request_t *request, uint8_t *buffer, size_t buffer_len );
+typedef enum {
+  HKS_HTTP_PARSER_METHOD = 0,
+  HKS_HTTP_PARSER_PATH,
+  HKS_HTTP_PARSER_PROTOCOL,
+  HKS_HTTP_PARSER_HEADER_START,
+  HKS_HTTP_PARSER_HEADER_NAME,
+  HKS_HTTP_PARSER_HEADER_VALUE,
+  HKS_HTTP_PARSER_BODY,
+} hks_http_parser_state_t;
+
+struct hks_http_slice_s {
+  uint16_t offset;
+  uint16_t len;
+};
+typedef struct hks_http_slice_s hks_http_slice_t;
+
+// Resumable parser state. Every position is an offset from the first byte of
+// the request so the receive buffer may move between calls.
+struct hks_http_parser_s {
+  hks_http_parser_state_t state;
+  uint16_t pos;   // next byte to scan
+  uint16_t mark;  // start of the token being scanned
+
+  hks_http_slice_t name; // header currently being scanned
+
+  hks_http_slice_t method;
+  hks_http_slice_t path;
+  hks_http_slice_t protocol;
+  hks_http_slice_t header_names[HKS_HTTP_MAX_HEADERS];
+  hks_http_slice_t header_values[HKS_HTTP_MAX_HEADERS];
+  uint8_t header_count;
+
+  uint16_t body_offset;
+  size_t content_length;
+  uint8_t content_length_seen;
+  uint8_t keep_alive;
+};
+typedef struct hks_http_parser_s hks_http_parser_t;
+
+extern void hks_http_parser_reset( hks_http_parser_t *parser );
+
+// Feed the parser every byte received since the start of the current request;
+// `buffer` may grow (and move) between calls, scanning resumes where it stopped.
+// Returns ESP_OK with `request` filled once a full request including its body
+// is available, HKS_ERR_HTTP_INCOMPLETE if more bytes are needed,
+// HKS_ERR_HTTP_VERSION for a well-formed HTTP/d.d other than HTTP/1.0 and
+// HTTP/1.1, or another error for a malformed request, repeated
+// Content-Length headers that disagree included. The parser is reset after a
+// complete request.
+extern esp_err_t hks_http_request_parse(
+  hks_http_parser_t *parser,
+  hks_http_request_t *request,
+  uint8_t *buffer,
+  size_t buffer_len
+);
+
+extern const hks_http_header_t *hks_http_request_header( const hks_http_request_t *request, const char *name );
+
+// whether hks_http_response_write is sure to find room for a response, for
+// handlers with side effects to check before they act
+extern int hks_http_response_fits( const hks_send_queue_t *queue, const char *content_type );
+
+// Queue a response on `queue`. The status line and body are referenced, not
+// copied (`release` is called with `arg` once the body has been written);
+// only the Content-Type and Content-Length lines are formatted into the
+// queue's scratch area. Nothing is queued on failure: ESP_ERR_NO_MEM when the
+// queue is full, ESP_ERR_INVALID_ARG for an unknown status.
+extern esp_err_t hks_http_response_write(
+  hks_send_queue_t *queue,
+  uint16_t status,
+  const char *content_type,
+  const void *body,
+  size_t body_len,
+  hks_send_release_t release,
+  void *arg
+);
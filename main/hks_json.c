@@ -0,0 +1,369 @@
+#include "hks_json.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+static void _hks_json_put( hks_json_writer_t *w, uint8_t c );
+static int _hks_json_hex( uint8_t c );
+
+void hks_json_writer_init( hks_json_writer_t *w, uint8_t *data, size_t capacity )
+{
+  w->data = data;
+  w->capacity = data ? capacity : 0;
+  w->len = 0;
+}
+
+void hks_json_raw( hks_json_writer_t *w, const char *s, size_t len )
+{
+  if ( w->len + len <= w->capacity )
+    memcpy( w->data + w->len, s, len );
+  w->len += len;
+}
+
+void hks_json_literal( hks_json_writer_t *w, const char *s )
+{
+  hks_json_raw( w, s, strlen( s ) );
+}
+
+void hks_json_pad( hks_json_writer_t *w, size_t n )
+{
+  if ( w->len + n <= w->capacity )
+    memset( w->data + w->len, ' ', n );
+  w->len += n;
+}
+
+void hks_json_string( hks_json_writer_t *w, const char *s )
+{
+  static const char hex[] = "0123456789abcdef";
+
+  _hks_json_put( w, '"' );
+  for ( ; *s; s++ )
+  {
+    uint8_t c = (uint8_t)*s;
+    if ( c == '"' || c == '\\' )
+    {
+      _hks_json_put( w, '\\' );
+      _hks_json_put( w, c );
+    }
+    else if ( c < 0x20 )
+    {
+      hks_json_raw( w, "\\u00", 4 );
+      _hks_json_put( w, hex[c >> 4] );
+      _hks_json_put( w, hex[c & 0x0F] );
+    }
+    else
+      _hks_json_put( w, c );
+  }
+  _hks_json_put( w, '"' );
+}
+
+size_t hks_json_string_length( const char *s )
+{
+  hks_json_writer_t w;
+  hks_json_writer_init( &w, NULL, 0 );
+  hks_json_string( &w, s );
+  return w.len;
+}
+
+void hks_json_uint( hks_json_writer_t *w, uint64_t v )
+{
+  char digits[20];
+  size_t n = 0;
+
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while ( v > 0 );
+
+  while ( n > 0 )
+    _hks_json_put( w, digits[--n] );
+}
+
+void hks_json_int( hks_json_writer_t *w, int64_t v )
+{
+  if ( v < 0 )
+  {
+    _hks_json_put( w, '-' );
+    hks_json_uint( w, (uint64_t)0 - (uint64_t)v );
+    return;
+  }
+
+  hks_json_uint( w, (uint64_t)v );
+}
+
+void hks_json_float( hks_json_writer_t *w, float v )
+{
+  // JSON has no NaN or infinity
+  if ( !isfinite( v ) )
+    v = 0;
+
+  // whole numbers are by far the most common, skip printf for them
+  if ( fabsf( v ) < 2147483648.0f && v == (int32_t)v )
+  {
+    hks_json_int( w, (int32_t)v );
+    return;
+  }
+
+  char buffer[16];
+  int n = snprintf( buffer, sizeof( buffer ), "%.7g", v );
+  hks_json_raw( w, buffer, n );
+}
+
+void hks_json_bool( hks_json_writer_t *w, int v )
+{
+  if ( v )
+    hks_json_raw( w, "true", 4 );
+  else
+    hks_json_raw( w, "false", 5 );
+}
+
+void hks_json_key( hks_json_writer_t *w, const char *key )
+{
+  hks_json_string( w, key );
+  _hks_json_put( w, ':' );
+}
+
+void _hks_json_put( hks_json_writer_t *w, uint8_t c )
+{
+  if ( w->len < w->capacity )
+    w->data[w->len] = c;
+  w->len++;
+}
+
+void hks_json_reader_init( hks_json_reader_t *r, uint8_t *data, size_t len )
+{
+  r->data = data;
+  r->len = len;
+  r->pos = 0;
+}
+
+hks_json_type_t hks_json_next( hks_json_reader_t *r, hks_json_token_t *token )
+{
+  // whitespace and separators
+  while ( r->pos < r->len )
+  {
+    uint8_t c = r->data[r->pos];
+    if ( c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != ',' && c != ':' )
+      break;
+    r->pos++;
+  }
+
+  token->start = r->data + r->pos;
+  token->len = 0;
+
+  if ( r->pos == r->len )
+    return token->type = HKS_JSON_END;
+
+  uint8_t c = r->data[r->pos];
+  size_t start = r->pos;
+  switch ( c )
+  {
+    case '{': token->type = HKS_JSON_OBJECT; r->pos++; break;
+    case '}': token->type = HKS_JSON_OBJECT_END; r->pos++; break;
+    case '[': token->type = HKS_JSON_ARRAY; r->pos++; break;
+    case ']': token->type = HKS_JSON_ARRAY_END; r->pos++; break;
+
+    case '"':
+      start = ++r->pos;
+      while ( r->pos < r->len && r->data[r->pos] != '"' )
+      {
+        if ( r->data[r->pos] == '\\' )
+          r->pos++;
+        r->pos++;
+      }
+      if ( r->pos >= r->len )
+        return token->type = HKS_JSON_ERROR;
+
+      token->type = HKS_JSON_STRING;
+      token->start = r->data + start;
+      token->len = r->pos++ - start;
+      return token->type;
+
+    default:
+      // numbers and literals run up to the next delimiter
+      while ( r->pos < r->len )
+      {
+        c = r->data[r->pos];
+        if ( c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ':' )
+          break;
+        r->pos++;
+      }
+      token->len = r->pos - start;
+
+      if ( hks_json_token_equals( token, "true" ) )
+        token->type = HKS_JSON_TRUE;
+      else if ( hks_json_token_equals( token, "false" ) )
+        token->type = HKS_JSON_FALSE;
+      else if ( hks_json_token_equals( token, "null" ) )
+        token->type = HKS_JSON_NULL;
+      else if ( token->start[0] == '-' || ( token->start[0] >= '0' && token->start[0] <= '9' ) )
+        token->type = HKS_JSON_NUMBER;
+      else
+        token->type = HKS_JSON_ERROR;
+      return token->type;
+  }
+
+  token->len = 1;
+  return token->type;
+}
+
+int hks_json_skip( hks_json_reader_t *r, const hks_json_token_t *token )
+{
+  if ( token->type != HKS_JSON_OBJECT && token->type != HKS_JSON_ARRAY )
+    return token->type != HKS_JSON_ERROR && token->type != HKS_JSON_END;
+
+  size_t depth = 1;
+  hks_json_token_t t;
+  while ( depth > 0 )
+  {
+    switch ( hks_json_next( r, &t ) )
+    {
+      case HKS_JSON_OBJECT:
+      case HKS_JSON_ARRAY:
+        depth++;
+        break;
+
+      case HKS_JSON_OBJECT_END:
+      case HKS_JSON_ARRAY_END:
+        depth--;
+        break;
+
+      case HKS_JSON_END:
+      case HKS_JSON_ERROR:
+        return 0;
+
+      default:
+        break;
+    }
+  }
+
+  return 1;
+}
+
+int hks_json_token_equals( const hks_json_token_t *token, const char *s )
+{
+  size_t len = strlen( s );
+  return token->len == len && memcmp( token->start, s, len ) == 0;
+}
+
+int hks_json_token_int( const hks_json_token_t *token, int64_t *v )
+{
+  if ( token->type != HKS_JSON_NUMBER )
+    return 0;
+
+  size_t i = 0;
+  int negative = token->start[0] == '-';
+  if ( negative )
+    i++;
+  if ( i == token->len )
+    return 0;
+
+  uint64_t n = 0;
+  for ( ; i < token->len; i++ )
+  {
+    uint8_t c = token->start[i];
+    if ( c < '0' || c > '9' || n > ( INT64_MAX - 9 ) / 10 )
+      return 0;
+    n = n * 10 + ( c - '0' );
+  }
+
+  *v = negative ? -(int64_t)n : (int64_t)n;
+  return 1;
+}
+
+int hks_json_token_double( const hks_json_token_t *token, double *v )
+{
+  char buffer[32];
+  if ( token->type != HKS_JSON_NUMBER || token->len >= sizeof( buffer ) )
+    return 0;
+
+  memcpy( buffer, token->start, token->len );
+  buffer[token->len] = 0;
+
+  char *end;
+  *v = strtod( buffer, &end );
+  return end == buffer + token->len;
+}
+
+const char *hks_json_token_string( hks_json_token_t *token )
+{
+  if ( token->type != HKS_JSON_STRING )
+    return NULL;
+
+  uint8_t *src = token->start;
+  uint8_t *end = token->start + token->len;
+  uint8_t *dst = token->start;
+
+  while ( src < end )
+  {
+    if ( *src != '\\' )
+    {
+      *dst++ = *src++;
+      continue;
+    }
+
+    if ( ++src == end )
+      return NULL;
+
+    switch ( *src++ )
+    {
+      case '"':  *dst++ = '"'; break;
+      case '\\': *dst++ = '\\'; break;
+      case '/':  *dst++ = '/'; break;
+      case 'b':  *dst++ = '\b'; break;
+      case 'f':  *dst++ = '\f'; break;
+      case 'n':  *dst++ = '\n'; break;
+      case 'r':  *dst++ = '\r'; break;
+      case 't':  *dst++ = '\t'; break;
+
+      case 'u':
+      {
+        if ( end - src < 4 )
+          return NULL;
+
+        uint32_t cp = 0;
+        for ( int i = 0; i < 4; i++ )
+        {
+          int h = _hks_json_hex( *src++ );
+          if ( h < 0 )
+            return NULL;
+          cp = ( cp << 4 ) | h;
+        }
+
+        // UTF-8, never longer than the six byte escape it replaces
+        if ( cp < 0x80 )
+          *dst++ = cp;
+        else if ( cp < 0x800 )
+        {
+          *dst++ = 0xC0 | ( cp >> 6 );
+          *dst++ = 0x80 | ( cp & 0x3F );
+        }
+        else
+        {
+          *dst++ = 0xE0 | ( cp >> 12 );
+          *dst++ = 0x80 | ( ( cp >> 6 ) & 0x3F );
+          *dst++ = 0x80 | ( cp & 0x3F );
+        }
+        break;
+      }
+
+      default:
+        return NULL;
+    }
+  }
+
+  // the closing quote is ours to overwrite
+  *dst = 0;
+  token->len = dst - token->start;
+
+  return (const char *)token->start;
+}
+
+int _hks_json_hex( uint8_t c )
+{
+  if ( c >= '0' && c <= '9' ) return c - '0';
+  if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+  if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+  return -1;
+}
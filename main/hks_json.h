@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only JSON writer over a caller supplied buffer. Output past the
+// capacity is counted but not stored, so a writer over a NULL buffer measures
+// a document before the buffer for it is allocated.
+struct hks_json_writer_s {
+  uint8_t *data;
+  size_t capacity;
+  size_t len; // bytes written, or that would have been
+};
+typedef struct hks_json_writer_s hks_json_writer_t;
+
+extern void hks_json_writer_init( hks_json_writer_t *w, uint8_t *data, size_t capacity );
+
+static inline int hks_json_overflow( const hks_json_writer_t *w )
+{
+  return w->len > w->capacity;
+}
+
+extern void hks_json_raw( hks_json_writer_t *w, const char *s, size_t len );
+extern void hks_json_literal( hks_json_writer_t *w, const char *s );
+extern void hks_json_pad( hks_json_writer_t *w, size_t n ); // n spaces
+
+// quoted and escaped
+extern void hks_json_string( hks_json_writer_t *w, const char *s );
+extern size_t hks_json_string_length( const char *s );
+
+extern void hks_json_uint( hks_json_writer_t *w, uint64_t v );
+extern void hks_json_int( hks_json_writer_t *w, int64_t v );
+extern void hks_json_float( hks_json_writer_t *w, float v );
+extern void hks_json_bool( hks_json_writer_t *w, int v );
+
+// "key":
+extern void hks_json_key( hks_json_writer_t *w, const char *key );
+
+typedef enum {
+  HKS_JSON_END = 0,
+  HKS_JSON_ERROR,
+  HKS_JSON_OBJECT,        // {
+  HKS_JSON_OBJECT_END,    // }
+  HKS_JSON_ARRAY,         // [
+  HKS_JSON_ARRAY_END,     // ]
+  HKS_JSON_STRING,        // slice without the quotes, still escaped
+  HKS_JSON_NUMBER,
+  HKS_JSON_TRUE,
+  HKS_JSON_FALSE,
+  HKS_JSON_NULL,
+} hks_json_type_t;
+
+struct hks_json_token_s {
+  hks_json_type_t type;
+  uint8_t *start;
+  size_t len;
+};
+typedef struct hks_json_token_s hks_json_token_t;
+
+// Pull tokenizer over a buffer, nothing is allocated. Separators are checked
+// loosely: ',' and ':' are skipped, nesting is left to the caller.
+struct hks_json_reader_s {
+  uint8_t *data;
+  size_t len;
+  size_t pos;
+};
+typedef struct hks_json_reader_s hks_json_reader_t;
+
+extern void hks_json_reader_init( hks_json_reader_t *r, uint8_t *data, size_t len );
+extern hks_json_type_t hks_json_next( hks_json_reader_t *r, hks_json_token_t *token );
+
+// skip the value `token` starts, including everything nested in it
+extern int hks_json_skip( hks_json_reader_t *r, const hks_json_token_t *token );
+
+extern int hks_json_token_equals( const hks_json_token_t *token, const char *s );
+extern int hks_json_token_int( const hks_json_token_t *token, int64_t *v );
+extern int hks_json_token_double( const hks_json_token_t *token, double *v );
+
+// unescape a string token in place and NUL terminate it (over the closing
+// quote), returns the string or NULL if it is malformed
+extern const char *hks_json_token_string( hks_json_token_t *token );
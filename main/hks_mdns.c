@@ -0,0 +1,688 @@
+#include "hks_mdns.h"
+#include <string.h>
+#include <lwip/sockets.h>
+#include <esp_log.h>
+
+static const char *TAG = "hks-mdns";
+
+#define HKS_MDNS_TYPE_A       1
+#define HKS_MDNS_TYPE_PTR     12
+#define HKS_MDNS_TYPE_TXT     16
+#define HKS_MDNS_TYPE_AAAA    28
+#define HKS_MDNS_TYPE_SRV     33
+#define HKS_MDNS_TYPE_ANY     255
+
+#define HKS_MDNS_CLASS_IN     0x0001
+#define HKS_MDNS_CLASS_FLUSH  0x8000 // cache-flush in answers, unicast-response in questions
+
+// RFC 6762 section 10: host records 120 s, everything else 75 minutes
+#define HKS_MDNS_TTL_HOST     120
+#define HKS_MDNS_TTL_OTHER    4500
+
+#define HKS_MDNS_RATE_LIMIT_MS  1000
+
+// RFC 6762 section 6.7: answers to a legacy resolver are cached no longer
+#define HKS_MDNS_TTL_LEGACY   10
+
+static const uint8_t _HKS_MDNS_SERVICE[] = "\x04_hap\x04_tcp\x05local";
+static const uint8_t _HKS_MDNS_ENUMERATION[] = "\x09_services\x07_dns-sd\x04_udp\x05local";
+static const uint8_t _HKS_MDNS_LOCAL[] = "\x05local";
+
+// of the one record in the enumeration answer
+static const uint16_t _HKS_MDNS_ENUMERATION_TTL = 12 + sizeof( _HKS_MDNS_ENUMERATION ) + 4;
+
+static esp_err_t _hks_mdns_build( hks_mdns_t *mdns );
+static void _hks_mdns_build_enumeration( hks_mdns_t *mdns );
+static void _hks_mdns_addresses( hks_mdns_t *mdns, hks_mdns_addresses_t *addresses );
+static int _hks_mdns_distinct( const void *table, size_t size, int i );
+static int _hks_mdns_join( int fd, uint32_t ipv4 );
+static uint8_t *_hks_mdns_address( hks_mdns_t *mdns, uint8_t *p, uint16_t host, uint16_t type, const void *addr, size_t len );
+static uint8_t *_hks_mdns_pointer( hks_mdns_t *mdns, uint8_t *p, uint16_t target );
+static size_t _hks_mdns_legacy( uint8_t *pkt, size_t size, size_t questions_end,
+  const uint8_t *answer, size_t len, const uint16_t *ttls, uint8_t ttl_count, const uint16_t *pointers, uint8_t pointer_count );
+static size_t _hks_mdns_flat_name( uint8_t *dst, const char *label, const uint8_t *suffix, size_t suffix_len );
+static int _hks_mdns_read_name( const uint8_t *pkt, size_t len, size_t *pos, uint8_t *out );
+static esp_err_t _hks_mdns_send( hks_mdns_t *mdns, const uint8_t *data, size_t len, const struct sockaddr_in *to );
+static esp_err_t _hks_mdns_sendto( int fd, const uint8_t *data, size_t len, const struct sockaddr_in *to );
+
+static inline uint8_t *_put16( uint8_t *p, uint16_t v )
+{
+  p[0] = v >> 8;
+  p[1] = v;
+  return p + 2;
+}
+
+static inline uint8_t *_put32( uint8_t *p, uint32_t v )
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+  return p + 4;
+}
+
+static inline uint16_t _get16( const uint8_t *p )
+{
+  return ( p[0] << 8 ) | p[1];
+}
+
+static inline uint32_t _get32( const uint8_t *p )
+{
+  return ( (uint32_t)p[0] << 24 ) | ( (uint32_t)p[1] << 16 ) | ( p[2] << 8 ) | p[3];
+}
+
+void hks_mdns_init( hks_mdns_t *mdns, tcpip_adapter_if_t tcpip_if, const hks_txt_t *txt )
+{
+  memset( mdns, 0, sizeof( hks_mdns_t ) );
+  mdns->fd = -1;
+  mdns->interfaces = 1 << tcpip_if;
+  mdns->txt = txt;
+  _hks_mdns_build_enumeration( mdns );
+}
+
+esp_err_t hks_mdns_add_interface( hks_mdns_t *mdns, tcpip_adapter_if_t tcpip_if )
+{
+  if ( mdns == NULL || tcpip_if >= HKS_MDNS_INTERFACES )
+    return ESP_ERR_INVALID_ARG;
+
+  // joined and advertised as soon as it has an address
+  mdns->interfaces |= 1 << tcpip_if;
+
+  return hks_mdns_refresh( mdns );
+}
+
+esp_err_t hks_mdns_start( hks_mdns_t *mdns, uint16_t port )
+{
+  if ( mdns == NULL || mdns->fd >= 0 )
+    return ESP_ERR_INVALID_STATE;
+
+  int fd = lwip_socket( AF_INET, SOCK_DGRAM, 0 );
+  if ( fd < 0 )
+    return ESP_FAIL;
+
+  // share the port with any other responder on the host
+  int one = 1;
+  lwip_setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+#ifdef SO_REUSEPORT
+  lwip_setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof( one ) );
+#endif
+
+  struct sockaddr_in addr;
+  bzero( &addr, sizeof( addr ) );
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons( HKS_MDNS_PORT );
+  if ( lwip_bind( fd, (struct sockaddr *)&addr, sizeof( addr ) ) < 0 )
+  {
+    lwip_close( fd );
+    return ESP_FAIL;
+  }
+
+  _hks_mdns_addresses( mdns, &mdns->addresses );
+
+  // on every interface, the default one while none has an address
+  int joined = 0;
+  for ( int i = 0; i < HKS_MDNS_INTERFACES; i++ )
+    if ( _hks_mdns_distinct( mdns->addresses.ipv4, sizeof( uint32_t ), i ) )
+      joined |= _hks_mdns_join( fd, mdns->addresses.ipv4[i] ) == 0;
+  if ( !joined && _hks_mdns_join( fd, 0 ) )
+  {
+    lwip_close( fd );
+    return ESP_FAIL;
+  }
+
+  uint8_t ttl = 255;
+  uint8_t loop = 1;
+  lwip_setsockopt( fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof( ttl ) );
+  lwip_setsockopt( fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof( loop ) );
+
+  int flags = lwip_fcntl( fd, F_GETFL, 0 );
+  if ( flags < 0 || lwip_fcntl( fd, F_SETFL, flags | O_NONBLOCK ) < 0 )
+  {
+    lwip_close( fd );
+    return ESP_FAIL;
+  }
+
+  mdns->fd = fd;
+  mdns->port = port;
+
+  return _hks_mdns_build( mdns );
+}
+
+void hks_mdns_stop( hks_mdns_t *mdns )
+{
+  if ( mdns == NULL || mdns->fd < 0 )
+    return;
+
+  // goodbye: the same answers with a TTL of zero
+  if ( mdns->response_len > 0 )
+  {
+    uint8_t goodbye[HKS_MDNS_PACKET_LENGTH];
+    memcpy( goodbye, mdns->response, mdns->response_len );
+    for ( uint8_t i = 0; i < mdns->ttl_count; i++ )
+      _put32( goodbye + mdns->ttl_offsets[i], 0 );
+    _hks_mdns_send( mdns, goodbye, mdns->response_len, NULL );
+  }
+
+  lwip_close( mdns->fd );
+  mdns->fd = -1;
+  mdns->announcements = 0;
+}
+
+esp_err_t hks_mdns_set_instance( hks_mdns_t *mdns, const char *instance )
+{
+  if ( mdns == NULL || instance == NULL )
+    return ESP_ERR_INVALID_ARG;
+
+  size_t len = strlen( instance );
+  if ( len == 0 || len > HKS_MDNS_LABEL_LENGTH )
+    return ESP_ERR_INVALID_SIZE;
+
+  memcpy( mdns->instance, instance, len + 1 );
+
+  return _hks_mdns_build( mdns );
+}
+
+esp_err_t hks_mdns_set_hostname( hks_mdns_t *mdns, const char *hostname )
+{
+  if ( mdns == NULL || hostname == NULL )
+    return ESP_ERR_INVALID_ARG;
+
+  size_t len = strlen( hostname );
+  if ( len == 0 || len > HKS_MDNS_LABEL_LENGTH )
+    return ESP_ERR_INVALID_SIZE;
+
+  memcpy( mdns->hostname, hostname, len + 1 );
+
+  return _hks_mdns_build( mdns );
+}
+
+esp_err_t hks_mdns_refresh( hks_mdns_t *mdns )
+{
+  if ( mdns->fd < 0 )
+    return ESP_OK;
+
+  hks_mdns_addresses_t addresses;
+  _hks_mdns_addresses( mdns, &addresses );
+  if ( memcmp( &addresses, &mdns->addresses, sizeof( addresses ) ) == 0 && mdns->txt->version == mdns->txt_version )
+    return ESP_OK;
+
+  // an interface that got an address listens on it, one joined already is fine
+  for ( int i = 0; i < HKS_MDNS_INTERFACES; i++ )
+    if ( addresses.ipv4[i] != 0 && addresses.ipv4[i] != mdns->addresses.ipv4[i] )
+      _hks_mdns_join( mdns->fd, addresses.ipv4[i] );
+
+  mdns->addresses = addresses;
+
+  return _hks_mdns_build( mdns );
+}
+
+int32_t hks_mdns_announce( hks_mdns_t *mdns, uint32_t now )
+{
+  if ( mdns->fd < 0 || mdns->announcements == 0 || mdns->response_len == 0 )
+    return -1;
+
+  _hks_mdns_send( mdns, mdns->response, mdns->response_len, NULL );
+  mdns->last_answer = now;
+
+  if ( --mdns->announcements == 0 )
+    return -1;
+
+  // RFC 6762 section 8.3: one second apart, doubling
+  uint32_t interval = mdns->announce_interval;
+  mdns->announce_interval *= 2;
+  return interval;
+}
+
+esp_err_t hks_mdns_process( hks_mdns_t *mdns, uint32_t now )
+{
+  // room for an answer behind the question, a legacy reply is built in place
+  uint8_t pkt[HKS_MDNS_PACKET_LENGTH + HKS_MDNS_NAME_LENGTH + 4];
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof( from );
+
+  int n = lwip_recvfrom( mdns->fd, pkt, sizeof( pkt ), 0, (struct sockaddr *)&from, &from_len );
+  if ( n < 0 )
+    return ESP_FAIL;
+
+  // queries only: QR clear, standard opcode
+  if ( n < 12 || ( pkt[2] & 0xF8 ) || mdns->response_len == 0 )
+    return ESP_OK;
+
+  uint16_t qdcount = _get16( pkt + 4 );
+  uint16_t ancount = _get16( pkt + 6 );
+  size_t pos = 12;
+  uint8_t name[HKS_MDNS_NAME_LENGTH];
+
+  int answer = 0, ptr_only = 1, enumerate = 0, unicast = 1;
+  for ( uint16_t i = 0; i < qdcount; i++ )
+  {
+    int len = _hks_mdns_read_name( pkt, n, &pos, name );
+    if ( len < 0 || pos + 4 > (size_t)n )
+      return ESP_OK;
+
+    uint16_t type = _get16( pkt + pos );
+    uint16_t qclass = _get16( pkt + pos + 2 );
+    pos += 4;
+
+    int mine = 0;
+    if ( len == sizeof( _HKS_MDNS_SERVICE ) && memcmp( name, _HKS_MDNS_SERVICE, len ) == 0 )
+    {
+      mine = ( type == HKS_MDNS_TYPE_PTR || type == HKS_MDNS_TYPE_ANY );
+      answer |= mine;
+    }
+    else if ( len == mdns->instance_name_len && memcmp( name, mdns->instance_name, len ) == 0 )
+    {
+      mine = ( type == HKS_MDNS_TYPE_SRV || type == HKS_MDNS_TYPE_TXT || type == HKS_MDNS_TYPE_ANY );
+      answer |= mine;
+      ptr_only &= !mine;
+    }
+    else if ( len == mdns->host_name_len && memcmp( name, mdns->host_name, len ) == 0 )
+    {
+      mine = ( type == HKS_MDNS_TYPE_A || type == HKS_MDNS_TYPE_AAAA || type == HKS_MDNS_TYPE_ANY );
+      answer |= mine;
+      ptr_only &= !mine;
+    }
+    else if ( len == sizeof( _HKS_MDNS_ENUMERATION ) && memcmp( name, _HKS_MDNS_ENUMERATION, len ) == 0 )
+    {
+      mine = ( type == HKS_MDNS_TYPE_PTR || type == HKS_MDNS_TYPE_ANY );
+      enumerate |= mine;
+    }
+
+    if ( mine && !( qclass & HKS_MDNS_CLASS_FLUSH ) )
+      unicast = 0;
+  }
+  size_t questions_end = pos;
+
+  if ( !answer && !enumerate )
+    return ESP_OK;
+
+  // known-answer suppression for the shared PTR record
+  for ( uint16_t i = 0; i < ancount && answer && ptr_only; i++ )
+  {
+    int len = _hks_mdns_read_name( pkt, n, &pos, name );
+    if ( len < 0 || pos + 10 > (size_t)n )
+      break;
+
+    uint16_t type = _get16( pkt + pos );
+    uint32_t ttl = _get32( pkt + pos + 4 );
+    size_t rdata = pos + 10;
+    pos = rdata + _get16( pkt + pos + 8 );
+    if ( pos > (size_t)n )
+      break;
+
+    if ( type != HKS_MDNS_TYPE_PTR || ttl < HKS_MDNS_TTL_OTHER / 2 )
+      continue;
+    if ( len != sizeof( _HKS_MDNS_SERVICE ) || memcmp( name, _HKS_MDNS_SERVICE, len ) != 0 )
+      continue;
+
+    len = _hks_mdns_read_name( pkt, n, &rdata, name );
+    if ( len == mdns->instance_name_len && memcmp( name, mdns->instance_name, len ) == 0 )
+      answer = 0;
+  }
+
+  hks_mdns_refresh( mdns );
+
+  // legacy resolvers (not sending from 5353) and QU questions get a direct
+  // answer, everything else a multicast one rate limited per record set
+  int legacy = ntohs( from.sin_port ) != HKS_MDNS_PORT;
+  if ( legacy )
+  {
+    size_t len;
+    if ( answer && ( len = _hks_mdns_legacy( pkt, sizeof( pkt ), questions_end, mdns->response, mdns->response_len,
+           mdns->ttl_offsets, mdns->ttl_count, mdns->pointer_offsets, mdns->pointer_count ) ) > 0 )
+      _hks_mdns_send( mdns, pkt, len, &from );
+    if ( enumerate && ( len = _hks_mdns_legacy( pkt, sizeof( pkt ), questions_end, mdns->enumeration, mdns->enumeration_len,
+           &_HKS_MDNS_ENUMERATION_TTL, 1, NULL, 0 ) ) > 0 )
+      _hks_mdns_send( mdns, pkt, len, &from );
+    return ESP_OK;
+  }
+
+  if ( unicast )
+  {
+    if ( answer )
+      _hks_mdns_send( mdns, mdns->response, mdns->response_len, &from );
+    if ( enumerate )
+      _hks_mdns_send( mdns, mdns->enumeration, mdns->enumeration_len, &from );
+    return ESP_OK;
+  }
+
+  if ( answer && ( mdns->last_answer == 0 || (int32_t)( now - mdns->last_answer ) >= HKS_MDNS_RATE_LIMIT_MS ) )
+  {
+    _hks_mdns_send( mdns, mdns->response, mdns->response_len, NULL );
+    mdns->last_answer = now;
+  }
+  if ( enumerate && ( mdns->last_enumeration == 0 || (int32_t)( now - mdns->last_enumeration ) >= HKS_MDNS_RATE_LIMIT_MS ) )
+  {
+    _hks_mdns_send( mdns, mdns->enumeration, mdns->enumeration_len, NULL );
+    mdns->last_enumeration = now;
+  }
+
+  return ESP_OK;
+}
+
+// The answer for a resolver that is not a full mDNS responder, a plain DNS
+// response: the query's id and questions in front, the names compressed
+// against the answers moved past them, no cache-flush bits and TTLs of at
+// most 10 s. Built over the query in `pkt`, which keeps its id, question
+// count and questions for another answer; 0 if it does not fit `size`.
+size_t _hks_mdns_legacy( uint8_t *pkt, size_t size, size_t questions_end,
+  const uint8_t *answer, size_t len, const uint16_t *ttls, uint8_t ttl_count, const uint16_t *pointers, uint8_t pointer_count )
+{
+  size_t shift = questions_end - 12;
+  if ( shift + len > size )
+    return 0;
+
+  // the questions keep their offsets, names in them compress as they did
+  memcpy( pkt + 2, answer + 2, 2 );
+  memcpy( pkt + 6, answer + 6, 6 );
+  memcpy( pkt + questions_end, answer + 12, len - 12 );
+
+  for ( uint8_t i = 0; i < ttl_count; i++ )
+  {
+    uint8_t *ttl = pkt + ttls[i] + shift;
+    ttl[-2] &= ~( HKS_MDNS_CLASS_FLUSH >> 8 );
+    if ( _get32( ttl ) > HKS_MDNS_TTL_LEGACY )
+      _put32( ttl, HKS_MDNS_TTL_LEGACY );
+  }
+
+  for ( uint8_t i = 0; i < pointer_count; i++ )
+  {
+    uint8_t *pointer = pkt + pointers[i] + shift;
+    _put16( pointer, 0xC000 | ( ( _get16( pointer ) & 0x3FFF ) + shift ) );
+  }
+
+  return shift + len;
+}
+
+esp_err_t _hks_mdns_build( hks_mdns_t *mdns )
+{
+  if ( mdns->instance[0] == 0 || mdns->hostname[0] == 0 || mdns->fd < 0 )
+    return ESP_OK; // not enough to advertise yet
+
+  uint16_t txt_len;
+  const uint8_t *txt = hks_txt_get_rdata( mdns->txt, &txt_len );
+  size_t instance_len = strlen( mdns->instance );
+  size_t host_len = strlen( mdns->hostname );
+
+  uint8_t *base = mdns->response;
+  uint8_t *p = base;
+  uint16_t ancount = 0;
+  mdns->ttl_count = 0;
+  mdns->pointer_count = 0;
+
+  // header: response, authoritative
+  memset( p, 0, 12 );
+  p[2] = 0x84;
+  p += 12;
+
+  // PTR _hap._tcp.local -> <instance>._hap._tcp.local
+  uint16_t service = p - base;
+  uint16_t local = service + 10;
+  memcpy( p, _HKS_MDNS_SERVICE, sizeof( _HKS_MDNS_SERVICE ) );
+  p += sizeof( _HKS_MDNS_SERVICE );
+  p = _put16( p, HKS_MDNS_TYPE_PTR );
+  p = _put16( p, HKS_MDNS_CLASS_IN );
+  mdns->ttl_offsets[mdns->ttl_count++] = p - base;
+  p = _put32( p, HKS_MDNS_TTL_OTHER );
+  p = _put16( p, 1 + instance_len + 2 );
+  uint16_t instance = p - base;
+  *p++ = instance_len;
+  memcpy( p, mdns->instance, instance_len );
+  p += instance_len;
+  p = _hks_mdns_pointer( mdns, p, service );
+  ancount++;
+
+  // SRV <instance>._hap._tcp.local -> <hostname>.local:port
+  p = _hks_mdns_pointer( mdns, p, instance );
+  p = _put16( p, HKS_MDNS_TYPE_SRV );
+  p = _put16( p, HKS_MDNS_CLASS_FLUSH | HKS_MDNS_CLASS_IN );
+  mdns->ttl_offsets[mdns->ttl_count++] = p - base;
+  p = _put32( p, HKS_MDNS_TTL_HOST );
+  p = _put16( p, 6 + 1 + host_len + 2 );
+  p = _put16( p, 0 ); // priority
+  p = _put16( p, 0 ); // weight
+  p = _put16( p, mdns->port );
+  uint16_t host = p - base;
+  *p++ = host_len;
+  memcpy( p, mdns->hostname, host_len );
+  p += host_len;
+  p = _hks_mdns_pointer( mdns, p, local );
+  ancount++;
+
+  // TXT <instance>._hap._tcp.local, the RDATA is kept encoded by hks_txt
+  p = _hks_mdns_pointer( mdns, p, instance );
+  p = _put16( p, HKS_MDNS_TYPE_TXT );
+  p = _put16( p, HKS_MDNS_CLASS_FLUSH | HKS_MDNS_CLASS_IN );
+  mdns->ttl_offsets[mdns->ttl_count++] = p - base;
+  p = _put32( p, HKS_MDNS_TTL_OTHER );
+  p = _put16( p, txt_len );
+  memcpy( p, txt, txt_len );
+  p += txt_len;
+  ancount++;
+
+  // A and AAAA <hostname>.local, once for an address interfaces share
+  hks_mdns_addresses_t *addresses = &mdns->addresses;
+  for ( int i = 0; i < HKS_MDNS_INTERFACES; i++ )
+  {
+    if ( !_hks_mdns_distinct( addresses->ipv4, sizeof( uint32_t ), i ) )
+      continue;
+    p = _hks_mdns_address( mdns, p, host, HKS_MDNS_TYPE_A, &addresses->ipv4[i], 4 );
+    ancount++;
+  }
+#if CONFIG_HKS_IPV6
+  for ( int i = 0; i < HKS_MDNS_INTERFACES; i++ )
+  {
+    if ( !_hks_mdns_distinct( addresses->ipv6, 16, i ) )
+      continue;
+    p = _hks_mdns_address( mdns, p, host, HKS_MDNS_TYPE_AAAA, addresses->ipv6[i], 16 );
+    ancount++;
+  }
+#endif
+
+  _put16( base + 6, ancount );
+  mdns->response_len = p - base;
+  mdns->txt_version = mdns->txt->version;
+
+  mdns->instance_name_len = _hks_mdns_flat_name(
+    mdns->instance_name,
+    mdns->instance,
+    _HKS_MDNS_SERVICE,
+    sizeof( _HKS_MDNS_SERVICE )
+  );
+  mdns->host_name_len = _hks_mdns_flat_name(
+    mdns->host_name,
+    mdns->hostname,
+    _HKS_MDNS_LOCAL,
+    sizeof( _HKS_MDNS_LOCAL )
+  );
+
+  // announce the new content
+  mdns->announcements = HKS_MDNS_ANNOUNCE_COUNT;
+  mdns->announce_interval = 1000;
+  mdns->last_answer = 0;
+
+  ESP_LOGD( TAG, "Rebuilt answers (%u bytes)", mdns->response_len );
+
+  return ESP_OK;
+}
+
+void _hks_mdns_build_enumeration( hks_mdns_t *mdns )
+{
+  uint8_t *base = mdns->enumeration;
+  uint8_t *p = base;
+
+  memset( p, 0, 12 );
+  p[2] = 0x84;
+  p[7] = 1;
+  p += 12;
+
+  memcpy( p, _HKS_MDNS_ENUMERATION, sizeof( _HKS_MDNS_ENUMERATION ) );
+  p += sizeof( _HKS_MDNS_ENUMERATION );
+  p = _put16( p, HKS_MDNS_TYPE_PTR );
+  p = _put16( p, HKS_MDNS_CLASS_IN );
+  p = _put32( p, HKS_MDNS_TTL_OTHER );
+  p = _put16( p, sizeof( _HKS_MDNS_SERVICE ) );
+  memcpy( p, _HKS_MDNS_SERVICE, sizeof( _HKS_MDNS_SERVICE ) );
+  p += sizeof( _HKS_MDNS_SERVICE );
+
+  mdns->enumeration_len = p - base;
+}
+
+void _hks_mdns_addresses( hks_mdns_t *mdns, hks_mdns_addresses_t *addresses )
+{
+  memset( addresses, 0, sizeof( hks_mdns_addresses_t ) );
+  for ( int i = 0; i < HKS_MDNS_INTERFACES; i++ )
+  {
+    if ( !( mdns->interfaces & ( 1 << i ) ) )
+      continue;
+
+    tcpip_adapter_ip_info_t info;
+    if ( tcpip_adapter_get_ip_info( i, &info ) == ESP_OK )
+      addresses->ipv4[i] = info.ip.addr;
+
+#if CONFIG_HKS_IPV6
+    ip6_addr_t ip6;
+    if ( tcpip_adapter_get_ip6_linklocal( i, &ip6 ) == ESP_OK )
+      memcpy( addresses->ipv6[i], ip6.addr, 16 );
+#endif
+  }
+}
+
+// whether entry `i` of `table` is an address no entry before it has
+int _hks_mdns_distinct( const void *table, size_t size, int i )
+{
+  static const uint8_t none[16];
+  const uint8_t *entry = (const uint8_t *)table + i * size;
+  if ( memcmp( entry, none, size ) == 0 )
+    return 0;
+
+  for ( int j = 0; j < i; j++ )
+    if ( memcmp( entry, (const uint8_t *)table + j * size, size ) == 0 )
+      return 0;
+
+  return 1;
+}
+
+int _hks_mdns_join( int fd, uint32_t ipv4 )
+{
+  struct ip_mreq mreq;
+  mreq.imr_multiaddr.s_addr = inet_addr( "224.0.0.251" );
+  mreq.imr_interface.s_addr = ipv4;
+  return lwip_setsockopt( fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof( mreq ) );
+}
+
+uint8_t *_hks_mdns_address( hks_mdns_t *mdns, uint8_t *p, uint16_t host, uint16_t type, const void *addr, size_t len )
+{
+  p = _hks_mdns_pointer( mdns, p, host );
+  p = _put16( p, type );
+  p = _put16( p, HKS_MDNS_CLASS_FLUSH | HKS_MDNS_CLASS_IN );
+  mdns->ttl_offsets[mdns->ttl_count++] = p - mdns->response;
+  p = _put32( p, HKS_MDNS_TTL_HOST );
+  p = _put16( p, len );
+  memcpy( p, addr, len );
+  return p + len;
+}
+
+// a compressed name, remembered so a legacy answer can move it
+uint8_t *_hks_mdns_pointer( hks_mdns_t *mdns, uint8_t *p, uint16_t target )
+{
+  mdns->pointer_offsets[mdns->pointer_count++] = p - mdns->response;
+  return _put16( p, 0xC000 | target );
+}
+
+size_t _hks_mdns_flat_name( uint8_t *dst, const char *label, const uint8_t *suffix, size_t suffix_len )
+{
+  size_t len = strlen( label );
+  dst[0] = len;
+  for ( size_t i = 0; i < len; i++ )
+  {
+    uint8_t c = label[i];
+    dst[1 + i] = ( c >= 'A' && c <= 'Z' ) ? c + ( 'a' - 'A' ) : c;
+  }
+  memcpy( dst + 1 + len, suffix, suffix_len );
+  return 1 + len + suffix_len;
+}
+
+// Decode a possibly compressed name into lower-cased, uncompressed wire
+// format. Returns its length or -1 if malformed; `pos` moves past the name.
+int _hks_mdns_read_name( const uint8_t *pkt, size_t len, size_t *pos, uint8_t *out )
+{
+  size_t p = *pos;
+  size_t n = 0;
+  int jumps = 0;
+
+  for (;;)
+  {
+    if ( p >= len )
+      return -1;
+
+    uint8_t l = pkt[p];
+    if ( ( l & 0xC0 ) == 0xC0 )
+    {
+      if ( p + 1 >= len || ++jumps > 8 )
+        return -1;
+      if ( jumps == 1 )
+        *pos = p + 2;
+      p = ( ( l & 0x3F ) << 8 ) | pkt[p + 1];
+      continue;
+    }
+
+    if ( l & 0xC0 || n + l + 1 > HKS_MDNS_NAME_LENGTH || p + 1 + l > len )
+      return -1;
+
+    out[n++] = l;
+    if ( l == 0 )
+    {
+      if ( jumps == 0 )
+        *pos = p + 1;
+      return n;
+    }
+
+    for ( size_t i = 0; i < l; i++ )
+    {
+      uint8_t c = pkt[p + 1 + i];
+      out[n++] = ( c >= 'A' && c <= 'Z' ) ? c + ( 'a' - 'A' ) : c;
+    }
+    p += l + 1;
+  }
+}
+
+esp_err_t _hks_mdns_send( hks_mdns_t *mdns, const uint8_t *data, size_t len, const struct sockaddr_in *to )
+{
+  if ( to != NULL )
+    return _hks_mdns_sendto( mdns->fd, data, len, to );
+
+  struct sockaddr_in group;
+  bzero( &group, sizeof( group ) );
+  group.sin_family = AF_INET;
+  group.sin_port = htons( HKS_MDNS_PORT );
+  group.sin_addr.s_addr = inet_addr( "224.0.0.251" );
+
+  // out of every interface with an address, the default one if none has
+  esp_err_t err = ESP_OK;
+  int sent = 0;
+  for ( int i = 0; i < HKS_MDNS_INTERFACES; i++ )
+  {
+    if ( !_hks_mdns_distinct( mdns->addresses.ipv4, sizeof( uint32_t ), i ) )
+      continue;
+
+    struct in_addr itf = { .s_addr = mdns->addresses.ipv4[i] };
+    lwip_setsockopt( mdns->fd, IPPROTO_IP, IP_MULTICAST_IF, &itf, sizeof( itf ) );
+    if ( _hks_mdns_sendto( mdns->fd, data, len, &group ) )
+      err = ESP_FAIL;
+    sent = 1;
+  }
+
+  if ( !sent )
+    err = _hks_mdns_sendto( mdns->fd, data, len, &group );
+
+  return err;
+}
+
+esp_err_t _hks_mdns_sendto( int fd, const uint8_t *data, size_t len, const struct sockaddr_in *to )
+{
+  if ( lwip_sendto( fd, data, len, 0, (const struct sockaddr *)to, sizeof( *to ) ) < 0 )
+    return ESP_FAIL;
+
+  return ESP_OK;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+#include <tcpip_adapter.h>
+#include "hks_txt.h"
+
+#define HKS_MDNS_PORT             5353
+#define HKS_MDNS_LABEL_LENGTH     63
+#define HKS_MDNS_NAME_LENGTH      128   // uncompressed wire format
+#define HKS_MDNS_PACKET_LENGTH    640   // the answers with a full TXT record and every address
+#define HKS_MDNS_ANNOUNCE_COUNT   3
+#define HKS_MDNS_INTERFACES       TCPIP_ADAPTER_IF_MAX
+
+// what each interface can be reached at, zero where it has no address
+struct hks_mdns_addresses_s {
+  uint32_t ipv4[HKS_MDNS_INTERFACES]; // network order
+#if CONFIG_HKS_IPV6
+  uint8_t ipv6[HKS_MDNS_INTERFACES][16]; // link-local
+#endif
+};
+typedef struct hks_mdns_addresses_s hks_mdns_addresses_t;
+
+// mDNS/DNS-SD responder for the single _hap._tcp service on one or more
+// interfaces. The answer packet (PTR, SRV, TXT, then an A and an AAAA record
+// for every distinct address of those interfaces) is serialized once and
+// only rebuilt when the name, TXT record or an address changes; queries are
+// answered by sending it as is, or a copy with the question in front for a
+// legacy resolver. Queries and answers go over IPv4 multicast, which carries
+// the AAAA records just as well.
+struct hks_mdns_s {
+  int fd;
+  uint8_t interfaces; // bitmap of tcpip_adapter_if_t
+  uint16_t port; // HAP port advertised in the SRV record
+  const hks_txt_t *txt;
+  uint32_t txt_version;
+  hks_mdns_addresses_t addresses;
+
+  char instance[HKS_MDNS_LABEL_LENGTH + 1];
+  char hostname[HKS_MDNS_LABEL_LENGTH + 1];
+
+  // names in uncompressed, lower-cased wire format for matching queries
+  uint8_t instance_name[HKS_MDNS_NAME_LENGTH];
+  uint8_t instance_name_len;
+  uint8_t host_name[HKS_MDNS_NAME_LENGTH];
+  uint8_t host_name_len;
+
+  uint8_t response[HKS_MDNS_PACKET_LENGTH];
+  uint16_t response_len;
+  uint16_t ttl_offsets[3 + 2 * HKS_MDNS_INTERFACES];
+  uint8_t ttl_count;
+  uint16_t pointer_offsets[4 + 2 * HKS_MDNS_INTERFACES]; // compressed names
+  uint8_t pointer_count;
+
+  uint8_t enumeration[96]; // _services._dns-sd._udp.local PTR _hap._tcp.local
+  uint16_t enumeration_len;
+
+  // ms, rate limit multicast answers per record set
+  uint32_t last_answer;
+  uint32_t last_enumeration;
+  uint8_t announcements;   // still to be sent
+  uint32_t announce_interval;
+};
+typedef struct hks_mdns_s hks_mdns_t;
+
+extern void hks_mdns_init( hks_mdns_t *mdns, tcpip_adapter_if_t tcpip_if, const hks_txt_t *txt );
+
+// advertise on `tcpip_if` as well
+extern esp_err_t hks_mdns_add_interface( hks_mdns_t *mdns, tcpip_adapter_if_t tcpip_if );
+
+extern esp_err_t hks_mdns_start( hks_mdns_t *mdns, uint16_t port );
+extern void hks_mdns_stop( hks_mdns_t *mdns ); // sends goodbyes
+
+extern esp_err_t hks_mdns_set_instance( hks_mdns_t *mdns, const char *instance );
+extern esp_err_t hks_mdns_set_hostname( hks_mdns_t *mdns, const char *hostname );
+
+// rebuild the answer packet if the TXT record or an address changed
+extern esp_err_t hks_mdns_refresh( hks_mdns_t *mdns );
+
+// send the next announcement, returns ms until the one after or -1 when done
+extern int32_t hks_mdns_announce( hks_mdns_t *mdns, uint32_t now );
+
+// read and answer one pending query
+extern esp_err_t hks_mdns_process( hks_mdns_t *mdns, uint32_t now );
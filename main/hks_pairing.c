@@ -0,0 +1,627 @@
+#include "hks_pairing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_system.h>
+#include "hks_resume.h"
+
+#define HKS_PAIR_SETUP_USERNAME "Pair-Setup"
+
+static esp_err_t _hks_pair_begin( hks_pairings_t *p, hks_pair_t *pair, uint8_t *body, size_t len, hks_tlv_items_t *items );
+static void _hks_pair_fail( hks_pairings_t *p, hks_pair_t *pair, hks_tlv_error_t error );
+static int _hks_pair_open( const uint8_t key[HKS_CHACHA20_KEY_LENGTH], const char *label, uint8_t *data, size_t *len, hks_tlv_items_t *items );
+static void _hks_pair_seal( hks_pair_t *pair, const char *label, hks_tlv_writer_t *w );
+static void _hks_pair_nonce( uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH], const char *label );
+static int _hks_pair_controller( hks_pair_t *pair, const hks_tlv_items_t *items, int with_key );
+static void _hks_pair_setup_compute( hks_pair_t *pair );
+static void _hks_pair_setup_finish( hks_pairings_t *p, hks_pair_t *pair, hks_tlv_writer_t *w );
+static void _hks_pair_verify_compute( hks_pair_t *pair );
+static void _hks_pair_verify_finish( hks_pairings_t *p, hks_pair_t *pair, hks_tlv_writer_t *w );
+static void _hks_pair_verify_keys( hks_pair_t *pair );
+static int _hks_pair_resume( hks_pairings_t *p, hks_resume_t *resume, hks_pair_t *pair, const hks_tlv_items_t *items );
+static void _hks_pair_resume_key( const uint8_t *shared, const hks_pair_t *pair, const uint8_t *id, const char *info, uint8_t *out );
+
+esp_err_t hks_pairings_init( hks_pairings_t *p, const uint8_t device_id[6] )
+{
+  memset( p, 0, sizeof( hks_pairings_t ) );
+
+  // the same form as the TXT record's id
+  snprintf( p->accessory_id, sizeof( p->accessory_id ), "%02x:%02x:%02x:%02x:%02x:%02x",
+    device_id[0], device_id[1], device_id[2], device_id[3], device_id[4], device_id[5] );
+
+  esp_fill_random( p->seed, sizeof( p->seed ) );
+  hks_ed25519_public( p->public_key, p->seed );
+
+  return ESP_OK;
+}
+
+void hks_pairings_load( hks_pairings_t *p, const uint8_t seed[HKS_ED25519_SEED_LENGTH], const hks_pairing_t *pairings, uint8_t count )
+{
+  memcpy( p->seed, seed, HKS_ED25519_SEED_LENGTH );
+  hks_ed25519_public( p->public_key, p->seed );
+
+  p->count = 0;
+  for ( uint8_t i = 0; i < count && i < HKS_PAIRING_MAX; i++ )
+    hks_pairings_add( p, pairings[i].id, pairings[i].id_len, pairings[i].public_key, pairings[i].permissions );
+}
+
+esp_err_t hks_pairings_set_setup_code( hks_pairings_t *p, const char *code )
+{
+  if ( code == NULL || strlen( code ) != HKS_PAIRING_SETUP_CODE_LENGTH )
+    return ESP_ERR_INVALID_ARG;
+
+  char digits[8];
+  size_t n = 0;
+  for ( size_t i = 0; i < HKS_PAIRING_SETUP_CODE_LENGTH; i++ )
+  {
+    if ( i == 3 || i == 6 )
+    {
+      if ( code[i] != '-' )
+        return ESP_ERR_INVALID_ARG;
+    }
+    else if ( code[i] < '0' || code[i] > '9' )
+      return ESP_ERR_INVALID_ARG;
+    else
+      digits[n++] = code[i];
+  }
+
+  // codes the specification forbids for being too easy to guess
+  int same = 1;
+  for ( size_t i = 1; i < sizeof( digits ); i++ )
+    same &= digits[i] == digits[0];
+  if ( same || memcmp( digits, "12345678", 8 ) == 0 || memcmp( digits, "87654321", 8 ) == 0 )
+    return ESP_ERR_INVALID_ARG;
+
+  memcpy( p->setup_code, code, HKS_PAIRING_SETUP_CODE_LENGTH + 1 );
+  return ESP_OK;
+}
+
+uint8_t hks_pairings_find( const hks_pairings_t *p, const uint8_t *id, size_t id_len )
+{
+  // a handful of entries, a scan beats hashing the id
+  for ( uint8_t i = 0; i < p->count; i++ )
+    if ( p->pairings[i].id_len == id_len && memcmp( p->pairings[i].id, id, id_len ) == 0 )
+      return i;
+
+  return HKS_PAIRING_NONE;
+}
+
+esp_err_t hks_pairings_add( hks_pairings_t *p, const uint8_t *id, size_t id_len, const uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH], uint8_t permissions )
+{
+  if ( id_len == 0 || id_len > HKS_PAIRING_ID_LENGTH )
+    return ESP_ERR_INVALID_ARG;
+
+  // pairing again replaces the key
+  uint8_t i = hks_pairings_find( p, id, id_len );
+  if ( i == HKS_PAIRING_NONE )
+  {
+    if ( p->count == HKS_PAIRING_MAX )
+      return ESP_ERR_NO_MEM;
+    i = p->count++;
+  }
+
+  hks_pairing_t *pairing = &p->pairings[i];
+  memcpy( pairing->id, id, id_len );
+  pairing->id_len = id_len;
+  memcpy( pairing->public_key, public_key, HKS_ED25519_PUBLIC_LENGTH );
+  pairing->permissions = permissions;
+
+  return ESP_OK;
+}
+
+hks_pair_t *hks_pair_new( hks_heap_t *heap, hks_pair_method_t method )
+{
+  hks_pair_t *pair = (hks_pair_t *)hks_heap_alloc( heap, sizeof( hks_pair_t ) );
+  if ( pair == NULL )
+    return NULL;
+
+  memset( pair, 0, sizeof( hks_pair_t ) );
+  pair->method = method;
+  pair->controller = HKS_PAIRING_NONE;
+  return pair;
+}
+
+void hks_pair_free( hks_pairings_t *p, hks_pair_t *pair )
+{
+  if ( pair == NULL )
+    return;
+
+  if ( p->setup == pair )
+    p->setup = NULL;
+
+  hks_pair_release( pair );
+}
+
+void hks_pair_release( void *arg )
+{
+  // the exchange holds session keys and the SRP secret
+  memset( arg, 0, sizeof( hks_pair_t ) );
+  hks_heap_free( arg );
+}
+
+esp_err_t hks_pair_setup( hks_pairings_t *p, hks_pair_t *pair, uint8_t *body, size_t len )
+{
+  hks_tlv_items_t items;
+  esp_err_t err = _hks_pair_begin( p, pair, body, len, &items );
+  if ( err != HKS_ERR_PAIR_COMPUTE )
+    return err;
+
+  switch ( pair->state )
+  {
+    case 1:
+      if ( p->count > 0 || p->setup_code[0] == '\0' )
+        _hks_pair_fail( p, pair, HKS_TLV_ERROR_UNAVAILABLE );
+      else if ( p->attempts >= HKS_PAIRING_MAX_ATTEMPTS )
+        _hks_pair_fail( p, pair, HKS_TLV_ERROR_MAX_TRIES );
+      else if ( p->setup != NULL && p->setup != pair )
+        _hks_pair_fail( p, pair, HKS_TLV_ERROR_BUSY );
+      else
+      {
+        p->setup = pair;
+        esp_fill_random( pair->setup.salt, sizeof( pair->setup.salt ) );
+        esp_fill_random( pair->setup.secret, sizeof( pair->setup.secret ) );
+        return HKS_ERR_PAIR_COMPUTE;
+      }
+      return ESP_OK;
+
+    case 3:
+    {
+      // copied, the body is gone by the time the proof has been checked
+      const hks_tlv_item_t *a = hks_tlv_get( &items, HKS_TLV_PUBLIC_KEY );
+      const hks_tlv_item_t *proof = hks_tlv_get( &items, HKS_TLV_PROOF );
+      if ( a == NULL || a->len > HKS_SRP_PUBLIC_LENGTH || proof == NULL || proof->len != HKS_SRP_PROOF_LENGTH )
+      {
+        _hks_pair_fail( p, pair, HKS_TLV_ERROR_AUTHENTICATION );
+        return ESP_OK;
+      }
+
+      memcpy( pair->setup.public_key, a->value, a->len );
+      pair->setup.public_key_len = a->len;
+      memcpy( pair->setup.proof, proof->value, HKS_SRP_PROOF_LENGTH );
+      return HKS_ERR_PAIR_COMPUTE;
+    }
+
+    case 5:
+    {
+      const hks_tlv_item_t *data = hks_tlv_get( &items, HKS_TLV_ENCRYPTED_DATA );
+      hks_tlv_items_t sub;
+      size_t sub_len = data ? data->len : 0;
+      if ( data == NULL || !_hks_pair_open( pair->key, "PS-Msg05", data->value, &sub_len, &sub ) || !_hks_pair_controller( pair, &sub, 1 ) )
+        _hks_pair_fail( p, pair, HKS_TLV_ERROR_AUTHENTICATION );
+      else if ( p->count == HKS_PAIRING_MAX && hks_pairings_find( p, pair->controller_id, pair->controller_id_len ) == HKS_PAIRING_NONE )
+        _hks_pair_fail( p, pair, HKS_TLV_ERROR_MAX_PEERS );
+      else
+        return HKS_ERR_PAIR_COMPUTE;
+      return ESP_OK;
+    }
+  }
+
+  _hks_pair_fail( p, pair, HKS_TLV_ERROR_UNKNOWN );
+  return ESP_OK;
+}
+
+esp_err_t hks_pair_verify( hks_pairings_t *p, hks_resume_t *resume, hks_pair_t *pair, uint8_t *body, size_t len )
+{
+  hks_tlv_items_t items;
+  esp_err_t err = _hks_pair_begin( p, pair, body, len, &items );
+  if ( err != HKS_ERR_PAIR_COMPUTE )
+    return err;
+
+  switch ( pair->state )
+  {
+    case 1:
+    {
+      const hks_tlv_item_t *key = hks_tlv_get( &items, HKS_TLV_PUBLIC_KEY );
+      if ( key == NULL || key->len != HKS_X25519_KEY_LENGTH )
+        break;
+
+      memcpy( pair->verify.controller_public_key, key->value, HKS_X25519_KEY_LENGTH );
+      pair->resumed = 0;
+
+      uint8_t method;
+      if ( hks_tlv_get_byte( &items, HKS_TLV_METHOD, &method ) && method == HKS_PAIRING_METHOD_RESUME
+        && _hks_pair_resume( p, resume, pair, &items ) )
+        return ESP_OK;
+
+      esp_fill_random( pair->verify.secret, sizeof( pair->verify.secret ) );
+      return HKS_ERR_PAIR_COMPUTE;
+    }
+
+    case 3:
+    {
+      // the controller's key is copied out, the pairing may go away while
+      // its signature is checked and is looked up again afterwards
+      const hks_tlv_item_t *data = hks_tlv_get( &items, HKS_TLV_ENCRYPTED_DATA );
+      hks_tlv_items_t sub;
+      size_t sub_len = data ? data->len : 0;
+      if ( data == NULL || !_hks_pair_open( pair->key, "PV-Msg03", data->value, &sub_len, &sub ) || !_hks_pair_controller( pair, &sub, 0 ) )
+      {
+        _hks_pair_fail( p, pair, HKS_TLV_ERROR_AUTHENTICATION );
+        return ESP_OK;
+      }
+
+      pair->controller = hks_pairings_find( p, pair->controller_id, pair->controller_id_len );
+      if ( pair->controller == HKS_PAIRING_NONE )
+      {
+        _hks_pair_fail( p, pair, HKS_TLV_ERROR_AUTHENTICATION );
+        return ESP_OK;
+      }
+
+      memcpy( pair->controller_key, p->pairings[pair->controller].public_key, HKS_ED25519_PUBLIC_LENGTH );
+      return HKS_ERR_PAIR_COMPUTE;
+    }
+  }
+
+  _hks_pair_fail( p, pair, HKS_TLV_ERROR_UNKNOWN );
+  return ESP_OK;
+}
+
+void hks_pair_compute( hks_pair_t *pair )
+{
+  if ( pair->method == HKS_PAIR_SETUP )
+    _hks_pair_setup_compute( pair );
+  else
+    _hks_pair_verify_compute( pair );
+}
+
+void hks_pair_finish( hks_pairings_t *p, hks_pair_t *pair )
+{
+  hks_tlv_writer_t w;
+  hks_tlv_writer_init( &w, pair->response, sizeof( pair->response ) );
+  hks_tlv_put_byte( &w, HKS_TLV_STATE, pair->state + 1 );
+
+  if ( !pair->error )
+  {
+    if ( pair->method == HKS_PAIR_SETUP )
+      _hks_pair_setup_finish( p, pair, &w );
+    else
+      _hks_pair_verify_finish( p, pair, &w );
+  }
+
+  // any error ends the exchange, the controller starts over
+  if ( pair->error )
+  {
+    // a wrong setup code counts against the attempts left
+    if ( pair->method == HKS_PAIR_SETUP && pair->state == 3 )
+      p->attempts++;
+
+    hks_tlv_put_byte( &w, HKS_TLV_ERROR, pair->error );
+    pair->done = 1;
+  }
+
+  if ( pair->done && p->setup == pair )
+    p->setup = NULL;
+
+  pair->response_len = w.len;
+}
+
+esp_err_t _hks_pair_begin( hks_pairings_t *p, hks_pair_t *pair, uint8_t *body, size_t len, hks_tlv_items_t *items )
+{
+  uint8_t state;
+  if ( hks_tlv_decode( body, len, items ) || !hks_tlv_get_byte( items, HKS_TLV_STATE, &state ) )
+    return ESP_ERR_INVALID_ARG;
+
+  pair->accessory = p;
+  pair->error = 0;
+
+  // the controller may start over at any point, otherwise each message
+  // follows the one answered last
+  if ( state != 1 && ( pair->state == 0 || state != pair->state + 2 ) )
+  {
+    pair->state = state;
+    _hks_pair_fail( p, pair, HKS_TLV_ERROR_UNKNOWN );
+    return ESP_OK;
+  }
+
+  pair->state = state;
+  return HKS_ERR_PAIR_COMPUTE;
+}
+
+void _hks_pair_fail( hks_pairings_t *p, hks_pair_t *pair, hks_tlv_error_t error )
+{
+  pair->error = error;
+  hks_pair_finish( p, pair );
+}
+
+int _hks_pair_open( const uint8_t key[HKS_CHACHA20_KEY_LENGTH], const char *label, uint8_t *data, size_t *len, hks_tlv_items_t *items )
+{
+  if ( *len < HKS_POLY1305_TAG_LENGTH )
+    return 0;
+  *len -= HKS_POLY1305_TAG_LENGTH;
+
+  uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH];
+  _hks_pair_nonce( nonce, label );
+
+  hks_aead_t aead;
+  uint8_t tag[HKS_POLY1305_TAG_LENGTH];
+  hks_aead_init( &aead, key, nonce, NULL, 0 );
+  hks_aead_decrypt( &aead, data, data, *len );
+  hks_aead_finish( &aead, tag );
+
+  if ( !hks_crypto_equal( tag, data + *len, HKS_POLY1305_TAG_LENGTH ) )
+    return 0;
+
+  return hks_tlv_decode( data, *len, items ) == ESP_OK;
+}
+
+void _hks_pair_seal( hks_pair_t *pair, const char *label, hks_tlv_writer_t *w )
+{
+  uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH];
+  _hks_pair_nonce( nonce, label );
+
+  hks_aead_t aead;
+  hks_aead_init( &aead, pair->key, nonce, NULL, 0 );
+  hks_aead_encrypt( &aead, pair->sealed, pair->sealed, w->len );
+  hks_aead_finish( &aead, pair->sealed + w->len );
+
+  pair->sealed_len = w->len + HKS_POLY1305_TAG_LENGTH;
+}
+
+void _hks_pair_nonce( uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH], const char *label )
+{
+  // 32 zero bits, then the eight characters of the message label
+  memset( nonce, 0, 4 );
+  memcpy( nonce + 4, label, 8 );
+}
+
+int _hks_pair_controller( hks_pair_t *pair, const hks_tlv_items_t *items, int with_key )
+{
+  const hks_tlv_item_t *id = hks_tlv_get( items, HKS_TLV_IDENTIFIER );
+  const hks_tlv_item_t *key = hks_tlv_get( items, HKS_TLV_PUBLIC_KEY );
+  const hks_tlv_item_t *signature = hks_tlv_get( items, HKS_TLV_SIGNATURE );
+
+  if ( id == NULL || id->len == 0 || id->len > HKS_PAIRING_ID_LENGTH )
+    return 0;
+  if ( signature == NULL || signature->len != HKS_ED25519_SIGNATURE_LENGTH )
+    return 0;
+  if ( with_key && ( key == NULL || key->len != HKS_ED25519_PUBLIC_LENGTH ) )
+    return 0;
+
+  memcpy( pair->controller_id, id->value, id->len );
+  pair->controller_id_len = id->len;
+  memcpy( pair->signature, signature->value, HKS_ED25519_SIGNATURE_LENGTH );
+  if ( with_key )
+    memcpy( pair->controller_key, key->value, HKS_ED25519_PUBLIC_LENGTH );
+
+  return 1;
+}
+
+void _hks_pair_setup_compute( hks_pair_t *pair )
+{
+  const hks_pairings_t *p = pair->accessory;
+  hks_srp_t *srp = &pair->setup.srp;
+
+  if ( pair->state == 1 )
+  {
+    hks_srp_start( srp, HKS_PAIR_SETUP_USERNAME, p->setup_code, pair->setup.salt, pair->setup.secret );
+    return;
+  }
+
+  if ( pair->state == 3 )
+  {
+    if ( hks_srp_verify( srp, pair->setup.public_key, pair->setup.public_key_len, pair->setup.proof ) )
+    {
+      pair->error = HKS_TLV_ERROR_AUTHENTICATION;
+      return;
+    }
+
+    hks_hkdf_sha512( srp->key, HKS_SRP_KEY_LENGTH, "Pair-Setup-Encrypt-Salt", "Pair-Setup-Encrypt-Info",
+      pair->key, sizeof( pair->key ) );
+    return;
+  }
+
+  // M5: the controller signed its id and key
+  uint8_t info[32 + HKS_PAIRING_ID_LENGTH + HKS_ED25519_PUBLIC_LENGTH];
+  size_t info_len = 0;
+  hks_hkdf_sha512( srp->key, HKS_SRP_KEY_LENGTH, "Pair-Setup-Controller-Sign-Salt", "Pair-Setup-Controller-Sign-Info", info, 32 );
+  info_len += 32;
+  memcpy( info + info_len, pair->controller_id, pair->controller_id_len );
+  info_len += pair->controller_id_len;
+  memcpy( info + info_len, pair->controller_key, HKS_ED25519_PUBLIC_LENGTH );
+  info_len += HKS_ED25519_PUBLIC_LENGTH;
+
+  if ( !hks_ed25519_verify( pair->signature, info, info_len, pair->controller_key ) )
+  {
+    pair->error = HKS_TLV_ERROR_AUTHENTICATION;
+    return;
+  }
+
+  // M6: and the accessory its own
+  info_len = 0;
+  hks_hkdf_sha512( srp->key, HKS_SRP_KEY_LENGTH, "Pair-Setup-Accessory-Sign-Salt", "Pair-Setup-Accessory-Sign-Info", info, 32 );
+  info_len += 32;
+  memcpy( info + info_len, p->accessory_id, HKS_PAIRING_ACCESSORY_ID_LENGTH );
+  info_len += HKS_PAIRING_ACCESSORY_ID_LENGTH;
+  memcpy( info + info_len, p->public_key, HKS_ED25519_PUBLIC_LENGTH );
+  info_len += HKS_ED25519_PUBLIC_LENGTH;
+
+  uint8_t signature[HKS_ED25519_SIGNATURE_LENGTH];
+  hks_ed25519_sign( signature, info, info_len, p->seed, p->public_key );
+
+  hks_tlv_writer_t w;
+  hks_tlv_writer_init( &w, pair->sealed, sizeof( pair->sealed ) - HKS_POLY1305_TAG_LENGTH );
+  hks_tlv_put( &w, HKS_TLV_IDENTIFIER, p->accessory_id, HKS_PAIRING_ACCESSORY_ID_LENGTH );
+  hks_tlv_put( &w, HKS_TLV_PUBLIC_KEY, p->public_key, HKS_ED25519_PUBLIC_LENGTH );
+  hks_tlv_put( &w, HKS_TLV_SIGNATURE, signature, sizeof( signature ) );
+  _hks_pair_seal( pair, "PS-Msg06", &w );
+}
+
+void _hks_pair_setup_finish( hks_pairings_t *p, hks_pair_t *pair, hks_tlv_writer_t *w )
+{
+  hks_srp_t *srp = &pair->setup.srp;
+
+  switch ( pair->state )
+  {
+    case 1:
+      hks_tlv_put( w, HKS_TLV_SALT, srp->salt, HKS_SRP_SALT_LENGTH );
+      hks_tlv_put( w, HKS_TLV_PUBLIC_KEY, srp->public_key, HKS_SRP_PUBLIC_LENGTH );
+      break;
+
+    case 3:
+      hks_tlv_put( w, HKS_TLV_PROOF, srp->proof, HKS_SRP_PROOF_LENGTH );
+      break;
+
+    case 5:
+      // the table may have filled up meanwhile
+      if ( hks_pairings_add( p, pair->controller_id, pair->controller_id_len, pair->controller_key, HKS_PAIRING_PERMISSION_ADMIN ) )
+      {
+        pair->error = HKS_TLV_ERROR_MAX_PEERS;
+        return;
+      }
+      pair->added = 1;
+      pair->done = 1;
+      hks_tlv_put( w, HKS_TLV_ENCRYPTED_DATA, pair->sealed, pair->sealed_len );
+      break;
+  }
+}
+
+void _hks_pair_verify_compute( hks_pair_t *pair )
+{
+  const hks_pairings_t *p = pair->accessory;
+  uint8_t info[2 * HKS_X25519_KEY_LENGTH + HKS_PAIRING_ID_LENGTH];
+  size_t info_len = 0;
+
+  if ( pair->state == 1 )
+  {
+    hks_x25519_public( pair->verify.public_key, pair->verify.secret );
+    hks_x25519( pair->verify.shared, pair->verify.secret, pair->verify.controller_public_key );
+
+    // a point of small order makes the secret known to anyone
+    uint8_t zero[HKS_X25519_KEY_LENGTH] = { 0 };
+    if ( hks_crypto_equal( pair->verify.shared, zero, sizeof( zero ) ) )
+    {
+      pair->error = HKS_TLV_ERROR_AUTHENTICATION;
+      return;
+    }
+
+    hks_hkdf_sha512( pair->verify.shared, HKS_X25519_KEY_LENGTH, "Pair-Verify-Encrypt-Salt", "Pair-Verify-Encrypt-Info",
+      pair->key, sizeof( pair->key ) );
+
+    memcpy( info + info_len, pair->verify.public_key, HKS_X25519_KEY_LENGTH );
+    info_len += HKS_X25519_KEY_LENGTH;
+    memcpy( info + info_len, p->accessory_id, HKS_PAIRING_ACCESSORY_ID_LENGTH );
+    info_len += HKS_PAIRING_ACCESSORY_ID_LENGTH;
+    memcpy( info + info_len, pair->verify.controller_public_key, HKS_X25519_KEY_LENGTH );
+    info_len += HKS_X25519_KEY_LENGTH;
+
+    uint8_t signature[HKS_ED25519_SIGNATURE_LENGTH];
+    hks_ed25519_sign( signature, info, info_len, p->seed, p->public_key );
+
+    hks_tlv_writer_t w;
+    hks_tlv_writer_init( &w, pair->sealed, sizeof( pair->sealed ) - HKS_POLY1305_TAG_LENGTH );
+    hks_tlv_put( &w, HKS_TLV_IDENTIFIER, p->accessory_id, HKS_PAIRING_ACCESSORY_ID_LENGTH );
+    hks_tlv_put( &w, HKS_TLV_SIGNATURE, signature, sizeof( signature ) );
+    _hks_pair_seal( pair, "PV-Msg02", &w );
+    return;
+  }
+
+  // M3: the controller signed both keys with its long-term key
+  memcpy( info + info_len, pair->verify.controller_public_key, HKS_X25519_KEY_LENGTH );
+  info_len += HKS_X25519_KEY_LENGTH;
+  memcpy( info + info_len, pair->controller_id, pair->controller_id_len );
+  info_len += pair->controller_id_len;
+  memcpy( info + info_len, pair->verify.public_key, HKS_X25519_KEY_LENGTH );
+  info_len += HKS_X25519_KEY_LENGTH;
+
+  if ( !hks_ed25519_verify( pair->signature, info, info_len, pair->controller_key ) )
+  {
+    pair->error = HKS_TLV_ERROR_AUTHENTICATION;
+    return;
+  }
+
+  hks_hkdf_sha512( pair->verify.shared, HKS_X25519_KEY_LENGTH, "Pair-Verify-ResumeSessionID-Salt", "Pair-Verify-ResumeSessionID-Info",
+    pair->verify.session_id, HKS_PAIRING_SESSION_ID_LENGTH );
+  _hks_pair_verify_keys( pair );
+}
+
+void _hks_pair_verify_finish( hks_pairings_t *p, hks_pair_t *pair, hks_tlv_writer_t *w )
+{
+  if ( pair->resumed )
+  {
+    hks_tlv_put( w, HKS_TLV_SESSION_ID, pair->verify.session_id, HKS_PAIRING_SESSION_ID_LENGTH );
+    hks_tlv_put( w, HKS_TLV_ENCRYPTED_DATA, pair->sealed, pair->sealed_len );
+    pair->verified = 1;
+    pair->done = 1;
+    return;
+  }
+
+  if ( pair->state == 1 )
+  {
+    hks_tlv_put( w, HKS_TLV_PUBLIC_KEY, pair->verify.public_key, HKS_X25519_KEY_LENGTH );
+    hks_tlv_put( w, HKS_TLV_ENCRYPTED_DATA, pair->sealed, pair->sealed_len );
+    return;
+  }
+
+  // removed while its signature was being checked
+  if ( hks_pairings_find( p, pair->controller_id, pair->controller_id_len ) != pair->controller )
+  {
+    pair->error = HKS_TLV_ERROR_AUTHENTICATION;
+    return;
+  }
+
+  pair->verified = 1;
+  pair->done = 1;
+}
+
+void _hks_pair_verify_keys( hks_pair_t *pair )
+{
+  // named from the controller's side: it reads what the accessory writes
+  hks_hkdf_sha512( pair->verify.shared, HKS_X25519_KEY_LENGTH, "Control-Salt", "Control-Read-Encryption-Key",
+    pair->verify.write_key, sizeof( pair->verify.write_key ) );
+  hks_hkdf_sha512( pair->verify.shared, HKS_X25519_KEY_LENGTH, "Control-Salt", "Control-Write-Encryption-Key",
+    pair->verify.read_key, sizeof( pair->verify.read_key ) );
+}
+
+int _hks_pair_resume( hks_pairings_t *p, hks_resume_t *resume, hks_pair_t *pair, const hks_tlv_items_t *items )
+{
+  const hks_tlv_item_t *id = hks_tlv_get( items, HKS_TLV_SESSION_ID );
+  const hks_tlv_item_t *data = hks_tlv_get( items, HKS_TLV_ENCRYPTED_DATA );
+  if ( resume == NULL || id == NULL || id->len != HKS_PAIRING_SESSION_ID_LENGTH || data == NULL )
+    return 0;
+
+  hks_resume_entry_t *entry = hks_resume_find( resume, id->value );
+  if ( entry == NULL )
+    return 0;
+
+  // unpaired since
+  pair->controller = hks_pairings_find( p, entry->controller_id, entry->controller_id_len );
+  if ( pair->controller == HKS_PAIRING_NONE )
+  {
+    hks_resume_drop( resume, entry );
+    return 0;
+  }
+
+  // the controller shows it holds the secret by sealing an empty message; a
+  // wrong tag leaves the session for its rightful owner
+  hks_tlv_items_t sub;
+  size_t sub_len = data->len;
+  _hks_pair_resume_key( entry->shared, pair, id->value, "Pair-Resume-Request-Info", pair->key );
+  if ( !_hks_pair_open( pair->key, "PR-Msg01", data->value, &sub_len, &sub ) )
+    return 0;
+
+  // it goes on under a new id, keyed from a new secret
+  memcpy( pair->controller_id, entry->controller_id, entry->controller_id_len );
+  pair->controller_id_len = entry->controller_id_len;
+  esp_fill_random( pair->verify.session_id, HKS_PAIRING_SESSION_ID_LENGTH );
+  _hks_pair_resume_key( entry->shared, pair, pair->verify.session_id, "Pair-Resume-Response-Info", pair->key );
+  _hks_pair_resume_key( entry->shared, pair, pair->verify.session_id, "Pair-Resume-Shared-Secret-Info", pair->verify.shared );
+  hks_resume_drop( resume, entry );
+  _hks_pair_verify_keys( pair );
+
+  hks_tlv_writer_t w;
+  hks_tlv_writer_init( &w, pair->sealed, sizeof( pair->sealed ) - HKS_POLY1305_TAG_LENGTH );
+  _hks_pair_seal( pair, "PR-Msg02", &w );
+
+  pair->resumed = 1;
+  hks_pair_finish( p, pair );
+  return 1;
+}
+
+void _hks_pair_resume_key( const uint8_t *shared, const hks_pair_t *pair, const uint8_t *id, const char *info, uint8_t *out )
+{
+  // salted with the controller's new public key and the session id
+  uint8_t salt[HKS_X25519_KEY_LENGTH + HKS_PAIRING_SESSION_ID_LENGTH];
+  memcpy( salt, pair->verify.controller_public_key, HKS_X25519_KEY_LENGTH );
+  memcpy( salt + HKS_X25519_KEY_LENGTH, id, HKS_PAIRING_SESSION_ID_LENGTH );
+  hks_hkdf_sha512_salt( shared, HKS_X25519_KEY_LENGTH, salt, sizeof( salt ), info, out, HKS_CHACHA20_KEY_LENGTH );
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+#include "hks_types.h"
+#include "hks_arena.h"
+#include "hks_crypto.h"
+#include "hks_curve25519.h"
+#include "hks_srp.h"
+#include "hks_tlv.h"
+#include "hks_worker.h"
+
+#define HKS_PAIRING_MAX               CONFIG_HKS_MAX_PAIRINGS
+#define HKS_PAIRING_NONE              0xFF
+#define HKS_PAIRING_ID_LENGTH         36  // controllers use UUID strings
+#define HKS_PAIRING_ACCESSORY_ID_LENGTH 17 // XX:XX:XX:XX:XX:XX
+#define HKS_PAIRING_SETUP_CODE_LENGTH 10  // XXX-XX-XXX
+#define HKS_PAIRING_MAX_ATTEMPTS      100 // failed pair-setup proofs before giving up for good
+#define HKS_PAIRING_RESPONSE_LENGTH   512 // pair-setup M2 with its 384 byte key is the largest
+#define HKS_PAIRING_SESSION_ID_LENGTH 8   // names a verified session for pair-resume
+#define HKS_PAIRING_METHOD_RESUME     0x06 // pair-verify M1 asking to resume a session
+
+#define HKS_PAIRING_PERMISSION_ADMIN  0x01
+
+// a paired controller
+struct hks_pairing_s {
+  uint8_t id[HKS_PAIRING_ID_LENGTH];
+  uint8_t id_len;
+  uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH];
+  uint8_t permissions;
+};
+typedef struct hks_pairing_s hks_pairing_t;
+
+// The accessory's side of pairing: its identity, long-term Ed25519 key and
+// setup code, and the controllers paired with it. Only the socket loop
+// changes it.
+struct hks_pairings_s {
+  char accessory_id[HKS_PAIRING_ACCESSORY_ID_LENGTH + 1];
+  uint8_t seed[HKS_ED25519_SEED_LENGTH];
+  uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH];
+  char setup_code[HKS_PAIRING_SETUP_CODE_LENGTH + 1];
+
+  hks_pairing_t pairings[HKS_PAIRING_MAX];
+  uint8_t count;
+
+  uint8_t attempts;                 // failed pair-setup proofs
+  const struct hks_pair_s *setup;   // the one pair-setup allowed at a time
+};
+typedef struct hks_pairings_s hks_pairings_t;
+
+typedef enum {
+  HKS_PAIR_SETUP = 0,
+  HKS_PAIR_VERIFY,
+} hks_pair_method_t;
+
+// One connection's pair-setup or pair-verify exchange, allocated while it is
+// in progress. Each received message is handled in three parts:
+//
+//   hks_pair_setup / hks_pair_verify  parse it on the socket loop, checking
+//                                     the state and looking up pairings
+//   hks_pair_compute                  the SRP, Curve25519 and Ed25519 work,
+//                                     seconds on the device; it reads the
+//                                     accessory keys and writes nothing but
+//                                     the exchange so it may run elsewhere
+//   hks_pair_finish                   back on the loop, records the outcome
+//                                     and writes the response TLV
+//
+// Errors found while parsing skip straight to a response.
+struct hks_pair_s {
+  const hks_pairings_t *accessory;
+  uint8_t method;
+  uint8_t state;      // of the message being answered
+  uint8_t error;      // hks_tlv_error_t to answer with, 0 for none
+  uint8_t done;       // the response ends the exchange
+  uint8_t added;      // pair-setup added a pairing
+  uint8_t verified;   // pair-verify succeeded, the session keys are valid
+  uint8_t resumed;    // pair-verify M1 resumed a session, M2 ends the exchange
+  uint8_t controller; // pairing of the controller being verified
+
+  uint8_t controller_id[HKS_PAIRING_ID_LENGTH];
+  uint8_t controller_id_len;
+  uint8_t controller_key[HKS_ED25519_PUBLIC_LENGTH];
+  uint8_t signature[HKS_ED25519_SIGNATURE_LENGTH];
+  uint8_t key[HKS_CHACHA20_KEY_LENGTH]; // for the encrypted sub-TLVs
+
+  union {
+    struct {
+      hks_srp_t srp;
+      uint8_t salt[HKS_SRP_SALT_LENGTH];
+      uint8_t secret[HKS_SRP_SECRET_LENGTH];
+      uint8_t public_key[HKS_SRP_PUBLIC_LENGTH]; // A
+      uint16_t public_key_len;
+      uint8_t proof[HKS_SRP_PROOF_LENGTH];       // M1
+    } setup;
+    struct {
+      uint8_t secret[HKS_X25519_KEY_LENGTH];
+      uint8_t public_key[HKS_X25519_KEY_LENGTH];
+      uint8_t controller_public_key[HKS_X25519_KEY_LENGTH];
+      uint8_t shared[HKS_X25519_KEY_LENGTH];
+      uint8_t read_key[HKS_CHACHA20_KEY_LENGTH];  // controller to accessory
+      uint8_t write_key[HKS_CHACHA20_KEY_LENGTH]; // accessory to controller
+      uint8_t session_id[HKS_PAIRING_SESSION_ID_LENGTH]; // to resume it by
+    } verify;
+  };
+
+  // the sealed sub-TLV of pair-setup M6 or pair-verify M2
+  uint8_t sealed[128 + HKS_POLY1305_TAG_LENGTH];
+  uint8_t sealed_len;
+
+  uint8_t response[HKS_PAIRING_RESPONSE_LENGTH];
+  uint16_t response_len;
+
+  hks_job_t job; // hks_pair_compute off the loop
+};
+typedef struct hks_pair_s hks_pair_t;
+
+struct hks_resume_s;
+
+// a fresh long-term key, replaced by hks_pairings_load with the stored one
+extern esp_err_t hks_pairings_init( hks_pairings_t *p, const uint8_t device_id[6] );
+
+// the long-term key and pairings kept from a previous run
+extern void hks_pairings_load( hks_pairings_t *p, const uint8_t seed[HKS_ED25519_SEED_LENGTH], const hks_pairing_t *pairings, uint8_t count );
+
+// XXX-XX-XXX, ESP_ERR_INVALID_ARG for a malformed or trivial code
+extern esp_err_t hks_pairings_set_setup_code( hks_pairings_t *p, const char *code );
+
+// index of the controller, HKS_PAIRING_NONE if it is not paired
+extern uint8_t hks_pairings_find( const hks_pairings_t *p, const uint8_t *id, size_t id_len );
+extern esp_err_t hks_pairings_add( hks_pairings_t *p, const uint8_t *id, size_t id_len, const uint8_t public_key[HKS_ED25519_PUBLIC_LENGTH], uint8_t permissions );
+
+// from `heap`, NULL when it is full
+extern hks_pair_t *hks_pair_new( hks_heap_t *heap, hks_pair_method_t method );
+
+// drop an exchange, giving up pair-setup if it held it
+extern void hks_pair_free( hks_pairings_t *p, hks_pair_t *pair );
+
+// hks_send_release_t for the final response: the exchange goes with it
+extern void hks_pair_release( void *arg );
+
+// ESP_OK with the response ready, HKS_ERR_PAIR_COMPUTE when the message needs
+// hks_pair_compute and hks_pair_finish first, ESP_ERR_INVALID_ARG for a body
+// that is not TLV8. `body` is decrypted and decoded in place. Pair-verify
+// answers a pair-resume M1 found in `resume` on the spot, only hashing; one
+// it cannot resume gets the full M2.
+extern esp_err_t hks_pair_setup( hks_pairings_t *p, hks_pair_t *pair, uint8_t *body, size_t len );
+extern esp_err_t hks_pair_verify( hks_pairings_t *p, struct hks_resume_s *resume, hks_pair_t *pair, uint8_t *body, size_t len );
+
+extern void hks_pair_compute( hks_pair_t *pair );
+extern void hks_pair_finish( hks_pairings_t *p, hks_pair_t *pair );
@@ -0,0 +1,54 @@
+#include "hks_resume.h"
+#include <string.h>
+
+void hks_resume_init( hks_resume_t *r )
+{
+  memset( r, 0, sizeof( hks_resume_t ) );
+}
+
+void hks_resume_put(
+  hks_resume_t *r,
+  const uint8_t id[HKS_PAIRING_SESSION_ID_LENGTH],
+  const uint8_t shared[HKS_X25519_KEY_LENGTH],
+  const uint8_t *controller_id,
+  size_t controller_id_len
+)
+{
+  // the same id again, else a free slot, else the least recently used
+  hks_resume_entry_t *entry = hks_resume_find( r, id );
+  for ( int i = 0; entry == NULL && i < HKS_RESUME_SLOTS; i++ )
+    if ( r->entries[i].used == 0 )
+      entry = &r->entries[i];
+
+  if ( entry == NULL )
+  {
+    entry = &r->entries[0];
+    for ( int i = 1; i < HKS_RESUME_SLOTS; i++ )
+      if ( r->entries[i].used < entry->used )
+        entry = &r->entries[i];
+  }
+
+  memcpy( entry->id, id, HKS_PAIRING_SESSION_ID_LENGTH );
+  memcpy( entry->shared, shared, HKS_X25519_KEY_LENGTH );
+  memcpy( entry->controller_id, controller_id, controller_id_len );
+  entry->controller_id_len = controller_id_len;
+  entry->used = ++r->clock;
+}
+
+hks_resume_entry_t *hks_resume_find( hks_resume_t *r, const uint8_t id[HKS_PAIRING_SESSION_ID_LENGTH] )
+{
+  for ( int i = 0; i < HKS_RESUME_SLOTS; i++ )
+  {
+    hks_resume_entry_t *entry = &r->entries[i];
+    if ( entry->used != 0 && memcmp( entry->id, id, HKS_PAIRING_SESSION_ID_LENGTH ) == 0 )
+      return entry;
+  }
+
+  return NULL;
+}
+
+void hks_resume_drop( hks_resume_t *r, hks_resume_entry_t *entry )
+{
+  // the secret keys every session resumed from it
+  memset( entry, 0, sizeof( hks_resume_entry_t ) );
+}
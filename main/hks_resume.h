@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+#include "hks_pairing.h"
+
+#define HKS_RESUME_SLOTS CONFIG_HKS_RESUME_SESSIONS
+
+// a verified session: the secret it was keyed from and whose it is
+struct hks_resume_entry_s {
+  uint8_t id[HKS_PAIRING_SESSION_ID_LENGTH];
+  uint8_t shared[HKS_X25519_KEY_LENGTH];
+  uint8_t controller_id[HKS_PAIRING_ID_LENGTH];
+  uint8_t controller_id_len;
+  uint32_t used; // 0 for a free slot
+};
+typedef struct hks_resume_entry_s hks_resume_entry_t;
+
+// Sessions a reconnecting controller may resume without the curve arithmetic,
+// keyed by the id both sides derive for them. A few slots searched in order,
+// the least recently verified or resumed one is overwritten when all are in
+// use. Only the socket loop touches it.
+struct hks_resume_s {
+  hks_resume_entry_t entries[HKS_RESUME_SLOTS];
+  uint32_t clock;
+};
+typedef struct hks_resume_s hks_resume_t;
+
+extern void hks_resume_init( hks_resume_t *r );
+
+// remember a session under `id`, replacing one with the same id
+extern void hks_resume_put(
+  hks_resume_t *r,
+  const uint8_t id[HKS_PAIRING_SESSION_ID_LENGTH],
+  const uint8_t shared[HKS_X25519_KEY_LENGTH],
+  const uint8_t *controller_id,
+  size_t controller_id_len
+);
+
+// NULL for an unknown or evicted id
+extern hks_resume_entry_t *hks_resume_find( hks_resume_t *r, const uint8_t id[HKS_PAIRING_SESSION_ID_LENGTH] );
+
+// forget a session, it resumes at most once and goes on under a new id
+extern void hks_resume_drop( hks_resume_t *r, hks_resume_entry_t *entry );
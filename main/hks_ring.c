@@ -0,0 +1,63 @@
+#include "hks_ring.h"
+#include <string.h>
+
+void hks_ring_init( hks_ring_t *ring, uint8_t *data, uint16_t size )
+{
+  ring->data = data;
+  ring->size = size;
+  hks_ring_reset( ring );
+}
+
+void hks_ring_reset( hks_ring_t *ring )
+{
+  ring->head = 0;
+  ring->len = 0;
+}
+
+uint8_t *hks_ring_write_ptr( hks_ring_t *ring, size_t *space )
+{
+  size_t tail = ring->head + ring->len;
+
+  // more room in front of the head than after the tail: wrap around by
+  // moving the pending bytes (usually a partial request) to the front
+  if ( ring->head > 0 && ring->size - tail < ring->head )
+  {
+    memmove( ring->data, ring->data + ring->head, ring->len );
+    ring->head = 0;
+    tail = ring->len;
+  }
+
+  *space = ring->size - tail;
+  return ring->data + tail;
+}
+
+void hks_ring_commit( hks_ring_t *ring, size_t n )
+{
+  ring->len += n;
+}
+
+uint8_t *hks_ring_read_ptr( hks_ring_t *ring, size_t *len )
+{
+  *len = ring->len;
+  return ring->data + ring->head;
+}
+
+void hks_ring_consume( hks_ring_t *ring, size_t n )
+{
+  if ( n >= ring->len )
+  {
+    hks_ring_reset( ring );
+    return;
+  }
+
+  ring->head += n;
+  ring->len -= n;
+}
+
+void hks_ring_truncate( hks_ring_t *ring, size_t len )
+{
+  if ( len == 0 )
+    hks_ring_reset( ring );
+  else if ( len < ring->len )
+    ring->len = len;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-capacity receive ring. Unconsumed bytes are always kept contiguous so
+// the HTTP parser can hand out slices straight into the ring; consuming only
+// moves the head. When the free space after the pending bytes runs short the
+// (partial) pending bytes are moved to the front, which is the only copy.
+struct hks_ring_s {
+  uint8_t *data;
+  uint16_t size;
+  uint16_t head; // first unconsumed byte
+  uint16_t len;  // number of unconsumed bytes
+};
+typedef struct hks_ring_s hks_ring_t;
+
+extern void hks_ring_init( hks_ring_t *ring, uint8_t *data, uint16_t size );
+extern void hks_ring_reset( hks_ring_t *ring );
+
+// contiguous free space following the pending bytes
+extern uint8_t *hks_ring_write_ptr( hks_ring_t *ring, size_t *space );
+extern void hks_ring_commit( hks_ring_t *ring, size_t n );
+
+// pending bytes, always contiguous
+extern uint8_t *hks_ring_read_ptr( hks_ring_t *ring, size_t *len );
+extern void hks_ring_consume( hks_ring_t *ring, size_t n );
+
+// drop pending bytes past the first `len`
+extern void hks_ring_truncate( hks_ring_t *ring, size_t len );
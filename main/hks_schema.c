@@ -0,0 +1,11 @@
+#include "hks_schema.h"
+
+#define _HKS_SCHEMA_DEFINE_CHARACTERISTIC( name, uuid, format, perms, min, max, step ) \
+  const hks_characteristic_meta_t hks_characteristic_##name = { \
+    uuid, HKS_FORMAT_##format, perms, ( max ) > ( min ), min, max, step, 0 \
+  };
+#define _HKS_SCHEMA_DEFINE_SERVICE( name, uuid ) \
+  const char hks_service_##name[] = uuid;
+
+HKS_SCHEMA_CHARACTERISTICS( _HKS_SCHEMA_DEFINE_CHARACTERISTIC )
+HKS_SCHEMA_SERVICES( _HKS_SCHEMA_DEFINE_SERVICE )
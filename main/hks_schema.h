@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+#include "hks_db.h"
+
+// HAP characteristic and service types, one const (flash resident) object
+// each: hks_characteristic_<name> and hks_service_<name>.
+
+#define _HKS_PR   HKS_PERM_READ
+#define _HKS_PW   HKS_PERM_WRITE
+#define _HKS_EV   HKS_PERM_EVENTS
+
+// X( name, short uuid, format, perms, min, max, step ), no range if max == min
+#define HKS_SCHEMA_CHARACTERISTICS( X ) \
+  X( administrator_only_access,      "1",  BOOL,   _HKS_PR | _HKS_PW | _HKS_EV, 0, 0, 0 ) \
+  X( brightness,                     "8",  INT,    _HKS_PR | _HKS_PW | _HKS_EV, 0, 100, 1 ) \
+  X( cooling_threshold_temperature,  "D",  FLOAT,  _HKS_PR | _HKS_PW | _HKS_EV, 10, 35, 0.1f ) \
+  X( current_door_state,             "E",  UINT8,  _HKS_PR | _HKS_EV,          0, 4, 1 ) \
+  X( current_heating_cooling_state,  "F",  UINT8,  _HKS_PR | _HKS_EV,          0, 2, 1 ) \
+  X( current_relative_humidity,      "10", FLOAT,  _HKS_PR | _HKS_EV,          0, 100, 1 ) \
+  X( current_temperature,            "11", FLOAT,  _HKS_PR | _HKS_EV,          0, 100, 0.1f ) \
+  X( heating_threshold_temperature,  "12", FLOAT,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 25, 0.1f ) \
+  X( hue,                            "13", FLOAT,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 360, 1 ) \
+  X( identify,                       "14", BOOL,   _HKS_PW,                    0, 0, 0 ) \
+  X( lock_current_state,             "1D", UINT8,  _HKS_PR | _HKS_EV,          0, 3, 1 ) \
+  X( lock_target_state,              "1E", UINT8,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 1, 1 ) \
+  X( manufacturer,                   "20", STRING, _HKS_PR,                    0, 0, 0 ) \
+  X( model,                          "21", STRING, _HKS_PR,                    0, 0, 0 ) \
+  X( motion_detected,                "22", BOOL,   _HKS_PR | _HKS_EV,          0, 0, 0 ) \
+  X( name,                           "23", STRING, _HKS_PR,                    0, 0, 0 ) \
+  X( obstruction_detected,           "24", BOOL,   _HKS_PR | _HKS_EV,          0, 0, 0 ) \
+  X( on,                             "25", BOOL,   _HKS_PR | _HKS_PW | _HKS_EV, 0, 0, 0 ) \
+  X( outlet_in_use,                  "26", BOOL,   _HKS_PR | _HKS_EV,          0, 0, 0 ) \
+  X( rotation_direction,             "28", INT,    _HKS_PR | _HKS_PW | _HKS_EV, 0, 1, 1 ) \
+  X( rotation_speed,                 "29", FLOAT,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 100, 1 ) \
+  X( saturation,                     "2F", FLOAT,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 100, 1 ) \
+  X( serial_number,                  "30", STRING, _HKS_PR,                    0, 0, 0 ) \
+  X( target_door_state,              "32", UINT8,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 1, 1 ) \
+  X( target_heating_cooling_state,   "33", UINT8,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 3, 1 ) \
+  X( target_relative_humidity,       "34", FLOAT,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 100, 1 ) \
+  X( target_temperature,             "35", FLOAT,  _HKS_PR | _HKS_PW | _HKS_EV, 10, 38, 0.1f ) \
+  X( temperature_display_units,      "36", UINT8,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 1, 1 ) \
+  X( version,                        "37", STRING, _HKS_PR,                    0, 0, 0 ) \
+  X( firmware_revision,              "52", STRING, _HKS_PR,                    0, 0, 0 ) \
+  X( hardware_revision,              "53", STRING, _HKS_PR,                    0, 0, 0 ) \
+  X( security_system_current_state,  "66", UINT8,  _HKS_PR | _HKS_EV,          0, 4, 1 ) \
+  X( security_system_target_state,   "67", UINT8,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 3, 1 ) \
+  X( battery_level,                  "68", UINT8,  _HKS_PR | _HKS_EV,          0, 100, 1 ) \
+  X( contact_sensor_state,           "6A", UINT8,  _HKS_PR | _HKS_EV,          0, 1, 1 ) \
+  X( current_ambient_light_level,    "6B", FLOAT,  _HKS_PR | _HKS_EV,          0.0001f, 100000, 0 ) \
+  X( current_position,               "6D", UINT8,  _HKS_PR | _HKS_EV,          0, 100, 1 ) \
+  X( leak_detected,                  "70", UINT8,  _HKS_PR | _HKS_EV,          0, 1, 1 ) \
+  X( occupancy_detected,             "71", UINT8,  _HKS_PR | _HKS_EV,          0, 1, 1 ) \
+  X( position_state,                 "72", UINT8,  _HKS_PR | _HKS_EV,          0, 2, 1 ) \
+  X( programmable_switch_event,      "73", UINT8,  _HKS_PR | _HKS_EV,          0, 2, 1 ) \
+  X( status_active,                  "75", BOOL,   _HKS_PR | _HKS_EV,          0, 0, 0 ) \
+  X( smoke_detected,                 "76", UINT8,  _HKS_PR | _HKS_EV,          0, 1, 1 ) \
+  X( status_fault,                   "77", UINT8,  _HKS_PR | _HKS_EV,          0, 1, 1 ) \
+  X( status_low_battery,             "79", UINT8,  _HKS_PR | _HKS_EV,          0, 1, 1 ) \
+  X( target_position,                "7C", UINT8,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 100, 1 ) \
+  X( charging_state,                 "8F", UINT8,  _HKS_PR | _HKS_EV,          0, 2, 1 ) \
+  X( air_quality,                    "95", UINT8,  _HKS_PR | _HKS_EV,          0, 5, 1 ) \
+  X( accessory_flags,                "A6", UINT32, _HKS_PR | _HKS_EV,          0, 0, 0 ) \
+  X( active,                         "B0", UINT8,  _HKS_PR | _HKS_PW | _HKS_EV, 0, 1, 1 ) \
+  X( color_temperature,              "CE", UINT32, _HKS_PR | _HKS_PW | _HKS_EV, 140, 500, 1 ) \
+  X( in_use,                         "D2", UINT8,  _HKS_PR | _HKS_EV,          0, 1, 1 )
+
+// X( name, short uuid )
+#define HKS_SCHEMA_SERVICES( X ) \
+  X( accessory_information,           "3E" ) \
+  X( fan,                             "40" ) \
+  X( garage_door_opener,              "41" ) \
+  X( lightbulb,                       "43" ) \
+  X( lock_management,                 "44" ) \
+  X( lock_mechanism,                  "45" ) \
+  X( outlet,                          "47" ) \
+  X( switch,                          "49" ) \
+  X( thermostat,                      "4A" ) \
+  X( security_system,                 "7E" ) \
+  X( carbon_monoxide_sensor,          "7F" ) \
+  X( contact_sensor,                  "80" ) \
+  X( door,                            "81" ) \
+  X( humidity_sensor,                 "82" ) \
+  X( leak_sensor,                     "83" ) \
+  X( light_sensor,                    "84" ) \
+  X( motion_sensor,                   "85" ) \
+  X( occupancy_sensor,                "86" ) \
+  X( smoke_sensor,                    "87" ) \
+  X( stateless_programmable_switch,   "89" ) \
+  X( temperature_sensor,              "8A" ) \
+  X( window,                          "8B" ) \
+  X( window_covering,                 "8C" ) \
+  X( air_quality_sensor,              "8D" ) \
+  X( battery_service,                 "96" ) \
+  X( protocol_information,            "A2" ) \
+  X( fan_v2,                          "B7" )
+
+#define _HKS_SCHEMA_DECLARE_CHARACTERISTIC( name, uuid, format, perms, min, max, step ) \
+  extern const hks_characteristic_meta_t hks_characteristic_##name;
+#define _HKS_SCHEMA_DECLARE_SERVICE( name, uuid ) \
+  extern const char hks_service_##name[];
+
+HKS_SCHEMA_CHARACTERISTICS( _HKS_SCHEMA_DECLARE_CHARACTERISTIC )
+HKS_SCHEMA_SERVICES( _HKS_SCHEMA_DECLARE_SERVICE )
+
+// entries of a declarative accessory database, see hks_db_entry_t
+#define HKS_DB_ACCESSORY( id ) \
+  { .kind = HKS_DB_KIND_ACCESSORY, .aid = ( id ) }
+#define HKS_DB_SERVICE( name, service_flags ) \
+  { .kind = HKS_DB_KIND_SERVICE, .flags = ( service_flags ), .service = hks_service_##name }
+#define HKS_DB_CHARACTERISTIC( name, ... ) \
+  { .kind = HKS_DB_KIND_CHARACTERISTIC, .characteristic = &hks_characteristic_##name, .initial = { __VA_ARGS__ } }
+#define HKS_DB_CUSTOM_CHARACTERISTIC( meta, ... ) \
+  { .kind = HKS_DB_KIND_CHARACTERISTIC, .characteristic = ( meta ), .initial = { __VA_ARGS__ } }
@@ -0,0 +1,168 @@
+#include "hks_send.h"
+#include <errno.h>
+#include <string.h>
+#include <lwip/sockets.h>
+
+static hks_send_segment_t *_hks_send_queue_at( hks_send_queue_t *queue, uint8_t i );
+
+void hks_send_queue_init( hks_send_queue_t *queue )
+{
+  queue->head = 0;
+  queue->count = 0;
+  queue->offset = 0;
+  queue->pending = 0;
+  queue->scratch_used = 0;
+}
+
+void hks_send_queue_clear( hks_send_queue_t *queue )
+{
+  hks_send_queue_advance( queue, queue->pending );
+}
+
+esp_err_t hks_send_queue_push(
+  hks_send_queue_t *queue,
+  const void *data,
+  size_t len,
+  hks_send_release_t release,
+  void *arg
+)
+{
+  if ( data == NULL && len > 0 )
+    return ESP_ERR_INVALID_ARG;
+
+  if ( queue->count == HKS_SEND_SEGMENTS )
+    return ESP_ERR_NO_MEM;
+
+  hks_send_segment_t *segment = _hks_send_queue_at( queue, queue->count++ );
+  segment->data = data;
+  segment->len = len;
+  segment->release = release;
+  segment->arg = arg;
+  queue->pending += len;
+
+  // an empty segment still has to be released, in order
+  if ( len == 0 && queue->count == 1 )
+    hks_send_queue_advance( queue, 0 );
+
+  return ESP_OK;
+}
+
+uint8_t *hks_send_queue_scratch( hks_send_queue_t *queue, size_t *space )
+{
+  *space = HKS_SEND_SCRATCH_LENGTH - queue->scratch_used;
+  return queue->scratch + queue->scratch_used;
+}
+
+esp_err_t hks_send_queue_commit( hks_send_queue_t *queue, size_t len )
+{
+  if ( len > (size_t)( HKS_SEND_SCRATCH_LENGTH - queue->scratch_used ) )
+    return ESP_ERR_INVALID_SIZE;
+
+  const uint8_t *data = queue->scratch + queue->scratch_used;
+
+  // extend the previous segment when it ends right where this one starts
+  if ( queue->count > 0 )
+  {
+    hks_send_segment_t *tail = _hks_send_queue_at( queue, queue->count - 1 );
+    if ( tail->release == NULL && tail->data + tail->len == data )
+    {
+      tail->len += len;
+      queue->pending += len;
+      queue->scratch_used += len;
+      return ESP_OK;
+    }
+  }
+
+  esp_err_t err = hks_send_queue_push( queue, data, len, NULL, NULL );
+  if ( err )
+    return err;
+
+  queue->scratch_used += len;
+
+  return ESP_OK;
+}
+
+size_t hks_send_queue_available( const hks_send_queue_t *queue )
+{
+  return HKS_SEND_SEGMENTS - queue->count;
+}
+
+esp_err_t hks_send_queue_flush( hks_send_queue_t *queue, int fd )
+{
+  struct iovec iov[HKS_SEND_SEGMENTS];
+
+  while ( queue->pending > 0 )
+  {
+    int iovcnt = 0;
+    for ( uint8_t i = 0; i < queue->count; i++ )
+    {
+      hks_send_segment_t *segment = _hks_send_queue_at( queue, i );
+      size_t skip = i == 0 ? queue->offset : 0;
+      if ( segment->len == skip )
+        continue;
+
+      iov[iovcnt].iov_base = (void *)( segment->data + skip );
+      iov[iovcnt].iov_len = segment->len - skip;
+      iovcnt++;
+    }
+
+    int n = lwip_writev( fd, iov, iovcnt );
+    if ( n < 0 )
+    {
+      if ( errno == EAGAIN || errno == EWOULDBLOCK )
+        return HKS_ERR_SEND_PENDING;
+      if ( errno == EINTR )
+        continue;
+      return ESP_FAIL;
+    }
+
+    hks_send_queue_advance( queue, n );
+  }
+
+  return ESP_OK;
+}
+
+hks_send_segment_t *_hks_send_queue_at( hks_send_queue_t *queue, uint8_t i )
+{
+  return &queue->segments[( queue->head + i ) % HKS_SEND_SEGMENTS];
+}
+
+const uint8_t *hks_send_queue_peek( const hks_send_queue_t *queue, size_t *len )
+{
+  if ( queue->count == 0 )
+  {
+    *len = 0;
+    return NULL;
+  }
+
+  const hks_send_segment_t *segment = &queue->segments[queue->head];
+  *len = segment->len - queue->offset;
+  return segment->data + queue->offset;
+}
+
+void hks_send_queue_advance( hks_send_queue_t *queue, size_t n )
+{
+  queue->pending -= n;
+
+  while ( queue->count > 0 )
+  {
+    hks_send_segment_t *segment = _hks_send_queue_at( queue, 0 );
+    size_t left = segment->len - queue->offset;
+    if ( n < left )
+    {
+      queue->offset += n;
+      return;
+    }
+
+    n -= left;
+    queue->offset = 0;
+    queue->head = ( queue->head + 1 ) % HKS_SEND_SEGMENTS;
+    queue->count--;
+
+    if ( segment->release )
+      segment->release( segment->arg );
+  }
+
+  queue->head = 0;
+  queue->scratch_used = 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+#include "hks_types.h"
+
+#define HKS_SEND_SEGMENTS         CONFIG_HKS_CLIENT_TX_SEGMENTS
+#define HKS_SEND_SCRATCH_LENGTH   256   // status/header lines formatted per client
+
+// called once the last byte of a segment has been written (or dropped)
+typedef void (*hks_send_release_t)( void *arg );
+
+struct hks_send_segment_s {
+  const uint8_t *data;
+  size_t len;
+  hks_send_release_t release; // NULL for static buffers
+  void *arg;
+};
+typedef struct hks_send_segment_s hks_send_segment_t;
+
+// Per-client outbound queue. Segments point at static or borrowed buffers and
+// are written with a single writev; only the small formatted header lines
+// are copied, into the scratch area. A partial write resumes from `offset`.
+struct hks_send_queue_s {
+  hks_send_segment_t segments[HKS_SEND_SEGMENTS];
+  uint8_t head;
+  uint8_t count;
+  size_t offset;  // bytes of the head segment already written
+  size_t pending; // bytes left to write
+
+  uint8_t scratch[HKS_SEND_SCRATCH_LENGTH];
+  uint16_t scratch_used; // reclaimed once the queue drains
+};
+typedef struct hks_send_queue_s hks_send_queue_t;
+
+extern void hks_send_queue_init( hks_send_queue_t *queue );
+
+// drop everything still queued, releasing borrowed buffers
+extern void hks_send_queue_clear( hks_send_queue_t *queue );
+
+// queue `len` bytes at `data` without copying, ESP_ERR_NO_MEM when full in
+// which case `release` is not called and the caller keeps the buffer
+extern esp_err_t hks_send_queue_push(
+  hks_send_queue_t *queue,
+  const void *data,
+  size_t len,
+  hks_send_release_t release,
+  void *arg
+);
+
+// free scratch space to format into, queued by hks_send_queue_commit
+extern uint8_t *hks_send_queue_scratch( hks_send_queue_t *queue, size_t *space );
+extern esp_err_t hks_send_queue_commit( hks_send_queue_t *queue, size_t len );
+
+// number of segments that can still be queued
+extern size_t hks_send_queue_available( const hks_send_queue_t *queue );
+
+// write as much as the socket takes: ESP_OK once drained, HKS_ERR_SEND_PENDING
+// when the socket would block, ESP_FAIL when the connection is gone
+extern esp_err_t hks_send_queue_flush( hks_send_queue_t *queue, int fd );
+
+// for writers that transform the bytes on the way out: the unwritten part of
+// the head segment, and marking `n` bytes as written
+extern const uint8_t *hks_send_queue_peek( const hks_send_queue_t *queue, size_t *len );
+extern void hks_send_queue_advance( hks_send_queue_t *queue, size_t n );
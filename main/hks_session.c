@@ -0,0 +1,199 @@
+#include "hks_session.h"
+#include <string.h>
+#include <errno.h>
+#include <lwip/sockets.h>
+#include "hks_utils.h"
+
+static void _hks_session_nonce( uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH], uint64_t count );
+static void _hks_session_seal( hks_session_t *session, hks_send_queue_t *queue, size_t len );
+static esp_err_t _hks_session_write( int fd, const uint8_t *data, size_t len, size_t *written );
+
+void hks_session_init( hks_session_t *session )
+{
+  memset( session, 0, offsetof( hks_session_t, out ) );
+}
+
+void hks_session_start(
+  hks_session_t *session,
+  const hks_send_queue_t *queue,
+  const uint8_t read_key[HKS_CHACHA20_KEY_LENGTH],
+  const uint8_t write_key[HKS_CHACHA20_KEY_LENGTH]
+)
+{
+  memcpy( session->read_key, read_key, HKS_CHACHA20_KEY_LENGTH );
+  memcpy( session->write_key, write_key, HKS_CHACHA20_KEY_LENGTH );
+  session->read_count = 0;
+  session->write_count = 0;
+  session->plain = queue->pending;
+  session->out_len = 0;
+  session->out_sent = 0;
+  session->active = 1;
+}
+
+esp_err_t hks_session_decrypt( hks_session_t *session, uint8_t *data, size_t *len, size_t *decrypted )
+{
+  size_t dst = *decrypted;
+  size_t src = *decrypted;
+
+  while ( *len - src >= 2 )
+  {
+    uint8_t *frame = data + src;
+    size_t frame_len = frame[0] | ( frame[1] << 8 );
+    if ( frame_len > HKS_SESSION_FRAME_LENGTH )
+      return ESP_FAIL;
+    if ( *len - src < frame_len + HKS_SESSION_FRAME_OVERHEAD )
+      break;
+
+    uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH];
+    _hks_session_nonce( nonce, session->read_count );
+
+    // the plaintext lands over the previous frame's length and tag, the
+    // cipher reads every byte before anything is written over it
+    hks_aead_t aead;
+    uint8_t tag[HKS_POLY1305_TAG_LENGTH];
+    hks_aead_init( &aead, session->read_key, nonce, frame, 2 );
+    hks_aead_decrypt( &aead, data + dst, frame + 2, frame_len );
+    hks_aead_finish( &aead, tag );
+
+    if ( !hks_crypto_equal( tag, frame + 2 + frame_len, HKS_POLY1305_TAG_LENGTH ) )
+      return ESP_FAIL;
+
+    session->read_count++;
+    dst += frame_len;
+    src += frame_len + HKS_SESSION_FRAME_OVERHEAD;
+  }
+
+  // a partial frame follows the plaintext
+  if ( src > dst )
+    memmove( data + dst, data + src, *len - src );
+  *len -= src - dst;
+  *decrypted = dst;
+
+  return ESP_OK;
+}
+
+esp_err_t hks_session_flush( hks_session_t *session, hks_send_queue_t *queue, int fd )
+{
+  for (;;)
+  {
+    // sealed frames first
+    if ( session->out_sent < session->out_len )
+    {
+      size_t written;
+      esp_err_t err = _hks_session_write( fd, session->out + session->out_sent, session->out_len - session->out_sent, &written );
+      session->out_sent += written;
+      if ( err )
+        return err;
+    }
+    session->out_len = 0;
+    session->out_sent = 0;
+
+    if ( queue->pending == 0 )
+      return ESP_OK;
+
+    // the response that set up the keys is not encrypted; it is gathered
+    // into `out` all the same, written a segment at a time its header and
+    // body would wait on each other's ACK
+    if ( session->plain > 0 )
+    {
+      while ( session->plain > 0 && session->out_len < sizeof( session->out ) )
+      {
+        size_t len;
+        const uint8_t *data = hks_send_queue_peek( queue, &len );
+        size_t space = sizeof( session->out ) - session->out_len;
+        if ( len > session->plain )
+          len = session->plain;
+        if ( len > space )
+          len = space;
+
+        memcpy( session->out + session->out_len, data, len );
+        hks_send_queue_advance( queue, len );
+        session->plain -= len;
+        session->out_len += len;
+      }
+      continue;
+    }
+
+    // seal as many frames as fit, they go out in one write
+#if CONFIG_HKS_STATS
+    uint32_t sealing = hksu_now_us();
+#endif
+    for (;;)
+    {
+      size_t space = sizeof( session->out ) - session->out_len;
+      if ( queue->pending == 0 || space <= HKS_SESSION_FRAME_OVERHEAD )
+        break;
+
+      size_t frame_len = space - HKS_SESSION_FRAME_OVERHEAD;
+      if ( frame_len > HKS_SESSION_FRAME_LENGTH )
+        frame_len = HKS_SESSION_FRAME_LENGTH;
+      if ( frame_len > queue->pending )
+        frame_len = queue->pending;
+
+      _hks_session_seal( session, queue, frame_len );
+    }
+#if CONFIG_HKS_STATS
+    session->seal_us += hksu_now_us() - sealing;
+#endif
+  }
+}
+
+void _hks_session_nonce( uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH], uint64_t count )
+{
+  // 32 zero bits, then the counter little endian
+  memset( nonce, 0, 4 );
+  for ( int i = 0; i < 8; i++ )
+    nonce[4 + i] = count >> ( i * 8 );
+}
+
+void _hks_session_seal( hks_session_t *session, hks_send_queue_t *queue, size_t len )
+{
+  uint8_t *frame = session->out + session->out_len;
+  frame[0] = len & 0xFF;
+  frame[1] = len >> 8;
+
+  uint8_t nonce[HKS_CHACHA20_NONCE_LENGTH];
+  _hks_session_nonce( nonce, session->write_count++ );
+
+  hks_aead_t aead;
+  hks_aead_init( &aead, session->write_key, nonce, frame, 2 );
+
+  // a frame may span segments, each is released once it is sealed
+  uint8_t *dst = frame + 2;
+  size_t left = len;
+  while ( left > 0 )
+  {
+    size_t n;
+    const uint8_t *src = hks_send_queue_peek( queue, &n );
+    if ( n > left )
+      n = left;
+
+    hks_aead_encrypt( &aead, dst, src, n );
+    hks_send_queue_advance( queue, n );
+    dst += n;
+    left -= n;
+  }
+
+  hks_aead_finish( &aead, dst );
+  session->out_len += len + HKS_SESSION_FRAME_OVERHEAD;
+}
+
+esp_err_t _hks_session_write( int fd, const uint8_t *data, size_t len, size_t *written )
+{
+  *written = 0;
+  while ( *written < len )
+  {
+    int n = lwip_write( fd, data + *written, len - *written );
+    if ( n < 0 )
+    {
+      if ( errno == EAGAIN || errno == EWOULDBLOCK )
+        return HKS_ERR_SEND_PENDING;
+      if ( errno == EINTR )
+        continue;
+      return ESP_FAIL;
+    }
+    *written += n;
+  }
+
+  return ESP_OK;
+}
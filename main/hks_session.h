@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+#include "hks_crypto.h"
+#include "hks_send.h"
+
+#define HKS_SESSION_FRAME_LENGTH    1024 // plaintext per frame at most
+#define HKS_SESSION_FRAME_OVERHEAD  ( 2 + HKS_POLY1305_TAG_LENGTH ) // length + tag
+#define HKS_SESSION_TX_FRAMES       CONFIG_HKS_SESSION_TX_FRAMES
+
+// The secured HAP session of a connection once pair-verify has set up its
+// keys. Every message is cut into frames of
+//
+//   length (2 bytes LE, also the additional data) | ciphertext | tag
+//
+// sealed with ChaCha20-Poly1305 under a per-direction key; the nonce is a
+// 64-bit frame counter per direction.
+//
+// Received frames are opened in place in the receive ring. Outgoing frames
+// are sealed straight from the send queue's segments into `out`: those are
+// often shared between connections (the /accessories document, events) so
+// they are never encrypted in place, but the cipher writes each byte once
+// and nothing else is copied.
+struct hks_session_s {
+  uint8_t active;
+  uint8_t read_key[HKS_CHACHA20_KEY_LENGTH];
+  uint8_t write_key[HKS_CHACHA20_KEY_LENGTH];
+  uint64_t read_count;
+  uint64_t write_count;
+
+  size_t plain; // queued bytes that still go out unencrypted
+
+#if CONFIG_HKS_STATS
+  uint32_t seal_us; // spent sealing, hks_stats counts and clears it
+#endif
+
+  uint16_t out_len;  // sealed frames in `out`
+  uint16_t out_sent; // of which written
+  uint8_t out[HKS_SESSION_TX_FRAMES * ( HKS_SESSION_FRAME_LENGTH + HKS_SESSION_FRAME_OVERHEAD )];
+};
+typedef struct hks_session_s hks_session_t;
+
+extern void hks_session_init( hks_session_t *session );
+
+// Encrypt everything from now on. Whatever `queue` holds already (the
+// response that set up the keys) is still sent as is.
+extern void hks_session_start(
+  hks_session_t *session,
+  const hks_send_queue_t *queue,
+  const uint8_t read_key[HKS_CHACHA20_KEY_LENGTH],
+  const uint8_t write_key[HKS_CHACHA20_KEY_LENGTH]
+);
+
+// `data` holds `*decrypted` bytes of plaintext followed by received frames
+// up to `*len`. Every complete frame is opened in place and its plaintext
+// moved down to follow the previous one; both counts are updated. ESP_FAIL
+// for a frame that does not authenticate or is too long, the connection
+// cannot continue.
+extern esp_err_t hks_session_decrypt( hks_session_t *session, uint8_t *data, size_t *len, size_t *decrypted );
+
+// hks_send_queue_flush for an encrypted connection
+extern esp_err_t hks_session_flush( hks_session_t *session, hks_send_queue_t *queue, int fd );
+
+static inline int hks_session_pending( const hks_session_t *session, const hks_send_queue_t *queue )
+{
+  return queue->pending > 0 || session->out_sent < session->out_len;
+}
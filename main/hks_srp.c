@@ -0,0 +1,158 @@
+#include "hks_srp.h"
+#include <string.h>
+
+static void _hks_srp_hash_padded( hks_sha512_t *sha, const hks_bn_t *a );
+
+static const uint8_t _hks_srp_n[HKS_BN_BYTES] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xc9, 0x0f, 0xda, 0xa2, 0x21, 0x68, 0xc2, 0x34,
+  0xc4, 0xc6, 0x62, 0x8b, 0x80, 0xdc, 0x1c, 0xd1, 0x29, 0x02, 0x4e, 0x08, 0x8a, 0x67, 0xcc, 0x74,
+  0x02, 0x0b, 0xbe, 0xa6, 0x3b, 0x13, 0x9b, 0x22, 0x51, 0x4a, 0x08, 0x79, 0x8e, 0x34, 0x04, 0xdd,
+  0xef, 0x95, 0x19, 0xb3, 0xcd, 0x3a, 0x43, 0x1b, 0x30, 0x2b, 0x0a, 0x6d, 0xf2, 0x5f, 0x14, 0x37,
+  0x4f, 0xe1, 0x35, 0x6d, 0x6d, 0x51, 0xc2, 0x45, 0xe4, 0x85, 0xb5, 0x76, 0x62, 0x5e, 0x7e, 0xc6,
+  0xf4, 0x4c, 0x42, 0xe9, 0xa6, 0x37, 0xed, 0x6b, 0x0b, 0xff, 0x5c, 0xb6, 0xf4, 0x06, 0xb7, 0xed,
+  0xee, 0x38, 0x6b, 0xfb, 0x5a, 0x89, 0x9f, 0xa5, 0xae, 0x9f, 0x24, 0x11, 0x7c, 0x4b, 0x1f, 0xe6,
+  0x49, 0x28, 0x66, 0x51, 0xec, 0xe4, 0x5b, 0x3d, 0xc2, 0x00, 0x7c, 0xb8, 0xa1, 0x63, 0xbf, 0x05,
+  0x98, 0xda, 0x48, 0x36, 0x1c, 0x55, 0xd3, 0x9a, 0x69, 0x16, 0x3f, 0xa8, 0xfd, 0x24, 0xcf, 0x5f,
+  0x83, 0x65, 0x5d, 0x23, 0xdc, 0xa3, 0xad, 0x96, 0x1c, 0x62, 0xf3, 0x56, 0x20, 0x85, 0x52, 0xbb,
+  0x9e, 0xd5, 0x29, 0x07, 0x70, 0x96, 0x96, 0x6d, 0x67, 0x0c, 0x35, 0x4e, 0x4a, 0xbc, 0x98, 0x04,
+  0xf1, 0x74, 0x6c, 0x08, 0xca, 0x18, 0x21, 0x7c, 0x32, 0x90, 0x5e, 0x46, 0x2e, 0x36, 0xce, 0x3b,
+  0xe3, 0x9e, 0x77, 0x2c, 0x18, 0x0e, 0x86, 0x03, 0x9b, 0x27, 0x83, 0xa2, 0xec, 0x07, 0xa2, 0x8f,
+  0xb5, 0xc5, 0x5d, 0xf0, 0x6f, 0x4c, 0x52, 0xc9, 0xde, 0x2b, 0xcb, 0xf6, 0x95, 0x58, 0x17, 0x18,
+  0x39, 0x95, 0x49, 0x7c, 0xea, 0x95, 0x6a, 0xe5, 0x15, 0xd2, 0x26, 0x18, 0x98, 0xfa, 0x05, 0x10,
+  0x15, 0x72, 0x8e, 0x5a, 0x8a, 0xaa, 0xc4, 0x2d, 0xad, 0x33, 0x17, 0x0d, 0x04, 0x50, 0x7a, 0x33,
+  0xa8, 0x55, 0x21, 0xab, 0xdf, 0x1c, 0xba, 0x64, 0xec, 0xfb, 0x85, 0x04, 0x58, 0xdb, 0xef, 0x0a,
+  0x8a, 0xea, 0x71, 0x57, 0x5d, 0x06, 0x0c, 0x7d, 0xb3, 0x97, 0x0f, 0x85, 0xa6, 0xe1, 0xe4, 0xc7,
+  0xab, 0xf5, 0xae, 0x8c, 0xdb, 0x09, 0x33, 0xd7, 0x1e, 0x8c, 0x94, 0xe0, 0x4a, 0x25, 0x61, 0x9d,
+  0xce, 0xe3, 0xd2, 0x26, 0x1a, 0xd2, 0xee, 0x6b, 0xf1, 0x2f, 0xfa, 0x06, 0xd9, 0x8a, 0x08, 0x64,
+  0xd8, 0x76, 0x02, 0x73, 0x3e, 0xc8, 0x6a, 0x64, 0x52, 0x1f, 0x2b, 0x18, 0x17, 0x7b, 0x20, 0x0c,
+  0xbb, 0xe1, 0x17, 0x57, 0x7a, 0x61, 0x5d, 0x6c, 0x77, 0x09, 0x88, 0xc0, 0xba, 0xd9, 0x46, 0xe2,
+  0x08, 0xe2, 0x4f, 0xa0, 0x74, 0xe5, 0xab, 0x31, 0x43, 0xdb, 0x5b, 0xfc, 0xe0, 0xfd, 0x10, 0x8e,
+  0x4b, 0x82, 0xd1, 0x20, 0xa9, 0x3a, 0xd2, 0xca, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static const uint8_t _hks_srp_g = 5;
+
+void hks_srp_start(
+  hks_srp_t *srp,
+  const char *username,
+  const char *password,
+  const uint8_t salt[HKS_SRP_SALT_LENGTH],
+  const uint8_t secret[HKS_SRP_SECRET_LENGTH]
+)
+{
+  memcpy( srp->salt, salt, HKS_SRP_SALT_LENGTH );
+  memcpy( srp->secret, secret, HKS_SRP_SECRET_LENGTH );
+  hks_sha512( username, strlen( username ), srp->username_hash );
+
+  hks_bn_t *k = &srp->t[0];
+  hks_bn_t *g = &srp->t[1];
+  hks_bn_from_bytes( k, _hks_srp_n, sizeof( _hks_srp_n ) );
+  hks_bn_mont_init( &srp->mont, k );
+  hks_bn_from_bytes( g, &_hks_srp_g, 1 );
+
+  // x = H(s | H(I ":" P)), v = g^x
+  hks_sha512_t sha;
+  uint8_t digest[HKS_SHA512_LENGTH];
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, username, strlen( username ) );
+  hks_sha512_update( &sha, ":", 1 );
+  hks_sha512_update( &sha, password, strlen( password ) );
+  hks_sha512_finish( &sha, digest );
+
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, salt, HKS_SRP_SALT_LENGTH );
+  hks_sha512_update( &sha, digest, sizeof( digest ) );
+  hks_sha512_finish( &sha, digest );
+
+  hks_bn_mod_exp( &srp->mont, &srp->v, g, digest, sizeof( digest ) );
+
+  // k = H(N | PAD(g)), B = k v + g^b
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, _hks_srp_n, sizeof( _hks_srp_n ) );
+  _hks_srp_hash_padded( &sha, g );
+  hks_sha512_finish( &sha, digest );
+
+  hks_bn_from_bytes( k, digest, sizeof( digest ) );
+  hks_bn_mod_mul( &srp->mont, k, k, &srp->v );
+  hks_bn_mod_exp( &srp->mont, g, g, secret, HKS_SRP_SECRET_LENGTH );
+  hks_bn_mod_add( &srp->mont, k, k, g );
+  hks_bn_to_bytes( k, srp->public_key );
+}
+
+esp_err_t hks_srp_verify(
+  hks_srp_t *srp,
+  const uint8_t *public_key,
+  size_t public_key_len,
+  const uint8_t proof[HKS_SRP_PROOF_LENGTH]
+)
+{
+  if ( public_key_len > HKS_SRP_PUBLIC_LENGTH )
+    return ESP_FAIL;
+
+  // A mod N must not be 0
+  hks_bn_t *a = &srp->t[0];
+  hks_bn_t *s = &srp->t[1];
+  hks_bn_from_bytes( a, public_key, public_key_len );
+  hks_bn_mod( &srp->mont, a, a );
+  if ( hks_bn_is_zero( a ) )
+    return ESP_FAIL;
+
+  // u = H(PAD(A) | PAD(B))
+  hks_sha512_t sha;
+  uint8_t digest[HKS_SHA512_LENGTH];
+  hks_sha512_init( &sha );
+  _hks_srp_hash_padded( &sha, a );
+  hks_sha512_update( &sha, srp->public_key, HKS_SRP_PUBLIC_LENGTH );
+  hks_sha512_finish( &sha, digest );
+
+  // S = (A v^u)^b, v is not needed after this
+  hks_bn_mod_exp( &srp->mont, &srp->v, &srp->v, digest, sizeof( digest ) );
+  hks_bn_mod_mul( &srp->mont, &srp->v, &srp->v, a );
+  hks_bn_mod_exp( &srp->mont, s, &srp->v, srp->secret, HKS_SRP_SECRET_LENGTH );
+
+  hks_sha512_init( &sha );
+  _hks_srp_hash_padded( &sha, s );
+  hks_sha512_finish( &sha, srp->key );
+
+  // M1 = H(H(N) xor H(g) | H(I) | s | A | B | K)
+  uint8_t hn[HKS_SHA512_LENGTH];
+  hks_sha512( _hks_srp_n, sizeof( _hks_srp_n ), hn );
+  hks_sha512( &_hks_srp_g, 1, digest );
+  for ( int i = 0; i < HKS_SHA512_LENGTH; i++ )
+    hn[i] ^= digest[i];
+
+  hks_sha512_init( &sha );
+  hks_sha512_update( &sha, hn, sizeof( hn ) );
+  hks_sha512_update( &sha, srp->username_hash, HKS_SHA512_LENGTH );
+  hks_sha512_update( &sha, srp->salt, HKS_SRP_SALT_LENGTH );
+  _hks_srp_hash_padded( &sha, a );
+  hks_sha512_update( &sha, srp->public_key, HKS_SRP_PUBLIC_LENGTH );
+  hks_sha512_update( &sha, srp->key, HKS_SRP_KEY_LENGTH );
+  hks_sha512_finish( &sha, digest );
+
+  if ( !hks_crypto_equal( digest, proof, HKS_SRP_PROOF_LENGTH ) )
+    return ESP_FAIL;
+
+  // M2 = H(A | M1 | K)
+  hks_sha512_init( &sha );
+  _hks_srp_hash_padded( &sha, a );
+  hks_sha512_update( &sha, digest, sizeof( digest ) );
+  hks_sha512_update( &sha, srp->key, HKS_SRP_KEY_LENGTH );
+  hks_sha512_finish( &sha, srp->proof );
+
+  return ESP_OK;
+}
+
+void _hks_srp_hash_padded( hks_sha512_t *sha, const hks_bn_t *a )
+{
+  // big endian a limb at a time, no 384 byte buffer on the stack
+  uint8_t word[4];
+  for ( int i = HKS_BN_LIMBS - 1; i >= 0; i-- )
+  {
+    word[0] = a->v[i] >> 24;
+    word[1] = a->v[i] >> 16;
+    word[2] = a->v[i] >> 8;
+    word[3] = a->v[i];
+    hks_sha512_update( sha, word, sizeof( word ) );
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "hks_bignum.h"
+#include "hks_crypto.h"
+
+#define HKS_SRP_SALT_LENGTH    16
+#define HKS_SRP_SECRET_LENGTH  32 // b
+#define HKS_SRP_PUBLIC_LENGTH  HKS_BN_BYTES
+#define HKS_SRP_PROOF_LENGTH   HKS_SHA512_LENGTH
+#define HKS_SRP_KEY_LENGTH     HKS_SHA512_LENGTH
+
+// Server side of SRP-6a as HAP pair-setup uses it: the 3072-bit group of
+// RFC 5054 with g = 5, SHA-512 throughout, K = H(S) over the padded S and
+// the M1/M2 proofs of RFC 2945. Both steps are modular exponentiations that
+// take seconds on the device, nothing in here touches a socket.
+struct hks_srp_s {
+  hks_bn_mont_t mont;
+  hks_bn_t v;
+  hks_bn_t t[2];
+  uint8_t salt[HKS_SRP_SALT_LENGTH];
+  uint8_t secret[HKS_SRP_SECRET_LENGTH];
+  uint8_t username_hash[HKS_SHA512_LENGTH];
+  uint8_t public_key[HKS_SRP_PUBLIC_LENGTH]; // B
+  uint8_t key[HKS_SRP_KEY_LENGTH];           // K, once verified
+  uint8_t proof[HKS_SRP_PROOF_LENGTH];       // M2, once verified
+};
+typedef struct hks_srp_s hks_srp_t;
+
+// the verifier for `username`:`password` and B from the random `secret`
+extern void hks_srp_start(
+  hks_srp_t *srp,
+  const char *username,
+  const char *password,
+  const uint8_t salt[HKS_SRP_SALT_LENGTH],
+  const uint8_t secret[HKS_SRP_SECRET_LENGTH]
+);
+
+// the shared key from the client's A, ESP_FAIL for an invalid A or when the
+// client's proof M1 shows it used another password
+extern esp_err_t hks_srp_verify(
+  hks_srp_t *srp,
+  const uint8_t *public_key,
+  size_t public_key_len,
+  const uint8_t proof[HKS_SRP_PROOF_LENGTH]
+);
@@ -0,0 +1,145 @@
+#include "hks_stats.h"
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const char *_hks_stats_stage_names[HKS_STATS_STAGES] = {
+  "accept", "parse", "handler", "encrypt", "write"
+};
+
+static void _hks_stats_begin( hks_stats_t *s );
+static void _hks_stats_end( hks_stats_t *s );
+static void _hks_stats_histogram_json( hks_json_writer_t *w, const hks_stats_histogram_t *h );
+
+void hks_stats_init( hks_stats_t *s )
+{
+  memset( s, 0, sizeof( hks_stats_t ) );
+}
+
+void hks_stats_record( hks_stats_t *s, hks_stats_stage_t stage, uint32_t us )
+{
+  uint32_t bucket = us == 0 ? 0 : 32 - __builtin_clz( us );
+  if ( bucket >= HKS_STATS_BUCKETS )
+    bucket = HKS_STATS_BUCKETS - 1;
+
+  hks_stats_histogram_t *h = &s->stages[stage];
+  _hks_stats_begin( s );
+  h->count++;
+  h->sum_us += us;
+  if ( us > h->max_us )
+    h->max_us = us;
+  h->buckets[bucket]++;
+  _hks_stats_end( s );
+}
+
+void hks_stats_wakeup( hks_stats_t *s )
+{
+  _hks_stats_begin( s );
+  s->wakeups++;
+  _hks_stats_end( s );
+}
+
+void hks_stats_client_open( hks_stats_t *s, uint8_t slot )
+{
+  _hks_stats_begin( s );
+  memset( &s->clients[slot], 0, sizeof( hks_stats_client_t ) );
+  _hks_stats_end( s );
+}
+
+void hks_stats_bytes( hks_stats_t *s, uint8_t slot, size_t in, size_t out )
+{
+  _hks_stats_begin( s );
+  s->bytes_in += in;
+  s->bytes_out += out;
+  s->clients[slot].bytes_in += in;
+  s->clients[slot].bytes_out += out;
+  _hks_stats_end( s );
+}
+
+void hks_stats_snapshot( const hks_stats_t *s, hks_stats_t *out )
+{
+  for (;;)
+  {
+    uint32_t seq = __atomic_load_n( &s->seq, __ATOMIC_ACQUIRE );
+    if ( seq & 1 )
+    {
+      // the loop may be on this core below us, let it finish
+      vTaskDelay( 1 );
+      continue;
+    }
+
+    memcpy( out, s, sizeof( hks_stats_t ) );
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    if ( __atomic_load_n( &s->seq, __ATOMIC_RELAXED ) == seq )
+      return;
+  }
+}
+
+void hks_stats_json( hks_json_writer_t *w, const hks_stats_t *s, uint32_t clients )
+{
+  hks_json_literal( w, "{\"wakeups\":" );
+  hks_json_uint( w, s->wakeups );
+  hks_json_literal( w, ",\"bytes_in\":" );
+  hks_json_uint( w, s->bytes_in );
+  hks_json_literal( w, ",\"bytes_out\":" );
+  hks_json_uint( w, s->bytes_out );
+
+  for ( int stage = 0; stage < HKS_STATS_STAGES; stage++ )
+  {
+    hks_json_raw( w, ",", 1 );
+    hks_json_key( w, _hks_stats_stage_names[stage] );
+    _hks_stats_histogram_json( w, &s->stages[stage] );
+  }
+
+  hks_json_literal( w, ",\"clients\":[" );
+  for ( uint32_t m = clients, first = 1; m; m &= m - 1, first = 0 )
+  {
+    uint8_t slot = __builtin_ctz( m );
+    if ( !first )
+      hks_json_raw( w, ",", 1 );
+
+    hks_json_literal( w, "{\"slot\":" );
+    hks_json_uint( w, slot );
+    hks_json_literal( w, ",\"bytes_in\":" );
+    hks_json_uint( w, s->clients[slot].bytes_in );
+    hks_json_literal( w, ",\"bytes_out\":" );
+    hks_json_uint( w, s->clients[slot].bytes_out );
+    hks_json_raw( w, "}", 1 );
+  }
+  hks_json_literal( w, "]}" );
+}
+
+const char *hks_stats_stage_name( hks_stats_stage_t stage )
+{
+  return stage < HKS_STATS_STAGES ? _hks_stats_stage_names[stage] : NULL;
+}
+
+void _hks_stats_begin( hks_stats_t *s )
+{
+  // single writer, a plain increment published before the fields change
+  __atomic_store_n( &s->seq, s->seq + 1, __ATOMIC_RELAXED );
+  __atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+void _hks_stats_end( hks_stats_t *s )
+{
+  __atomic_store_n( &s->seq, s->seq + 1, __ATOMIC_RELEASE );
+}
+
+void _hks_stats_histogram_json( hks_json_writer_t *w, const hks_stats_histogram_t *h )
+{
+  hks_json_literal( w, "{\"count\":" );
+  hks_json_uint( w, h->count );
+  hks_json_literal( w, ",\"sum_us\":" );
+  hks_json_uint( w, h->sum_us );
+  hks_json_literal( w, ",\"max_us\":" );
+  hks_json_uint( w, h->max_us );
+  hks_json_literal( w, ",\"buckets\":[" );
+  for ( int i = 0; i < HKS_STATS_BUCKETS; i++ )
+  {
+    if ( i > 0 )
+      hks_json_raw( w, ",", 1 );
+    hks_json_uint( w, h->buckets[i] );
+  }
+  hks_json_literal( w, "]}" );
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sdkconfig.h>
+#include "hks_json.h"
+#include "hks_utils.h"
+
+#define HKS_STATS_BUCKETS  20 // powers of two in microseconds, the last open ended
+#define HKS_STATS_CLIENTS  CONFIG_HKS_MAX_CLIENTS
+
+// stages of a request through the server loop
+typedef enum {
+  HKS_STATS_ACCEPT = 0, // accepting and setting up a connection
+  HKS_STATS_PARSE,      // the pass that completes a request
+  HKS_STATS_HANDLER,    // answering it, up to the queued response
+  HKS_STATS_ENCRYPT,    // opening received frames, sealing sent ones
+  HKS_STATS_WRITE,      // handing responses to the socket
+  HKS_STATS_STAGES,
+} hks_stats_stage_t;
+
+// bucket 0 counts samples under 1us, bucket i those from 2^(i-1) to 2^i us
+struct hks_stats_histogram_s {
+  uint32_t count;
+  uint32_t max_us;
+  uint64_t sum_us;
+  uint32_t buckets[HKS_STATS_BUCKETS];
+};
+typedef struct hks_stats_histogram_s hks_stats_histogram_t;
+
+// by client slot, cleared when the slot takes a new connection
+struct hks_stats_client_s {
+  uint64_t bytes_in;  // read from the socket
+  uint64_t bytes_out; // taken off the send queue, before session framing
+};
+typedef struct hks_stats_client_s hks_stats_client_t;
+
+// Counters of the server loop. The loop is the only writer and never waits:
+// `seq` is odd while it updates, so a reader on another task copies until it
+// sees the same even value before and after (hks_stats_snapshot).
+struct hks_stats_s {
+  uint32_t seq;
+  uint32_t wakeups; // returns from select
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  hks_stats_histogram_t stages[HKS_STATS_STAGES];
+  hks_stats_client_t clients[HKS_STATS_CLIENTS];
+};
+typedef struct hks_stats_s hks_stats_t;
+
+extern void hks_stats_init( hks_stats_t *s );
+
+// a sample of `us` microseconds spent in `stage`
+extern void hks_stats_record( hks_stats_t *s, hks_stats_stage_t stage, uint32_t us );
+extern void hks_stats_wakeup( hks_stats_t *s );
+extern void hks_stats_client_open( hks_stats_t *s, uint8_t slot );
+extern void hks_stats_bytes( hks_stats_t *s, uint8_t slot, size_t in, size_t out );
+
+// a consistent copy, from any task
+extern void hks_stats_snapshot( const hks_stats_t *s, hks_stats_t *out );
+
+// the counters as a JSON object, per client for the slots set in `clients`
+extern void hks_stats_json( hks_json_writer_t *w, const hks_stats_t *s, uint32_t clients );
+
+extern const char *hks_stats_stage_name( hks_stats_stage_t stage );
+
+// For the server loop, timing from HKS_STATS_START to HKS_STATS_RECORD.
+// Nothing is left of these, not even the clock reads, when CONFIG_HKS_STATS
+// is off.
+#if CONFIG_HKS_STATS
+#define HKS_STATS_START( t )                  uint32_t t = hksu_now_us()
+#define HKS_STATS_RECORD( s, stage, t )       hks_stats_record( s, stage, hksu_now_us() - t )
+#define HKS_STATS_WAKEUP( s )                 hks_stats_wakeup( s )
+#define HKS_STATS_CLIENT_OPEN( s, slot )      hks_stats_client_open( s, slot )
+#define HKS_STATS_BYTES( s, slot, in, out )   hks_stats_bytes( s, slot, in, out )
+#else
+#define HKS_STATS_START( t )
+#define HKS_STATS_RECORD( s, stage, t )
+#define HKS_STATS_WAKEUP( s )
+#define HKS_STATS_CLIENT_OPEN( s, slot )
+#define HKS_STATS_BYTES( s, slot, in, out )
+#endif
@@ -0,0 +1,112 @@
+#include "hks_store.h"
+#include <string.h>
+
+static uint32_t _hks_store_crc( const hks_store_image_t *image );
+static void _hks_store_set( hks_store_t *s, void *field, const void *value, size_t len );
+
+esp_err_t hks_store_open( hks_store_t *s, const hks_store_backend_t *backend )
+{
+  memset( s, 0, sizeof( hks_store_t ) );
+  s->backend = *backend;
+
+  // find the newest slot that checks out, then read it again to keep it:
+  // there is only room for one image
+  hks_store_image_t *image = &s->image;
+  uint8_t newest = HKS_STORE_SLOTS;
+  uint32_t generation = 0;
+  for ( uint8_t slot = 0; slot < HKS_STORE_SLOTS; slot++ )
+  {
+    esp_err_t err = s->backend.read( s->backend.ctx, slot, image, sizeof( hks_store_image_t ) );
+    if ( err || image->magic != HKS_STORE_MAGIC || image->crc != _hks_store_crc( image ) )
+      continue;
+
+    if ( newest == HKS_STORE_SLOTS || image->generation > generation )
+    {
+      newest = slot;
+      generation = image->generation;
+    }
+  }
+
+  if ( newest == HKS_STORE_SLOTS ||
+       s->backend.read( s->backend.ctx, newest, image, sizeof( hks_store_image_t ) ) ||
+       image->generation != generation || image->crc != _hks_store_crc( image ) )
+  {
+    memset( image, 0, sizeof( hks_store_image_t ) );
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  s->slot = ( newest + 1 ) % HKS_STORE_SLOTS;
+  return ESP_OK;
+}
+
+void hks_store_close( hks_store_t *s )
+{
+  if ( s->backend.close != NULL )
+    s->backend.close( s->backend.ctx );
+
+  // the long-term key
+  memset( s, 0, sizeof( hks_store_t ) );
+}
+
+void hks_store_set_pairings( hks_store_t *s, const hks_pairings_t *p )
+{
+  _hks_store_set( s, s->image.seed, p->seed, sizeof( p->seed ) );
+  _hks_store_set( s, &s->image.count, &p->count, sizeof( p->count ) );
+  _hks_store_set( s, s->image.pairings, p->pairings, p->count * sizeof( hks_pairing_t ) );
+}
+
+void hks_store_set_configuration( hks_store_t *s, uint32_t configuration, uint32_t digest )
+{
+  _hks_store_set( s, &s->image.configuration, &configuration, sizeof( configuration ) );
+  _hks_store_set( s, &s->image.digest, &digest, sizeof( digest ) );
+}
+
+esp_err_t hks_store_commit( hks_store_t *s )
+{
+  if ( !s->dirty )
+    return ESP_OK;
+
+  // over the older image, which stays valid until the write is complete
+  hks_store_image_t *image = &s->image;
+  image->magic = HKS_STORE_MAGIC;
+  image->generation++;
+  image->crc = _hks_store_crc( image );
+
+  esp_err_t err = s->backend.write( s->backend.ctx, s->slot, image, sizeof( hks_store_image_t ) );
+  if ( err )
+  {
+    // tried again with the next commit, under the same generation
+    image->generation--;
+    return err;
+  }
+
+  s->slot = ( s->slot + 1 ) % HKS_STORE_SLOTS;
+  s->dirty = 0;
+  return ESP_OK;
+}
+
+uint32_t _hks_store_crc( const hks_store_image_t *image )
+{
+  // reflected CRC-32, bit at a time: an image is written seldom and read once
+  const uint8_t *data = (const uint8_t *)image + offsetof( hks_store_image_t, seed );
+  size_t len = sizeof( hks_store_image_t ) - offsetof( hks_store_image_t, seed );
+
+  uint32_t crc = 0xFFFFFFFF;
+  for ( size_t i = 0; i < len; i++ )
+  {
+    crc ^= data[i];
+    for ( int bit = 0; bit < 8; bit++ )
+      crc = ( crc >> 1 ) ^ ( 0xEDB88320 & -( crc & 1 ) );
+  }
+
+  return ~crc;
+}
+
+void _hks_store_set( hks_store_t *s, void *field, const void *value, size_t len )
+{
+  if ( memcmp( field, value, len ) == 0 )
+    return;
+
+  memcpy( field, value, len );
+  s->dirty = 1;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+#include "hks_pairing.h"
+
+#define HKS_STORE_MAGIC         0x31534b48 // "HKS1"
+#define HKS_STORE_SLOTS         2
+#define HKS_STORE_COMMIT_DELAY  CONFIG_HKS_STORE_COMMIT_DELAY_MS
+
+// Where images are kept: HKS_STORE_SLOTS places of one image each. hks_store
+// writes them in turn, so an interrupted write only ever damages the slot
+// that was not the newest.
+struct hks_store_backend_s {
+  // ESP_ERR_NOT_FOUND for a slot never written
+  esp_err_t (*read)( void *ctx, uint8_t slot, void *data, size_t len );
+  // durable once it returns
+  esp_err_t (*write)( void *ctx, uint8_t slot, const void *data, size_t len );
+  void (*close)( void *ctx );
+  void *ctx;
+};
+typedef struct hks_store_backend_s hks_store_backend_t;
+
+// Everything kept across restarts, written whole. The layout follows the
+// build configuration; an image of another size reads as no image at all.
+struct hks_store_image_s {
+  uint32_t magic;
+  uint32_t generation; // the newest valid image wins
+  uint32_t crc;        // CRC-32 of what follows
+
+  uint8_t seed[HKS_ED25519_SEED_LENGTH]; // the accessory's long-term key
+  uint32_t configuration;                // c#, 0 before a database was served
+  uint32_t digest;                       // hks_db_digest it was counted for
+  uint8_t count;
+  hks_pairing_t pairings[HKS_PAIRING_MAX];
+};
+typedef struct hks_store_image_s hks_store_image_t;
+
+// The image as it is to be written, and the slot the next commit goes to.
+// Setters only mark it dirty when something changed; hks_store_commit writes
+// it once for however many changes came before.
+struct hks_store_s {
+  hks_store_backend_t backend;
+  hks_store_image_t image;
+  uint8_t slot;
+  uint8_t dirty;
+};
+typedef struct hks_store_s hks_store_t;
+
+// the newest valid image, ESP_ERR_NOT_FOUND when there is none yet; the
+// store can be written either way
+extern esp_err_t hks_store_open( hks_store_t *s, const hks_store_backend_t *backend );
+extern void hks_store_close( hks_store_t *s );
+
+extern void hks_store_set_pairings( hks_store_t *s, const hks_pairings_t *p );
+extern void hks_store_set_configuration( hks_store_t *s, uint32_t configuration, uint32_t digest );
+
+// write the image if dirty, ESP_OK otherwise
+extern esp_err_t hks_store_commit( hks_store_t *s );
+
+// NVS namespace `name` on the device (hks_store_nvs.c), a memory-mapped file
+// at `name` on the host (host/store.c)
+extern esp_err_t hks_store_nvs_init( hks_store_backend_t *backend, const char *name );
+extern esp_err_t hks_store_file_init( hks_store_backend_t *backend, const char *name );
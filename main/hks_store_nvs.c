@@ -0,0 +1,57 @@
+// hks_store on the device: one NVS blob per slot. Part of the firmware build
+// only, the host build uses host/store.c.
+
+#include "hks_store.h"
+#include <stdio.h>
+#include <nvs.h>
+
+static esp_err_t _hks_store_nvs_read( void *ctx, uint8_t slot, void *data, size_t len );
+static esp_err_t _hks_store_nvs_write( void *ctx, uint8_t slot, const void *data, size_t len );
+static void _hks_store_nvs_close( void *ctx );
+
+esp_err_t hks_store_nvs_init( hks_store_backend_t *backend, const char *name )
+{
+  nvs_handle handle;
+  esp_err_t err = nvs_open( name, NVS_READWRITE, &handle );
+  if ( err )
+    return err;
+
+  backend->read = _hks_store_nvs_read;
+  backend->write = _hks_store_nvs_write;
+  backend->close = _hks_store_nvs_close;
+  backend->ctx = (void *)(uintptr_t)handle;
+  return ESP_OK;
+}
+
+esp_err_t _hks_store_nvs_read( void *ctx, uint8_t slot, void *data, size_t len )
+{
+  char key[8];
+  snprintf( key, sizeof( key ), "image%u", slot );
+
+  size_t stored = len;
+  esp_err_t err = nvs_get_blob( (nvs_handle)(uintptr_t)ctx, key, data, &stored );
+  if ( err == ESP_ERR_NVS_NOT_FOUND )
+    return ESP_ERR_NOT_FOUND;
+  if ( err == ESP_OK && stored != len )
+    return ESP_ERR_INVALID_SIZE;
+
+  return err;
+}
+
+esp_err_t _hks_store_nvs_write( void *ctx, uint8_t slot, const void *data, size_t len )
+{
+  char key[8];
+  snprintf( key, sizeof( key ), "image%u", slot );
+
+  nvs_handle handle = (nvs_handle)(uintptr_t)ctx;
+  esp_err_t err = nvs_set_blob( handle, key, data, len );
+  if ( err )
+    return err;
+
+  return nvs_commit( handle );
+}
+
+void _hks_store_nvs_close( void *ctx )
+{
+  nvs_close( (nvs_handle)(uintptr_t)ctx );
+}
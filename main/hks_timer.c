@@ -0,0 +1,124 @@
+#include "hks_timer.h"
+#include <stddef.h>
+
+#define HKS_TIMER_BEFORE( a, b ) ( (int32_t)( (a) - (b) ) < 0 )
+
+static void _hks_timers_swap( hks_timers_t *timers, uint8_t i, uint8_t j );
+static void _hks_timers_sift_up( hks_timers_t *timers, uint8_t i );
+static void _hks_timers_sift_down( hks_timers_t *timers, uint8_t i );
+
+void hks_timers_init( hks_timers_t *timers, hks_timer_t **heap, uint8_t capacity )
+{
+  timers->heap = heap;
+  timers->capacity = capacity;
+  timers->count = 0;
+}
+
+void hks_timer_init( hks_timer_t *timer, hks_timer_cb_t cb, void *arg )
+{
+  timer->deadline = 0;
+  timer->index = HKS_TIMER_INDEX_NONE;
+  timer->cb = cb;
+  timer->arg = arg;
+}
+
+esp_err_t hks_timer_start( hks_timers_t *timers, hks_timer_t *timer, uint32_t deadline )
+{
+  if ( hks_timer_armed( timer ) )
+  {
+    uint32_t previous = timer->deadline;
+    timer->deadline = deadline;
+    if ( HKS_TIMER_BEFORE( deadline, previous ) )
+      _hks_timers_sift_up( timers, timer->index );
+    else
+      _hks_timers_sift_down( timers, timer->index );
+    return ESP_OK;
+  }
+
+  if ( timers->count == timers->capacity )
+    return ESP_ERR_NO_MEM;
+
+  timer->deadline = deadline;
+  timer->index = timers->count++;
+  timers->heap[timer->index] = timer;
+  _hks_timers_sift_up( timers, timer->index );
+
+  return ESP_OK;
+}
+
+void hks_timer_stop( hks_timers_t *timers, hks_timer_t *timer )
+{
+  if ( !hks_timer_armed( timer ) )
+    return;
+
+  uint8_t i = timer->index;
+  uint8_t last = --timers->count;
+  if ( i != last )
+  {
+    _hks_timers_swap( timers, i, last );
+    _hks_timers_sift_down( timers, i );
+    _hks_timers_sift_up( timers, i );
+  }
+
+  timer->index = HKS_TIMER_INDEX_NONE;
+}
+
+int32_t hks_timers_next( const hks_timers_t *timers, uint32_t now )
+{
+  if ( timers->count == 0 )
+    return -1;
+
+  int32_t remaining = (int32_t)( timers->heap[0]->deadline - now );
+  return remaining > 0 ? remaining : 0;
+}
+
+void hks_timers_run( hks_timers_t *timers, uint32_t now, void *ctx )
+{
+  while ( timers->count > 0 && !HKS_TIMER_BEFORE( now, timers->heap[0]->deadline ) )
+  {
+    hks_timer_t *timer = timers->heap[0];
+    hks_timer_stop( timers, timer );
+    timer->cb( timer, now, ctx );
+  }
+}
+
+void _hks_timers_swap( hks_timers_t *timers, uint8_t i, uint8_t j )
+{
+  hks_timer_t *t = timers->heap[i];
+  timers->heap[i] = timers->heap[j];
+  timers->heap[j] = t;
+  timers->heap[i]->index = i;
+  timers->heap[j]->index = j;
+}
+
+void _hks_timers_sift_up( hks_timers_t *timers, uint8_t i )
+{
+  while ( i > 0 )
+  {
+    uint8_t parent = ( i - 1 ) / 2;
+    if ( !HKS_TIMER_BEFORE( timers->heap[i]->deadline, timers->heap[parent]->deadline ) )
+      break;
+    _hks_timers_swap( timers, i, parent );
+    i = parent;
+  }
+}
+
+void _hks_timers_sift_down( hks_timers_t *timers, uint8_t i )
+{
+  for (;;)
+  {
+    uint8_t smallest = i;
+    uint8_t left = 2 * i + 1;
+    uint8_t right = left + 1;
+
+    if ( left < timers->count && HKS_TIMER_BEFORE( timers->heap[left]->deadline, timers->heap[smallest]->deadline ) )
+      smallest = left;
+    if ( right < timers->count && HKS_TIMER_BEFORE( timers->heap[right]->deadline, timers->heap[smallest]->deadline ) )
+      smallest = right;
+    if ( smallest == i )
+      break;
+
+    _hks_timers_swap( timers, i, smallest );
+    i = smallest;
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+
+#define HKS_TIMER_INDEX_NONE 0xFF
+
+struct hks_timer_s;
+typedef void (*hks_timer_cb_t)( struct hks_timer_s *timer, uint32_t now, void *ctx );
+
+// Intrusive timer, embed it in the object it belongs to.
+struct hks_timer_s {
+  uint32_t deadline;  // ms, compared modulo 2^32
+  uint8_t index;      // position in the heap or HKS_TIMER_INDEX_NONE
+  hks_timer_cb_t cb;
+  void *arg;
+};
+typedef struct hks_timer_s hks_timer_t;
+
+// Fixed-capacity min-heap of armed timers. Time is always passed in so the
+// heap can be driven by any clock.
+struct hks_timers_s {
+  hks_timer_t **heap;
+  uint8_t capacity;
+  uint8_t count;
+};
+typedef struct hks_timers_s hks_timers_t;
+
+extern void hks_timers_init( hks_timers_t *timers, hks_timer_t **heap, uint8_t capacity );
+
+extern void hks_timer_init( hks_timer_t *timer, hks_timer_cb_t cb, void *arg );
+extern esp_err_t hks_timer_start( hks_timers_t *timers, hks_timer_t *timer, uint32_t deadline );
+extern void hks_timer_stop( hks_timers_t *timers, hks_timer_t *timer );
+
+static inline int hks_timer_armed( const hks_timer_t *timer )
+{
+  return timer->index != HKS_TIMER_INDEX_NONE;
+}
+
+// milliseconds until the nearest deadline (0 if overdue), -1 if none is armed
+extern int32_t hks_timers_next( const hks_timers_t *timers, uint32_t now );
+
+// fire every expired timer; callbacks may re-arm or stop any timer
+extern void hks_timers_run( hks_timers_t *timers, uint32_t now, void *ctx );
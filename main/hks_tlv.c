@@ -0,0 +1,91 @@
+#include "hks_tlv.h"
+#include <string.h>
+
+static void _hks_tlv_raw( hks_tlv_writer_t *w, const void *data, size_t len );
+
+esp_err_t hks_tlv_decode( uint8_t *data, size_t len, hks_tlv_items_t *items )
+{
+  size_t pos = 0;
+  items->count = 0;
+
+  while ( pos < len )
+  {
+    if ( len - pos < 2 || len - pos - 2 < data[pos + 1] )
+      return ESP_ERR_INVALID_SIZE;
+    if ( items->count == HKS_TLV_MAX_ITEMS )
+      return ESP_ERR_INVALID_SIZE;
+
+    hks_tlv_item_t *item = &items->items[items->count++];
+    item->type = data[pos];
+    item->len = data[pos + 1];
+    item->value = data + pos + 2;
+    pos += 2 + item->len;
+
+    // a full fragment continues into the next item of the same type
+    size_t last = item->len;
+    while ( last == HKS_TLV_FRAGMENT_LENGTH && len - pos >= 2 && data[pos] == item->type )
+    {
+      last = data[pos + 1];
+      if ( len - pos - 2 < last )
+        return ESP_ERR_INVALID_SIZE;
+
+      memmove( item->value + item->len, data + pos + 2, last );
+      item->len += last;
+      pos += 2 + last;
+    }
+  }
+
+  return ESP_OK;
+}
+
+const hks_tlv_item_t *hks_tlv_get( const hks_tlv_items_t *items, uint8_t type )
+{
+  for ( uint8_t i = 0; i < items->count; i++ )
+  {
+    if ( items->items[i].type == type )
+      return &items->items[i];
+  }
+  return NULL;
+}
+
+int hks_tlv_get_byte( const hks_tlv_items_t *items, uint8_t type, uint8_t *v )
+{
+  const hks_tlv_item_t *item = hks_tlv_get( items, type );
+  if ( item == NULL || item->len != 1 )
+    return 0;
+
+  *v = item->value[0];
+  return 1;
+}
+
+void hks_tlv_writer_init( hks_tlv_writer_t *w, uint8_t *data, size_t capacity )
+{
+  w->data = data;
+  w->capacity = data ? capacity : 0;
+  w->len = 0;
+}
+
+void hks_tlv_put( hks_tlv_writer_t *w, uint8_t type, const void *value, size_t len )
+{
+  const uint8_t *p = (const uint8_t *)value;
+  do
+  {
+    uint8_t header[2] = { type, len > HKS_TLV_FRAGMENT_LENGTH ? HKS_TLV_FRAGMENT_LENGTH : (uint8_t)len };
+    _hks_tlv_raw( w, header, 2 );
+    _hks_tlv_raw( w, p, header[1] );
+    p += header[1];
+    len -= header[1];
+  } while ( len > 0 );
+}
+
+void hks_tlv_put_byte( hks_tlv_writer_t *w, uint8_t type, uint8_t v )
+{
+  hks_tlv_put( w, type, &v, 1 );
+}
+
+void _hks_tlv_raw( hks_tlv_writer_t *w, const void *data, size_t len )
+{
+  if ( len > 0 && w->len + len <= w->capacity )
+    memcpy( w->data + w->len, data, len );
+  w->len += len;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// TLV8 as the pairing endpoints speak it: a type byte, a length byte and up
+// to 255 bytes of value. Longer values are sent as consecutive fragments of
+// the same type.
+
+typedef enum {
+  HKS_TLV_METHOD          = 0x00,
+  HKS_TLV_IDENTIFIER      = 0x01,
+  HKS_TLV_SALT            = 0x02,
+  HKS_TLV_PUBLIC_KEY      = 0x03,
+  HKS_TLV_PROOF           = 0x04,
+  HKS_TLV_ENCRYPTED_DATA  = 0x05,
+  HKS_TLV_STATE           = 0x06,
+  HKS_TLV_ERROR           = 0x07,
+  HKS_TLV_RETRY_DELAY     = 0x08,
+  HKS_TLV_CERTIFICATE     = 0x09,
+  HKS_TLV_SIGNATURE       = 0x0a,
+  HKS_TLV_PERMISSIONS     = 0x0b,
+  HKS_TLV_FRAGMENT_DATA   = 0x0c,
+  HKS_TLV_FRAGMENT_LAST   = 0x0d,
+  HKS_TLV_SESSION_ID      = 0x0e,
+  HKS_TLV_FLAGS           = 0x13,
+  HKS_TLV_SEPARATOR       = 0xff,
+} hks_tlv_type_t;
+
+typedef enum {
+  HKS_TLV_ERROR_UNKNOWN         = 0x01,
+  HKS_TLV_ERROR_AUTHENTICATION  = 0x02,
+  HKS_TLV_ERROR_BACKOFF         = 0x03,
+  HKS_TLV_ERROR_MAX_PEERS       = 0x04,
+  HKS_TLV_ERROR_MAX_TRIES       = 0x05,
+  HKS_TLV_ERROR_UNAVAILABLE     = 0x06,
+  HKS_TLV_ERROR_BUSY            = 0x07,
+} hks_tlv_error_t;
+
+#define HKS_TLV_FRAGMENT_LENGTH  255
+#define HKS_TLV_MAX_ITEMS        8   // a pairing message has no more
+
+struct hks_tlv_item_s {
+  uint8_t type;
+  uint8_t *value;
+  size_t len;
+};
+typedef struct hks_tlv_item_s hks_tlv_item_t;
+
+struct hks_tlv_items_s {
+  hks_tlv_item_t items[HKS_TLV_MAX_ITEMS];
+  uint8_t count;
+};
+typedef struct hks_tlv_items_s hks_tlv_items_t;
+
+// Split a received body into its items. Fragments are joined in place: each
+// one's value is moved down over the header in front of it, so a 384 byte
+// SRP public key comes out contiguous inside `data` and nothing is copied
+// into another buffer. `data` is rewritten and cannot be decoded again.
+// ESP_ERR_INVALID_SIZE for a truncated item or more than HKS_TLV_MAX_ITEMS.
+extern esp_err_t hks_tlv_decode( uint8_t *data, size_t len, hks_tlv_items_t *items );
+
+// first item of `type`, NULL if there is none
+extern const hks_tlv_item_t *hks_tlv_get( const hks_tlv_items_t *items, uint8_t type );
+
+// 1 with the value of a one byte item
+extern int hks_tlv_get_byte( const hks_tlv_items_t *items, uint8_t type, uint8_t *v );
+
+// Append-only writer over a caller supplied buffer with the semantics of the
+// JSON writer: output past the capacity is counted but not stored.
+struct hks_tlv_writer_s {
+  uint8_t *data;
+  size_t capacity;
+  size_t len;
+};
+typedef struct hks_tlv_writer_s hks_tlv_writer_t;
+
+extern void hks_tlv_writer_init( hks_tlv_writer_t *w, uint8_t *data, size_t capacity );
+
+static inline int hks_tlv_overflow( const hks_tlv_writer_t *w )
+{
+  return w->len > w->capacity;
+}
+
+// fragmented as needed, an empty value is a single empty item
+extern void hks_tlv_put( hks_tlv_writer_t *w, uint8_t type, const void *value, size_t len );
+extern void hks_tlv_put_byte( hks_tlv_writer_t *w, uint8_t type, uint8_t v );
+
+// bytes `len` of value take on the wire
+static inline size_t hks_tlv_length( size_t len )
+{
+  return len + 2 * ( len == 0 ? 1 : ( len + HKS_TLV_FRAGMENT_LENGTH - 1 ) / HKS_TLV_FRAGMENT_LENGTH );
+}
@@ -0,0 +1,107 @@
+#include "hks_trace.h"
+#include <stdio.h>
+#include <string.h>
+
+// the paths a request token is looked up in, anything else prints as a hash
+static const char *_hks_trace_paths[] = {
+  "/accessories", "/characteristics", "/identify", "/pair-setup", "/pair-verify",
+  "/pairings", "/prepare", "/resource", "/stats"
+};
+
+// level letter of each event
+static const char _hks_trace_levels[HKS_TRACE_EVENTS] = {
+  [HKS_TRACE_ACCEPT] = 'I',
+  [HKS_TRACE_REFUSE] = 'W',
+  [HKS_TRACE_REQUEST] = 'I',
+  [HKS_TRACE_IDLE] = 'I',
+  [HKS_TRACE_CLOSE] = 'D',
+  [HKS_TRACE_EVICT] = 'W',
+};
+
+void hks_trace_init( hks_trace_t *t )
+{
+  memset( t, 0, sizeof( hks_trace_t ) );
+}
+
+size_t hks_trace_read( const hks_trace_t *t, uint32_t *cursor, hks_trace_record_t *records, size_t max, uint32_t *dropped )
+{
+  uint32_t head = __atomic_load_n( &t->head, __ATOMIC_ACQUIRE );
+  if ( head - *cursor > HKS_TRACE_RECORDS )
+  {
+    *dropped += head - *cursor - HKS_TRACE_RECORDS;
+    *cursor = head - HKS_TRACE_RECORDS;
+  }
+
+  size_t n = 0;
+  while ( n < max && *cursor != head )
+  {
+    const hks_trace_record_t *r = &t->records[*cursor & ( HKS_TRACE_RECORDS - 1 )];
+    uint32_t seq = __atomic_load_n( &r->seq, __ATOMIC_ACQUIRE );
+    memcpy( &records[n], r, sizeof( hks_trace_record_t ) );
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+    // lapped by the writer while copying
+    if ( seq != *cursor + 1 || __atomic_load_n( &r->seq, __ATOMIC_RELAXED ) != seq )
+      (*dropped)++;
+    else
+      n++;
+    (*cursor)++;
+  }
+
+  return n;
+}
+
+int hks_trace_format( const hks_trace_record_t *record, char *buf, size_t size )
+{
+  char level = record->event < HKS_TRACE_EVENTS ? _hks_trace_levels[record->event] : 0;
+  int n = snprintf( buf, size, "%c (%u.%06u) ", level ? level : '?',
+    record->time_us / 1000000, record->time_us % 1000000 );
+  if ( n < 0 || (size_t)n >= size )
+    return n;
+
+  buf += n;
+  size -= n;
+  switch ( record->event )
+  {
+    case HKS_TRACE_ACCEPT:
+      return n + snprintf( buf, size, "Accepted new client (%d)", record->fd );
+    case HKS_TRACE_REFUSE:
+      return n + snprintf( buf, size, "Refusing client (%d): %d", record->fd, (int)record->args[0] );
+    case HKS_TRACE_IDLE:
+      return n + snprintf( buf, size, "Closing client (%d) due to timeout", record->fd );
+    case HKS_TRACE_CLOSE:
+      return n + snprintf( buf, size, "Closed client (%d)", record->fd );
+    case HKS_TRACE_EVICT:
+      return n + snprintf( buf, size, "Evicting idle client (%d) for (%d)", record->fd, (int)record->args[0] );
+    case HKS_TRACE_REQUEST:
+    {
+      char method[5] = { 0 };
+      memcpy( method, &record->args[0], 4 );
+      for ( size_t i = 0; i < sizeof( _hks_trace_paths ) / sizeof( _hks_trace_paths[0] ); i++ )
+      {
+        const char *path = _hks_trace_paths[i];
+        if ( hks_trace_token( (const uint8_t *)path, strlen( path ) ) == record->args[1] )
+          return n + snprintf( buf, size, "%s Request: %s (%d)", method, path, record->fd );
+      }
+      return n + snprintf( buf, size, "%s Request: #%08x (%d)", method, record->args[1], record->fd );
+    }
+    default:
+      return n + snprintf( buf, size, "event %u (%d) %08x %08x", record->event, record->fd, record->args[0], record->args[1] );
+  }
+}
+
+uint32_t hks_trace_pack( const uint8_t *s, size_t len )
+{
+  uint32_t v = 0;
+  memcpy( &v, s, len < sizeof( v ) ? len : sizeof( v ) );
+  return v;
+}
+
+uint32_t hks_trace_token( const uint8_t *s, size_t len )
+{
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  for ( size_t i = 0; i < len; i++ )
+    h = ( h ^ s[i] ) * 16777619u;
+  return h;
+}
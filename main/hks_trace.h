@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sdkconfig.h>
+#include "hks_utils.h"
+
+#define HKS_TRACE_LEVEL_NONE   0
+#define HKS_TRACE_LEVEL_ERROR  1
+#define HKS_TRACE_LEVEL_WARN   2
+#define HKS_TRACE_LEVEL_INFO   3
+#define HKS_TRACE_LEVEL_DEBUG  4
+
+#define HKS_TRACE_LEVEL    CONFIG_HKS_TRACE_LEVEL
+#define HKS_TRACE_RECORDS  CONFIG_HKS_TRACE_RECORDS
+#define HKS_TRACE_MAGIC    0x31544b48 // "HKT1", starts a dump of records
+
+#if HKS_TRACE_RECORDS & ( HKS_TRACE_RECORDS - 1 )
+#error "CONFIG_HKS_TRACE_RECORDS must be a power of two"
+#endif
+
+// what the two arguments of each event hold
+typedef enum {
+  HKS_TRACE_ACCEPT = 1, // -
+  HKS_TRACE_REFUSE,     // esp_err_t
+  HKS_TRACE_REQUEST,    // hks_trace_pack( method ), hks_trace_token( path )
+  HKS_TRACE_IDLE,       // -
+  HKS_TRACE_CLOSE,      // -
+  HKS_TRACE_EVICT,      // fd of the client let in instead
+  HKS_TRACE_EVENTS,
+} hks_trace_event_t;
+
+struct hks_trace_record_s {
+  uint32_t seq;     // position in the ring + 1 once written, 0 while it is
+  uint32_t time_us; // hksu_now_us()
+  uint16_t event;
+  int16_t fd;
+  uint32_t args[2];
+};
+typedef struct hks_trace_record_s hks_trace_record_t;
+
+// Fixed-size records in a ring that overwrites the oldest, for events of
+// the server loop that used to be printed as they happened. The loop is
+// the only writer and never waits; readers on other tasks keep their own
+// cursor and format what they read whenever they like (hks_trace_format).
+struct hks_trace_s {
+  uint32_t head; // records ever written
+  hks_trace_record_t records[HKS_TRACE_RECORDS];
+};
+typedef struct hks_trace_s hks_trace_t;
+
+extern void hks_trace_init( hks_trace_t *t );
+
+static inline void hks_trace_write( hks_trace_t *t, hks_trace_event_t event, int fd, uint32_t a, uint32_t b )
+{
+  uint32_t head = t->head;
+  hks_trace_record_t *r = &t->records[head & ( HKS_TRACE_RECORDS - 1 )];
+
+  // a reader copying the record it replaces sees it change
+  __atomic_store_n( &r->seq, 0, __ATOMIC_RELAXED );
+  __atomic_thread_fence( __ATOMIC_RELEASE );
+  r->time_us = hksu_now_us();
+  r->event = event;
+  r->fd = fd;
+  r->args[0] = a;
+  r->args[1] = b;
+  __atomic_store_n( &r->seq, head + 1, __ATOMIC_RELEASE );
+  __atomic_store_n( &t->head, head + 1, __ATOMIC_RELEASE );
+}
+
+// Up to `max` records from `*cursor` on, which moves past them. Records
+// overwritten before they were read are added to `*dropped`.
+extern size_t hks_trace_read( const hks_trace_t *t, uint32_t *cursor, hks_trace_record_t *records, size_t max, uint32_t *dropped );
+
+// a line of text like snprintf, without the newline
+extern int hks_trace_format( const hks_trace_record_t *record, char *buf, size_t size );
+
+// up to four bytes as they are, "GET", "POST"
+extern uint32_t hks_trace_pack( const uint8_t *s, size_t len );
+
+// a 32-bit hash hks_trace_format turns back into the paths the server knows
+extern uint32_t hks_trace_token( const uint8_t *s, size_t len );
+
+// Record an event of the level in the name. Events above HKS_TRACE_LEVEL
+// are left out at build time, arguments and all.
+#if HKS_TRACE_LEVEL >= HKS_TRACE_LEVEL_ERROR
+#define HKS_TRACEE( t, event, fd, a, b )  hks_trace_write( t, event, fd, a, b )
+#else
+#define HKS_TRACEE( t, event, fd, a, b )
+#endif
+
+#if HKS_TRACE_LEVEL >= HKS_TRACE_LEVEL_WARN
+#define HKS_TRACEW( t, event, fd, a, b )  hks_trace_write( t, event, fd, a, b )
+#else
+#define HKS_TRACEW( t, event, fd, a, b )
+#endif
+
+#if HKS_TRACE_LEVEL >= HKS_TRACE_LEVEL_INFO
+#define HKS_TRACEI( t, event, fd, a, b )  hks_trace_write( t, event, fd, a, b )
+#else
+#define HKS_TRACEI( t, event, fd, a, b )
+#endif
+
+#if HKS_TRACE_LEVEL >= HKS_TRACE_LEVEL_DEBUG
+#define HKS_TRACED( t, event, fd, a, b )  hks_trace_write( t, event, fd, a, b )
+#else
+#define HKS_TRACED( t, event, fd, a, b )
+#endif
@@ -1,6 +1,5 @@
 #include "hks_txt.h"
-#include <stdarg.h>
-#include <stdlib.h>
+#include <string.h>
 
 typedef enum {
   HKS_TXT_RECORD_CN, // c#: configuration number
@@ -13,18 +12,39 @@ typedef enum {
   HKS_TXT_RECORD_CI, // ci: category identifier
 } hks_txt_record_key_t;
 
-static esp_err_t hks_txt_set( hks_txt_t *txt, hks_txt_record_key_t key, const char *fmt, ... );
+static const char _hks_txt_keys[HKS_TXT_RECORD_COUNT][2] = {
+  { 'c', '#' },
+  { 'f', 'f' },
+  { 'i', 'd' },
+  { 'm', 'd' },
+  { 'p', 'v' },
+  { 's', '#' },
+  { 's', 'f' },
+  { 'c', 'i' },
+};
+
+static esp_err_t hks_txt_set( hks_txt_t *txt, hks_txt_record_key_t key, const char *value, size_t len );
 static esp_err_t hks_txt_set_feature_flags( hks_txt_t *txt, uint8_t v );
 static esp_err_t hks_txt_set_state_number( hks_txt_t *txt, uint8_t v );
+static size_t _hks_txt_format_uint( char *dst, uint32_t v );
 
 esp_err_t hks_txt_init( hks_txt_t *txt )
 {
+  if ( txt == NULL )
+    return ESP_ERR_INVALID_STATE;
+
+  // start with every record holding just its key
+  uint16_t pos = 0;
   for ( int i = 0; i < HKS_TXT_RECORD_COUNT; i++ )
   {
-    txt->records[i] = malloc( HKS_TXT_RECORD_LENGTH );
-
-    // TODO: to check result and free preceding items
+    txt->offsets[i] = pos;
+    txt->rdata[pos++] = 3;
+    txt->rdata[pos++] = _hks_txt_keys[i][0];
+    txt->rdata[pos++] = _hks_txt_keys[i][1];
+    txt->rdata[pos++] = '=';
   }
+  txt->rdata_len = pos;
+  txt->version = 0;
 
   uint8_t device_id[6] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
 
@@ -40,79 +60,115 @@ esp_err_t hks_txt_init( hks_txt_t *txt )
   return ESP_OK;
 }
 
-void hks_txt_free( hks_txt_t *txt )
+const uint8_t *hks_txt_get_rdata( const hks_txt_t *txt, uint16_t *len )
 {
-  for ( int i = 0; i < HKS_TXT_RECORD_COUNT; i++ )
-  {
-    free( txt->records[i] );
-    txt->records[i] = NULL;
-  }
+  if ( len )
+    *len = txt->rdata_len;
+  return txt->rdata;
 }
 
-const char **hks_txt_get_records( hks_txt_t *txt, uint8_t *count )
-{
-  if ( count )
-    *count = HKS_TXT_RECORD_COUNT;
-  return (const char **)txt->records;
-}
-
-esp_err_t hks_txt_set( hks_txt_t *txt, hks_txt_record_key_t key, const char *fmt, ... )
+esp_err_t hks_txt_set( hks_txt_t *txt, hks_txt_record_key_t key, const char *value, size_t len )
 {
   if ( txt == NULL )
     return ESP_ERR_INVALID_STATE;
 
-  va_list ap;
-  va_start( ap, fmt );
-  int n = vsnprintf( txt->records[key], HKS_TXT_RECORD_LENGTH, fmt, ap );
-  va_end( ap );
+  if ( len + 3 > HKS_TXT_RECORD_LENGTH )
+    return ESP_ERR_INVALID_SIZE;
+
+  uint8_t *record = txt->rdata + txt->offsets[key];
+  uint8_t old_len = record[0] - 3;
+  if ( old_len == len && memcmp( record + 4, value, len ) == 0 )
+    return ESP_OK;
 
-  if ( n < 0 )
-    return ESP_FAIL;
+  // only a change in width moves the records that follow
+  if ( old_len != len )
+  {
+    int delta = (int)len - (int)old_len;
+    uint8_t *tail = record + 4 + old_len;
+    memmove( tail + delta, tail, txt->rdata + txt->rdata_len - tail );
+    txt->rdata_len += delta;
+    for ( int i = key + 1; i < HKS_TXT_RECORD_COUNT; i++ )
+      txt->offsets[i] += delta;
+    record[0] = (uint8_t)( len + 3 );
+  }
+
+  memcpy( record + 4, value, len );
+  txt->version++;
 
   return ESP_OK;
 }
 
 esp_err_t hks_txt_set_configuration_number( hks_txt_t *txt, uint32_t v )
 {
-  return hks_txt_set( txt, HKS_TXT_RECORD_CN, "c#=%u", v );
+  char buf[10];
+  return hks_txt_set( txt, HKS_TXT_RECORD_CN, buf, _hks_txt_format_uint( buf, v ) );
 }
 
 esp_err_t hks_txt_set_feature_flags( hks_txt_t *txt, uint8_t v )
 {
-  return hks_txt_set( txt, HKS_TXT_RECORD_FF, "ff=%hhu", v );
+  char buf[3];
+  return hks_txt_set( txt, HKS_TXT_RECORD_FF, buf, _hks_txt_format_uint( buf, v ) );
 }
 
 esp_err_t hks_txt_set_device_id( hks_txt_t *txt, const uint8_t v[6] )
 {
-  return hks_txt_set(
-    txt,
-    HKS_TXT_RECORD_ID,
-    "id=%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx",
-    v[0], v[1], v[2], v[3], v[4], v[5]
-  );
+  static const char hex[] = "0123456789abcdef";
+  char buf[17];
+  char *p = buf;
+  for ( int i = 0; i < 6; i++ )
+  {
+    if ( i > 0 )
+      *p++ = ':';
+    *p++ = hex[v[i] >> 4];
+    *p++ = hex[v[i] & 0x0f];
+  }
+  return hks_txt_set( txt, HKS_TXT_RECORD_ID, buf, sizeof( buf ) );
 }
 
 esp_err_t hks_txt_set_model_name( hks_txt_t *txt, const char *v )
 {
-  return hks_txt_set( txt, HKS_TXT_RECORD_MD, "md=%s", v );
+  return hks_txt_set( txt, HKS_TXT_RECORD_MD, v, strlen( v ) );
 }
 
 esp_err_t hks_txt_set_protocol_version( hks_txt_t *txt, uint16_t major, uint16_t minor )
 {
-  return hks_txt_set( txt, HKS_TXT_RECORD_PV, "pv=%hu.%hu", major, minor );
+  char buf[11];
+  size_t len = _hks_txt_format_uint( buf, major );
+  buf[len++] = '.';
+  len += _hks_txt_format_uint( buf + len, minor );
+  return hks_txt_set( txt, HKS_TXT_RECORD_PV, buf, len );
 }
 
 esp_err_t hks_txt_set_state_number( hks_txt_t *txt, uint8_t v )
 {
-  return hks_txt_set( txt, HKS_TXT_RECORD_SN, "s#=%hhu", v );
+  char buf[3];
+  return hks_txt_set( txt, HKS_TXT_RECORD_SN, buf, _hks_txt_format_uint( buf, v ) );
 }
 
 esp_err_t hks_txt_set_state_flags( hks_txt_t *txt, hks_txt_state_t state )
 {
-  return hks_txt_set( txt, HKS_TXT_RECORD_SF, "sf=%hhu", state );
+  char buf[3];
+  return hks_txt_set( txt, HKS_TXT_RECORD_SF, buf, _hks_txt_format_uint( buf, (uint8_t)state ) );
 }
 
 esp_err_t hks_txt_set_category_id( hks_txt_t *txt, hks_category_id_t id )
 {
-  return hks_txt_set( txt, HKS_TXT_RECORD_CI, "ci=%hu", id );
+  char buf[5];
+  return hks_txt_set( txt, HKS_TXT_RECORD_CI, buf, _hks_txt_format_uint( buf, (uint16_t)id ) );
+}
+
+size_t _hks_txt_format_uint( char *dst, uint32_t v )
+{
+  char tmp[10];
+  size_t n = 0;
+  do
+  {
+    tmp[n++] = '0' + ( v % 10 );
+    v /= 10;
+  } while ( v );
+
+  for ( size_t i = 0; i < n; i++ )
+    dst[i] = tmp[n - 1 - i];
+
+  return n;
 }
@@ -1,12 +1,20 @@
+#pragma once
+
 #include <stdio.h>
 #include <esp_err.h>
 #include "hks_types.h"
 
 #define HKS_TXT_RECORD_COUNT 8
-#define HKS_TXT_RECORD_LENGTH 32 // length of each string
+#define HKS_TXT_RECORD_LENGTH 32 // max length of each key=value string
+#define HKS_TXT_RDATA_LENGTH ( HKS_TXT_RECORD_COUNT * ( HKS_TXT_RECORD_LENGTH + 1 ) )
 
+// The TXT record kept in DNS wire format: length prefixed key=value strings
+// in a fixed key order, ready to be handed to the responder as RDATA.
 struct hks_txt_s {
-  char *records[HKS_TXT_RECORD_COUNT];
+  uint8_t rdata[HKS_TXT_RDATA_LENGTH];
+  uint16_t rdata_len;
+  uint16_t offsets[HKS_TXT_RECORD_COUNT]; // length byte of each record
+  uint32_t version; // bumped whenever the content changes
 };
 typedef struct hks_txt_s hks_txt_t;
 
@@ -17,9 +25,8 @@ typedef enum {
 } hks_txt_state_t;
 
 extern esp_err_t hks_txt_init( hks_txt_t *txt );
-extern void hks_txt_free( hks_txt_t *txt );
 
-extern const char **hks_txt_get_records( hks_txt_t *txt, uint8_t *count );
+extern const uint8_t *hks_txt_get_rdata( const hks_txt_t *txt, uint16_t *len );
 
 extern esp_err_t hks_txt_set_configuration_number( hks_txt_t *txt, uint32_t v );
 extern esp_err_t hks_txt_set_device_id( hks_txt_t *txt, const uint8_t v[6] );
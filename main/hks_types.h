@@ -1,3 +1,5 @@
+#pragma once
+
 #include <stdio.h>
 
 typedef enum {
@@ -20,4 +22,12 @@ typedef enum {
   HKS_CATEGORY_ID_IP_CAMERA           = 17,
   HKS_CATEGORY_ID_VIDEO_DOOR_BELL     = 18,
   HKS_CATEGORY_ID_AIR_PURIFIER        = 19
-} hks_category_id_t;
\ No newline at end of file
+} hks_category_id_t;
+
+// hk_server specific error codes
+#define HKS_ERR_BASE                0xA000
+#define HKS_ERR_HTTP_INCOMPLETE     ( HKS_ERR_BASE + 0x01 ) // need more bytes
+#define HKS_ERR_SEND_PENDING        ( HKS_ERR_BASE + 0x02 ) // socket would block
+#define HKS_ERR_PAIR_COMPUTE        ( HKS_ERR_BASE + 0x03 ) // expensive pairing step to run
+#define HKS_ERR_HTTP_VERSION        ( HKS_ERR_BASE + 0x04 ) // not HTTP/1.0 or HTTP/1.1
+#define HKS_ERR_CLIENT_DONE         ( HKS_ERR_BASE + 0x05 ) // last response sent, close
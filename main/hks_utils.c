@@ -1,5 +1,8 @@
 #include "hks_utils.h"
 #include <esp_wifi.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 esp_err_t hksu_validate_if( tcpip_adapter_if_t tcpip_if )
 {
@@ -8,8 +11,8 @@ esp_err_t hksu_validate_if( tcpip_adapter_if_t tcpip_if )
   if ( tcpip_if >= TCPIP_ADAPTER_IF_MAX )
     return ESP_ERR_INVALID_ARG;
 
-  uint8_t mode;
-  err = esp_wifi_get_mode( (wifi_mode_t *)&mode );
+  wifi_mode_t mode;
+  err = esp_wifi_get_mode( &mode );
   if ( err )
     return err;
 
@@ -21,3 +24,13 @@ esp_err_t hksu_validate_if( tcpip_adapter_if_t tcpip_if )
 
   return ESP_OK;
 }
+
+uint32_t hksu_now_ms( void )
+{
+  return (uint32_t)( xTaskGetTickCount() * portTICK_PERIOD_MS );
+}
+
+uint32_t hksu_now_us( void )
+{
+  return (uint32_t)esp_timer_get_time();
+}
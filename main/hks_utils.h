@@ -1,5 +1,13 @@
+#pragma once
+
 #include <stdio.h>
 #include <tcpip_adapter.h>
 #include <esp_err.h>
 
-extern esp_err_t hksu_validate_if( tcpip_adapter_if_t tcpip_if );
\ No newline at end of file
+extern esp_err_t hksu_validate_if( tcpip_adapter_if_t tcpip_if );
+
+// monotonic milliseconds, wraps after ~49 days
+extern uint32_t hksu_now_ms( void );
+
+// monotonic microseconds for timing short stretches, wraps after ~71 minutes
+extern uint32_t hksu_now_us( void );
@@ -0,0 +1,152 @@
+#include "hks_worker.h"
+#include <string.h>
+#include <errno.h>
+#include <lwip/sockets.h>
+
+static void _hks_worker_task( void *arg );
+static esp_err_t _hks_worker_socket( hks_worker_t *worker );
+
+esp_err_t hks_worker_init( hks_worker_t *worker )
+{
+  memset( worker, 0, sizeof( hks_worker_t ) );
+  worker->fd = -1;
+  worker->stack_free = HKS_WORKER_STACK;
+
+  worker->jobs = xQueueCreate( HKS_WORKER_JOBS, sizeof( hks_job_t * ) );
+  worker->done = xQueueCreate( HKS_WORKER_JOBS, sizeof( hks_job_t * ) );
+  if ( worker->jobs == NULL || worker->done == NULL )
+  {
+    hks_worker_free( worker );
+    return ESP_ERR_NO_MEM;
+  }
+
+  esp_err_t err = _hks_worker_socket( worker );
+  if ( err )
+  {
+    hks_worker_free( worker );
+    return err;
+  }
+
+  BaseType_t core = HKS_WORKER_CORE < 0 ? tskNO_AFFINITY : HKS_WORKER_CORE;
+  for ( int i = 0; i < HKS_WORKER_COUNT; i++ )
+  {
+    if ( xTaskCreatePinnedToCore( _hks_worker_task, "hks_worker", HKS_WORKER_STACK, worker, HKS_WORKER_PRIORITY, NULL, core ) != pdPASS )
+    {
+      hks_worker_free( worker );
+      return ESP_ERR_NO_MEM;
+    }
+    __atomic_add_fetch( &worker->running, 1, __ATOMIC_SEQ_CST );
+  }
+
+  return ESP_OK;
+}
+
+void hks_worker_stop( hks_worker_t *worker )
+{
+  // a NULL job stops one task once the jobs ahead of it are done
+  hks_job_t *stop = NULL;
+  for ( uint8_t i = __atomic_load_n( &worker->running, __ATOMIC_SEQ_CST ); i > 0; i-- )
+    xQueueSend( worker->jobs, &stop, portMAX_DELAY );
+  while ( __atomic_load_n( &worker->running, __ATOMIC_SEQ_CST ) > 0 )
+    vTaskDelay( 1 );
+}
+
+void hks_worker_free( hks_worker_t *worker )
+{
+  hks_worker_stop( worker );
+
+  if ( worker->fd >= 0 )
+    lwip_close( worker->fd );
+  worker->fd = -1;
+
+  if ( worker->jobs != NULL )
+    vQueueDelete( worker->jobs );
+  if ( worker->done != NULL )
+    vQueueDelete( worker->done );
+  worker->jobs = NULL;
+  worker->done = NULL;
+}
+
+esp_err_t hks_worker_submit( hks_worker_t *worker, hks_job_t *job )
+{
+  if ( xQueueSend( worker->jobs, &job, 0 ) != pdPASS )
+    return ESP_ERR_NO_MEM;
+
+  return ESP_OK;
+}
+
+void hks_worker_wake( hks_worker_t *worker )
+{
+  // a full socket buffer means the loop has wakeups to read already
+  uint8_t wakeup = 0;
+  lwip_send( worker->fd, &wakeup, 1, 0 );
+}
+
+hks_job_t *hks_worker_done( hks_worker_t *worker )
+{
+  // a wakeup may announce a job taken on an earlier call, or one that is
+  // about to be queued and announces itself again
+  uint8_t wakeups[16];
+  while ( lwip_recv( worker->fd, wakeups, sizeof( wakeups ), 0 ) > 0 );
+
+  hks_job_t *job;
+  if ( xQueueReceive( worker->done, &job, 0 ) != pdTRUE )
+    return NULL;
+
+  return job;
+}
+
+void _hks_worker_task( void *arg )
+{
+  hks_worker_t *worker = (hks_worker_t *)arg;
+
+  for (;;)
+  {
+    hks_job_t *job;
+    if ( xQueueReceive( worker->jobs, &job, portMAX_DELAY ) != pdTRUE )
+      continue;
+    if ( job == NULL )
+      break;
+
+    job->work( job->arg );
+
+    // the arithmetic has been as deep as it goes
+    uint32_t free = uxTaskGetStackHighWaterMark( NULL );
+    uint32_t lowest = __atomic_load_n( &worker->stack_free, __ATOMIC_RELAXED );
+    while ( free < lowest && !__atomic_compare_exchange_n( &worker->stack_free, &lowest, free, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+
+    // the queue has room for every job there can be
+    xQueueSend( worker->done, &job, portMAX_DELAY );
+    hks_worker_wake( worker );
+  }
+
+  __atomic_sub_fetch( &worker->running, 1, __ATOMIC_SEQ_CST );
+  vTaskDelete( NULL );
+}
+
+esp_err_t _hks_worker_socket( hks_worker_t *worker )
+{
+  // bound to a loopback port and connected to itself
+  int fd = lwip_socket( AF_INET, SOCK_DGRAM, 0 );
+  if ( fd < 0 )
+    return ESP_FAIL;
+  worker->fd = fd;
+
+  struct sockaddr_in addr;
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+  addr.sin_port = 0;
+
+  socklen_t addr_len = sizeof( addr );
+  if ( lwip_bind( fd, (struct sockaddr *)&addr, sizeof( addr ) ) < 0 ||
+       lwip_getsockname( fd, (struct sockaddr *)&addr, &addr_len ) < 0 ||
+       lwip_connect( fd, (struct sockaddr *)&addr, sizeof( addr ) ) < 0 )
+    return ESP_FAIL;
+
+  int flags = lwip_fcntl( fd, F_GETFL, 0 );
+  if ( flags < 0 || lwip_fcntl( fd, F_SETFL, flags | O_NONBLOCK ) < 0 )
+    return ESP_FAIL;
+
+  return ESP_OK;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <sdkconfig.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#define HKS_WORKER_COUNT     CONFIG_HKS_CRYPTO_WORKERS
+#define HKS_WORKER_CORE      CONFIG_HKS_CRYPTO_WORKER_CORE // < 0 for any
+#define HKS_WORKER_STACK     CONFIG_HKS_CRYPTO_WORKER_STACK
+#define HKS_WORKER_PRIORITY  4  // below the task running the server loop
+#define HKS_WORKER_JOBS      CONFIG_HKS_MAX_CLIENTS // one per client at most
+
+typedef void (*hks_work_t)( void *arg );
+
+// A unit of work run off the socket loop. The workers only call `work` on
+// `arg`; `owner` belongs to the loop, which may change it while the job runs.
+struct hks_job_s {
+  hks_work_t work;
+  void *arg;
+  void *owner;
+};
+typedef struct hks_job_s hks_job_t;
+
+// Tasks that take jobs from a queue, run them and queue them back. Each
+// finished job also sends a byte to a loopback UDP socket so the loop,
+// asleep in select, wakes up for it; lwIP has no pipes. Other tasks with
+// news for the loop wake it the same way with hks_worker_wake.
+struct hks_worker_s {
+  QueueHandle_t jobs;
+  QueueHandle_t done;
+  int fd;               // select it for reading, then call hks_worker_done
+  uint8_t running;      // tasks still alive
+  uint32_t stack_free;  // the least stack any task had left after a job
+};
+typedef struct hks_worker_s hks_worker_t;
+
+extern esp_err_t hks_worker_init( hks_worker_t *worker );
+
+// waits for the tasks to finish what they were given; jobs they finish
+// meanwhile are left for hks_worker_done until hks_worker_free
+extern void hks_worker_stop( hks_worker_t *worker );
+
+// stops the tasks if they still run and releases the queues and socket
+extern void hks_worker_free( hks_worker_t *worker );
+
+// ESP_ERR_NO_MEM when HKS_WORKER_JOBS are already queued
+extern esp_err_t hks_worker_submit( hks_worker_t *worker, hks_job_t *job );
+
+// from any task, the loop comes out of select and finds no job
+extern void hks_worker_wake( hks_worker_t *worker );
+
+// next finished job, NULL once there are none
+extern hks_job_t *hks_worker_done( hks_worker_t *worker );
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
@@ -14,6 +15,8 @@
 
 #define HAP_TEST_PORT 42424
 #define HAP_TEST_NAME "HAP32 Test"
+#define HAP_TEST_SETUP_CODE "031-45-154"
+#define HAP_TEST_STORE "hks" // NVS namespace
 
 static EventGroupHandle_t wifi_event_group;
 
@@ -24,6 +27,10 @@ const int CONNECTED_BIT = BIT0;
 
 static const char *TAG = "hap-test";
 
+// the server's RAM, in .bss rather than one large allocation at start; the
+// build checks hk_server_budget fits CONFIG_HKS_RAM_BUDGET
+static uint8_t hks_region[CONFIG_HKS_RAM_BUDGET] __attribute__(( aligned( 8 ) ));
+
 static esp_err_t event_handler(void *ctx, system_event_t *event)
 {
   switch(event->event_id)
@@ -70,61 +77,82 @@ static void initialise_wifi(void)
   ESP_ERROR_CHECK( esp_wifi_start() );
 }
 
-static void hks_task( void *pvParameters )
+#if CONFIG_HKS_TRACE_LEVEL > 0
+// prints what the server recorded, below the server task's priority
+static void hks_trace_task( void *pvParameters )
 {
-  hk_server_t *hks = NULL;
+  hk_server_t *hks = pvParameters;
+  hks_trace_record_t records[16];
+  uint32_t cursor = 0, dropped = 0, reported = 0;
+  char line[96];
   for(;;)
   {
-    xEventGroupWaitBits( wifi_event_group, CONNECTED_BIT,
-                         false, true, portMAX_DELAY );
-
-    if ( hks == NULL )
+    size_t count = sizeof( records ) / sizeof( records[0] );
+    hk_server_read_trace( hks, &cursor, records, &count, &dropped );
+    for ( size_t i = 0; i < count; i++ )
     {
-      ESP_LOGI( TAG, "Starting HomeKit server..." );
-
-      esp_err_t err = hk_server_init( TCPIP_ADAPTER_IF_STA, &hks );
-      if ( err )
-      {
-        ESP_LOGE( TAG, "Failed starting HomeKit server: %u", err );
-        continue;
-      }
-
-      err = hk_server_listen( hks, HAP_TEST_PORT );
-      if ( err )
-      {
-        ESP_LOGE( TAG, "Failed starting HomeKit server: %u", err );
-        continue;
-      }
-
-      err = hk_server_set_name( hks, HAP_TEST_NAME );
-      if ( err )
-      {
-        ESP_LOGE( TAG, "Failed setting HomeKit server name: %u", err );
-        continue;
-      }
+      hks_trace_format( &records[i], line, sizeof( line ) );
+      printf( "%s\n", line );
     }
 
-    if ( hks != NULL )
+    if ( dropped != reported )
     {
-      esp_err_t err = hk_server_accept( hks );
-      if ( err && err != ESP_ERR_TIMEOUT )
-      {
-        ESP_LOGE( TAG, "Failed running HomeKit server: %u", err );
-        continue;
-      }
-
-      err = hk_server_process_clients( hks );
-      if ( err && err != ESP_ERR_TIMEOUT )
-      {
-        if ( err == ESP_ERR_INVALID_STATE )
-          ESP_LOGE( TAG, "Fatal error processing HomeKit clients: %u", err );
-
-        ESP_LOGE( TAG, "Failed processing HomeKit clients: %u", err );
-        continue;
-      }
+      ESP_LOGW( TAG, "%u trace records lost", dropped - reported );
+      reported = dropped;
     }
 
-    taskYIELD();
+    if ( count < sizeof( records ) / sizeof( records[0] ) )
+      vTaskDelay( 100 / portTICK_PERIOD_MS );
+  }
+}
+#endif
+
+// a server that cannot start is not worth running the app for
+static void hks_check( esp_err_t err, const char *what )
+{
+  if ( err )
+  {
+    ESP_LOGE( TAG, "Failed %s: %u", what, err );
+    abort();
+  }
+}
+
+static void hks_task( void *pvParameters )
+{
+  xEventGroupWaitBits( wifi_event_group, CONNECTED_BIT,
+                       false, true, portMAX_DELAY );
+
+  ESP_LOGI( TAG, "Starting HomeKit server, %u of %u bytes...", hk_server_budget( NULL, NULL ), sizeof( hks_region ) );
+
+  hk_server_t *hks = NULL;
+  hks_check( hk_server_init_static( TCPIP_ADAPTER_IF_STA, hks_region, sizeof( hks_region ), &hks ), "starting HomeKit server" );
+
+#if CONFIG_HKS_TRACE_LEVEL > 0
+  xTaskCreate( &hks_trace_task, "hks_trace", 2048, hks, 1, NULL );
+#endif
+
+  // pairings from before the restart
+  hks_store_backend_t store;
+  esp_err_t err = hks_store_nvs_init( &store, HAP_TEST_STORE );
+  if ( !err )
+    err = hk_server_set_storage( hks, &store );
+  hks_check( err, "opening HomeKit store" );
+
+  hks_check( hk_server_listen( hks, HAP_TEST_PORT ), "starting HomeKit server" );
+  hks_check( hk_server_set_name( hks, HAP_TEST_NAME ), "setting HomeKit server name" );
+  hks_check( hk_server_set_setup_code( hks, HAP_TEST_SETUP_CODE ), "setting HomeKit setup code" );
+
+  // the loop runs on a task of its own from here
+  hks_check( hk_server_start( hks ), "starting HomeKit server task" );
+
+  for(;;)
+  {
+    vTaskDelay( 60000 / portTICK_PERIOD_MS );
+
+    hks_watermarks_t w;
+    if ( hk_server_get_watermarks( hks, &w ) == ESP_OK && w.samples > 0 )
+      ESP_LOGI( TAG, "Least left: server stack %u, worker stack %u, heap %u, server heap %u (largest block %u)",
+        w.server_stack, w.worker_stack, w.heap, w.server_heap, w.server_heap_largest );
   }
 }
 
@@ -132,5 +160,7 @@ void app_main()
 {
   nvs_flash_init();
   initialise_wifi();
-  xTaskCreate( &hks_task, "hks_task", 2048, NULL, 5, NULL );
+  // sets the server up and reports its watermarks, the loop and the pairing
+  // arithmetic run on tasks of the server's own
+  xTaskCreate( &hks_task, "hks_task", 4096, NULL, 5, NULL );
 }